@@ -7,6 +7,7 @@
 #include "application.hpp"
 #include "build-system/build-systems-extension-point.hpp"
 #include "build-system/build-log-view-group.hpp"
+#include "build-system/job-server.hpp"
 #include "editors/file.hpp"
 #include "editors/file-observers-extension-point.hpp"
 #include "editors/source-editor.hpp"
@@ -17,6 +18,8 @@
 #include "plugin/extension-point-manager.hpp"
 #include "plugin/plugin-manager.hpp"
 #include "project/project.hpp"
+#include "project/project-db.hpp"
+#include "project/project-watcher.hpp"
 #include "project/project-explorer.hpp"
 #include "project/project-explorer-model.hpp"
 #include "session/file-recoverers-extension-point.hpp"
@@ -228,6 +231,9 @@ gboolean Application::startUp(gpointer app)
     TextEditor::installPreferences();
     SourceFile::installPreferences();
     SourceEditor::installPreferences();
+    ProjectDb::installPreferences();
+    ProjectWatcher::installPreferences();
+    JobServer::installPreferences();
 
     // Initialize the histories with the default values.
     a->m_histories = new PropertyTree(HISTORIES);
@@ -0,0 +1,63 @@
+// Build estimator.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "build-estimator.hpp"
+#include "build-system.hpp"
+#include "project/project.hpp"
+#include <string>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+namespace Samoyed
+{
+
+BuildEstimator::BuildEstimator(Scheduler &scheduler,
+                               unsigned int priority,
+                               const BuildSystem &buildSystem,
+                               const Configuration &config,
+                               const char *fileUri,
+                               bool compileOnly):
+    Worker(scheduler, priority),
+    m_buildSystem(buildSystem),
+    m_config(config),
+    m_fileUri(fileUri ? fileUri : ""),
+    m_compileOnly(compileOnly),
+    m_targetFound(false),
+    m_estimatedDuration(-1)
+{
+    char *desc;
+    if (fileUri)
+        desc = g_strdup_printf(_("Finding the target containing file \"%s\"."),
+                               fileUri);
+    else
+        desc = g_strdup_printf(
+            _("Estimating the build duration of project \"%s\"."),
+            buildSystem.project().uri());
+    setDescription(desc);
+    g_free(desc);
+}
+
+bool BuildEstimator::step()
+{
+    if (m_fileUri.empty())
+    {
+        m_estimatedDuration =
+            m_buildSystem.estimateBuildDuration(m_config, NULL);
+        return true;
+    }
+    std::string target;
+    m_targetFound = m_buildSystem.getTargetBuildCommands(m_config,
+                                                         m_fileUri.c_str(),
+                                                         m_compileOnly,
+                                                         m_commands,
+                                                         target);
+    if (m_targetFound)
+        m_estimatedDuration =
+            m_buildSystem.estimateBuildDuration(m_config, target.c_str());
+    return true;
+}
+
+}
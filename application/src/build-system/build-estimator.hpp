@@ -0,0 +1,83 @@
+// Build estimator.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_BUILD_ESTIMATOR_HPP
+#define SMYD_BUILD_ESTIMATOR_HPP
+
+#include "configuration.hpp"
+#include "utilities/worker.hpp"
+#include <string>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+class BuildSystem;
+
+/**
+ * A build estimator finds the commands to build only the target containing a
+ * file, if any, and estimates the duration of the build in the background,
+ * because the build system may read large build files to do them.  It works
+ * on a copy of the configuration, which may be changed meanwhile.
+ */
+class BuildEstimator: public Worker
+{
+public:
+    /**
+     * @param fileUri The file whose target is to be built, or NULL if building
+     * the whole project.
+     * @param compileOnly True iff only compiling the file.
+     */
+    BuildEstimator(Scheduler &scheduler,
+                   unsigned int priority,
+                   const BuildSystem &buildSystem,
+                   const Configuration &config,
+                   const char *fileUri,
+                   bool compileOnly);
+
+    const char *configurationName() const { return m_config.name(); }
+
+    /**
+     * @return The file whose target is to be built, or NULL if building the
+     * whole project.
+     */
+    const char *fileUri() const
+    { return m_fileUri.empty() ? NULL : m_fileUri.c_str(); }
+
+    bool compileOnly() const { return m_compileOnly; }
+
+    /**
+     * @return False iff the build system can't build the file alone.  Valid
+     * after the estimator finishes.
+     */
+    bool targetFound() const { return m_targetFound; }
+
+    /**
+     * @return The commands to build only the target.  Valid after the
+     * estimator finishes.
+     */
+    const char *commands() const { return m_commands.c_str(); }
+
+    /**
+     * @return The estimated duration of the build, in milliseconds, or -1 if
+     * unknown.  Valid after the estimator finishes.
+     */
+    gint64 estimatedDuration() const { return m_estimatedDuration; }
+
+protected:
+    virtual bool step();
+
+private:
+    const BuildSystem &m_buildSystem;
+    const Configuration m_config;
+    const std::string m_fileUri;
+    const bool m_compileOnly;
+
+    bool m_targetFound;
+    std::string m_commands;
+    gint64 m_estimatedDuration;
+};
+
+}
+
+#endif
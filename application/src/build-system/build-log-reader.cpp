@@ -0,0 +1,180 @@
+// Build log reader.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "build-log-reader.hpp"
+#include <algorithm>
+#include <string>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <glib.h>
+#include <gio/gio.h>
+
+namespace
+{
+
+// The interval between batches, in milliseconds, which is about one frame.
+const guint DELIVERY_INTERVAL = 16;
+
+// The maximum size of a batch.  Inserting and parsing a batch of this size
+// takes a small fraction of a frame.
+const std::string::size_type MAX_BATCH_SIZE = 256 * 1024;
+
+// The maximum size of the buffered output.  The background thread stops
+// reading when it is exceeded, which makes the build process block on writing
+// its output rather than the memory grow unboundedly.
+const std::string::size_type MAX_BUFFER_SIZE = 16 * 1024 * 1024;
+
+const gsize READ_SIZE = 64 * 1024;
+
+}
+
+namespace Samoyed
+{
+
+void BuildLogReader::Procedure::operator()()
+{
+    char *buffer = static_cast<char *>(g_malloc(READ_SIZE));
+    for (;;)
+    {
+        GError *error = NULL;
+        gssize length = g_input_stream_read(m_reader.m_outputPipe,
+                                            buffer,
+                                            READ_SIZE,
+                                            m_reader.m_cancellable,
+                                            &error);
+        boost::mutex::scoped_lock lock(m_reader.m_mutex);
+        if (length <= 0)
+        {
+            if (length < 0)
+            {
+                if (!g_error_matches(error,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_CANCELLED))
+                    m_reader.m_error = error->message;
+                g_error_free(error);
+            }
+            m_reader.m_eof = true;
+            break;
+        }
+        while (m_reader.m_buffer.length() >= MAX_BUFFER_SIZE &&
+               !g_cancellable_is_cancelled(m_reader.m_cancellable))
+            m_reader.m_bufferDrained.wait(lock);
+        if (g_cancellable_is_cancelled(m_reader.m_cancellable))
+        {
+            m_reader.m_eof = true;
+            break;
+        }
+        m_reader.m_buffer.append(buffer, length);
+        m_reader.m_bufferGrown = true;
+    }
+    g_free(buffer);
+}
+
+BuildLogReader::BuildLogReader(GInputStream *outputPipe,
+                               const LogRead &onLogRead,
+                               const Finished &onFinished):
+    m_outputPipe(outputPipe),
+    m_cancellable(g_cancellable_new()),
+    m_onLogRead(onLogRead),
+    m_onFinished(onFinished),
+    m_running(false),
+    m_thread(NULL),
+    m_delivererId(0),
+    m_bufferGrown(false),
+    m_eof(false)
+{
+    g_object_ref(m_outputPipe);
+}
+
+BuildLogReader::~BuildLogReader()
+{
+    stop();
+    delete m_thread;
+    g_object_unref(m_cancellable);
+    g_object_unref(m_outputPipe);
+}
+
+void BuildLogReader::start()
+{
+    m_running = true;
+    m_thread = new boost::thread(Procedure(*this));
+    // Use a priority lower than redrawing so that the log view is redrawn
+    // between batches.
+    m_delivererId = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE,
+                                       DELIVERY_INTERVAL,
+                                       deliver,
+                                       this,
+                                       NULL);
+}
+
+void BuildLogReader::stop()
+{
+    if (!m_running)
+        return;
+    g_cancellable_cancel(m_cancellable);
+    {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_bufferDrained.notify_all();
+    }
+    m_thread->join();
+    g_source_remove(m_delivererId);
+    m_delivererId = 0;
+    m_running = false;
+    m_buffer.clear();
+}
+
+gboolean BuildLogReader::deliver(gpointer reader)
+{
+    BuildLogReader *r = static_cast<BuildLogReader *>(reader);
+    std::string batch;
+    bool finished = false;
+    std::string error;
+    {
+        boost::mutex::scoped_lock lock(r->m_mutex);
+        std::string::size_type length =
+            std::min(r->m_buffer.length(), MAX_BATCH_SIZE);
+        if (!r->m_eof && length > 0)
+        {
+            // End the batch at a line boundary.  If no line is complete, wait
+            // for the rest of the line unless the output stalls.
+            std::string::size_type lineEnd = r->m_buffer.rfind('\n',
+                                                               length - 1);
+            if (lineEnd != std::string::npos)
+                length = lineEnd + 1;
+            else if (length < MAX_BATCH_SIZE && r->m_bufferGrown)
+                length = 0;
+        }
+        r->m_bufferGrown = false;
+        if (length > 0)
+        {
+            batch.assign(r->m_buffer, 0, length);
+            r->m_buffer.erase(0, length);
+            r->m_bufferDrained.notify_all();
+        }
+        if (r->m_eof && r->m_buffer.empty())
+        {
+            finished = true;
+            error = r->m_error;
+        }
+    }
+
+    if (!batch.empty())
+        r->m_onLogRead(batch.data(), batch.length());
+
+    if (!finished)
+        return TRUE;
+
+    // The background thread has exited or is exiting.
+    r->m_thread->join();
+    r->m_delivererId = 0;
+    r->m_running = false;
+    Finished onFinished(r->m_onFinished);
+    onFinished(error.empty() ? NULL : error.c_str());
+    return FALSE;
+}
+
+}
@@ -0,0 +1,98 @@
+// Build log reader.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_BUILD_LOG_READER_HPP
+#define SMYD_BUILD_LOG_READER_HPP
+
+#include <string>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <glib.h>
+#include <gio/gio.h>
+
+namespace Samoyed
+{
+
+/**
+ * A build log reader reads the output of a build process in a background
+ * thread, so that a chatty build never blocks the main thread by reading.  The
+ * output is buffered and handed to the main thread in batches, at most one
+ * batch per frame, each of which ends at a line boundary unless the output
+ * stalls in the middle of a line.  The background thread stops reading if the
+ * buffered output exceeds a limit, until the main thread consumes it.
+ */
+class BuildLogReader: public boost::noncopyable
+{
+public:
+    /**
+     * @param log The batch of the output, not terminated by '\0'.
+     * @param length The length of the batch in bytes.
+     */
+    typedef boost::function<void (const char *log, int length)> LogRead;
+
+    /**
+     * The callback may destroy the build log reader.
+     * @param error The error message if failed to read the output, or NULL if
+     * reached the end of the output.
+     */
+    typedef boost::function<void (const char *error)> Finished;
+
+    /**
+     * @param outputPipe The output pipe of the build process, referenced by the
+     * reader.
+     */
+    BuildLogReader(GInputStream *outputPipe,
+                   const LogRead &onLogRead,
+                   const Finished &onFinished);
+
+    /**
+     * Stop reading and wait for the background thread to exit.
+     */
+    ~BuildLogReader();
+
+    void start();
+
+    /**
+     * Stop reading and wait for the background thread to exit.  The buffered
+     * output is discarded and the finished callback is not called.
+     */
+    void stop();
+
+    bool running() const { return m_running; }
+
+private:
+    class Procedure
+    {
+    public:
+        Procedure(BuildLogReader &reader): m_reader(reader) {}
+        void operator()();
+    private:
+        BuildLogReader &m_reader;
+    };
+
+    static gboolean deliver(gpointer reader);
+
+    GInputStream *m_outputPipe;
+    GCancellable *m_cancellable;
+    LogRead m_onLogRead;
+    Finished m_onFinished;
+
+    bool m_running;
+    boost::thread *m_thread;
+    guint m_delivererId;
+
+    // The data shared with the background thread.
+    std::string m_buffer;
+    bool m_bufferGrown;
+    bool m_eof;
+    std::string m_error;
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_bufferDrained;
+};
+
+}
+
+#endif
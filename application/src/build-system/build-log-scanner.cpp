@@ -0,0 +1,423 @@
+// Build log scanner.
+// Copyright (C) 2015 Gang Chen.
+
+/*
+UNIT TEST BUILD
+g++ build-log-scanner.cpp -DSMYD_BUILD_LOG_SCANNER_UNIT_TEST \
+`pkg-config --cflags --libs glib-2.0` -Werror -Wall -O2 -o build-log-scanner
+
+Run "./build-log-scanner LOG-FILE" to benchmark scanning a recorded build log.
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "build-log-scanner.hpp"
+#ifdef SMYD_BUILD_LOG_SCANNER_UNIT_TEST
+# include <assert.h>
+# include <stdio.h>
+#endif
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <glib.h>
+
+namespace
+{
+
+const char ENTERING_DIRECTORY[] = "Entering directory ";
+const char LEAVING_DIRECTORY[] = "Leaving directory ";
+
+const char *DIAGNOSTIC_TYPE_MARKERS[
+    Samoyed::BuildLogScanner::Diagnostic::N_TYPES] =
+{
+    "note: ",
+    "warning: ",
+    "error: "
+};
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool startsWith(const char *begin, const char *end, const char *prefix)
+{
+    int length = strlen(prefix);
+    return end - begin >= length && memcmp(begin, prefix, length) == 0;
+}
+
+// Find the end of the line, i.e., the first "\n" or "\r".
+inline const char *findLineEnd(const char *begin, const char *end)
+{
+    for (; begin < end; ++begin)
+    {
+        if (*begin > '\r')
+            continue;
+        if (*begin == '\n' || *begin == '\r')
+            break;
+    }
+    return begin;
+}
+
+// Parse ":NUMBER" backward from the end.  On success, the end is moved to the
+// colon.
+bool parseNumberBackward(const char *begin, const char *&end, int &number)
+{
+    const char *cp = end;
+    while (cp > begin && isDigit(cp[-1]))
+        cp--;
+    if (cp == end || end - cp > 9 || cp - begin < 2 || cp[-1] != ':')
+        return false;
+    number = 0;
+    for (const char *p = cp; p < end; p++)
+        number = number * 10 + (*p - '0');
+    end = cp - 1;
+    return true;
+}
+
+bool compareLogLine(const Samoyed::BuildLogScanner::Diagnostic &diag,
+                    int logLine)
+{
+    return diag.logLine < logLine;
+}
+
+}
+
+namespace Samoyed
+{
+
+BuildLogScanner::BuildLogScanner(const char *projectDir):
+    m_projectDir(projectDir),
+#ifdef OS_WINDOWS
+    m_usingWindowsCmd(false),
+#endif
+    m_lineCount(0),
+    m_lastCharIsCr(false)
+{
+}
+
+void BuildLogScanner::clear()
+{
+    m_lineCount = 0;
+    m_incompleteLine.clear();
+    m_lastCharIsCr = false;
+    m_directoryStack.clear();
+    m_diagnostics.clear();
+    m_fileNameIds.clear();
+    m_fileNames.clear();
+    m_messages.clear();
+}
+
+void BuildLogScanner::scan(const char *log, int length)
+{
+    const char *cp = log, *end = log + length;
+
+    // Skip the "\n" following the "\r" ending the last piece.
+    if (m_lastCharIsCr && cp < end && *cp == '\n')
+        cp++;
+    m_lastCharIsCr = false;
+
+    while (cp < end)
+    {
+        const char *lineEnd = findLineEnd(cp, end);
+        if (lineEnd == end)
+        {
+            m_incompleteLine.append(cp, end - cp);
+            break;
+        }
+        if (m_incompleteLine.empty())
+            scanLine(cp, lineEnd);
+        else
+        {
+            m_incompleteLine.append(cp, lineEnd - cp);
+            scanLine(m_incompleteLine.data(),
+                     m_incompleteLine.data() + m_incompleteLine.length());
+            m_incompleteLine.clear();
+        }
+        m_lineCount++;
+        cp = lineEnd + 1;
+        if (*lineEnd == '\r')
+        {
+            if (cp == end)
+                m_lastCharIsCr = true;
+            else if (*cp == '\n')
+                cp++;
+        }
+    }
+}
+
+void BuildLogScanner::finish()
+{
+    if (m_incompleteLine.empty())
+        return;
+    scanLine(m_incompleteLine.data(),
+             m_incompleteLine.data() + m_incompleteLine.length());
+    m_incompleteLine.clear();
+    m_lineCount++;
+}
+
+std::vector<BuildLogScanner::Diagnostic>::size_type
+BuildLogScanner::lowerBound(int logLine) const
+{
+    return std::lower_bound(m_diagnostics.begin(), m_diagnostics.end(),
+                            logLine, compareLogLine) -
+        m_diagnostics.begin();
+}
+
+const BuildLogScanner::Diagnostic *
+BuildLogScanner::findDiagnostic(int logLine) const
+{
+    std::vector<Diagnostic>::size_type i = lowerBound(logLine);
+    if (i == m_diagnostics.size() || m_diagnostics[i].logLine != logLine)
+        return NULL;
+    return &m_diagnostics[i];
+}
+
+bool BuildLogScanner::scanDirectory(const char *begin,
+                                    const char *end,
+                                    bool entering)
+{
+    // The directory is quoted by "'...'" or "`...'".
+    if (begin == end || (*begin != '\'' && *begin != '`'))
+        return false;
+    begin++;
+    const char *dirEnd =
+        static_cast<const char *>(memchr(begin, '\'', end - begin));
+    if (!dirEnd)
+        return false;
+    if (entering)
+        m_directoryStack.push_back(std::string(begin, dirEnd - begin));
+    else if (!m_directoryStack.empty() &&
+             m_directoryStack.back().compare(0, std::string::npos,
+                                             begin, dirEnd - begin) == 0)
+        m_directoryStack.pop_back();
+    return true;
+}
+
+void BuildLogScanner::scanLine(const char *begin, const char *end)
+{
+    if (begin == end || g_ascii_isspace(*begin))
+        return;
+
+    // Find the first ": ", which follows the program name in the messages of
+    // make or the location in the compiler diagnostics.
+    const char *colon = begin;
+    for (;;)
+    {
+        colon = static_cast<const char *>(memchr(colon, ':', end - colon));
+        if (!colon || colon + 1 == end)
+            return;
+        if (colon[1] == ' ')
+            break;
+        colon++;
+    }
+    const char *rest = colon + 2;
+
+    if (startsWith(rest, end, ENTERING_DIRECTORY))
+    {
+        scanDirectory(rest + sizeof(ENTERING_DIRECTORY) - 1, end, true);
+        return;
+    }
+    if (startsWith(rest, end, LEAVING_DIRECTORY))
+    {
+        scanDirectory(rest + sizeof(LEAVING_DIRECTORY) - 1, end, false);
+        return;
+    }
+
+    // Filename:line:column: error|warning|note:
+    Diagnostic diag;
+    int type;
+    for (type = Diagnostic::N_TYPES - 1; type >= 0; type--)
+        if (startsWith(rest, end, DIAGNOSTIC_TYPE_MARKERS[type]))
+            break;
+    if (type < 0)
+        return;
+    diag.type = static_cast<Diagnostic::Type>(type);
+    const char *fileNameEnd = colon;
+    if (!parseNumberBackward(begin, fileNameEnd, diag.column) ||
+        !parseNumberBackward(begin, fileNameEnd, diag.line))
+        return;
+    diag.line--;
+    diag.column--;
+    diag.logLine = m_lineCount;
+
+    std::string fileName;
+    if (g_path_is_absolute(std::string(begin, fileNameEnd - begin).c_str()))
+    {
+#ifdef OS_WINDOWS
+        if (m_usingWindowsCmd ||
+            (fileNameEnd - begin >= 3 &&
+             g_ascii_isalpha(begin[0]) && begin[1] == ':' &&
+             G_IS_DIR_SEPARATOR(begin[2])))
+            diag.needPathConversion = false;
+        else
+            diag.needPathConversion = true;
+#endif
+        fileName.assign(begin, fileNameEnd - begin);
+    }
+    else
+    {
+        // If the file name is a relative path, prepend the current directory.
+        if (!m_directoryStack.empty() && !m_directoryStack.back().empty())
+        {
+            fileName = m_directoryStack.back();
+#ifdef OS_WINDOWS
+            if (m_usingWindowsCmd ||
+                (fileName.length() >= 3 &&
+                 g_ascii_isalpha(fileName[0]) &&
+                 fileName[1] == ':' &&
+                 G_IS_DIR_SEPARATOR(fileName[2])))
+            {
+                diag.needPathConversion = false;
+                if (!G_IS_DIR_SEPARATOR(fileName[fileName.length() - 1]))
+                    fileName += '\\';
+            }
+            else
+            {
+                diag.needPathConversion = true;
+                if (!G_IS_DIR_SEPARATOR(fileName[fileName.length() - 1]))
+                    fileName += '/';
+            }
+#else
+            if (!G_IS_DIR_SEPARATOR(fileName[fileName.length() - 1]))
+                fileName += G_DIR_SEPARATOR;
+#endif
+        }
+        else
+        {
+#ifdef OS_WINDOWS
+            diag.needPathConversion = false;
+#endif
+            fileName = m_projectDir;
+            fileName += G_DIR_SEPARATOR;
+        }
+        fileName.append(begin, fileNameEnd - begin);
+    }
+
+#ifdef OS_WINDOWS
+    // Unify directory separators.
+    if (!m_usingWindowsCmd && !diag.needPathConversion)
+        std::replace(fileName.begin(), fileName.end(), '/', '\\');
+#endif
+
+    diag.fileName = internFileName(fileName);
+    diag.message = m_messages.length();
+    rest += strlen(DIAGNOSTIC_TYPE_MARKERS[type]);
+    m_messages.append(rest, end - rest);
+    m_messages += '\0';
+    m_diagnostics.push_back(diag);
+}
+
+int BuildLogScanner::internFileName(const std::string &fileName)
+{
+    std::pair<std::map<std::string, int>::iterator, bool> ins =
+        m_fileNameIds.insert(std::make_pair(fileName, m_fileNames.size()));
+    if (ins.second)
+        m_fileNames.push_back(&ins.first->first);
+    return ins.first->second;
+}
+
+}
+
+#ifdef SMYD_BUILD_LOG_SCANNER_UNIT_TEST
+
+namespace
+{
+
+const char TEST_LOG[] =
+    "make[1]: Entering directory '/src/lib'\n"
+    "gcc -c a.c\n"
+    "a.c: In function 'main':\r\n"
+    "a.c:12:5: warning: unused variable 'x'\n"
+    "  int x;\n"
+    "/usr/include/b.h:3:1: note: declared here\r"
+    "make[2]: Entering directory `/src/lib/sub'\n"
+    "c.c:7:9: error: expected ';'\n"
+    "make[2]: Leaving directory '/src/lib/sub'\n"
+    "a.c:20:1: error: unknown type\n"
+    "make[1]: Leaving directory '/src/lib'\n"
+    "d.c:1:1: note: no directory\n"
+    "e.c:1: error: no column\n"
+    "f.c:2:3: error: incomplete";
+
+void check(const Samoyed::BuildLogScanner &scanner)
+{
+    const std::vector<Samoyed::BuildLogScanner::Diagnostic> &diags =
+        scanner.diagnostics();
+    assert(scanner.lineCount() == 14);
+    assert(diags.size() == 6);
+    assert(diags[0].logLine == 3);
+    assert(diags[0].type ==
+           Samoyed::BuildLogScanner::Diagnostic::TYPE_WARNING);
+    assert(strcmp(scanner.fileName(diags[0].fileName), "/src/lib/a.c") == 0);
+    assert(diags[0].line == 11 && diags[0].column == 4);
+    assert(strcmp(scanner.message(diags[0]), "unused variable 'x'") == 0);
+    assert(diags[1].logLine == 5);
+    assert(strcmp(scanner.fileName(diags[1].fileName),
+                  "/usr/include/b.h") == 0);
+    assert(diags[2].logLine == 7);
+    assert(diags[2].type == Samoyed::BuildLogScanner::Diagnostic::TYPE_ERROR);
+    assert(strcmp(scanner.fileName(diags[2].fileName),
+                  "/src/lib/sub/c.c") == 0);
+    assert(diags[3].logLine == 9);
+    assert(diags[3].fileName == diags[0].fileName);
+    assert(diags[4].logLine == 11);
+    assert(strcmp(scanner.fileName(diags[4].fileName), "/proj/d.c") == 0);
+    assert(diags[5].logLine == 13);
+    assert(diags[5].line == 1 && diags[5].column == 2);
+    assert(strcmp(scanner.message(diags[5]), "incomplete") == 0);
+    assert(scanner.findDiagnostic(7) == &diags[2]);
+    assert(!scanner.findDiagnostic(8));
+    assert(scanner.lowerBound(8) == 3);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    // Scanning in pieces is the same as scanning at once.
+    int length = strlen(TEST_LOG);
+    for (int step = 1; step <= length; step++)
+    {
+        Samoyed::BuildLogScanner scanner("/proj");
+        for (int i = 0; i < length; i += step)
+            scanner.scan(TEST_LOG + i, std::min(step, length - i));
+        scanner.finish();
+        check(scanner);
+    }
+
+    // Benchmark.
+    if (argc > 1)
+    {
+        GError *error = NULL;
+        GMappedFile *mapped = g_mapped_file_new(argv[1], FALSE, &error);
+        if (!mapped)
+        {
+            fprintf(stderr, "%s\n", error->message);
+            g_error_free(error);
+            return 1;
+        }
+        const char *log = g_mapped_file_get_contents(mapped);
+        gsize logLength = g_mapped_file_get_length(mapped);
+        Samoyed::BuildLogScanner scanner("/proj");
+        gint64 begin = g_get_monotonic_time();
+        for (gsize i = 0; i < logLength; i += 256 * 1024)
+            scanner.scan(log + i, std::min<gsize>(256 * 1024, logLength - i));
+        scanner.finish();
+        gint64 time = g_get_monotonic_time() - begin;
+        printf("Scanned %" G_GSIZE_FORMAT " bytes, %d lines, %d diagnostics "
+               "in %" G_GINT64_FORMAT " ms, %.1f MB/s.\n",
+               logLength,
+               scanner.lineCount(),
+               static_cast<int>(scanner.diagnostics().size()),
+               time / 1000,
+               time ? logLength / (time / 1000000.0) / (1024 * 1024) : 0.0);
+        g_mapped_file_unref(mapped);
+    }
+    return 0;
+}
+
+#endif // #ifdef SMYD_BUILD_LOG_SCANNER_UNIT_TEST
@@ -0,0 +1,134 @@
+// Build log scanner.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_BUILD_LOG_SCANNER_HPP
+#define SMYD_BUILD_LOG_SCANNER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+
+namespace Samoyed
+{
+
+/**
+ * A build log scanner finds the compiler diagnostics in a build log as the raw
+ * output is streamed in, before it is inserted into a text buffer.  Each line
+ * is scanned once for the directory changes reported by make and for compiler
+ * diagnostics in the form "file:line:column: error|warning|note: ...".  The
+ * file names of the diagnostics are resolved against the current directory and
+ * interned, and the diagnostics are stored in the order of their lines.  The
+ * messages are stored in a single pool, so that a diagnostic costs only a few
+ * integers besides its message.
+ *
+ * Lines are terminated by "\n", "\r\n" or "\r", like those in a GTK+ text
+ * buffer, so that the line numbers of the diagnostics are the line numbers in
+ * the text buffer holding the log.
+ */
+class BuildLogScanner: public boost::noncopyable
+{
+public:
+    struct Diagnostic
+    {
+        enum Type
+        {
+            TYPE_NOTE,
+            TYPE_WARNING,
+            TYPE_ERROR,
+            N_TYPES
+        };
+        // The line in the build log.
+        int logLine;
+        Type type;
+        // The ID of the interned file name.
+        int fileName;
+        // The zero-based line and column in the file.
+        int line;
+        int column;
+        // The offset of the message in the message pool.
+        int message;
+#ifdef OS_WINDOWS
+        bool needPathConversion;
+#endif
+    };
+
+    /**
+     * @param projectDir The directory against which relative file names are
+     * resolved if make does not report the current directory.
+     */
+    BuildLogScanner(const char *projectDir);
+
+#ifdef OS_WINDOWS
+    void setUsingWindowsCmd(bool usingWindowsCmd)
+    { m_usingWindowsCmd = usingWindowsCmd; }
+#endif
+
+    /**
+     * Scan a piece of the build log.  An incomplete last line is kept and
+     * scanned when completed by the next piece or by 'finish()'.
+     */
+    void scan(const char *log, int length);
+
+    /**
+     * Scan the incomplete last line, if any.
+     */
+    void finish();
+
+    void clear();
+
+    /**
+     * @return The number of the scanned lines, including the incomplete last
+     * line scanned by 'finish()'.
+     */
+    int lineCount() const { return m_lineCount; }
+
+    const std::vector<Diagnostic> &diagnostics() const { return m_diagnostics; }
+
+    /**
+     * @return The diagnostic at a line of the build log, or NULL if none.
+     */
+    const Diagnostic *findDiagnostic(int logLine) const;
+
+    /**
+     * @return The index of the first diagnostic at or after a line of the
+     * build log.
+     */
+    std::vector<Diagnostic>::size_type lowerBound(int logLine) const;
+
+    const char *fileName(int id) const { return m_fileNames[id]->c_str(); }
+
+    const char *message(const Diagnostic &diag) const
+    { return m_messages.c_str() + diag.message; }
+
+private:
+    void scanLine(const char *begin, const char *end);
+
+    bool scanDirectory(const char *begin, const char *end, bool entering);
+
+    int internFileName(const std::string &fileName);
+
+    std::string m_projectDir;
+
+#ifdef OS_WINDOWS
+    bool m_usingWindowsCmd;
+#endif
+
+    int m_lineCount;
+    std::string m_incompleteLine;
+    bool m_lastCharIsCr;
+
+    std::vector<std::string> m_directoryStack;
+
+    std::vector<Diagnostic> m_diagnostics;
+
+    std::map<std::string, int> m_fileNameIds;
+    std::vector<const std::string *> m_fileNames;
+
+    // The NUL-terminated messages of the diagnostics.
+    std::string m_messages;
+};
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+// Build log store.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "build-log-store.hpp"
+#include <errno.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+namespace
+{
+
+// The size of the text at which the open chunk is sealed.
+const std::string::size_type CHUNK_SIZE = 256 * 1024;
+
+// Compress the chunks at the lowest level, which is fast enough to be done in
+// the main thread and still shrinks a build log severalfold.
+const int COMPRESSION_LEVEL = 1;
+
+const gsize CONVERSION_BUFFER_SIZE = 16 * 1024;
+
+bool convert(GConverter *converter,
+             const char *input,
+             gsize inputLength,
+             std::string &output)
+{
+    char *buffer = static_cast<char *>(g_malloc(CONVERSION_BUFFER_SIZE));
+    GConverterResult result;
+    do
+    {
+        gsize bytesRead, bytesWritten;
+        GError *error = NULL;
+        result = g_converter_convert(converter,
+                                     input,
+                                     inputLength,
+                                     buffer,
+                                     CONVERSION_BUFFER_SIZE,
+                                     G_CONVERTER_INPUT_AT_END,
+                                     &bytesRead,
+                                     &bytesWritten,
+                                     &error);
+        if (result == G_CONVERTER_ERROR)
+        {
+            g_error_free(error);
+            g_free(buffer);
+            return false;
+        }
+        input += bytesRead;
+        inputLength -= bytesRead;
+        output.append(buffer, bytesWritten);
+    }
+    while (result != G_CONVERTER_FINISHED);
+    g_free(buffer);
+    return true;
+}
+
+}
+
+namespace Samoyed
+{
+
+BuildLogStore::BuildLogStore():
+#ifdef OS_WINDOWS
+    m_fileName(NULL),
+#endif
+    m_fileLength(0),
+    m_openChunkFirstLine(0),
+    m_lineCount(0)
+{
+    char *fileName;
+    GError *error = NULL;
+    m_fd = g_file_open_tmp("samoyed-build-log-XXXXXX", &fileName, &error);
+    if (m_fd == -1)
+    {
+        g_warning(_("Samoyed failed to create a temporary file to store the "
+                    "build log: %s. The build log will be kept in memory."),
+                  error->message);
+        g_error_free(error);
+        return;
+    }
+#ifdef OS_WINDOWS
+    // An open file can't be removed on Windows.
+    m_fileName = fileName;
+#else
+    g_unlink(fileName);
+    g_free(fileName);
+#endif
+}
+
+BuildLogStore::~BuildLogStore()
+{
+    if (m_fd != -1)
+    {
+        close(m_fd);
+#ifdef OS_WINDOWS
+        g_unlink(m_fileName);
+        g_free(m_fileName);
+#endif
+    }
+}
+
+void BuildLogStore::clear()
+{
+    m_chunks.clear();
+    m_openChunk.clear();
+    m_openChunkFirstLine = 0;
+    m_lineCount = 0;
+    m_fileLength = 0;
+    // Release the disk space.
+    if (m_fd != -1 && ftruncate(m_fd, 0))
+        g_warning(_("Samoyed failed to truncate the temporary file storing the "
+                    "build log: %s."),
+                  g_strerror(errno));
+}
+
+void BuildLogStore::append(const char *log, int length, int lineCount)
+{
+    m_openChunk.append(log, length);
+    m_lineCount += lineCount;
+    // Seal the open chunk at a line boundary.  Don't seal it at "\r", which
+    // may be followed by "\n".
+    if (m_openChunk.length() >= CHUNK_SIZE &&
+        m_openChunk[m_openChunk.length() - 1] == '\n')
+        seal();
+}
+
+void BuildLogStore::seal()
+{
+    GZlibCompressor *compressor =
+        g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, COMPRESSION_LEVEL);
+    std::string compressed;
+    bool successful = convert(G_CONVERTER(compressor),
+                              m_openChunk.data(),
+                              m_openChunk.length(),
+                              compressed);
+    g_object_unref(compressor);
+    if (!successful)
+        return;
+
+    m_chunks.push_back(Chunk());
+    Chunk &chunk = m_chunks.back();
+    chunk.firstLine = m_openChunkFirstLine;
+    chunk.compressedLength = compressed.length();
+    if (m_fd != -1 && write(compressed, m_fileLength))
+    {
+        chunk.offset = m_fileLength;
+        m_fileLength += compressed.length();
+    }
+    else
+    {
+        chunk.offset = -1;
+        chunk.data.swap(compressed);
+    }
+
+    m_openChunk.clear();
+    m_openChunkFirstLine = m_lineCount;
+}
+
+int BuildLogStore::chunkFirstLine(int chunk) const
+{
+    if (chunk == static_cast<int>(m_chunks.size()))
+        return m_openChunkFirstLine;
+    return m_chunks[chunk].firstLine;
+}
+
+int BuildLogStore::findChunk(int line) const
+{
+    if (line >= m_openChunkFirstLine)
+        return m_chunks.size();
+    int lower = 0, upper = m_chunks.size();
+    // Find the last chunk whose first line is not after the line.
+    while (upper - lower > 1)
+    {
+        int middle = (lower + upper) / 2;
+        if (line < m_chunks[middle].firstLine)
+            upper = middle;
+        else
+            lower = middle;
+    }
+    return lower;
+}
+
+bool BuildLogStore::readChunk(int chunk, std::string &text) const
+{
+    text.clear();
+    if (chunk == static_cast<int>(m_chunks.size()))
+    {
+        text = m_openChunk;
+        return true;
+    }
+
+    const Chunk &c = m_chunks[chunk];
+    std::string compressed;
+    const std::string *data = &c.data;
+    if (c.offset != -1)
+    {
+        if (!read(compressed, c.compressedLength, c.offset))
+            return false;
+        data = &compressed;
+    }
+    GZlibDecompressor *decompressor =
+        g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW);
+    bool successful = convert(G_CONVERTER(decompressor),
+                              data->data(),
+                              data->length(),
+                              text);
+    g_object_unref(decompressor);
+    return successful;
+}
+
+bool BuildLogStore::write(const std::string &data, goffset offset)
+{
+    if (lseek(m_fd, offset, SEEK_SET) == -1)
+        return false;
+    const char *cp = data.data();
+    gsize length = data.length();
+    while (length)
+    {
+        ssize_t written = ::write(m_fd, cp, length);
+        if (written == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        cp += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool BuildLogStore::read(std::string &data, gsize length, goffset offset) const
+{
+    if (lseek(m_fd, offset, SEEK_SET) == -1)
+        return false;
+    data.resize(length);
+    gsize total = 0;
+    while (total < length)
+    {
+        ssize_t bytesRead = ::read(m_fd, &data[total], length - total);
+        if (bytesRead == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (bytesRead == 0)
+            return false;
+        total += bytesRead;
+    }
+    return true;
+}
+
+}
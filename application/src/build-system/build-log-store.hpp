@@ -0,0 +1,89 @@
+// Build log store.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_BUILD_LOG_STORE_HPP
+#define SMYD_BUILD_LOG_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+/**
+ * A build log store keeps a build log in chunks, each of which holds whole
+ * lines.  The last chunk is open and kept in memory as the log is appended.
+ * Once it grows large enough, it is sealed, compressed and appended to an
+ * anonymous temporary file, like the scrollback of a terminal.  The chunks are
+ * indexed by their offsets in the file and their first lines in the log, so
+ * that any part of the log can be read back by decompressing a few chunks.  If
+ * the temporary file can't be created, the compressed chunks are kept in
+ * memory.
+ */
+class BuildLogStore: public boost::noncopyable
+{
+public:
+    BuildLogStore();
+
+    ~BuildLogStore();
+
+    void clear();
+
+    /**
+     * Append a piece of the log to the open chunk.
+     * @param lineCount The number of the lines completed by the piece.
+     */
+    void append(const char *log, int length, int lineCount);
+
+    /**
+     * @return The number of the chunks, including the open one.
+     */
+    int chunkCount() const { return m_chunks.size() + 1; }
+
+    int chunkFirstLine(int chunk) const;
+
+    /**
+     * @return The chunk containing a line of the log.
+     */
+    int findChunk(int line) const;
+
+    /**
+     * Read the text of a chunk.
+     * @return False iff failed to read the chunk from the temporary file.
+     */
+    bool readChunk(int chunk, std::string &text) const;
+
+private:
+    struct Chunk
+    {
+        goffset offset;
+        gsize compressedLength;
+        int firstLine;
+        // The compressed text if not stored in the file.
+        std::string data;
+    };
+
+    void seal();
+
+    bool write(const std::string &data, goffset offset);
+
+    bool read(std::string &data, gsize length, goffset offset) const;
+
+    int m_fd;
+#ifdef OS_WINDOWS
+    char *m_fileName;
+#endif
+    goffset m_fileLength;
+
+    std::vector<Chunk> m_chunks;
+
+    std::string m_openChunk;
+    int m_openChunkFirstLine;
+    int m_lineCount;
+};
+
+}
+
+#endif
@@ -15,10 +15,11 @@
 #include "utilities/miscellaneous.hpp"
 #include "application.hpp"
 #include <assert.h>
-#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
-#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <utility>
+#include <vector>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
 #include <glib/gi18n.h>
@@ -30,12 +31,20 @@ namespace
 
 const int DOUBLE_CLICK_INTERVAL = 250;
 
+// The interval at which the estimated remaining time of a build is updated, in
+// seconds.
+const guint COUNTDOWN_INTERVAL = 1;
+
+// The maximum number of the chunks of the build log in the text buffer.
+const int MAX_WINDOW_CHUNKS = 4;
+
 const char *ACTION_TEXT[] =
 {
     N_("Configuring"),
     N_("Building"),
     N_("Installing"),
-    N_("Cleaning")
+    N_("Cleaning"),
+    N_("Compiling")
 };
 
 const char *ACTION_TEXT_2[] =
@@ -43,7 +52,8 @@ const char *ACTION_TEXT_2[] =
     N_("configuring"),
     N_("building"),
     N_("installing"),
-    N_("cleaning")
+    N_("cleaning"),
+    N_("compiling")
 };
 
 const char *ACTION_TEXT_3[] =
@@ -51,7 +61,27 @@ const char *ACTION_TEXT_3[] =
     N_("configure"),
     N_("build"),
     N_("install"),
-    N_("clean")
+    N_("clean"),
+    N_("compile")
+};
+
+enum CompilationColumn
+{
+    FILE_COLUMN,
+    DURATION_COLUMN,
+    PREVIOUS_DURATION_COLUMN,
+    CHANGE_COLUMN,
+    MEMORY_COLUMN,
+    STATUS_COLUMN
+};
+
+const char *COMPILATION_COLUMN_RENDERERS[][2] =
+{
+    { "duration-column", "duration-renderer" },
+    { "previous-duration-column", "previous-duration-renderer" },
+    { "change-column", "change-renderer" },
+    { "memory-column", "memory-renderer" },
+    { NULL, NULL }
 };
 
 const char *COMPILER_DIAGNOSTIC_TYPE_NAMES[
@@ -70,6 +100,244 @@ const char *COMPILER_DIAGNOSTIC_COLORS[
     "red"
 };
 
+const char *COMPILER_DIAGNOSTIC_ICON_NAMES[
+    Samoyed::BuildLogView::CompilerDiagnostic::N_TYPES] =
+{
+    "dialog-information",
+    "dialog-warning",
+    "dialog-error"
+};
+
+const char *DIAGNOSTIC_TYPE_BUTTONS[
+    Samoyed::BuildLogView::CompilerDiagnostic::N_TYPES] =
+{
+    "show-notes",
+    "show-warnings",
+    "show-errors"
+};
+
+enum DiagnosticColumn
+{
+    DIAGNOSTIC_ICON_COLUMN,
+    DIAGNOSTIC_FILE_COLUMN,
+    DIAGNOSTIC_LOCATION_COLUMN,
+    DIAGNOSTIC_MESSAGE_COLUMN,
+    N_DIAGNOSTIC_COLUMNS
+};
+
+// A GtkTreeModel showing the rows of an error list.  The cells are formatted on
+// demand and no row is stored, so that a tree view in the fixed height mode
+// costs time only for the visible rows, however many diagnostics are found.
+struct ErrorListModel
+{
+    GObject parent;
+    const Samoyed::BuildLogScanner *scanner;
+    const Samoyed::ErrorList *errorList;
+    // The project directory, with a trailing directory separator, which is
+    // stripped from the file names.
+    char *projectDir;
+    int projectDirLength;
+    gint stamp;
+};
+
+struct ErrorListModelClass
+{
+    GObjectClass parent;
+};
+
+static void error_list_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(
+    ErrorListModel,
+    error_list_model,
+    G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+                          error_list_model_tree_model_init))
+
+#define ERROR_LIST_MODEL(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+                                error_list_model_get_type(), \
+                                ErrorListModel))
+
+static bool error_list_model_set_iter(ErrorListModel *m,
+                                      GtkTreeIter *iter,
+                                      int row)
+{
+    if (row < 0 || row >= m->errorList->rowCount())
+        return false;
+    iter->stamp = m->stamp;
+    iter->user_data = GINT_TO_POINTER(row);
+    return true;
+}
+
+static GtkTreeModelFlags error_list_model_get_flags_impl(GtkTreeModel *model)
+{
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint error_list_model_get_n_columns_impl(GtkTreeModel *model)
+{
+    return N_DIAGNOSTIC_COLUMNS;
+}
+
+static GType error_list_model_get_column_type_impl(GtkTreeModel *model,
+                                                   gint index)
+{
+    return G_TYPE_STRING;
+}
+
+static gboolean error_list_model_get_iter_impl(GtkTreeModel *model,
+                                               GtkTreeIter *iter,
+                                               GtkTreePath *path)
+{
+    if (gtk_tree_path_get_depth(path) != 1)
+        return FALSE;
+    if (error_list_model_set_iter(ERROR_LIST_MODEL(model),
+                                  iter,
+                                  gtk_tree_path_get_indices(path)[0]))
+        return TRUE;
+    return FALSE;
+}
+
+static GtkTreePath *error_list_model_get_path_impl(GtkTreeModel *model,
+                                                   GtkTreeIter *iter)
+{
+    return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data),
+                                          -1);
+}
+
+static void error_list_model_get_value_impl(GtkTreeModel *model,
+                                            GtkTreeIter *iter,
+                                            gint column,
+                                            GValue *value)
+{
+    ErrorListModel *m = ERROR_LIST_MODEL(model);
+    const Samoyed::BuildLogScanner::Diagnostic &diag =
+        m->scanner->diagnostics()[
+            m->errorList->diagnostic(GPOINTER_TO_INT(iter->user_data))];
+    g_value_init(value, G_TYPE_STRING);
+    switch (column)
+    {
+    case DIAGNOSTIC_ICON_COLUMN:
+        g_value_set_static_string(value,
+                                  COMPILER_DIAGNOSTIC_ICON_NAMES[diag.type]);
+        break;
+    case DIAGNOSTIC_FILE_COLUMN:
+    {
+        // Show the file names relative to the project directory.
+        const char *fileName = m->scanner->fileName(diag.fileName);
+        if (strncmp(fileName, m->projectDir, m->projectDirLength) == 0)
+            fileName += m->projectDirLength;
+        g_value_set_string(value, fileName);
+        break;
+    }
+    case DIAGNOSTIC_LOCATION_COLUMN:
+    {
+        char location[32];
+        g_snprintf(location, sizeof(location), "%d:%d",
+                   diag.line + 1, diag.column + 1);
+        g_value_set_string(value, location);
+        break;
+    }
+    case DIAGNOSTIC_MESSAGE_COLUMN:
+        g_value_set_string(value, m->scanner->message(diag));
+        break;
+    }
+}
+
+static gboolean error_list_model_iter_next_impl(GtkTreeModel *model,
+                                                GtkTreeIter *iter)
+{
+    if (error_list_model_set_iter(ERROR_LIST_MODEL(model),
+                                  iter,
+                                  GPOINTER_TO_INT(iter->user_data) + 1))
+        return TRUE;
+    return FALSE;
+}
+
+static gboolean error_list_model_iter_previous_impl(GtkTreeModel *model,
+                                                    GtkTreeIter *iter)
+{
+    if (error_list_model_set_iter(ERROR_LIST_MODEL(model),
+                                  iter,
+                                  GPOINTER_TO_INT(iter->user_data) - 1))
+        return TRUE;
+    return FALSE;
+}
+
+static gboolean error_list_model_iter_children_impl(GtkTreeModel *model,
+                                                    GtkTreeIter *iter,
+                                                    GtkTreeIter *parent)
+{
+    if (!parent && error_list_model_set_iter(ERROR_LIST_MODEL(model), iter, 0))
+        return TRUE;
+    return FALSE;
+}
+
+static gboolean error_list_model_iter_has_child_impl(GtkTreeModel *model,
+                                                     GtkTreeIter *iter)
+{
+    return FALSE;
+}
+
+static gint error_list_model_iter_n_children_impl(GtkTreeModel *model,
+                                                  GtkTreeIter *iter)
+{
+    if (iter)
+        return 0;
+    return ERROR_LIST_MODEL(model)->errorList->rowCount();
+}
+
+static gboolean error_list_model_iter_nth_child_impl(GtkTreeModel *model,
+                                                     GtkTreeIter *iter,
+                                                     GtkTreeIter *parent,
+                                                     gint n)
+{
+    if (!parent && error_list_model_set_iter(ERROR_LIST_MODEL(model), iter, n))
+        return TRUE;
+    return FALSE;
+}
+
+static gboolean error_list_model_iter_parent_impl(GtkTreeModel *model,
+                                                  GtkTreeIter *iter,
+                                                  GtkTreeIter *child)
+{
+    return FALSE;
+}
+
+static void error_list_model_tree_model_init(GtkTreeModelIface *iface)
+{
+    iface->get_flags = error_list_model_get_flags_impl;
+    iface->get_n_columns = error_list_model_get_n_columns_impl;
+    iface->get_column_type = error_list_model_get_column_type_impl;
+    iface->get_iter = error_list_model_get_iter_impl;
+    iface->get_path = error_list_model_get_path_impl;
+    iface->get_value = error_list_model_get_value_impl;
+    iface->iter_next = error_list_model_iter_next_impl;
+    iface->iter_previous = error_list_model_iter_previous_impl;
+    iface->iter_children = error_list_model_iter_children_impl;
+    iface->iter_has_child = error_list_model_iter_has_child_impl;
+    iface->iter_n_children = error_list_model_iter_n_children_impl;
+    iface->iter_nth_child = error_list_model_iter_nth_child_impl;
+    iface->iter_parent = error_list_model_iter_parent_impl;
+}
+
+static void error_list_model_init(ErrorListModel *m)
+{
+    m->stamp = g_random_int();
+}
+
+static void error_list_model_finalize(GObject *object)
+{
+    g_free(ERROR_LIST_MODEL(object)->projectDir);
+    G_OBJECT_CLASS(error_list_model_parent_class)->finalize(object);
+}
+
+static void error_list_model_class_init(ErrorListModelClass *c)
+{
+    G_OBJECT_CLASS(c)->finalize = error_list_model_finalize;
+}
+
 #ifdef OS_WINDOWS
 struct DataReadParam
 {
@@ -86,36 +354,12 @@ struct DataReadParam
 };
 #endif
 
-gboolean scrollToEnd(gpointer textView)
+std::string projectDirectory(const char *projectUri)
 {
-    GtkAdjustment *adj =
-        gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(textView));
-    gtk_adjustment_set_value(adj, gtk_adjustment_get_upper(adj));
-    g_object_unref(textView);
-    return FALSE;
-}
-
-bool parseInteger(char *begin, char *&end, int &integer)
-{
-    char *cp;
-    for (cp = end - 1; cp >= begin; cp--)
-    {
-        if (!isdigit(*cp))
-            break;
-    }
-    if (cp == end - 1 || cp < begin || *cp != ':')
-        return false;
-    try
-    {
-        integer = boost::lexical_cast<int>(cp + 1);
-    }
-    catch (boost::bad_lexical_cast &error)
-    {
-        return false;
-    }
-    end = cp;
-    *end = '\0';
-    return true;
+    char *projectDir = g_filename_from_uri(projectUri, NULL, NULL);
+    std::string dir(projectDir);
+    g_free(projectDir);
+    return dir;
 }
 
 }
@@ -126,7 +370,18 @@ namespace Samoyed
 BuildLogView::BuildLogView(const char *projectUri,
                            const char *configName):
     m_projectUri(projectUri),
-    m_configName(configName)
+    m_configName(configName),
+    m_scrollerId(0),
+    m_startTime(0),
+    m_estimatedEndTime(-1),
+    m_countdownId(0),
+    m_scanner(projectDirectory(projectUri).c_str()),
+    m_errorList(m_scanner),
+    m_errorListModel(NULL),
+    m_windowBegin(0),
+    m_windowEnd(0),
+    m_following(true),
+    m_windowUpdaterId(0)
 #ifdef OS_WINDOWS
     ,
     m_usingWindowsCmd(false),
@@ -138,17 +393,27 @@ BuildLogView::BuildLogView(const char *projectUri,
 
 BuildLogView::~BuildLogView()
 {
+    if (m_scrollerId)
+        g_source_remove(m_scrollerId);
+    stopCountingDown();
+    if (m_windowUpdaterId)
+        g_source_remove(m_windowUpdaterId);
+    g_signal_handlers_disconnect_by_data(
+        gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(m_log)),
+        this);
+    if (m_errorListModel)
+    {
+        // The model refers to the error list, which is destroyed with the
+        // view.
+        gtk_tree_view_set_model(m_errorListView, NULL);
+        g_object_unref(m_errorListModel);
+    }
+
 #ifdef OS_WINDOWS
     if (m_pathInConversion)
         cancelConvertingPath();
     m_pathConversionCache.clear();
 #endif
-
-    for (std::map<int, CompilerDiagnostic *>::iterator it
-            = m_diagnostics.begin();
-         it != m_diagnostics.end();
-         ++it)
-        delete it->second;
 }
 
 bool BuildLogView::setup()
@@ -192,6 +457,60 @@ bool BuildLogView::setup()
     }
     g_signal_connect_after(m_log, "button-press-event",
                            G_CALLBACK(onButtonPressEvent), this);
+    g_signal_connect(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(m_log)),
+                     "value-changed",
+                     G_CALLBACK(onScrolled), this);
+
+    m_compilationStore =
+        GTK_LIST_STORE(gtk_builder_get_object(m_builder, "compilations"));
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(m_compilationStore),
+                                         DURATION_COLUMN,
+                                         GTK_SORT_DESCENDING);
+    for (int i = 0; COMPILATION_COLUMN_RENDERERS[i][0]; i++)
+        gtk_tree_view_column_set_cell_data_func(
+            GTK_TREE_VIEW_COLUMN(gtk_builder_get_object(
+                m_builder,
+                COMPILATION_COLUMN_RENDERERS[i][0])),
+            GTK_CELL_RENDERER(gtk_builder_get_object(
+                m_builder,
+                COMPILATION_COLUMN_RENDERERS[i][1])),
+            formatCompilationColumn,
+            GINT_TO_POINTER(DURATION_COLUMN + i),
+            NULL);
+    m_timeline = GTK_WIDGET(gtk_builder_get_object(m_builder, "timeline"));
+    g_signal_connect(m_timeline, "draw", G_CALLBACK(drawTimeline), this);
+
+    ErrorListModel *errorListModel = ERROR_LIST_MODEL(
+        g_object_new(error_list_model_get_type(), NULL));
+    errorListModel->scanner = &m_scanner;
+    errorListModel->errorList = &m_errorList;
+    std::string projectDir = projectDirectory(m_projectUri.c_str());
+    projectDir += G_DIR_SEPARATOR;
+    errorListModel->projectDir = g_strdup(projectDir.c_str());
+    errorListModel->projectDirLength = projectDir.length();
+    m_errorListModel = GTK_TREE_MODEL(errorListModel);
+    m_errorListView =
+        GTK_TREE_VIEW(gtk_builder_get_object(m_builder, "error-list"));
+    gtk_tree_view_set_model(m_errorListView, m_errorListModel);
+    g_signal_connect(m_errorListView, "row-activated",
+                     G_CALLBACK(onDiagnosticActivated), this);
+    for (int i = 0; i < CompilerDiagnostic::N_TYPES; i++)
+    {
+        m_diagnosticTypeButtons[i] = GTK_TOGGLE_BUTTON(
+            gtk_builder_get_object(m_builder, DIAGNOSTIC_TYPE_BUTTONS[i]));
+        g_signal_connect(m_diagnosticTypeButtons[i], "toggled",
+                         G_CALLBACK(onDiagnosticTypeToggled), this);
+    }
+    g_signal_connect(gtk_builder_get_object(m_builder, "group-by-file"),
+                     "toggled",
+                     G_CALLBACK(onGroupByFileToggled), this);
+    g_signal_connect(gtk_builder_get_object(m_builder, "error-filter"),
+                     "search-changed",
+                     G_CALLBACK(onErrorFilterChanged), this);
+    m_diagnosticCounts =
+        GTK_LABEL(gtk_builder_get_object(m_builder, "diagnostic-counts"));
+    updateDiagnosticCounts();
+
     GtkWidget *grid = GTK_WIDGET(gtk_builder_get_object(m_builder, "grid"));
     setGtkWidget(grid);
     gtk_widget_show_all(grid);
@@ -213,6 +532,8 @@ BuildLogView *BuildLogView::create(const char *projectUri,
 void BuildLogView::startBuild(Builder::Action action)
 {
     m_action = action;
+    m_startTime = g_get_monotonic_time();
+    stopCountingDown();
     char *message = g_strdup_printf(
         _("%s project \"%s\" with configuration \"%s\"."),
         gettext(ACTION_TEXT[m_action]),
@@ -223,6 +544,50 @@ void BuildLogView::startBuild(Builder::Action action)
     gtk_widget_show(GTK_WIDGET(m_stopButton));
 }
 
+void BuildLogView::setEstimatedDuration(gint64 duration)
+{
+    stopCountingDown();
+    m_estimatedEndTime = m_startTime + duration * 1000;
+    updateRemainingTime(this);
+    m_countdownId = g_timeout_add_seconds(COUNTDOWN_INTERVAL,
+                                          updateRemainingTime,
+                                          this);
+}
+
+gboolean BuildLogView::updateRemainingTime(gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    gint64 remaining = v->m_estimatedEndTime - g_get_monotonic_time();
+    char *message;
+    if (remaining > 0)
+        message = g_strdup_printf(
+            _("%s project \"%s\" with configuration \"%s\". About %d "
+              "seconds remaining."),
+            gettext(ACTION_TEXT[v->m_action]),
+            v->m_projectUri.c_str(),
+            v->m_configName.c_str(),
+            static_cast<int>((remaining + 999999) / 1000000));
+    else
+        message = g_strdup_printf(
+            _("%s project \"%s\" with configuration \"%s\". Taking longer "
+              "than estimated."),
+            gettext(ACTION_TEXT[v->m_action]),
+            v->m_projectUri.c_str(),
+            v->m_configName.c_str());
+    gtk_label_set_label(v->m_message, message);
+    g_free(message);
+    return TRUE;
+}
+
+void BuildLogView::stopCountingDown()
+{
+    if (m_countdownId)
+    {
+        g_source_remove(m_countdownId);
+        m_countdownId = 0;
+    }
+}
+
 void BuildLogView::clear()
 {
     GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
@@ -237,34 +602,345 @@ void BuildLogView::clear()
     m_pathConversionCache.clear();
 #endif
 
-    for (std::map<int, CompilerDiagnostic *>::iterator it
-             = m_diagnostics.begin();
-         it != m_diagnostics.end();
-         ++it)
-        delete it->second;
-    m_diagnostics.clear();
+    m_scanner.clear();
+    m_errorList.clear();
+    resetErrorList();
+    updateDiagnosticCounts();
+    m_store.clear();
+    m_windowBegin = 0;
+    m_windowEnd = 0;
+    m_following = true;
 
-    while (!m_directoryStack.empty())
-        m_directoryStack.pop();
+    gtk_list_store_clear(m_compilationStore);
+    m_compilationTimes.clear();
+    gtk_widget_queue_draw(m_timeline);
 }
 
 void BuildLogView::addLog(const char *log, int length)
 {
+    // Scan the raw log before storing it.
+    std::vector<CompilerDiagnostic>::size_type numDiags =
+        m_scanner.diagnostics().size();
+    int numLines = m_scanner.lineCount();
+    m_scanner.scan(log, length);
+    m_store.append(log, length, m_scanner.lineCount() - numLines);
+    if (m_scanner.diagnostics().size() != numDiags)
+        updateErrorList();
+
+    // If the user scrolled back, the log will be loaded when the user scrolls
+    // to the end.
+    if (!m_following)
+        return;
+
     GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
     GtkTextIter end;
     gtk_text_buffer_get_end_iter(buffer, &end);
-    int line = gtk_text_iter_get_line(&end);
     // TBD: Need to convert the log from the encoding of the current locale into
     // the UTF-8 encoding?
     gtk_text_buffer_insert(buffer, &end, log, length);
-    parseLog(line, gtk_text_buffer_get_line_count(buffer));
+    highlightDiagnostics(numDiags, m_scanner.diagnostics().size());
+
+    // Keep the recent log only.
+    while (windowEnd() - m_windowBegin > MAX_WINDOW_CHUNKS)
+        unloadFirstChunk();
 
     // Scroll to the end.
-    g_idle_add(scrollToEnd, g_object_ref(m_log));
+    if (!m_scrollerId)
+        m_scrollerId = g_idle_add(scrollToEnd, this);
+}
+
+void BuildLogView::endLog()
+{
+    std::vector<CompilerDiagnostic>::size_type numDiags =
+        m_scanner.diagnostics().size();
+    int numLines = m_scanner.lineCount();
+    m_scanner.finish();
+    m_store.append("", 0, m_scanner.lineCount() - numLines);
+    if (m_scanner.diagnostics().size() != numDiags)
+        updateErrorList();
+    if (m_following)
+        highlightDiagnostics(numDiags, m_scanner.diagnostics().size());
+}
+
+void BuildLogView::highlightDiagnostics(
+    std::vector<CompilerDiagnostic>::size_type begin,
+    std::vector<CompilerDiagnostic>::size_type end)
+{
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
+    GtkTextIter lineBegin, lineEnd;
+    const std::vector<CompilerDiagnostic> &diags = m_scanner.diagnostics();
+    int firstLine = windowFirstLine();
+    for (std::vector<CompilerDiagnostic>::size_type i = begin; i < end; i++)
+    {
+        gtk_text_buffer_get_iter_at_line(buffer, &lineBegin,
+                                         diags[i].logLine - firstLine);
+        gtk_text_buffer_get_iter_at_line(buffer, &lineEnd,
+                                         diags[i].logLine - firstLine + 1);
+        gtk_text_buffer_apply_tag(buffer,
+                                  m_diagnosticTags[diags[i].type],
+                                  &lineBegin, &lineEnd);
+    }
+}
+
+// Insert the rows of the newly found diagnostics into the tree view one by one,
+// or reset the tree view if most rows are new.
+void BuildLogView::updateErrorList()
+{
+    std::vector<int> insertedRows;
+    m_errorList.update(insertedRows);
+    if (insertedRows.size() * 2 > static_cast<size_t>(m_errorList.rowCount()))
+        resetErrorList();
+    else
+    {
+        GtkTreeIter iter;
+        iter.stamp = ERROR_LIST_MODEL(m_errorListModel)->stamp;
+        for (std::vector<int>::const_iterator it = insertedRows.begin();
+             it != insertedRows.end();
+             ++it)
+        {
+            iter.user_data = GINT_TO_POINTER(*it);
+            GtkTreePath *path = gtk_tree_path_new_from_indices(*it, -1);
+            gtk_tree_model_row_inserted(m_errorListModel, path, &iter);
+            gtk_tree_path_free(path);
+        }
+    }
+    updateDiagnosticCounts();
+}
+
+// Let the tree view fetch all the rows again after the error list is sorted or
+// filtered differently.
+void BuildLogView::resetErrorList()
+{
+    ERROR_LIST_MODEL(m_errorListModel)->stamp++;
+    gtk_tree_view_set_model(m_errorListView, NULL);
+    gtk_tree_view_set_model(m_errorListView, m_errorListModel);
+}
+
+void BuildLogView::updateDiagnosticCounts()
+{
+    char *counts = g_strdup_printf(
+        _("%d errors, %d warnings, %d notes"),
+        m_errorList.count(CompilerDiagnostic::TYPE_ERROR),
+        m_errorList.count(CompilerDiagnostic::TYPE_WARNING),
+        m_errorList.count(CompilerDiagnostic::TYPE_NOTE));
+    gtk_label_set_label(m_diagnosticCounts, counts);
+    g_free(counts);
+}
+
+void BuildLogView::selectDiagnostic(int row)
+{
+    GtkTreePath *path = gtk_tree_path_new_from_indices(row, -1);
+    gtk_tree_view_set_cursor(m_errorListView, path, NULL, FALSE);
+    gtk_tree_path_free(path);
+}
+
+void BuildLogView::showAdjacentDiagnostic(bool next)
+{
+    int rowCount = m_errorList.rowCount();
+    if (rowCount == 0)
+        return;
+    int row;
+    GtkTreePath *path;
+    gtk_tree_view_get_cursor(m_errorListView, &path, NULL);
+    if (path)
+    {
+        row = gtk_tree_path_get_indices(path)[0] + (next ? 1 : -1);
+        gtk_tree_path_free(path);
+        if (row < 0 || row >= rowCount)
+            return;
+    }
+    else
+        row = next ? 0 : rowCount - 1;
+    selectDiagnostic(row);
+    openDiagnostic(&m_scanner.diagnostics()[m_errorList.diagnostic(row)]);
+}
+
+void BuildLogView::showNextDiagnostic()
+{
+    showAdjacentDiagnostic(true);
+}
+
+void BuildLogView::showPreviousDiagnostic()
+{
+    showAdjacentDiagnostic(false);
+}
+
+void BuildLogView::onDiagnosticActivated(GtkTreeView *treeView,
+                                         GtkTreePath *path,
+                                         GtkTreeViewColumn *column,
+                                         gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    v->openDiagnostic(&v->m_scanner.diagnostics()[
+        v->m_errorList.diagnostic(gtk_tree_path_get_indices(path)[0])]);
+}
+
+void BuildLogView::onDiagnosticTypeToggled(GtkToggleButton *button,
+                                           gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    for (int i = 0; i < CompilerDiagnostic::N_TYPES; i++)
+    {
+        if (v->m_diagnosticTypeButtons[i] == button)
+        {
+            v->m_errorList.setTypeShown(
+                static_cast<CompilerDiagnostic::Type>(i),
+                gtk_toggle_button_get_active(button));
+            break;
+        }
+    }
+    v->resetErrorList();
+}
+
+void BuildLogView::onGroupByFileToggled(GtkToggleButton *button,
+                                        gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    v->m_errorList.setOrder(gtk_toggle_button_get_active(button) ?
+                            ErrorList::ORDER_BY_FILE :
+                            ErrorList::ORDER_BY_LOG_LINE);
+    v->resetErrorList();
+}
+
+void BuildLogView::onErrorFilterChanged(GtkSearchEntry *entry, gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    v->m_errorList.setFilterText(gtk_entry_get_text(GTK_ENTRY(entry)));
+    v->resetErrorList();
+}
+
+bool BuildLogView::loadPreviousChunk()
+{
+    std::string text;
+    if (!m_store.readChunk(m_windowBegin - 1, text))
+        return false;
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
+    GtkTextIter begin;
+    gtk_text_buffer_get_start_iter(buffer, &begin);
+    gtk_text_buffer_insert(buffer, &begin, text.data(), text.length());
+    m_windowBegin--;
+    highlightDiagnostics(
+        m_scanner.lowerBound(m_store.chunkFirstLine(m_windowBegin)),
+        m_scanner.lowerBound(m_store.chunkFirstLine(m_windowBegin + 1)));
+    return true;
+}
+
+bool BuildLogView::loadNextChunk()
+{
+    std::string text;
+    if (!m_store.readChunk(m_windowEnd, text))
+        return false;
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
+    GtkTextIter end;
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_insert(buffer, &end, text.data(), text.length());
+    int beginLine = m_store.chunkFirstLine(m_windowEnd);
+    m_windowEnd++;
+    if (m_windowEnd == m_store.chunkCount())
+    {
+        // Loaded the open chunk, including the incomplete last line.
+        m_following = true;
+        highlightDiagnostics(m_scanner.lowerBound(beginLine),
+                             m_scanner.diagnostics().size());
+    }
+    else
+        highlightDiagnostics(
+            m_scanner.lowerBound(beginLine),
+            m_scanner.lowerBound(m_store.chunkFirstLine(m_windowEnd)));
+    return true;
+}
+
+void BuildLogView::unloadFirstChunk()
+{
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
+    GtkTextIter begin, end;
+    gtk_text_buffer_get_start_iter(buffer, &begin);
+    gtk_text_buffer_get_iter_at_line(
+        buffer,
+        &end,
+        m_store.chunkFirstLine(m_windowBegin + 1) - windowFirstLine());
+    gtk_text_buffer_delete(buffer, &begin, &end);
+    m_windowBegin++;
+}
+
+void BuildLogView::unloadLastChunk()
+{
+    int last = windowEnd() - 1;
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
+    GtkTextIter begin, end;
+    gtk_text_buffer_get_iter_at_line(
+        buffer,
+        &begin,
+        m_store.chunkFirstLine(last) - windowFirstLine());
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_delete(buffer, &begin, &end);
+    m_windowEnd = last;
+    m_following = false;
+}
+
+void BuildLogView::onScrolled(GtkAdjustment *adjustment, gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    if (!v->m_windowUpdaterId)
+        v->m_windowUpdaterId = g_idle_add(updateWindow, v);
+}
+
+gboolean BuildLogView::updateWindow(gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    v->m_windowUpdaterId = 0;
+
+    GtkAdjustment *adj =
+        gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(v->m_log));
+    double value = gtk_adjustment_get_value(adj);
+    double pageSize = gtk_adjustment_get_page_size(adj);
+    bool nearBegin = value - gtk_adjustment_get_lower(adj) < pageSize;
+    bool nearEnd = gtk_adjustment_get_upper(adj) - value - pageSize < pageSize;
+    if (!(nearBegin && v->m_windowBegin > 0) && !(nearEnd && !v->m_following))
+        return FALSE;
+
+    // Keep the first visible line in place while loading and unloading chunks.
+    GtkTextBuffer *buffer = gtk_text_view_get_buffer(v->m_log);
+    GdkRectangle rect;
+    GtkTextIter top;
+    gtk_text_view_get_visible_rect(v->m_log, &rect);
+    gtk_text_view_get_line_at_y(v->m_log, &top, rect.y, NULL);
+    GtkTextMark *topMark =
+        gtk_text_buffer_create_mark(buffer, NULL, &top, TRUE);
+
+    if (nearBegin && v->m_windowBegin > 0)
+    {
+        if (v->loadPreviousChunk() &&
+            v->windowEnd() - v->m_windowBegin > MAX_WINDOW_CHUNKS)
+            v->unloadLastChunk();
+    }
+    else
+    {
+        if (v->loadNextChunk() &&
+            v->windowEnd() - v->m_windowBegin > MAX_WINDOW_CHUNKS)
+            v->unloadFirstChunk();
+    }
+
+    gtk_text_view_scroll_to_mark(v->m_log, topMark, 0.0, TRUE, 0.0, 0.0);
+    gtk_text_buffer_delete_mark(buffer, topMark);
+    return FALSE;
+}
+
+gboolean BuildLogView::scrollToEnd(gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    v->m_scrollerId = 0;
+    if (!v->m_following)
+        return FALSE;
+    GtkAdjustment *adj =
+        gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(v->m_log));
+    gtk_adjustment_set_value(adj, gtk_adjustment_get_upper(adj));
+    return FALSE;
 }
 
 void BuildLogView::onBuildFinished(bool successful, const char *error)
 {
+    stopCountingDown();
     char *message;
     if (successful)
         message = g_strdup_printf(
@@ -285,8 +961,145 @@ void BuildLogView::onBuildFinished(bool successful, const char *error)
     gtk_widget_hide(GTK_WIDGET(m_stopButton));
 }
 
+void BuildLogView::addCompilations(
+    const std::vector<CompilerOptionsCollector::Compilation> &compilations)
+{
+    std::string projectDir = projectDirectory(m_projectUri.c_str());
+    projectDir += G_DIR_SEPARATOR;
+    for (std::vector<CompilerOptionsCollector::Compilation>::const_iterator it =
+            compilations.begin();
+         it != compilations.end();
+         ++it)
+    {
+        // Show the file names relative to the project directory.
+        char *fileName = g_filename_from_uri(it->fileUri.c_str(), NULL, NULL);
+        if (!fileName)
+            continue;
+        const char *shownFileName = fileName;
+        if (strncmp(fileName, projectDir.c_str(), projectDir.length()) == 0)
+            shownFileName += projectDir.length();
+        double duration = (it->endTime - it->startTime) / 1e6;
+        double previousDuration = it->previousDuration / 1e6;
+        // The sorted store inserts each row in logarithmic time.
+        gtk_list_store_insert_with_values(
+            m_compilationStore, NULL, -1,
+            FILE_COLUMN, shownFileName,
+            DURATION_COLUMN, duration,
+            PREVIOUS_DURATION_COLUMN,
+            it->previousDuration >= 0 ? previousDuration : -1.0,
+            CHANGE_COLUMN,
+            it->previousDuration >= 0 ? duration - previousDuration : 0.0,
+            MEMORY_COLUMN, it->peakMemory / 1024.0,
+            STATUS_COLUMN, it->exitStatus,
+            -1);
+        g_free(fileName);
+        m_compilationTimes.push_back(std::make_pair(it->startTime,
+                                                    it->endTime));
+    }
+    gtk_widget_queue_draw(m_timeline);
+}
+
+void BuildLogView::formatCompilationColumn(GtkTreeViewColumn *column,
+                                           GtkCellRenderer *renderer,
+                                           GtkTreeModel *model,
+                                           GtkTreeIter *iter,
+                                           gpointer modelColumn)
+{
+    int col = GPOINTER_TO_INT(modelColumn);
+    double value, previousDuration;
+    gtk_tree_model_get(model, iter,
+                       col, &value,
+                       PREVIOUS_DURATION_COLUMN, &previousDuration,
+                       -1);
+    char text[32];
+    if ((col == PREVIOUS_DURATION_COLUMN || col == CHANGE_COLUMN) &&
+        previousDuration < 0.0)
+        text[0] = '\0';
+    else
+        g_snprintf(text, sizeof(text),
+                   col == CHANGE_COLUMN ? "%+.2f" :
+                   col == MEMORY_COLUMN ? "%.1f" : "%.2f",
+                   value);
+    g_object_set(renderer, "text", text, NULL);
+}
+
+// Plot the number of the concurrent compilations over time as a step graph.
+gboolean BuildLogView::drawTimeline(GtkWidget *widget,
+                                    cairo_t *cr,
+                                    gpointer view)
+{
+    BuildLogView *v = static_cast<BuildLogView *>(view);
+    if (v->m_compilationTimes.empty())
+        return FALSE;
+
+    // Each compilation starts with a +1 event and ends with a -1 event.  End
+    // events sort before start events at the same time.
+    std::vector<std::pair<gint64, int> > events;
+    events.reserve(v->m_compilationTimes.size() * 2);
+    for (std::vector<std::pair<gint64, gint64> >::const_iterator it =
+            v->m_compilationTimes.begin();
+         it != v->m_compilationTimes.end();
+         ++it)
+    {
+        events.push_back(std::make_pair(it->first, 1));
+        events.push_back(std::make_pair(it->second, -1));
+    }
+    std::sort(events.begin(), events.end());
+    int concurrency = 0, maxConcurrency = 0;
+    for (std::vector<std::pair<gint64, int> >::const_iterator it =
+            events.begin();
+         it != events.end();
+         ++it)
+    {
+        concurrency += it->second;
+        maxConcurrency = std::max(maxConcurrency, concurrency);
+    }
+    if (maxConcurrency == 0)
+        return FALSE;
+
+    double width = gtk_widget_get_allocated_width(widget);
+    double height = gtk_widget_get_allocated_height(widget);
+    gint64 begin = events.front().first;
+    double span = std::max(events.back().first - begin,
+                           static_cast<gint64>(1));
+
+    GdkRGBA color;
+    gtk_style_context_get_color(gtk_widget_get_style_context(widget),
+                                gtk_widget_get_state_flags(widget),
+                                &color);
+    color.alpha *= 0.5;
+    gdk_cairo_set_source_rgba(cr, &color);
+    cairo_move_to(cr, 0.0, height);
+    concurrency = 0;
+    for (std::vector<std::pair<gint64, int> >::const_iterator it =
+            events.begin();
+         it != events.end();
+         ++it)
+    {
+        double x = (it->first - begin) * width / span;
+        cairo_line_to(cr, x, height - concurrency * height / maxConcurrency);
+        concurrency += it->second;
+        cairo_line_to(cr, x, height - concurrency * height / maxConcurrency);
+    }
+    cairo_line_to(cr, width, height);
+    cairo_close_path(cr);
+    cairo_fill(cr);
+
+    color.alpha /= 0.5;
+    gdk_cairo_set_source_rgba(cr, &color);
+    char *label = g_strdup_printf(
+        _("At most %d concurrent compilations in %.1f seconds"),
+        maxConcurrency,
+        span / 1e6);
+    cairo_move_to(cr, 4.0, 14.0);
+    cairo_show_text(cr, label);
+    g_free(label);
+    return FALSE;
+}
+
 void BuildLogView::onBuildStopped()
 {
+    stopCountingDown();
     char *message = g_strdup_printf(
         _("Stopped %s project \"%s\" with configuration \"%s\"."),
         gettext(ACTION_TEXT_2[m_action]),
@@ -310,165 +1123,6 @@ void BuildLogView::onStopBuild(GtkButton *button, gpointer view)
     project->buildSystem().stopBuild(v->m_configName.c_str());
 }
 
-void BuildLogView::parseLog(int beginLine, int endLine)
-{
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(m_log);
-    GtkTextIter begin, end;
-
-    for (int line = beginLine; line < endLine; line++)
-    {
-        gtk_text_buffer_get_iter_at_line(buffer, &begin, line);
-        gtk_text_buffer_get_iter_at_line(buffer, &end, line + 1);
-        char *text = gtk_text_iter_get_text(&begin, &end);
-
-        if (isspace(*text))
-        {
-            g_free(text);
-            continue;
-        }
-
-        char *enterDir = strstr(text, "Entering directory '");
-        if (enterDir)
-        {
-            char *dirBegin = enterDir + 20;
-            char *dirEnd = strchr(dirBegin, '\'');
-            if (dirEnd)
-            {
-                *dirEnd = '\0';
-                m_directoryStack.push(dirBegin);
-            }
-            g_free(text);
-            continue;
-        }
-
-        char *leaveDir = strstr(text, "Leaving directory '");
-        if (leaveDir)
-        {
-            char *dirBegin = leaveDir + 19;
-            char *dirEnd = strchr(dirBegin, '\'');
-            if (dirEnd)
-            {
-                *dirEnd = '\0';
-                if (!m_directoryStack.empty() &&
-                    m_directoryStack.top() == dirBegin)
-                    m_directoryStack.pop();
-            }
-            g_free(text);
-            continue;
-        }
-
-        // Filename:line:column: error|warning|note:
-        char *colon = strstr(text, ": ");
-        if (colon && colon != text)
-        {
-            CompilerDiagnostic *diag = new CompilerDiagnostic;
-            char *cp = colon;
-            *cp = '\0';
-            if (parseInteger(text, cp, diag->column) &&
-                parseInteger(text, cp, diag->line))
-            {
-                diag->line--;
-                diag->column--;
-
-                // Check to see if the file name is an absolute path.
-                if (g_path_is_absolute(text))
-                {
-#ifdef OS_WINDOWS
-                    if (m_usingWindowsCmd ||
-                        (isalpha(text[0]) && text[1] == ':' &&
-                         G_IS_DIR_SEPARATOR(text[2])))
-                        diag->needPathConversion = false;
-                    else
-                        diag->needPathConversion = true;
-#endif
-                    diag->fileName = text;
-                }
-                else
-                {
-                    // If the file name is a relative path, prepend the current
-                    // directory.
-                    if (!m_directoryStack.empty() &&
-                        !m_directoryStack.top().empty())
-                    {
-                        diag->fileName = m_directoryStack.top();
-#ifdef OS_WINDOWS
-                        if (m_usingWindowsCmd ||
-                            (diag->fileName.length() >= 3 &&
-                             isalpha(diag->fileName[0]) &&
-                             diag->fileName[1] == ':' &&
-                             G_IS_DIR_SEPARATOR(diag->fileName[2])))
-                        {
-                            diag->needPathConversion = false;
-                            if (!G_IS_DIR_SEPARATOR(diag->
-                                    fileName[diag->fileName.length() - 1]))
-                                diag->fileName += '\\';
-                        }
-                        else
-                        {
-                            diag->needPathConversion = true;
-                            if (!G_IS_DIR_SEPARATOR(diag->
-                                    fileName[diag->fileName.length() - 1]))
-                                diag->fileName += '/';
-                        }
-#else
-                        if (!G_IS_DIR_SEPARATOR(diag->
-                                fileName[diag->fileName.length() - 1]))
-                            diag->fileName += G_DIR_SEPARATOR;
-#endif
-                    }
-                    else
-                    {
-#ifdef OS_WINDOWS
-                        diag->needPathConversion = false;
-#endif
-                        char *projectDir =
-                            g_filename_from_uri(m_projectUri.c_str(),
-                                                NULL,
-                                                NULL);
-                        diag->fileName = projectDir;
-                        g_free(projectDir);
-                        diag->fileName += G_DIR_SEPARATOR;
-                    }
-                    diag->fileName += text;
-                }
-
-#ifdef OS_WINDOWS
-                // Unify directory separators.
-                if (!m_usingWindowsCmd && !diag->needPathConversion)
-                    for (int i = 0; i < diag->fileName.length(); i++)
-                        if (diag->fileName[i] == '/')
-                            diag->fileName[i] = '\\';
-#endif
-
-                bool diagMatched = true;
-                colon += 2;
-                if (strncmp(colon, "error: ", strlen("error: ")) == 0)
-                    diag->type = CompilerDiagnostic::TYPE_ERROR;
-                else if (strncmp(colon, "warning: ", strlen("warning: "))
-                         == 0)
-                    diag->type = CompilerDiagnostic::TYPE_WARNING;
-                else if (strncmp(colon, "note: ", strlen("note: ")) == 0)
-                    diag->type = CompilerDiagnostic::TYPE_NOTE;
-                else
-                    diagMatched = false;
-                if (diagMatched)
-                {
-                    m_diagnostics[line] = diag;
-                    gtk_text_buffer_apply_tag(buffer,
-                                              m_diagnosticTags[diag->type],
-                                              &begin, &end);
-                }
-                else
-                    delete diag;
-            }
-            else
-                delete diag;
-        }
-
-        g_free(text);
-    }
-}
-
 void BuildLogView::openFile(const char *fileName, int line, int column)
 {
     char *uri = g_filename_to_uri(fileName, NULL, NULL);
@@ -497,6 +1151,42 @@ void BuildLogView::openFile(const char *fileName, int line, int column)
     g_free(uri);
 }
 
+void BuildLogView::openDiagnostic(const CompilerDiagnostic *diag)
+{
+    const char *fileName = m_scanner.fileName(diag->fileName);
+#ifdef OS_WINDOWS
+    bool wait = false;
+    if (diag->needPathConversion)
+    {
+        if (m_pathInConversion)
+        {
+            if (strcmp(m_pathInConversion, fileName) != 0)
+                cancelConvertingPath();
+            else
+            {
+                m_targetDiagnostic = diag;
+                wait = true;
+            }
+        }
+        if (!wait)
+        {
+            std::map<ComparablePointer<const char>, std::string>::iterator it =
+                m_pathConversionCache.find(fileName);
+            if (it != m_pathConversionCache.end())
+                fileName = it->second.c_str();
+            else
+            {
+                m_targetDiagnostic = diag;
+                convertPath(fileName);
+                wait = true;
+            }
+        }
+    }
+    if (!wait)
+#endif
+    openFile(fileName, diag->line, diag->column);
+}
+
 gboolean BuildLogView::onButtonPressEvent(GtkWidget *widget,
                                           GdkEvent *event,
                                           BuildLogView *buildLogView)
@@ -507,50 +1197,25 @@ gboolean BuildLogView::onButtonPressEvent(GtkWidget *widget,
         buffer,
         &iter,
         gtk_text_buffer_get_insert(buffer));
-    std::map<int, CompilerDiagnostic *>::iterator iter2 =
-        buildLogView->m_diagnostics.find(gtk_text_iter_get_line(&iter));
-    if (iter2 == buildLogView->m_diagnostics.end())
+    const CompilerDiagnostic *diag =
+        buildLogView->m_scanner.findDiagnostic(
+            buildLogView->windowFirstLine() + gtk_text_iter_get_line(&iter));
+    if (!diag)
         return FALSE;
 
-    CompilerDiagnostic *diag = iter2->second;
-    const char *fileName = diag->fileName.c_str();
     if (event->type == GDK_2BUTTON_PRESS)
     {
-#ifdef OS_WINDOWS
-        bool wait = false;
-        if (diag->needPathConversion)
-        {
-            if (buildLogView->m_pathInConversion)
-            {
-                if (strcmp(buildLogView->m_pathInConversion, fileName) != 0)
-                    buildLogView->cancelConvertingPath();
-                else
-                {
-                    buildLogView->m_targetDiagnostic = diag;
-                    wait = true;
-                }
-            }
-            if (!wait)
-            {
-                std::map<ComparablePointer<const char>, std::string>::iterator
-                    it = buildLogView->m_pathConversionCache.find(fileName);
-                if (it != buildLogView->m_pathConversionCache.end())
-                    fileName = it->second.c_str();
-                else
-                {
-                    buildLogView->m_targetDiagnostic = diag;
-                    buildLogView->convertPath(fileName);
-                    wait = true;
-                }
-            }
-        }
-        if (!wait)
-#endif
-        buildLogView->openFile(fileName, diag->line, diag->column);
+        int row = buildLogView->m_errorList.row(
+            diag - &buildLogView->m_scanner.diagnostics()[0]);
+        if (row != -1)
+            buildLogView->selectDiagnostic(row);
+        buildLogView->openDiagnostic(diag);
     }
 #ifdef OS_WINDOWS
     else if (event->type == GDK_BUTTON_PRESS)
     {
+        const char *fileName =
+            buildLogView->m_scanner.fileName(diag->fileName);
         if (diag->needPathConversion)
         {
             // We are using the MSYS2 shell.  The dumped paths are in the POSIX
@@ -564,11 +1229,11 @@ gboolean BuildLogView::onButtonPressEvent(GtkWidget *widget,
                     if (strcmp(buildLogView->m_pathInConversion, fileName) != 0)
                     {
                         buildLogView->cancelConvertingPath();
-                        buildLogView->convertPath(diag->fileName.c_str());
+                        buildLogView->convertPath(fileName);
                     }
                 }
                 else
-                    buildLogView->convertPath(diag->fileName.c_str());
+                    buildLogView->convertPath(fileName);
             }
         }
     }
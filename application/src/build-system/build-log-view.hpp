@@ -6,10 +6,15 @@
 
 #include "widget/widget.hpp"
 #include "builder.hpp"
+#include "build-log-scanner.hpp"
+#include "build-log-store.hpp"
+#include "compiler-options-collector.hpp"
+#include "error-list.hpp"
 #include "utilities/miscellaneous.hpp"
 #include <map>
 #include <string>
-#include <stack>
+#include <utility>
+#include <vector>
 
 namespace Samoyed
 {
@@ -17,23 +22,7 @@ namespace Samoyed
 class BuildLogView: public Widget
 {
 public:
-    struct CompilerDiagnostic
-    {
-        enum Type
-        {
-            TYPE_NOTE,
-            TYPE_WARNING,
-            TYPE_ERROR,
-            N_TYPES
-        };
-        Type type;
-        std::string fileName;
-        int line;
-        int column;
-#ifdef OS_WINDOWS
-        bool needPathConversion;
-#endif
-    };
+    typedef BuildLogScanner::Diagnostic CompilerDiagnostic;
 
     static BuildLogView *create(const char *projectUri,
                                 const char *configName);
@@ -44,21 +33,62 @@ public:
 
     void startBuild(Builder::Action action);
 
+    /**
+     * Show the estimated remaining time of the build, counting down from the
+     * estimated duration.
+     * @param duration The estimated duration, in milliseconds.
+     */
+    void setEstimatedDuration(gint64 duration);
+
     void clear();
 
+    /**
+     * Append a batch of the build log, which is expected to end at a line
+     * boundary.  The view is scrolled to the end once for all the batches added
+     * before the next idle time.
+     */
     void addLog(const char *log, int length);
 
+    /**
+     * Called after the last batch of the build log is added.
+     */
+    void endLog();
+
     void onBuildFinished(bool successful, const char *error);
 
+    /**
+     * Show profiled compilations on the performance page, which lists the
+     * compilations sorted by duration and plots the number of the concurrent
+     * compilations over time.
+     */
+    void addCompilations(
+        const std::vector<CompilerOptionsCollector::Compilation> &
+        compilations);
+
     void onBuildStopped();
 
+    /**
+     * Open the diagnostic following the selected one in the error list, or the
+     * first one if none is selected.
+     */
+    void showNextDiagnostic();
+
+    /**
+     * Open the diagnostic preceding the selected one in the error list, or the
+     * last one if none is selected.
+     */
+    void showPreviousDiagnostic();
+
     Builder::Action action() const { return m_action; }
     const char *projectUri() const { return m_projectUri.c_str(); }
     const char *configurationName() const { return m_configName.c_str(); }
 
 #ifdef OS_WINDOWS
     void setUsingWindowsCmd(bool usingWindowsCmd)
-    { m_usingWindowsCmd = usingWindowsCmd; }
+    {
+        m_usingWindowsCmd = usingWindowsCmd;
+        m_scanner.setUsingWindowsCmd(usingWindowsCmd);
+    }
 #endif
 
 protected:
@@ -69,10 +99,64 @@ protected:
 private:
     static void onStopBuild(GtkButton *button, gpointer view);
 
-    void parseLog(int beginLine, int endLine);
+    static gboolean scrollToEnd(gpointer view);
+
+    static void onScrolled(GtkAdjustment *adjustment, gpointer view);
+
+    static gboolean updateWindow(gpointer view);
+
+    static gboolean updateRemainingTime(gpointer view);
+
+    void stopCountingDown();
+
+    void highlightDiagnostics(
+        std::vector<CompilerDiagnostic>::size_type begin,
+        std::vector<CompilerDiagnostic>::size_type end);
+
+    int windowFirstLine() const
+    { return m_store.chunkFirstLine(m_windowBegin); }
+    int windowEnd() const
+    { return m_following ? m_store.chunkCount() : m_windowEnd; }
+
+    bool loadPreviousChunk();
+    bool loadNextChunk();
+    void unloadFirstChunk();
+    void unloadLastChunk();
 
     void openFile(const char *fileName, int line, int column);
 
+    void openDiagnostic(const CompilerDiagnostic *diag);
+
+    void updateErrorList();
+
+    void resetErrorList();
+
+    void updateDiagnosticCounts();
+
+    void selectDiagnostic(int row);
+
+    void showAdjacentDiagnostic(bool next);
+
+    static void onDiagnosticActivated(GtkTreeView *treeView,
+                                      GtkTreePath *path,
+                                      GtkTreeViewColumn *column,
+                                      gpointer view);
+
+    static void onDiagnosticTypeToggled(GtkToggleButton *button,
+                                        gpointer view);
+
+    static void onGroupByFileToggled(GtkToggleButton *button, gpointer view);
+
+    static void onErrorFilterChanged(GtkSearchEntry *entry, gpointer view);
+
+    static void formatCompilationColumn(GtkTreeViewColumn *column,
+                                        GtkCellRenderer *renderer,
+                                        GtkTreeModel *model,
+                                        GtkTreeIter *iter,
+                                        gpointer modelColumn);
+
+    static gboolean drawTimeline(GtkWidget *widget, cairo_t *cr, gpointer view);
+
     static gboolean onButtonPressEvent(GtkWidget *widget,
                                        GdkEvent *event,
                                        BuildLogView *buildLogView);
@@ -95,15 +179,43 @@ private:
     GtkLabel *m_message;
     GtkButton *m_stopButton;
     GtkTextView *m_log;
-
-    std::map<int, CompilerDiagnostic *> m_diagnostics;
-
-    std::stack<std::string> m_directoryStack;
+    guint m_scrollerId;
+
+    // The monotonic time when the build started and the estimated time when
+    // it will finish, in microseconds.
+    gint64 m_startTime;
+    gint64 m_estimatedEndTime;
+    guint m_countdownId;
+
+    GtkListStore *m_compilationStore;
+    GtkWidget *m_timeline;
+
+    // The start and end times of the profiled compilations.
+    std::vector<std::pair<gint64, gint64> > m_compilationTimes;
+
+    BuildLogScanner m_scanner;
+
+    // The error list is shown by a tree view in the fixed height mode through
+    // a tree model formatting the visible rows on demand.
+    ErrorList m_errorList;
+    GtkTreeModel *m_errorListModel;
+    GtkTreeView *m_errorListView;
+    GtkToggleButton *m_diagnosticTypeButtons[CompilerDiagnostic::N_TYPES];
+    GtkLabel *m_diagnosticCounts;
+
+    // The build log is stored out of the text buffer.  Only a window of the
+    // chunks of the build log is loaded into the text buffer.  The window ends
+    // with the open chunk if following the build log.
+    BuildLogStore m_store;
+    int m_windowBegin;
+    int m_windowEnd;
+    bool m_following;
+    guint m_windowUpdaterId;
 
 #ifdef OS_WINDOWS
     bool m_usingWindowsCmd;
 
-    CompilerDiagnostic *m_targetDiagnostic;
+    const CompilerDiagnostic *m_targetDiagnostic;
 
     const char *m_pathInConversion;
     GInputStream *m_pathConverterOutputPipe;
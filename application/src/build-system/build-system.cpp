@@ -7,13 +7,18 @@
 #include "build-system.hpp"
 #include "configuration.hpp"
 #include "build-system-file.hpp"
+#include "build-estimator.hpp"
 #include "build-systems-extension-point.hpp"
 #include "build-log-view.hpp"
 #include "build-log-view-group.hpp"
 #include "builder.hpp"
 #include "compiler-options-collector.hpp"
+#include "compilation-database-importer.hpp"
+#include "directory-importer.hpp"
+#include "job-server.hpp"
 #include "project/project.hpp"
 #include "project/project-file.hpp"
+#include "editors/source-file.hpp"
 #include "plugin/extension-point-manager.hpp"
 #include "window/window.hpp"
 #include "utilities/miscellaneous.hpp"
@@ -24,6 +29,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 #include <libxml/tree.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
@@ -264,14 +270,48 @@ bool BuildSystem::isBuildSystemFile(const char *fileName)
     return false;
 }
 
-bool BuildSystem::importDirectory(const char *dirName)
+int BuildSystem::classifyFile(const char *fileName, const char *baseName)
 {
-    GError *error = NULL;
-    GDir *dir;
-    dir = g_dir_open(dirName, 0, &error);
-    if (!dir)
+    if (isSourceFile(fileName))
+        return ProjectFile::TYPE_SOURCE_FILE;
+    if (isHeaderFile(fileName))
+        return ProjectFile::TYPE_HEADER_FILE;
+    if (isBuildSystemFile(baseName))
+        return ProjectFile::TYPE_GENERIC_FILE;
+    return -1;
+}
+
+JobServer &BuildSystem::jobServer()
+{
+    static JobServer server;
+    return server;
+}
+
+void BuildSystem::importDirectory(const char *dirName)
+{
+    boost::shared_ptr<DirectoryImporter>
+        importer(new
+            DirectoryImporter(
+                Application::instance().scheduler(),
+                Worker::PRIORITY_BACKGROUND,
+                project(),
+                dirName,
+                classifyFile));
+    m_workers.push_back(importer);
+    importer->addFinishedCallbackInMainThread(
+        boost::bind(onDirectoryImporterFinished, this, _1));
+    importer->addCanceledCallbackInMainThread(
+        boost::bind(onDirectoryImporterCanceled, this, _1));
+    importer->submit(importer);
+}
+
+void BuildSystem::onDirectoryImporterFinished(
+    const boost::shared_ptr<Worker> &worker)
+{
+    DirectoryImporter &importer = static_cast<DirectoryImporter &>(*worker);
+    importer.notifyImportedFiles();
+    if (*importer.error())
     {
-        char *uri = g_filename_to_uri(dirName, NULL, NULL);
         GtkWidget *dialog = gtk_message_dialog_new(
             Application::instance().currentWindow() ?
             GTK_WINDOW(Application::instance().currentWindow()->gtkWidget()) :
@@ -279,94 +319,78 @@ bool BuildSystem::importDirectory(const char *dirName)
             GTK_DIALOG_DESTROY_WITH_PARENT,
             GTK_MESSAGE_ERROR,
             GTK_BUTTONS_CLOSE,
-            _("Samoyed failed to import files in directory \"%s\" into project "
-              "\"%s\"."),
-            uri, project().uri());
-        gtkMessageDialogAddDetails(
-            dialog,
-            _("Samoyed failed to open directory \"%s\". %s."),
-            uri, error->message);
-        g_free(uri);
+            _("Samoyed failed to import files into project \"%s\"."),
+            project().uri());
+        gtkMessageDialogAddDetails(dialog, "%s", importer.error());
         gtk_dialog_set_default_response(GTK_DIALOG(dialog),
             GTK_RESPONSE_CLOSE);
         gtk_dialog_run(GTK_DIALOG(dialog));
         gtk_widget_destroy(dialog);
-        g_error_free(error);
-        return false;
     }
-    bool successful = true;
-    std::string name;
-    const char *entry;
-    while ((entry = g_dir_read_name(dir)) != NULL)
+    onWorkerFinished(worker);
+}
+
+void BuildSystem::onDirectoryImporterCanceled(
+    const boost::shared_ptr<Worker> &worker)
+{
+    static_cast<DirectoryImporter &>(*worker).notifyImportedFiles();
+    onWorkerCanceled(worker);
+}
+
+void BuildSystem::onCompilerOptionsCollectorFinished(
+    const boost::shared_ptr<Worker> &worker)
+{
+    CompilerOptionsCollector &collector =
+        static_cast<CompilerOptionsCollector &>(*worker);
+    std::set<std::string> changed;
+    collector.takeChangedFileUris(changed);
+    onCompilerOptionsChanged(changed);
+
+    // Show the compilations profiled after the build finished.
+    std::vector<CompilerOptionsCollector::Compilation> compilations;
+    collector.takeCompilations(compilations);
+    if (!compilations.empty() &&
+        Application::instance().currentWindow() &&
+        Application::instance().currentWindow()->buildLogViewGroup())
     {
-        if (entry[0] == '.')
-            continue;
-        name = dirName;
-        name += G_DIR_SEPARATOR;
-        name += entry;
-        if (g_file_test(name.c_str(), G_FILE_TEST_IS_REGULAR))
-        {
-            if (isSourceFile(name.c_str()))
-            {
-                ProjectFile *file =
-                    project().createFile(ProjectFile::TYPE_SOURCE_FILE);
-                char *uri = g_filename_to_uri(name.c_str(), NULL, NULL);
-                if (!project().addFile(uri, *file, false))
-                {
-                    successful = false;
-                    g_free(uri);
-                    break;
-                }
-                g_free(uri);
-            }
-            else if (isHeaderFile(name.c_str()))
-            {
-                ProjectFile *file =
-                    project().createFile(ProjectFile::TYPE_HEADER_FILE);
-                char *uri = g_filename_to_uri(name.c_str(), NULL, NULL);
-                if (!project().addFile(uri, *file, false))
-                {
-                    successful = false;
-                    g_free(uri);
-                    break;
-                }
-                g_free(uri);
-            }
-            else if (isBuildSystemFile(name.c_str()))
-            {
-                ProjectFile *file =
-                    project().createFile(ProjectFile::TYPE_GENERIC_FILE);
-                char *uri = g_filename_to_uri(name.c_str(), NULL, NULL);
-                if (!project().addFile(uri, *file, false))
-                {
-                    successful = false;
-                    g_free(uri);
-                    break;
-                }
-                g_free(uri);
-            }
-        }
-        else if (g_file_test(name.c_str(), G_FILE_TEST_IS_DIR))
-        {
-            if (!importDirectory(name.c_str()))
-            {
-                successful = false;
-                break;
-            }
-        }
+        BuildLogView *view = Application::instance().currentWindow()->
+            buildLogViewGroup()->buildLogViewForConfiguration(
+                project().uri(),
+                collector.configurationName());
+        if (view)
+            view->addCompilations(compilations);
     }
-    g_dir_close(dir);
-    return successful;
+
+    onWorkerFinished(worker);
 }
 
-bool BuildSystem::setup()
+void BuildSystem::onCompilerOptionsChanged(
+    const std::set<std::string> &fileUris)
 {
-    char *fileName = g_filename_from_uri(project().uri(), NULL, NULL);
-    if (!importDirectory(fileName))
+    if (fileUris.empty())
+        return;
+    for (File *file = Application::instance().files();
+         file;
+         file = file->next())
     {
-        g_free(fileName);
-        return false;
+        if ((file->type() & SourceFile::TYPE) &&
+            fileUris.find(file->uri()) != fileUris.end())
+            static_cast<SourceFile *>(file)->onCompilerOptionsChanged();
     }
+}
+
+bool BuildSystem::setup()
+{
+    char *fileName = g_filename_from_uri(project().uri(), NULL, NULL);
+    importDirectory(fileName);
+
+    // Import the compiler options from the compilation database, if any, so
+    // that the source files can be parsed correctly without building.
+    char *compileCommandsFileName =
+        g_build_filename(fileName, "compile_commands.json", NULL);
+    if (g_file_test(compileCommandsFileName, G_FILE_TEST_IS_REGULAR))
+        importCompilationDatabase(compileCommandsFileName);
+    g_free(compileCommandsFileName);
     g_free(fileName);
     return true;
 }
@@ -425,6 +449,134 @@ bool BuildSystem::build()
                                    *config,
                                    Builder::ACTION_BUILD);
     m_builders.insert(std::make_pair(config->name(), builder));
+    if (!builder->run())
+    {
+        m_builders.erase(config->name());
+        delete builder;
+        return false;
+    }
+
+    // Show the estimated duration when estimated in the background.
+    boost::shared_ptr<BuildEstimator>
+        estimator(new
+            BuildEstimator(
+                Application::instance().scheduler(),
+                Worker::PRIORITY_FOREGROUND,
+                *this,
+                *config,
+                NULL,
+                false));
+    builder->setBuildEstimator(estimator);
+    submitBuildEstimator(estimator);
+    return true;
+}
+
+void BuildSystem::submitBuildEstimator(
+    const boost::shared_ptr<BuildEstimator> &estimator)
+{
+    m_workers.push_back(estimator);
+    estimator->addFinishedCallbackInMainThread(
+        boost::bind(onBuildEstimatorFinished, this, _1));
+    estimator->addCanceledCallbackInMainThread(
+        boost::bind(onWorkerCanceled, this, _1));
+    estimator->submit(estimator);
+}
+
+void BuildSystem::onBuildEstimatorFinished(
+    const boost::shared_ptr<Worker> &worker)
+{
+    BuildEstimator &estimator = static_cast<BuildEstimator &>(*worker);
+    if (estimator.fileUri())
+        onTargetFound(estimator);
+    onWorkerFinished(worker);
+}
+
+bool BuildSystem::buildFile(const char *fileUri, bool compileOnly)
+{
+    if (!canBuild())
+        return false;
+    boost::shared_ptr<BuildEstimator>
+        estimator(new
+            BuildEstimator(
+                Application::instance().scheduler(),
+                Worker::PRIORITY_INTERACTIVE,
+                *this,
+                *activeConfiguration(),
+                fileUri,
+                compileOnly));
+    submitBuildEstimator(estimator);
+    return true;
+}
+
+void BuildSystem::onTargetFound(const BuildEstimator &estimator)
+{
+    if (m_project.closing())
+        return;
+    if (!estimator.targetFound())
+    {
+        GtkWidget *dialog = gtk_message_dialog_new(
+            Application::instance().currentWindow() ?
+            GTK_WINDOW(Application::instance().currentWindow()->gtkWidget()) :
+            NULL,
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            estimator.compileOnly() ?
+            _("Samoyed failed to find how to compile file \"%s\" in project "
+              "\"%s\".") :
+            _("Samoyed failed to find the target containing file \"%s\" in "
+              "project \"%s\"."),
+            estimator.fileUri(),
+            project().uri());
+        gtk_dialog_set_default_response(GTK_DIALOG(dialog),
+            GTK_RESPONSE_CLOSE);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    // Give up if another build was started meanwhile.
+    Configuration *config = findConfiguration(estimator.configurationName());
+    if (!config || m_builders.find(config->name()) != m_builders.end())
+        return;
+    Builder *builder = new Builder(*this,
+                                   *config,
+                                   Builder::ACTION_BUILD,
+                                   estimator.commands(),
+                                   estimator.estimatedDuration());
+    m_builders.insert(std::make_pair(config->name(), builder));
+    if (!builder->run())
+    {
+        m_builders.erase(config->name());
+        delete builder;
+    }
+}
+
+bool BuildSystem::buildTarget(const char *fileUri)
+{
+    return buildFile(fileUri, false);
+}
+
+bool BuildSystem::isSourceFileUri(const char *fileUri)
+{
+    char *fileName = g_filename_from_uri(fileUri, NULL, NULL);
+    if (!fileName)
+        return false;
+    bool source = isSourceFile(fileName);
+    g_free(fileName);
+    return source;
+}
+
+bool BuildSystem::compileFile(const char *fileUri)
+{
+    // Compile a source file directly with its stored compiler options.
+    if (!isSourceFileUri(fileUri))
+        return buildFile(fileUri, true);
+    if (!canBuild())
+        return false;
+    Configuration *config = activeConfiguration();
+    Builder *builder = new Builder(*this, *config, fileUri);
+    m_builders.insert(std::make_pair(config->name(), builder));
     if (builder->run())
         return true;
     m_builders.erase(config->name());
@@ -499,35 +651,82 @@ void BuildSystem::stopBuild(const char *configName)
     }
 }
 
-void BuildSystem::onBuildFinished(const char *configName,
-                                  const char *compilerOptsFileName)
+void BuildSystem::onBuildFinished(const char *configName)
 {
     BuilderTable::iterator it = m_builders.find(configName);
     if (it != m_builders.end())
     {
-        // Start the compiler options collector.
-        if (compilerOptsFileName)
-        {
-            boost::shared_ptr<CompilerOptionsCollector>
-                compilerOptsCollector(new
-                    CompilerOptionsCollector(
-                        Application::instance().scheduler(),
-                        Worker::PRIORITY_IDLE,
-                        project(),
-                        compilerOptsFileName));
-            m_compilerOptsCollectors.push_back(compilerOptsCollector);
-            compilerOptsCollector->addFinishedCallbackInMainThread(
-                boost::bind(onCompilerOptionsCollectorFinished, this, _1));
-            compilerOptsCollector->addCanceledCallbackInMainThread(
-                boost::bind(onCompilerOptionsCollectorCanceled, this, _1));
-            compilerOptsCollector->submit(compilerOptsCollector);
-        }
-
         delete it->second;
         m_builders.erase(it);
     }
 }
 
+boost::shared_ptr<CompilerOptionsCollector>
+BuildSystem::collectCompilerOptions(const char *configName,
+                                    const char *compilerOptsFileName)
+{
+    boost::shared_ptr<CompilerOptionsCollector>
+        compilerOptsCollector(new
+            CompilerOptionsCollector(
+                Application::instance().scheduler(),
+                Worker::PRIORITY_BACKGROUND,
+                project(),
+                configName,
+                compilerOptsFileName,
+                true));
+    m_workers.push_back(compilerOptsCollector);
+    compilerOptsCollector->addFinishedCallbackInMainThread(
+        boost::bind(onCompilerOptionsCollectorFinished, this, _1));
+    compilerOptsCollector->addCanceledCallbackInMainThread(
+        boost::bind(onWorkerCanceled, this, _1));
+    compilerOptsCollector->submit(compilerOptsCollector);
+    return compilerOptsCollector;
+}
+
+void BuildSystem::importCompilationDatabase(const char *fileName)
+{
+    boost::shared_ptr<CompilationDatabaseImporter>
+        importer(new
+            CompilationDatabaseImporter(
+                Application::instance().scheduler(),
+                Worker::PRIORITY_BACKGROUND,
+                project(),
+                fileName));
+    m_workers.push_back(importer);
+    importer->addFinishedCallbackInMainThread(
+        boost::bind(onCompilationDatabaseImporterFinished, this, _1));
+    importer->addCanceledCallbackInMainThread(
+        boost::bind(onWorkerCanceled, this, _1));
+    importer->submit(importer);
+}
+
+void BuildSystem::importCompilationDatabase(const char *cwd,
+                                            const char *const *generatorArgv)
+{
+    boost::shared_ptr<CompilationDatabaseImporter>
+        importer(new
+            CompilationDatabaseImporter(
+                Application::instance().scheduler(),
+                Worker::PRIORITY_BACKGROUND,
+                project(),
+                cwd,
+                generatorArgv));
+    m_workers.push_back(importer);
+    importer->addFinishedCallbackInMainThread(
+        boost::bind(onCompilationDatabaseImporterFinished, this, _1));
+    importer->addCanceledCallbackInMainThread(
+        boost::bind(onWorkerCanceled, this, _1));
+    importer->submit(importer);
+}
+
+void BuildSystem::onCompilationDatabaseImporterFinished(
+    const boost::shared_ptr<Worker> &worker)
+{
+    onCompilerOptionsChanged(
+        static_cast<CompilationDatabaseImporter &>(*worker).changedFileUris());
+    onWorkerFinished(worker);
+}
+
 Configuration BuildSystem::defaultConfiguration() const
 {
     return Configuration();
@@ -579,9 +778,9 @@ void BuildSystem::stopAllWorkers(
     while ((it = m_builders.begin()) != m_builders.end())
         stopBuild(it->first);
 
-    // Cancel all the compiler options collectors.
+    // Cancel all the workers.
     m_allWorkersStoppedCallback = callback;
-    if (m_compilerOptsCollectors.empty() && m_allWorkersStoppedCallback)
+    if (m_workers.empty() && m_allWorkersStoppedCallback)
     {
         g_idle_add_full(G_PRIORITY_HIGH,
                         onAllWorkersStoppedDeferred,
@@ -589,43 +788,43 @@ void BuildSystem::stopAllWorkers(
                         NULL);
         return;
     }
-    for (std::list<boost::shared_ptr<CompilerOptionsCollector> >::const_iterator
-            it = m_compilerOptsCollectors.begin();
-         it != m_compilerOptsCollectors.end();
+    for (std::list<boost::shared_ptr<Worker> >::const_iterator
+            it = m_workers.begin();
+         it != m_workers.end();
          ++it)
         (*it)->cancel(*it);
 }
 
-void BuildSystem::onCompilerOptionsCollectorFinished(
+void BuildSystem::onWorkerFinished(
     const boost::shared_ptr<Worker> &worker)
 {
-    for (std::list<boost::shared_ptr<CompilerOptionsCollector> >::iterator
-            it = m_compilerOptsCollectors.begin();
-         it != m_compilerOptsCollectors.end();
+    for (std::list<boost::shared_ptr<Worker> >::iterator
+            it = m_workers.begin();
+         it != m_workers.end();
          ++it)
     {
         if (*it == worker)
         {
-            m_compilerOptsCollectors.erase(it);
-            if (m_compilerOptsCollectors.empty() && m_allWorkersStoppedCallback)
+            m_workers.erase(it);
+            if (m_workers.empty() && m_allWorkersStoppedCallback)
                 m_allWorkersStoppedCallback(*this);
             break;
         }
     }
 }
 
-void BuildSystem::onCompilerOptionsCollectorCanceled(
+void BuildSystem::onWorkerCanceled(
     const boost::shared_ptr<Worker> &worker)
 {
-    for (std::list<boost::shared_ptr<CompilerOptionsCollector> >::iterator
-            it = m_compilerOptsCollectors.begin();
-         it != m_compilerOptsCollectors.end();
+    for (std::list<boost::shared_ptr<Worker> >::iterator
+            it = m_workers.begin();
+         it != m_workers.end();
          ++it)
     {
         if (*it == worker)
         {
-            m_compilerOptsCollectors.erase(it);
-            if (m_compilerOptsCollectors.empty() && m_allWorkersStoppedCallback)
+            m_workers.erase(it);
+            if (m_workers.empty() && m_allWorkersStoppedCallback)
                 m_allWorkersStoppedCallback(*this);
             break;
         }
@@ -7,6 +7,7 @@
 #include "utilities/miscellaneous.hpp"
 #include <map>
 #include <list>
+#include <set>
 #include <string>
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
@@ -22,7 +23,9 @@ class Project;
 class Configuration;
 class BuildSystemFile;
 class Builder;
+class BuildEstimator;
 class CompilerOptionsCollector;
+class JobServer;
 class Worker;
 
 class BuildSystem: public boost::noncopyable
@@ -34,7 +37,8 @@ public:
 
     /**
      * Setup the build system for a newly created project, including creating
-     * build-system-specific files, and importing existing files, if any.
+     * build-system-specific files, and importing existing files, if any.  The
+     * existing files are imported in the background.
      */
     virtual bool setup();
 
@@ -64,10 +68,89 @@ public:
     bool canClean() const;
     bool clean();
 
+    /**
+     * Build only the target containing a file, e.g., the program or library
+     * containing a source file.  The target is found in the background and
+     * the build starts when it is found.
+     */
+    bool buildTarget(const char *fileUri);
+
+    /**
+     * Compile only a file.  A source file is compiled directly with its
+     * compiler options stored in the project database, without the build
+     * system, and only checked for errors.  A header file is compiled as part
+     * of a source file including it by the build system, as a target found in
+     * the background.
+     */
+    bool compileFile(const char *fileUri);
+
     void stopBuild(const char *configName);
 
-    void onBuildFinished(const char *configName,
-                         const char *compilerOptsFileName);
+    void onBuildFinished(const char *configName);
+
+    /**
+     * Called when a build action succeeds, before 'onBuildFinished()'.
+     * @param action The 'Builder::Action' of the build.
+     */
+    virtual void onBuildSucceeded(const Configuration &config, int action) {}
+
+    /**
+     * @return True iff the compiler invocations need to be intercepted while
+     * building to collect the compiler options.  Build systems that can
+     * export the compiler options by themselves don't need it.
+     */
+    virtual bool interceptsCompilerInvocations() const { return true; }
+
+    /**
+     * Get the commands to build only the target containing a file, or to
+     * compile only the file.  This function is called in background threads.
+     * @param target The name of the target to be built.
+     * @return False iff the build system can't build the file alone.
+     */
+    virtual bool getTargetBuildCommands(const Configuration &config,
+                                        const char *fileUri,
+                                        bool compileOnly,
+                                        std::string &commands,
+                                        std::string &target) const
+    { return false; }
+
+    /**
+     * Estimate the duration of a build from the recorded durations of the
+     * previous builds.  This function is called in background threads.
+     * @param target The target to be built, as returned by
+     * 'getTargetBuildCommands()', or NULL if building the whole project.
+     * @return The estimated duration, in milliseconds, or -1 if unknown.
+     */
+    virtual gint64 estimateBuildDuration(const Configuration &config,
+                                         const char *target) const
+    { return -1; }
+
+    /**
+     * Start collecting the compiler options recorded by the compiler
+     * invocation interceptor in the background while a build is running.
+     */
+    boost::shared_ptr<CompilerOptionsCollector>
+    collectCompilerOptions(const char *configName,
+                           const char *compilerOptsFileName);
+
+    /**
+     * Parse the open source files whose compiler options are changed.
+     */
+    void onCompilerOptionsChanged(const std::set<std::string> &fileUris);
+
+    /**
+     * Import the compiler options of the source files from a JSON compilation
+     * database in the background.
+     */
+    void importCompilationDatabase(const char *fileName);
+
+    /**
+     * Import the compiler options of the source files from a JSON compilation
+     * database printed by a command in the background.
+     * @param generatorArgv The NULL-terminated arguments of the command.
+     */
+    void importCompilationDatabase(const char *cwd,
+                                   const char *const *generatorArgv);
 
     Project &project() { return m_project; }
     const Project &project() const { return m_project; }
@@ -95,6 +178,25 @@ public:
 
     void stopAllWorkers(const boost::function<void (BuildSystem &)> &callback);
 
+    /**
+     * Classify a file found in an imported directory.  This function is called
+     * in background threads.
+     * @return The type of the project file, or -1 if the file should not be
+     * imported.
+     */
+    static int classifyFile(const char *fileName, const char *baseName);
+
+    /**
+     * Start importing all the files in a directory recursively in the
+     * background.
+     */
+    void importDirectory(const char *dirName);
+
+    /**
+     * @return The job server shared by all the builds.
+     */
+    static JobServer &jobServer();
+
 protected:
     BuildSystem(Project &project, const char *extensionId);
 
@@ -102,19 +204,36 @@ protected:
     static bool isHeaderFile(const char *fileName);
     static bool isBuildSystemFile(const char *fileName);
 
-    bool importDirectory(const char *dirName);
-
 private:
     typedef std::map<ComparablePointer<const char>, Configuration *>
         ConfigurationTable;
 
     typedef std::map<ComparablePointer<const char>, Builder *> BuilderTable;
 
+    void onWorkerFinished(
+        const boost::shared_ptr<Worker> &worker);
+    void onWorkerCanceled(
+        const boost::shared_ptr<Worker> &worker);
+
+    void onDirectoryImporterFinished(const boost::shared_ptr<Worker> &worker);
+    void onDirectoryImporterCanceled(const boost::shared_ptr<Worker> &worker);
+
     void onCompilerOptionsCollectorFinished(
         const boost::shared_ptr<Worker> &worker);
-    void onCompilerOptionsCollectorCanceled(
+
+    void onCompilationDatabaseImporterFinished(
         const boost::shared_ptr<Worker> &worker);
 
+    void onBuildEstimatorFinished(const boost::shared_ptr<Worker> &worker);
+
+    void submitBuildEstimator(
+        const boost::shared_ptr<BuildEstimator> &estimator);
+
+    static bool isSourceFileUri(const char *fileUri);
+
+    bool buildFile(const char *fileUri, bool compileOnly);
+    void onTargetFound(const BuildEstimator &estimator);
+
     static gboolean onAllWorkersStoppedDeferred(gpointer buildSystem);
 
     Project &m_project;
@@ -129,8 +248,9 @@ private:
 
     BuilderTable m_builders;
 
-    std::list<boost::shared_ptr<CompilerOptionsCollector> >
-        m_compilerOptsCollectors;
+    // The compiler options collectors, compilation database importers,
+    // directory importers and build estimators.
+    std::list<boost::shared_ptr<Worker> > m_workers;
 
     boost::function<void (BuildSystem &)> m_allWorkersStoppedCallback;
 };
@@ -6,16 +6,25 @@
 #endif
 #include "builder.hpp"
 #include "build-system.hpp"
+#include "build-estimator.hpp"
+#include "build-log-reader.hpp"
 #include "build-log-view.hpp"
 #include "build-log-view-group.hpp"
+#include "compiler-options-collector.hpp"
+#include "compiler-options-reader.hpp"
 #include "configuration.hpp"
+#include "job-server.hpp"
 #include "project/project.hpp"
+#include "project/project-db.hpp"
 #include "utilities/miscellaneous.hpp"
 #include "utilities/scheduler.hpp"
+#include "utilities/worker.hpp"
 #include "window/window.hpp"
 #include "application.hpp"
 #include <string.h>
+#include <set>
 #include <string>
+#include <vector>
 #ifdef OS_WINDOWS
 # include <windows.h>
 #else
@@ -24,6 +33,7 @@
 # include <sys/types.h>
 # include <signal.h>
 #endif
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -38,29 +48,21 @@ const char *ACTION_TEXT[] =
     N_("configure"),
     N_("build"),
     N_("install"),
-    N_("clean")
+    N_("clean"),
+    N_("compile")
 };
 
+// The interval at which the compiler options collected during a build are
+// polled, in milliseconds.
+const guint COMPILER_OPTIONS_POLLING_INTERVAL = 500;
+
 const char *ACTION_TEXT_2[] =
 {
     N_("configuring"),
     N_("building"),
     N_("installing"),
-    N_("cleaning")
-};
-
-struct DataReadParam
-{
-    GCancellable *cancellable;
-    Samoyed::Builder &builder;
-    char buffer[BUFSIZ];
-    DataReadParam(GCancellable *c,
-                  Samoyed::Builder &b):
-        cancellable(c),
-        builder(b)
-    { g_object_ref(cancellable); }
-    ~DataReadParam()
-    { g_object_unref(cancellable); }
+    N_("cleaning"),
+    N_("compiling")
 };
 
 }
@@ -70,14 +72,33 @@ namespace Samoyed
 
 Builder::Builder(BuildSystem &buildSystem,
                  Configuration &config,
-                 Action action):
+                 Action action,
+                 const char *commands,
+                 gint64 estimatedDuration):
     m_buildSystem(buildSystem),
     m_configuration(config),
     m_action(action),
+    m_commands(commands ? commands : ""),
+    m_estimatedDuration(estimatedDuration),
+    m_logView(NULL),
+    m_processRunning(false),
+    m_logReader(NULL),
+    m_compilerOptsPollerId(0)
+{
+}
+
+Builder::Builder(BuildSystem &buildSystem,
+                 Configuration &config,
+                 const char *fileUri):
+    m_buildSystem(buildSystem),
+    m_configuration(config),
+    m_action(ACTION_COMPILE),
+    m_estimatedDuration(-1),
+    m_fileUri(fileUri),
     m_logView(NULL),
     m_processRunning(false),
-    m_outputPipe(NULL),
-    m_cancelReadingOutput(NULL)
+    m_logReader(NULL),
+    m_compilerOptsPollerId(0)
 {
 }
 
@@ -86,17 +107,21 @@ Builder::~Builder()
     if (running())
         stop();
 
+    m_buildEstimatedConn.disconnect();
     if (m_logView)
         m_logViewClosedConn.disconnect();
 }
 
 bool Builder::running() const
 {
-    return m_processRunning || m_outputPipe;
+    return m_processRunning || m_logReader || m_compilerOptsReader;
 }
 
 bool Builder::run()
 {
+    if (m_action == ACTION_COMPILE)
+        return compileFile();
+
     char *projectDir =
         g_filename_from_uri(m_buildSystem.project().uri(), NULL, NULL);
     const char *argv[5] = { NULL, NULL, NULL, NULL, NULL };
@@ -113,20 +138,27 @@ bool Builder::run()
 #endif
 
     // Add the real commands.
-    switch (m_action)
+    if (!m_commands.empty())
+        commands += m_commands;
+    else
     {
-    case ACTION_CONFIGURE:
-        commands += m_configuration.configureCommands();
-        break;
-    case ACTION_BUILD:
-        commands += m_configuration.buildCommands();
-        break;
-    case ACTION_INSTALL:
-        commands += m_configuration.installCommands();
-        break;
-    case ACTION_CLEAN:
-        commands += m_configuration.cleanCommands();
-        break;
+        switch (m_action)
+        {
+        case ACTION_CONFIGURE:
+            commands += m_configuration.configureCommands();
+            break;
+        case ACTION_BUILD:
+            commands += m_configuration.buildCommands();
+            break;
+        case ACTION_INSTALL:
+            commands += m_configuration.installCommands();
+            break;
+        case ACTION_CLEAN:
+            commands += m_configuration.cleanCommands();
+            break;
+        case ACTION_COMPILE:
+            break;
+        }
     }
 
     // Find a shell.
@@ -236,8 +268,13 @@ bool Builder::run()
         return false;
     }
 
+    std::string compilerOptsFileName;
+
 #ifdef OS_WINDOWS
-    if (!m_usingWindowsCmd)
+    if (!m_usingWindowsCmd && m_buildSystem.interceptsCompilerInvocations())
+    {
+#else
+    if (m_buildSystem.interceptsCompilerInvocations())
     {
 #endif
 
@@ -303,13 +340,25 @@ bool Builder::run()
                                 "SAMOYED_BUILDER_OUTPUT_FILE",
                                 output.c_str(),
                                 TRUE);
+        compilerOptsFileName = output;
     }
 
-#ifdef OS_WINDOWS
     }
-#endif
+
+    // Let make share the job server with the other builds.
+    JobServer &jobServer = BuildSystem::jobServer();
+    if (jobServer.available())
+    {
+        std::string makeFlags;
+        const char *oldMakeFlags = g_environ_getenv(envv, "MAKEFLAGS");
+        if (oldMakeFlags)
+            makeFlags = oldMakeFlags;
+        makeFlags += jobServer.makeFlags();
+        envv = g_environ_setenv(envv, "MAKEFLAGS", makeFlags.c_str(), TRUE);
+    }
 
     GError *error = NULL;
+    GInputStream *outputPipe;
     if (!spawnSubprocess(projectDir,
                          argv,
                          const_cast<const char **>(envv),
@@ -318,9 +367,10 @@ bool Builder::run()
                          SPAWN_SUBPROCESS_FLAG_STDERR_MERGE,
                          &m_processId,
                          NULL,
-                         &m_outputPipe,
+                         &outputPipe,
                          NULL,
-                         &error))
+                         &error,
+                         jobServer.available() ? jobServer.fds() : NULL))
     {
         GtkWidget *dialog = gtk_message_dialog_new(
             Application::instance().currentWindow() ?
@@ -355,36 +405,190 @@ bool Builder::run()
 
     m_processRunning = true;
     m_processWatchId = g_child_watch_add(m_processId, onProcessExited, this);
+    jobServer.onBuildStarted();
+
+    // Read the output in the background and show it in batches.
+    m_logReader = new BuildLogReader(
+        outputPipe,
+        boost::bind(onLogRead, this, _1, _2),
+        boost::bind(onLogReadFinished, this, _1));
+    g_object_unref(outputPipe);
+    m_logReader->start();
+
+    // Collect the compiler options while building, so that the newly compiled
+    // source files can be parsed correctly before the build finishes.
+    if (!compilerOptsFileName.empty())
+    {
+        m_compilerOptsCollector =
+            m_buildSystem.collectCompilerOptions(m_configuration.name(),
+                                                 compilerOptsFileName.c_str());
+        m_compilerOptsPollerId =
+            g_timeout_add(COMPILER_OPTIONS_POLLING_INTERVAL,
+                          pollCompilerOptions,
+                          this);
+    }
+
+    openLogView();
+    return true;
+}
+
+// Compiling a file directly is much faster than letting the build system
+// compile it, because the build system checks the dependencies of the whole
+// project before compiling.  The compiler options are read in the background,
+// and then the compiler is invoked.
+bool Builder::compileFile()
+{
+#ifdef OS_WINDOWS
+    m_usingWindowsCmd = false;
+#endif
+    m_compilerOptsReader.reset(
+        new CompilerOptionsReader(Application::instance().scheduler(),
+                                  Worker::PRIORITY_INTERACTIVE,
+                                  m_buildSystem.project(),
+                                  m_fileUri.c_str()));
+    m_compilerOptsReaderFinishedConn =
+        m_compilerOptsReader->addFinishedCallbackInMainThread(
+            boost::bind(onCompilerOptionsRead, this, _1));
+    m_compilerOptsReader->submit(m_compilerOptsReader);
+    openLogView();
+    return true;
+}
+
+void Builder::onCompilerOptionsRead(const boost::shared_ptr<Worker> &worker)
+{
+    boost::shared_ptr<const ProjectDb::CompilerOptions> compilerOpts =
+        static_cast<CompilerOptionsReader &>(*worker).compilerOptions();
+    m_compilerOptsReader.reset();
+
+    if (!compilerOpts)
+    {
+        if (m_logView)
+            m_logView->onBuildFinished(
+                false,
+                _("The compiler options of the file are unknown. Build the "
+                  "project to collect them"));
+        onFinished();
+        return;
+    }
+
+    // Choose the compiler by the file name suffix, as the compiler driver
+    // does.
+    char *fileName = g_filename_from_uri(m_fileUri.c_str(), NULL, NULL);
+    const char *ext = strrchr(fileName, '.');
+    const char *compiler = ext && strcmp(ext, ".c") == 0 ?
+        m_configuration.cCompiler() : m_configuration.cppCompiler();
+    int compilerArgc;
+    char **compilerArgv;
+    if (!g_shell_parse_argv(compiler, &compilerArgc, &compilerArgv, NULL))
+    {
+        compilerArgc = 1;
+        compilerArgv = g_new(char *, 2);
+        compilerArgv[0] = g_strdup(compiler);
+        compilerArgv[1] = NULL;
+    }
+    std::vector<const char *> argv(compilerArgv, compilerArgv + compilerArgc);
+    argv.insert(argv.end(),
+                compilerOpts->options.begin(),
+                compilerOpts->options.end());
+    argv.push_back("-fsyntax-only");
+    argv.push_back(fileName);
+    argv.push_back(NULL);
+
+    // Show the command line at the beginning of the log, as make does.
+    std::string commandLine;
+    for (std::vector<const char *>::const_iterator it = argv.begin();
+         *it;
+         ++it)
+    {
+        char *quoted = g_shell_quote(*it);
+        if (!commandLine.empty())
+            commandLine += ' ';
+        commandLine += quoted;
+        g_free(quoted);
+    }
+    commandLine += '\n';
+    if (m_logView)
+        m_logView->addLog(commandLine.c_str(), commandLine.length());
+
+    char *projectDir =
+        g_filename_from_uri(m_buildSystem.project().uri(), NULL, NULL);
+    GError *error = NULL;
+    GInputStream *outputPipe;
+    bool spawned = spawnSubprocess(projectDir,
+                                   &argv[0],
+                                   NULL,
+                                   SPAWN_SUBPROCESS_FLAG_STDOUT_PIPE |
+                                   SPAWN_SUBPROCESS_FLAG_STDERR_MERGE,
+                                   &m_processId,
+                                   NULL,
+                                   &outputPipe,
+                                   NULL,
+                                   &error);
+    g_free(projectDir);
+    g_free(fileName);
+    g_strfreev(compilerArgv);
+    if (!spawned)
+    {
+        if (m_logView)
+            m_logView->onBuildFinished(false, error->message);
+        g_error_free(error);
+        onFinished();
+        return;
+    }
+
+    m_processRunning = true;
+    m_processWatchId = g_child_watch_add(m_processId, onProcessExited, this);
+    BuildSystem::jobServer().onBuildStarted();
+
+    m_logReader = new BuildLogReader(
+        outputPipe,
+        boost::bind(onLogRead, this, _1, _2),
+        boost::bind(onLogReadFinished, this, _1));
+    g_object_unref(outputPipe);
+    m_logReader->start();
+}
 
-    m_cancelReadingOutput = g_cancellable_new();
-    DataReadParam *param = new DataReadParam(m_cancelReadingOutput, *this);
-    g_input_stream_read_async(
-        m_outputPipe,
-        param->buffer,
-        BUFSIZ,
-        G_PRIORITY_DEFAULT,
-        m_cancelReadingOutput,
-        onDataRead,
-        param);
-
-    // Show the build log view.
+void Builder::openLogView()
+{
     BuildLogViewGroup *group =
         Application::instance().currentWindow()->openBuildLogViewGroup();
     m_logView = group->openBuildLogView(m_buildSystem.project().uri(),
                                         m_configuration.name());
     m_logView->startBuild(m_action);
+    if (m_estimatedDuration >= 0)
+        m_logView->setEstimatedDuration(m_estimatedDuration);
 #ifdef OS_WINDOWS
     m_logView->setUsingWindowsCmd(m_usingWindowsCmd);
 #endif
     m_logView->clear();
     m_logViewClosedConn = m_logView->addClosedCallback(
         boost::bind(onLogViewClosed, this, _1));
+}
 
-    return true;
+void Builder::setBuildEstimator(
+    const boost::shared_ptr<BuildEstimator> &estimator)
+{
+    m_buildEstimatedConn = estimator->addFinishedCallbackInMainThread(
+        boost::bind(onBuildEstimated, this, _1));
+}
+
+void Builder::onBuildEstimated(const boost::shared_ptr<Worker> &worker)
+{
+    m_estimatedDuration =
+        static_cast<BuildEstimator &>(*worker).estimatedDuration();
+    if (m_logView && m_processRunning && m_estimatedDuration >= 0)
+        m_logView->setEstimatedDuration(m_estimatedDuration);
 }
 
 void Builder::stop()
 {
+    m_buildEstimatedConn.disconnect();
+    if (m_compilerOptsReader)
+    {
+        m_compilerOptsReaderFinishedConn.disconnect();
+        m_compilerOptsReader->cancel(m_compilerOptsReader);
+        m_compilerOptsReader.reset();
+    }
     if (m_processRunning)
     {
         g_source_remove(m_processWatchId);
@@ -395,14 +599,14 @@ void Builder::stop()
 #endif
         g_spawn_close_pid(m_processId);
         m_processRunning = false;
+        BuildSystem::jobServer().onBuildFinished();
     }
-    if (m_outputPipe)
+    stopCollectingCompilerOptions();
+    if (m_logReader)
     {
-        g_cancellable_cancel(m_cancelReadingOutput);
-        g_object_unref(m_cancelReadingOutput);
-        m_cancelReadingOutput = NULL;
-        g_object_unref(m_outputPipe);
-        m_outputPipe = NULL;
+        m_logReader->stop();
+        delete m_logReader;
+        m_logReader = NULL;
     }
     if (m_logView)
         m_logView->onBuildStopped();
@@ -410,23 +614,35 @@ void Builder::stop()
 
 void Builder::onFinished()
 {
-#ifdef OS_WINDOWS
-    if (m_usingWindowsCmd)
-    {
-        m_buildSystem.onBuildFinished(m_configuration.name(), NULL);
+    m_buildSystem.onBuildFinished(m_configuration.name());
+}
+
+// Reparse the open source files whose compiler options are just collected, show
+// the newly profiled compilations and let the collector read the newly recorded
+// compiler invocations.
+gboolean Builder::pollCompilerOptions(gpointer builder)
+{
+    Builder *b = static_cast<Builder *>(builder);
+    std::set<std::string> changed;
+    b->m_compilerOptsCollector->takeChangedFileUris(changed);
+    b->m_buildSystem.onCompilerOptionsChanged(changed);
+    std::vector<CompilerOptionsCollector::Compilation> compilations;
+    b->m_compilerOptsCollector->takeCompilations(compilations);
+    if (b->m_logView && !compilations.empty())
+        b->m_logView->addCompilations(compilations);
+    b->m_compilerOptsCollector->unblock(b->m_compilerOptsCollector);
+    return TRUE;
+}
+
+// Let the collector finish after reading the remaining compiler invocations.
+void Builder::stopCollectingCompilerOptions()
+{
+    if (!m_compilerOptsCollector)
         return;
-    }
-#endif
-    char *projectDir =
-        g_filename_from_uri(m_buildSystem.project().uri(), NULL, NULL);
-    std::string output(projectDir);
-    output += G_DIR_SEPARATOR_S ".samoyed" G_DIR_SEPARATOR_S "compiler-options"
-        G_DIR_SEPARATOR_S;
-    output += m_configuration.name();
-    output += '-';
-    output += ACTION_TEXT[m_action];
-    m_buildSystem.onBuildFinished(m_configuration.name(), output.c_str());
-    g_free(projectDir);
+    g_source_remove(m_compilerOptsPollerId);
+    m_compilerOptsCollector->stopFollowing();
+    m_compilerOptsCollector->unblock(m_compilerOptsCollector);
+    m_compilerOptsCollector.reset();
 }
 
 void Builder::onProcessExited(GPid processId,
@@ -437,70 +653,48 @@ void Builder::onProcessExited(GPid processId,
     g_source_remove(b->m_processWatchId);
     g_spawn_close_pid(b->m_processId);
     b->m_processRunning = false;
+    BuildSystem::jobServer().onBuildFinished();
+    b->stopCollectingCompilerOptions();
 
+    GError *error = NULL;
+    bool successful = g_spawn_check_exit_status(status, &error);
     if (b->m_logView)
-    {
-        GError *error = NULL;
-        bool successful = g_spawn_check_exit_status(status, &error);
         b->m_logView->onBuildFinished(successful,
                                       error ? error->message : NULL);
-        if (error)
-            g_error_free(error);
-    }
+    if (error)
+        g_error_free(error);
+    if (successful)
+        b->m_buildSystem.onBuildSucceeded(b->m_configuration, b->m_action);
 
-    if (!b->m_outputPipe)
+    if (!b->m_logReader)
         b->onFinished();
 }
 
-void Builder::onDataRead(GObject *stream,
-                         GAsyncResult *result,
-                         gpointer param)
+void Builder::onLogRead(const char *log, int length)
 {
-    DataReadParam *p = static_cast<DataReadParam *>(param);
-    if (!g_cancellable_is_cancelled(p->cancellable))
-    {
-        GError *error = NULL;
-        int length = g_input_stream_read_finish(G_INPUT_STREAM(stream),
-                                                result,
-                                                &error);
-        if (length > 0)
-        {
-            if (p->builder.m_logView)
-                p->builder.m_logView->addLog(p->buffer, length);
-            g_input_stream_read_async(G_INPUT_STREAM(stream),
-                                      p->buffer,
-                                      BUFSIZ,
-                                      G_PRIORITY_DEFAULT,
-                                      p->cancellable,
-                                      onDataRead,
-                                      p);
-        }
-        else
-        {
-            if (length == -1)
-            {
-                g_warning(_("Samoyed failed to read the stdout or stderr of "
-                            "the child process when %s project \"%s\" with "
-                            "configuration \"%s\": %s."),
-                       gettext(ACTION_TEXT_2[p->builder.m_action]),
-                       p->builder.m_buildSystem.project().uri(),
-                       p->builder.m_configuration.name(),
-                       error->message);
-                g_error_free(error);
-            }
+    if (m_logView)
+        m_logView->addLog(log, length);
+}
 
-            g_object_unref(p->builder.m_cancelReadingOutput);
-            p->builder.m_cancelReadingOutput = NULL;
-            g_object_unref(p->builder.m_outputPipe);
-            p->builder.m_outputPipe = NULL;
+void Builder::onLogReadFinished(const char *error)
+{
+    if (error)
+        g_warning(_("Samoyed failed to read the stdout or stderr of the child "
+                    "process when %s project \"%s\" with configuration "
+                    "\"%s\": %s."),
+                  gettext(ACTION_TEXT_2[m_action]),
+                  m_buildSystem.project().uri(),
+                  m_configuration.name(),
+                  error);
+
+    delete m_logReader;
+    m_logReader = NULL;
 
-            if (!p->builder.m_processRunning)
-                p->builder.onFinished();
-            delete p;
-        }
-    }
-    else
-        delete p;
+    if (m_logView)
+        m_logView->endLog();
+
+    if (!m_processRunning)
+        onFinished();
 }
 
 void Builder::onLogViewClosed(Widget &widget)
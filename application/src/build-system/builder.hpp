@@ -4,6 +4,8 @@
 #ifndef SMYD_BUILDER_HPP
 #define SMYD_BUILDER_HPP
 
+#include <string>
+#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 #include <boost/signals2/signal.hpp>
 #include <glib.h>
@@ -12,10 +14,15 @@
 namespace Samoyed
 {
 
+class BuildEstimator;
 class BuildSystem;
+class BuildLogReader;
 class BuildLogView;
+class CompilerOptionsCollector;
+class CompilerOptionsReader;
 class Configuration;
 class Widget;
+class Worker;
 
 class Builder: public boost::noncopyable
 {
@@ -25,12 +32,30 @@ public:
         ACTION_CONFIGURE,
         ACTION_BUILD,
         ACTION_INSTALL,
-        ACTION_CLEAN
+        ACTION_CLEAN,
+        ACTION_COMPILE
     };
 
+    /**
+     * @param commands The commands to be run instead of those of the
+     * configuration for the action, or NULL.
+     * @param estimatedDuration The estimated duration of the action, in
+     * milliseconds, or -1 if unknown.
+     */
     Builder(BuildSystem &buildSystem,
             Configuration &config,
-            Action action);
+            Action action,
+            const char *commands = NULL,
+            gint64 estimatedDuration = -1);
+
+    /**
+     * Construct a builder to compile a source file directly with its compiler
+     * options stored in the project database, bypassing the build system.
+     * Only the syntax and the semantics of the file are checked.
+     */
+    Builder(BuildSystem &buildSystem,
+            Configuration &config,
+            const char *fileUri);
 
     ~Builder();
 
@@ -40,22 +65,43 @@ public:
 
     void stop();
 
+    /**
+     * Show the estimated duration of the build when a build estimator
+     * finishes.
+     */
+    void setBuildEstimator(const boost::shared_ptr<BuildEstimator> &estimator);
+
 private:
+    void onBuildEstimated(const boost::shared_ptr<Worker> &worker);
+
+    bool compileFile();
+
+    void onCompilerOptionsRead(const boost::shared_ptr<Worker> &worker);
+
+    void openLogView();
+
     static void onProcessExited(GPid processId,
                                 gint status,
                                 gpointer builder);
 
-    static void onDataRead(GObject *stream,
-                           GAsyncResult *result,
-                           gpointer param);
+    void onLogRead(const char *log, int length);
+
+    void onLogReadFinished(const char *error);
 
     void onLogViewClosed(Widget &widget);
 
     void onFinished();
 
+    static gboolean pollCompilerOptions(gpointer builder);
+
+    void stopCollectingCompilerOptions();
+
     BuildSystem &m_buildSystem;
     Configuration &m_configuration;
     Action m_action;
+    std::string m_commands;
+    gint64 m_estimatedDuration;
+    std::string m_fileUri;
 
     BuildLogView *m_logView;
     boost::signals2::connection m_logViewClosedConn;
@@ -63,8 +109,15 @@ private:
     bool m_processRunning;
     GPid m_processId;
     guint m_processWatchId;
-    GInputStream *m_outputPipe;
-    GCancellable *m_cancelReadingOutput;
+    BuildLogReader *m_logReader;
+
+    boost::shared_ptr<CompilerOptionsCollector> m_compilerOptsCollector;
+    guint m_compilerOptsPollerId;
+
+    boost::shared_ptr<CompilerOptionsReader> m_compilerOptsReader;
+    boost::signals2::connection m_compilerOptsReaderFinishedConn;
+
+    boost::signals2::connection m_buildEstimatedConn;
 
 #ifdef OS_WINDOWS
     bool m_usingWindowsCmd;
@@ -0,0 +1,596 @@
+// Compilation database importer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "compilation-database-importer.hpp"
+#include "compiler-options-collector.hpp"
+#include "project/project.hpp"
+#include "project/project-db.hpp"
+#include "utilities/miscellaneous.hpp"
+#include <string.h>
+#ifdef OS_WINDOWS
+# include <windows.h>
+#else
+# include <signal.h>
+# include <sys/types.h>
+# include <sys/wait.h>
+#endif
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+namespace
+{
+
+const int BUFFER_SIZE = 1 << 20;
+
+// The number of source files whose compiler options are written to the
+// project database in one transaction.
+const size_t BATCH_SIZE = 4096;
+
+inline bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool isLiteralCharacter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+        c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+// Read 4 hexadecimal digits.  Return -1 if invalid.
+int readHexDigits(const char *cp)
+{
+    int value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int d = g_ascii_xdigit_value(cp[i]);
+        if (d == -1)
+            return -1;
+        value = (value << 4) | d;
+    }
+    return value;
+}
+
+}
+
+namespace Samoyed
+{
+
+CompilationDatabaseImporter::CompilationDatabaseImporter(
+    Scheduler &scheduler,
+    unsigned int priority,
+    Project &project,
+    const char *fileName):
+        Worker(scheduler, priority),
+        m_projectDb(project.db()),
+        m_fileName(fileName),
+        m_generatorArgv(NULL),
+        m_generatorRunning(false),
+        m_stream(NULL),
+        m_readBuffer(NULL),
+        m_readPointer(NULL),
+        m_readBufferSize(0),
+        m_state(STATE_BEFORE_DATABASE),
+        m_key(KEY_OTHER),
+        m_skippingDepth(0)
+{
+    char *desc =
+        g_strdup_printf(_("Importing compilation database \"%s\" into "
+                          "project \"%s\"."),
+                        fileName, project.uri());
+    setDescription(desc);
+    g_free(desc);
+
+    CompilerOptionsCollector::initialize();
+}
+
+CompilationDatabaseImporter::CompilationDatabaseImporter(
+    Scheduler &scheduler,
+    unsigned int priority,
+    Project &project,
+    const char *cwd,
+    const char *const *generatorArgv):
+        Worker(scheduler, priority),
+        m_projectDb(project.db()),
+        m_fileName(cwd),
+        m_generatorArgv(g_strdupv(const_cast<char **>(generatorArgv))),
+        m_generatorRunning(false),
+        m_stream(NULL),
+        m_readBuffer(NULL),
+        m_readPointer(NULL),
+        m_readBufferSize(0),
+        m_state(STATE_BEFORE_DATABASE),
+        m_key(KEY_OTHER),
+        m_skippingDepth(0)
+{
+    char *command = g_strjoinv(" ", m_generatorArgv);
+    char *desc =
+        g_strdup_printf(_("Importing compilation database generated by "
+                          "\"%s\" into project \"%s\"."),
+                        command, project.uri());
+    setDescription(desc);
+    g_free(desc);
+    g_free(command);
+
+    CompilerOptionsCollector::initialize();
+}
+
+CompilationDatabaseImporter::~CompilationDatabaseImporter()
+{
+    if (m_stream)
+        g_object_unref(m_stream);
+    // Don't wait for the generator to print the whole compilation database if
+    // canceled.
+    if (m_generatorRunning)
+    {
+#ifdef OS_WINDOWS
+        TerminateProcess(m_generatorId, 1);
+#else
+        kill(m_generatorId, SIGKILL);
+#endif
+        stopGenerator();
+    }
+    g_strfreev(m_generatorArgv);
+    delete[] m_readBuffer;
+}
+
+bool CompilationDatabaseImporter::openStream()
+{
+    GError *error = NULL;
+    if (m_generatorArgv)
+    {
+        if (!spawnSubprocess(m_fileName.c_str(),
+                             const_cast<const char **>(m_generatorArgv),
+                             NULL,
+                             SPAWN_SUBPROCESS_FLAG_STDOUT_PIPE |
+                             SPAWN_SUBPROCESS_FLAG_STDERR_SILENCE,
+                             &m_generatorId,
+                             NULL,
+                             &m_stream,
+                             NULL,
+                             &error))
+        {
+            g_warning(_("Samoyed failed to run \"%s\" to generate a "
+                        "compilation database: %s."),
+                      m_generatorArgv[0], error->message);
+            g_error_free(error);
+            return false;
+        }
+        m_generatorRunning = true;
+        return true;
+    }
+
+    GFile *file = g_file_new_for_path(m_fileName.c_str());
+    GFileInputStream *fileStream = g_file_read(file, NULL, &error);
+    g_object_unref(file);
+    if (!fileStream)
+    {
+        g_error_free(error);
+        return false;
+    }
+    m_stream = G_INPUT_STREAM(fileStream);
+    return true;
+}
+
+// Wait for the generator to exit.  The generator is not reaped by GLib because
+// it is not watched.
+void CompilationDatabaseImporter::stopGenerator()
+{
+#ifdef OS_WINDOWS
+    WaitForSingleObject(m_generatorId, INFINITE);
+#else
+    waitpid(m_generatorId, NULL, 0);
+#endif
+    g_spawn_close_pid(m_generatorId);
+    m_generatorRunning = false;
+}
+
+bool CompilationDatabaseImporter::step()
+{
+    GError *error = NULL;
+
+    if (!m_stream)
+    {
+        if (!openStream())
+            return true;
+        m_readBufferSize = BUFFER_SIZE;
+        m_readBuffer = new char[m_readBufferSize];
+        m_readPointer = m_readBuffer;
+    }
+
+    // If the buffer is filled with an incomplete token, enlarge it.
+    if (m_readPointer == m_readBuffer + m_readBufferSize)
+    {
+        char *buffer = new char[m_readBufferSize * 2];
+        memcpy(buffer, m_readBuffer, m_readBufferSize);
+        delete[] m_readBuffer;
+        m_readBuffer = buffer;
+        m_readPointer = m_readBuffer + m_readBufferSize;
+        m_readBufferSize *= 2;
+    }
+
+    int size = g_input_stream_read(m_stream,
+                                   m_readPointer,
+                                   m_readBuffer + m_readBufferSize -
+                                   m_readPointer,
+                                   NULL,
+                                   &error);
+    if (size == -1)
+    {
+        g_error_free(error);
+        writeCompilerOptions();
+        return true;
+    }
+    if (size == 0)
+    {
+        if (!g_input_stream_close(m_stream, NULL, &error))
+            g_error_free(error);
+        if (m_generatorRunning)
+            stopGenerator();
+        writeCompilerOptions();
+        return true;
+    }
+    m_readPointer += size;
+
+    const char *parsePointer = m_readBuffer;
+    if (!parse(parsePointer, m_readPointer) ||
+        m_state == STATE_AFTER_DATABASE)
+    {
+        writeCompilerOptions();
+        return true;
+    }
+
+    size = m_readPointer - parsePointer;
+    memmove(m_readBuffer, parsePointer, size);
+    m_readPointer = m_readBuffer + size;
+    return false;
+}
+
+// Scan the next token.  The content of a string token is decoded and stored
+// in 'm_string'.  If the token is incomplete, 'begin' is not changed.
+CompilationDatabaseImporter::Token
+CompilationDatabaseImporter::nextToken(const char *&begin, const char *end)
+{
+    const char *cp = begin;
+    while (cp < end && isWhitespace(*cp))
+        cp++;
+    if (cp == end)
+        return TOKEN_INCOMPLETE;
+
+    Token token;
+    switch (*cp)
+    {
+    case '[':
+        token = TOKEN_BEGIN_ARRAY;
+        break;
+    case ']':
+        token = TOKEN_END_ARRAY;
+        break;
+    case '{':
+        token = TOKEN_BEGIN_OBJECT;
+        break;
+    case '}':
+        token = TOKEN_END_OBJECT;
+        break;
+    case ':':
+        token = TOKEN_COLON;
+        break;
+    case ',':
+        token = TOKEN_COMMA;
+        break;
+    case '"':
+        m_string.clear();
+        for (cp++; ; )
+        {
+            // Copy the characters up to the next quote or escape in one go.
+            const char *run = cp;
+            while (cp < end && *cp != '"' && *cp != '\\')
+                cp++;
+            m_string.append(run, cp - run);
+            if (cp == end)
+                return TOKEN_INCOMPLETE;
+            if (*cp == '"')
+                break;
+
+            // An escape sequence.
+            if (end - cp < 2)
+                return TOKEN_INCOMPLETE;
+            cp++;
+            switch (*cp)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                m_string.push_back(*cp);
+                break;
+            case 'b':
+                m_string.push_back('\b');
+                break;
+            case 'f':
+                m_string.push_back('\f');
+                break;
+            case 'n':
+                m_string.push_back('\n');
+                break;
+            case 'r':
+                m_string.push_back('\r');
+                break;
+            case 't':
+                m_string.push_back('\t');
+                break;
+            case 'u':
+            {
+                if (end - cp < 5)
+                    return TOKEN_INCOMPLETE;
+                int c = readHexDigits(cp + 1);
+                if (c <= 0)
+                    return TOKEN_ERROR;
+                cp += 4;
+                if (c >= 0xD800 && c < 0xDC00)
+                {
+                    // A surrogate pair.
+                    if (end - cp < 7)
+                        return TOKEN_INCOMPLETE;
+                    if (cp[1] != '\\' || cp[2] != 'u')
+                        return TOKEN_ERROR;
+                    int c2 = readHexDigits(cp + 3);
+                    if (c2 < 0xDC00 || c2 >= 0xE000)
+                        return TOKEN_ERROR;
+                    c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+                    cp += 6;
+                }
+                char utf8[6];
+                m_string.append(utf8, g_unichar_to_utf8(c, utf8));
+                break;
+            }
+            default:
+                return TOKEN_ERROR;
+            }
+            cp++;
+        }
+        token = TOKEN_STRING;
+        break;
+    default:
+        if (!isLiteralCharacter(*cp))
+            return TOKEN_ERROR;
+        while (cp < end && isLiteralCharacter(*cp))
+            cp++;
+        if (cp == end)
+            return TOKEN_INCOMPLETE;
+        begin = cp;
+        return TOKEN_LITERAL;
+    }
+    begin = cp + 1;
+    return token;
+}
+
+bool CompilationDatabaseImporter::parse(const char *&begin, const char *end)
+{
+    for (;;)
+    {
+        Token token = nextToken(begin, end);
+        if (token == TOKEN_INCOMPLETE)
+            return true;
+        if (token == TOKEN_ERROR)
+            return false;
+
+        switch (m_state)
+        {
+        case STATE_BEFORE_DATABASE:
+            if (token != TOKEN_BEGIN_ARRAY)
+                return false;
+            m_state = STATE_IN_DATABASE;
+            break;
+
+        case STATE_IN_DATABASE:
+            if (token == TOKEN_BEGIN_OBJECT)
+            {
+                m_directory.clear();
+                m_file.clear();
+                m_arguments.clear();
+                m_command.clear();
+                m_state = STATE_IN_ENTRY;
+            }
+            else if (token == TOKEN_END_ARRAY)
+            {
+                m_state = STATE_AFTER_DATABASE;
+                return true;
+            }
+            else if (token != TOKEN_COMMA)
+                return false;
+            break;
+
+        case STATE_IN_ENTRY:
+            if (token == TOKEN_STRING)
+            {
+                if (m_string == "directory")
+                    m_key = KEY_DIRECTORY;
+                else if (m_string == "file")
+                    m_key = KEY_FILE;
+                else if (m_string == "arguments")
+                    m_key = KEY_ARGUMENTS;
+                else if (m_string == "command")
+                    m_key = KEY_COMMAND;
+                else
+                    m_key = KEY_OTHER;
+                m_state = STATE_BEFORE_VALUE;
+            }
+            else if (token == TOKEN_END_OBJECT)
+            {
+                importEntry();
+                m_state = STATE_IN_DATABASE;
+            }
+            else if (token != TOKEN_COMMA)
+                return false;
+            break;
+
+        case STATE_BEFORE_VALUE:
+            if (token == TOKEN_COLON)
+                break;
+            if (token == TOKEN_STRING)
+            {
+                if (m_key == KEY_DIRECTORY)
+                    m_directory.swap(m_string);
+                else if (m_key == KEY_FILE)
+                    m_file.swap(m_string);
+                else if (m_key == KEY_COMMAND)
+                    m_command.swap(m_string);
+                m_state = STATE_IN_ENTRY;
+            }
+            else if (token == TOKEN_BEGIN_ARRAY && m_key == KEY_ARGUMENTS)
+            {
+                m_arguments.clear();
+                m_state = STATE_IN_ARGUMENTS;
+            }
+            else if (token == TOKEN_BEGIN_ARRAY ||
+                     token == TOKEN_BEGIN_OBJECT)
+            {
+                m_skippingDepth = 1;
+                m_state = STATE_SKIPPING_VALUE;
+            }
+            else if (token == TOKEN_LITERAL)
+                m_state = STATE_IN_ENTRY;
+            else
+                return false;
+            break;
+
+        case STATE_IN_ARGUMENTS:
+            // Store the arguments as NUL-terminated strings, as recorded by
+            // the compiler invocation interceptor.
+            if (token == TOKEN_STRING)
+                m_arguments.append(m_string.c_str(), m_string.length() + 1);
+            else if (token == TOKEN_END_ARRAY)
+                m_state = STATE_IN_ENTRY;
+            else if (token != TOKEN_COMMA)
+                return false;
+            break;
+
+        case STATE_SKIPPING_VALUE:
+            if (token == TOKEN_BEGIN_ARRAY || token == TOKEN_BEGIN_OBJECT)
+                m_skippingDepth++;
+            else if (token == TOKEN_END_ARRAY || token == TOKEN_END_OBJECT)
+            {
+                if (--m_skippingDepth == 0)
+                    m_state = STATE_IN_ENTRY;
+            }
+            break;
+
+        case STATE_AFTER_DATABASE:
+            return true;
+        }
+    }
+}
+
+void CompilationDatabaseImporter::importEntry()
+{
+    if (m_directory.empty() || m_file.empty())
+        return;
+
+    // Split the command line if the arguments are not given.
+    if (m_arguments.empty() && !m_command.empty())
+    {
+        int argc;
+        char **argv;
+        if (!g_shell_parse_argv(m_command.c_str(), &argc, &argv, NULL))
+            return;
+        for (int i = 0; i < argc; i++)
+            m_arguments.append(argv[i], strlen(argv[i]) + 1);
+        g_strfreev(argv);
+    }
+    if (m_arguments.empty() || m_arguments[0] == '\0')
+        return;
+
+    // The directory may be relative to the compilation database.
+    if (!g_path_is_absolute(m_directory.c_str()))
+    {
+        char *dir = g_path_get_dirname(m_fileName.c_str());
+        char *absDir = g_build_filename(dir, m_directory.c_str(), NULL);
+        m_directory = absDir;
+        g_free(dir);
+        g_free(absDir);
+    }
+
+    // Terminate the arguments with an empty string and skip the compiler.
+    m_arguments.push_back('\0');
+    const char *cp = m_arguments.data();
+    const char *end = cp + m_arguments.length();
+    cp += strlen(cp) + 1;
+    m_compilerOpts.clear();
+    m_fileNames.clear();
+    if (!CompilerOptionsCollector::extractCompilerOptions(m_directory.c_str(),
+                                                          cp,
+                                                          end,
+                                                          m_compilerOpts,
+                                                          m_fileNames))
+        return;
+
+    char *buf = NULL;
+    const char *fn;
+    if (g_path_is_absolute(m_file.c_str()))
+        fn = m_file.c_str();
+    else
+    {
+        buf = g_build_filename(m_directory.c_str(), m_file.c_str(), NULL);
+        fn = buf;
+    }
+    char *uri = g_filename_to_uri(fn, NULL, NULL);
+    g_free(buf);
+    if (!uri)
+        return;
+    m_importedCompilerOpts[uri] =
+        &*m_compilerOptsPool.insert(m_compilerOpts).first;
+    g_free(uri);
+
+    if (m_importedCompilerOpts.size() >= BATCH_SIZE)
+        writeCompilerOptions();
+}
+
+void CompilationDatabaseImporter::writeCompilerOptions()
+{
+    // Skip the source files whose compiler options are not changed, which are
+    // most of them when the compilation database is imported again.
+    std::vector<CompilerOptionsTable::const_iterator> changed;
+    for (CompilerOptionsTable::const_iterator it =
+            m_importedCompilerOpts.begin();
+         it != m_importedCompilerOpts.end();
+         ++it)
+    {
+        if (CompilerOptionsCollector::compilerOptionsChanged(m_projectDb,
+                                                             it->first.c_str(),
+                                                             *it->second))
+            changed.push_back(it);
+    }
+    if (changed.empty())
+    {
+        m_importedCompilerOpts.clear();
+        return;
+    }
+
+    // Write the compiler options in one transaction.
+    ProjectDb::Error error = m_projectDb.runTransaction(
+        boost::bind(CompilerOptionsCollector::storeCompilerOptions,
+                    boost::ref(m_projectDb),
+                    boost::cref(changed),
+                    _1));
+    if (!error.code)
+    {
+        for (std::vector<CompilerOptionsTable::const_iterator>::const_iterator
+                it = changed.begin();
+             it != changed.end();
+             ++it)
+            m_changedFileUris.insert((*it)->first);
+    }
+    m_importedCompilerOpts.clear();
+}
+
+}
@@ -0,0 +1,155 @@
+// Compilation database importer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_COMPILATION_DATABASE_IMPORTER_HPP
+#define SMYD_COMPILATION_DATABASE_IMPORTER_HPP
+
+#include "utilities/worker.hpp"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <gio/gio.h>
+
+namespace Samoyed
+{
+
+class Project;
+class ProjectDb;
+
+/**
+ * A compilation database importer reads a JSON compilation database, such as
+ * "compile_commands.json" generated by CMake, and writes the compiler options
+ * of the listed source files to the project database.  The compilation
+ * database is parsed as a stream, so that huge compilation databases can be
+ * imported in bounded memory.  The compilation database can also be read from
+ * the output of a command that generates it, such as "ninja -t compdb".
+ */
+class CompilationDatabaseImporter: public Worker
+{
+public:
+    CompilationDatabaseImporter(Scheduler &scheduler,
+                                unsigned int priority,
+                                Project &project,
+                                const char *fileName);
+
+    /**
+     * @param cwd The working directory of the generator command.
+     * @param generatorArgv The NULL-terminated arguments of the command that
+     * prints the compilation database to its standard output.
+     */
+    CompilationDatabaseImporter(Scheduler &scheduler,
+                                unsigned int priority,
+                                Project &project,
+                                const char *cwd,
+                                const char *const *generatorArgv);
+
+    virtual ~CompilationDatabaseImporter();
+
+    /**
+     * @return The URIs of the source files whose compiler options are changed
+     * by the import.  Valid after the importer finishes.
+     */
+    const std::set<std::string> &changedFileUris() const
+    { return m_changedFileUris; }
+
+protected:
+    virtual bool step();
+
+private:
+    enum Token
+    {
+        TOKEN_INCOMPLETE,
+        TOKEN_ERROR,
+        TOKEN_BEGIN_ARRAY,
+        TOKEN_END_ARRAY,
+        TOKEN_BEGIN_OBJECT,
+        TOKEN_END_OBJECT,
+        TOKEN_COLON,
+        TOKEN_COMMA,
+        TOKEN_STRING,
+        TOKEN_LITERAL
+    };
+
+    enum State
+    {
+        STATE_BEFORE_DATABASE,
+        STATE_IN_DATABASE,
+        STATE_IN_ENTRY,
+        STATE_BEFORE_VALUE,
+        STATE_IN_ARGUMENTS,
+        STATE_SKIPPING_VALUE,
+        STATE_AFTER_DATABASE
+    };
+
+    enum Key
+    {
+        KEY_DIRECTORY,
+        KEY_FILE,
+        KEY_ARGUMENTS,
+        KEY_COMMAND,
+        KEY_OTHER
+    };
+
+    typedef std::map<std::string, const std::string *> CompilerOptionsTable;
+
+    bool openStream();
+
+    void stopGenerator();
+
+    Token nextToken(const char *&begin, const char *end);
+
+    bool parse(const char *&begin, const char *end);
+
+    void importEntry();
+
+    void writeCompilerOptions();
+
+    ProjectDb &m_projectDb;
+
+    std::string m_fileName;
+
+    char **m_generatorArgv;
+    GPid m_generatorId;
+    bool m_generatorRunning;
+
+    GInputStream *m_stream;
+    char *m_readBuffer;
+    char *m_readPointer;
+    int m_readBufferSize;
+
+    State m_state;
+    Key m_key;
+    int m_skippingDepth;
+
+    // The decoded string token.
+    std::string m_string;
+
+    // The current entry.
+    std::string m_directory;
+    std::string m_file;
+    std::string m_arguments;
+    std::string m_command;
+
+    // Scratch storage reused by all the entries.
+    std::vector<const char *> m_fileNames;
+    std::string m_compilerOpts;
+
+    /**
+     * The distinct compiler option strings.  Source files compiled with the
+     * same options share one string.
+     */
+    std::set<std::string> m_compilerOptsPool;
+
+    /**
+     * The imported compiler options not written to the project database yet,
+     * keyed by the URIs of the source files.
+     */
+    CompilerOptionsTable m_importedCompilerOpts;
+
+    std::set<std::string> m_changedFileUris;
+};
+
+}
+
+#endif
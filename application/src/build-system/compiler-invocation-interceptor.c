@@ -1,22 +1,72 @@
 // Compiler invocation interceptor.
 // Copyright (C) 2015 Gang Chen.
 
+// Each intercepted compiler invocation is written to the output file as one
+// record: a 32-bit little-endian payload length followed by the payload, which
+// consists of NUL-terminated fields.  The record is built in memory and
+// appended to the file with the file locked, so that records written by
+// concurrent compiler invocations never interleave.  A record that can't be
+// written completely is cut off, so that the file never ends with a partial
+// record.
+//
+// To profile the build, the library, which is preloaded into the compiler too,
+// takes the start time when the compiler starts and writes another record when
+// the compiler exits, with the start and end times, the exit status and the
+// peak resident set size of the compiler.  The intercepted execve() itself goes
+// straight to the real one, so that the caller, which may be a vfork() child of
+// make, is never blocked.  Profiling is not supported on Windows.
+
 #define _GNU_SOURCE
 #include <ctype.h>
-#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
 #ifdef OS_WINDOWS
-# define FWRITES(s, fp) fwrite(L##s, sizeof(wchar_t), wcslen(L##s) + 1, fp)
+# define APPENDS(s, r) append(r, L##s, sizeof(wchar_t) * (wcslen(L##s) + 1))
 # include <wchar.h>
 # include <sys/cygwin.h>
 # include <windows.h>
 #else
-# define FWRITES(s, fp) fwrite(s, sizeof(char), strlen(s) + 1, fp)
+# define APPENDS(s, r) append(r, s, strlen(s) + 1)
+# include <dlfcn.h>
+# include <stdio.h>
+# include <sys/auxv.h>
+# include <sys/resource.h>
+# include <sys/time.h>
 #endif
 
+struct record
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+static void append(struct record *r, const void *data, size_t length)
+{
+    if (!r->data)
+        return;
+    if (r->length + length > r->capacity)
+    {
+        char *d;
+        while (r->length + length > r->capacity)
+            r->capacity *= 2;
+        d = (char *) realloc(r->data, r->capacity);
+        if (!d)
+        {
+            free(r->data);
+            r->data = NULL;
+            return;
+        }
+        r->data = d;
+    }
+    memcpy(r->data + r->length, data, length);
+    r->length += length;
+}
+
 #ifdef OS_WINDOWS
 
 static int strip_exe(const char *a)
@@ -55,9 +105,9 @@ static int match_exe(const char *a, const char *b)
 
 #endif
 
-static void print(FILE *fp, const char *s)
+static void print(struct record *r, const char *s)
 {
-#if OS_WINDOWS
+#ifdef OS_WINDOWS
     // Convert the word into a wide string.
     mbstate_t state;
     memset(&state, 0, sizeof(state));
@@ -66,16 +116,18 @@ static void print(FILE *fp, const char *s)
         wchar_t buf[BUFSIZ];
         size_t n;
         n = mbsrtowcs(buf, &s, BUFSIZ, &state);
-        fwrite(buf, sizeof(wchar_t), n, fp);
+        if (n == (size_t) -1)
+            break;
+        append(r, buf, sizeof(wchar_t) * n);
     }
 #else
-    fwrite(s, sizeof(char), strlen(s), fp);
+    append(r, s, strlen(s));
 #endif
 }
 
 #ifdef OS_WINDOWS
 
-static void conv_print_path(FILE *fp, const char *path)
+static void conv_print_path(struct record *r, const char *path)
 {
     // Convert the path into the Windows format.
     ssize_t size;
@@ -91,21 +143,29 @@ static void conv_print_path(FILE *fp, const char *path)
                              path,
                              win,
                              size) == 0)
-            fwrite(win, 1, size, fp);
+            append(r, win, size);
         else
         {
-            print(fp, path);
-            FWRITES("", fp);
+            print(r, path);
+            APPENDS("", r);
         }
         free(win);
     }
     else
     {
-        print(fp, path);
-        FWRITES("", fp);
+        print(r, path);
+        APPENDS("", r);
     }
 }
 
+#else
+
+static void conv_print_path(struct record *r, const char *path)
+{
+    print(r, path);
+    APPENDS("", r);
+}
+
 #endif
 
 // On MSYS2 (Cygwin), the paths are probably in the POSIX format that need to
@@ -114,7 +174,7 @@ static void conv_print_path(FILE *fp, const char *path)
 // arguments except compiler options are paths and try to convert, if possible.
 const char *DIR_OPTIONS[] = { "-I", "-L", NULL };
 
-static void print_arg(FILE *fp, const char *arg)
+static void print_arg(struct record *r, const char *arg)
 {
 #ifdef OS_WINDOWS
 
@@ -122,7 +182,7 @@ static void print_arg(FILE *fp, const char *arg)
 
     if (*arg != '-')
     {
-        conv_print_path(fp, arg);
+        conv_print_path(r, arg);
         return;
     }
 
@@ -131,24 +191,255 @@ static void print_arg(FILE *fp, const char *arg)
         int l = strlen(*opt);
         if (strncmp(*opt, arg, l) == 0)
         {
-            print(fp, *opt);
+            print(r, *opt);
             arg += l;
-            conv_print_path(fp, arg);
+            conv_print_path(r, arg);
             return;
         }
     }
 
 #endif
-    print(fp, arg);
-    FWRITES("", fp);
+    print(r, arg);
+    APPENDS("", r);
 }
 
-static void print_argv(FILE *fp, char *const argv[])
+static void print_argv(struct record *r, char *const argv[])
 {
     for (; *argv; argv++)
-        print_arg(fp, *argv);
+        print_arg(r, *argv);
+}
+
+// Print the fields of a compiler invocation record after the executable.
+static void print_invocation(struct record *r, int is_cc, char *const argv[])
+{
+    char *cwd;
+
+    APPENDS("CWD:", r);
+    cwd = get_current_dir_name();
+    if (cwd)
+    {
+        conv_print_path(r, cwd);
+        free(cwd);
+    }
+    else
+        APPENDS("", r);
+    APPENDS("", r);
+
+    if (is_cc)
+        APPENDS("CC ARGV:", r);
+    else
+        APPENDS("CXX ARGV:", r);
+    print(r, argv[0]);
+    APPENDS("", r);
+    print_argv(r, argv + 1);
+    APPENDS("", r);
+
+    APPENDS("", r);
 }
 
+static void write_record(const char *output_file, struct record *r)
+{
+    size_t payload_length, written;
+    ssize_t n;
+    off_t offset;
+    struct flock lock;
+    int fd;
+
+    if (!r->data)
+        return;
+    payload_length = r->length - 4;
+    r->data[0] = payload_length & 0xff;
+    r->data[1] = (payload_length >> 8) & 0xff;
+    r->data[2] = (payload_length >> 16) & 0xff;
+    r->data[3] = (payload_length >> 24) & 0xff;
+
+    fd = open(output_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1)
+        return;
+
+    // A large record may be written in several parts, so lock the file to keep
+    // the records written by other processes from getting in between.
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &lock) == -1)
+    {
+        if (errno != EINTR)
+        {
+            close(fd);
+            return;
+        }
+    }
+
+    offset = lseek(fd, 0, SEEK_END);
+    for (written = 0; written < r->length; written += n)
+    {
+        n = write(fd, r->data + written, r->length - written);
+        if (n == -1 && errno == EINTR)
+            n = 0;
+        else if (n <= 0)
+        {
+            // Cut off the partial record.
+            if (offset != -1)
+                while (ftruncate(fd, offset) == -1 && errno == EINTR)
+                    ;
+            break;
+        }
+    }
+
+    // Closing the file releases the lock.
+    close(fd);
+}
+
+#ifndef OS_WINDOWS
+
+typedef int (*main_function)(int, char **, char **);
+typedef void (*exit_function)(int) __attribute__((noreturn));
+
+static main_function real_main;
+static exit_function real_exit;
+
+// The output file, the process ID, the start time and the fields of the
+// invocation record after the executable, if this process is a compiler being
+// profiled.
+static const char *profile_output_file;
+static pid_t profile_pid;
+static long long profile_start_time;
+static struct record profile_invocation;
+
+static long long now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void append_number(struct record *r, long long n)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", n);
+    APPENDS(buf, r);
+}
+
+// Start profiling if this process is a compiler.  The dynamic linker calls the
+// constructor with the command-line arguments before the main function.
+__attribute__((constructor))
+static void start_profile(int argc, char **argv, char **envp)
+{
+    const char *filename, *cc, *cxx, *output_file;
+    int is_cc;
+
+    real_exit = (exit_function) dlsym(RTLD_NEXT, "exit");
+
+    output_file = getenv("SAMOYED_BUILDER_OUTPUT_FILE");
+    if (!output_file || argc < 1)
+        return;
+
+    // Match the compiler the way the intercepted execve() did.  The auxiliary
+    // vector keeps the file name passed to execve().
+    filename = (const char *) getauxval(AT_EXECFN);
+    cc = getenv("SAMOYED_BUILDER_CC");
+    cxx = getenv("SAMOYED_BUILDER_CXX");
+    if (match_exe(filename, cc) || match_exe(argv[0], cc))
+        is_cc = 1;
+    else if (match_exe(filename, cxx) || match_exe(argv[0], cxx))
+        is_cc = 0;
+    else
+        return;
+
+    profile_pid = getpid();
+    profile_start_time = now();
+    profile_invocation.capacity = 4096;
+    profile_invocation.data = (char *) malloc(profile_invocation.capacity);
+    profile_invocation.length = 0;
+    print_invocation(&profile_invocation, is_cc, argv);
+    if (profile_invocation.data)
+        profile_output_file = output_file;
+}
+
+// Write the profile record, once.  The profile record consists of the
+// NUL-terminated fields: "PERF:" START END STATUS PEAK-RSS "" followed by the
+// fields of the compiler invocation record after the executable.  The times are
+// in microseconds since the epoch and the peak resident set size is in
+// kilobytes.
+static void finish_profile(int status)
+{
+    const char *output_file;
+    struct rusage self, children;
+    struct record r;
+
+    // Skip the children forked or vforked by the compiler, which share or copy
+    // the state of the profile.
+    output_file = profile_output_file;
+    if (!output_file || getpid() != profile_pid)
+        return;
+    profile_output_file = NULL;
+
+    // The compiler driver runs the compiler proper and the assembler as its
+    // children, which it has waited for before exiting.
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    r.capacity = profile_invocation.length + 256;
+    r.data = (char *) malloc(r.capacity);
+    r.length = 4;
+    APPENDS("PERF:", &r);
+    append_number(&r, profile_start_time);
+    append_number(&r, now());
+    append_number(&r, status & 0xff);
+    append_number(&r,
+                  self.ru_maxrss > children.ru_maxrss ?
+                  self.ru_maxrss : children.ru_maxrss);
+    APPENDS("", &r);
+    append(&r, profile_invocation.data, profile_invocation.length);
+    write_record(output_file, &r);
+    free(r.data);
+}
+
+static int profile_main(int argc, char **argv, char **envp)
+{
+    int status;
+    status = real_main(argc, argv, envp);
+    finish_profile(status);
+    return status;
+}
+
+// Returning from the main function exits the process within the C library,
+// where exit() can't be intercepted, so wrap the main function of the compiler.
+int __libc_start_main(main_function main,
+                      int argc,
+                      char **argv,
+                      void (*init)(void),
+                      void (*fini)(void),
+                      void (*rtld_fini)(void),
+                      void *stack_end)
+{
+    int (*real_start_main)(main_function, int, char **,
+                           void (*)(void), void (*)(void), void (*)(void),
+                           void *);
+
+    real_start_main = (int (*)(main_function, int, char **,
+                               void (*)(void), void (*)(void), void (*)(void),
+                               void *))
+        dlsym(RTLD_NEXT, "__libc_start_main");
+    if (!profile_output_file)
+        return real_start_main(main, argc, argv, init, fini, rtld_fini,
+                               stack_end);
+    real_main = main;
+    return real_start_main(profile_main, argc, argv, init, fini, rtld_fini,
+                           stack_end);
+}
+
+void exit(int status)
+{
+    finish_profile(status);
+    if (!real_exit)
+        real_exit = (exit_function) dlsym(RTLD_NEXT, "exit");
+    real_exit(status);
+}
+
+#endif
+
 int
 #ifdef OS_WINDOWS
 intercepted_execve(
@@ -159,11 +450,14 @@ execve(
     char *const argv[],
     char *const envp[])
 {
-    char *cc, *cxx, *output_file, *cwd;
-    int is_cc, is_cxx, i;
-    FILE *fp;
+    char *cc, *cxx, *output_file;
+    int is_cc, is_cxx;
+    struct record r;
 #ifndef OS_WINDOWS
-    int (*real_execve)(const char *, char *const[], char *const[]));
+    int (*real_execve)(const char *, char *const[], char *const[]);
+
+    real_execve = (int (*)(const char *, char *const[], char *const[]))
+        dlsym(RTLD_NEXT, "execve");
 #endif
 
     cc = getenv("SAMOYED_BUILDER_CC");
@@ -182,47 +476,26 @@ execve(
     output_file = getenv("SAMOYED_BUILDER_OUTPUT_FILE");
     if (!output_file)
         goto EXECVE;
-    fp = fopen(output_file, "a");
-    if (!fp)
-        goto EXECVE;
 
-    FWRITES("EXE:", fp);
-    print(fp, filename);
-    FWRITES("", fp);
-    FWRITES("", fp);
+    r.capacity = 4096;
+    r.data = (char *) malloc(r.capacity);
+    // Reserve the space for the payload length.
+    r.length = 4;
 
-    FWRITES("CWD:", fp);
-    cwd = get_current_dir_name();
-    conv_print_path(fp, cwd);
-    free(cwd);
-    FWRITES("", fp);
+    APPENDS("EXE:", &r);
+    print(&r, filename);
+    APPENDS("", &r);
+    APPENDS("", &r);
 
-    if (is_cc)
-    {
-        FWRITES("CC ARGV:", fp);
-        print(fp, argv[0]);
-        FWRITES("", fp);
-        print_argv(fp, argv + 1);
-        FWRITES("", fp);
-    }
-    else if (is_cxx)
-    {
-        FWRITES("CXX ARGV:", fp);
-        print(fp, argv[0]);
-        FWRITES("", fp);
-        print_argv(fp, argv + 1);
-        FWRITES("", fp);
-    }
+    print_invocation(&r, is_cc, argv);
 
-    FWRITES("", fp);
-    fclose(fp);
+    write_record(output_file, &r);
+    free(r.data);
 
 EXECVE:
 #ifdef OS_WINDOWS
     return execve(filename, argv, envp);
 #else
-    real_execve = (int (*)(const char *, char *const[], char *const[]))
-        dlsym(RTLD_NEXT, "execve");
     return real_execve(filename, argv, envp);
 #endif
 }
@@ -8,18 +8,30 @@
 #include "project/project.hpp"
 #include "project/project-db.hpp"
 #include "utilities/miscellaneous.hpp"
+#include <stdio.h>
 #include <string.h>
-#include <list>
+#include <map>
 #include <string>
 #include <set>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 namespace
 {
 
-const int BUFFER_SIZE = 10000;
+const int BUFFER_SIZE = 1 << 20;
+
+// The number of source files whose compiler options are written to the
+// project database in one transaction.
+const size_t BATCH_SIZE = 4096;
+
+const guint32 MAX_RECORD_SIZE = 1 << 28;
 
 const char *SOURCE_FILE_NAME_SUFFIXES[] =
 {
@@ -111,29 +123,90 @@ std::set<Samoyed::ComparablePointer<const char> > optionsNeedingArguments;
 
 std::set<Samoyed::ComparablePointer<const char> > optionsFilteredOut;
 
+// Return the beginning of the field following the NUL-terminated field
+// beginning at 'field', or NULL if the field is not completely read yet.
+inline const char *nextField(const char *field, const char *end)
+{
+    const char *nul =
+        static_cast<const char *>(memchr(field, '\0', end - field));
+    return nul ? nul + 1 : NULL;
 }
 
-namespace Samoyed
+inline bool fieldEquals(const char *field, const char *next,
+                        const char *str, int length)
 {
+    return next - field == length + 1 && memcmp(field, str, length) == 0;
+}
 
-CompilerOptionsCollector::CompilerOptionsCollector(
-    Scheduler &scheduler,
-    unsigned int priority,
-    Project &project,
-    const char *inputFileName):
-        Worker(scheduler, priority),
-        m_projectDb(project.db()),
-        m_inputFileName(inputFileName),
-        m_stream(NULL),
-        m_readBuffer(NULL)
+bool parseNumber(const char *field, const char *next, gint64 &number)
 {
-    char *desc =
-        g_strdup_printf(_("Collecting compiler options from file \"%s\" for "
-                          "project \"%s\"."),
-                        inputFileName, project.uri());
-    setDescription(desc);
-    g_free(desc);
+    char *numberEnd;
+    number = g_ascii_strtoll(field, &numberEnd, 10);
+    return numberEnd != field && numberEnd == next - 1;
+}
 
+void appendJsonString(std::string &json, const char *str)
+{
+    json += '"';
+    for (const char *cp = str; *cp; cp++)
+    {
+        switch (*cp)
+        {
+        case '"':
+            json += "\\\"";
+            break;
+        case '\\':
+            json += "\\\\";
+            break;
+        case '\n':
+            json += "\\n";
+            break;
+        case '\t':
+            json += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(*cp) < 0x20)
+            {
+                char escaped[7];
+                g_snprintf(escaped, sizeof(escaped), "\\u%04x", *cp);
+                json += escaped;
+            }
+            else
+                json += *cp;
+        }
+    }
+    json += '"';
+}
+
+void writeJsonString(FILE *file, const char *str)
+{
+    std::string json;
+    appendJsonString(json, str);
+    fputs(json.c_str(), file);
+}
+
+// Append the NUL-terminated path ending at 'end', which is resolved against
+// the current working directory if relative.
+void appendPath(std::string &opts, const char *cwd,
+                const char *path, const char *end)
+{
+    if (g_path_is_absolute(path))
+        opts.append(path, end - path);
+    else
+    {
+        char *fn = g_build_filename(cwd, path, NULL);
+        opts.append(fn, strlen(fn) + 1);
+        g_free(fn);
+    }
+}
+
+}
+
+namespace Samoyed
+{
+
+void CompilerOptionsCollector::initialize()
+{
     if (sourceFileNameSuffixes.empty())
     {
         for (const char **suffix = SOURCE_FILE_NAME_SUFFIXES; *suffix; suffix++)
@@ -151,11 +224,165 @@ CompilerOptionsCollector::CompilerOptionsCollector(
     }
 }
 
+bool CompilerOptionsCollector::isSourceFile(const char *fileName)
+{
+    const char *ext = strrchr(fileName, '.');
+    return ext &&
+        !strchr(ext, G_DIR_SEPARATOR) &&
+        sourceFileNameSuffixes.find(ext + 1) != sourceFileNameSuffixes.end();
+}
+
+bool CompilerOptionsCollector::extractCompilerOptions(
+    const char *cwd,
+    const char *&cp,
+    const char *end,
+    std::string &compilerOpts,
+    std::vector<const char *> &fileNames)
+{
+    const char *next;
+    for (;;)
+    {
+        const char *arg = cp;
+        if (!(next = nextField(cp, end)))
+            return false;
+        cp = next;
+        // The terminating "".
+        if (cp == arg + 1)
+            return true;
+
+        if (arg[0] != '-')
+        {
+            // A source file name is found.
+            fileNames.push_back(arg);
+        }
+        else if (optionsNeedingArguments.find(arg) ==
+                 optionsNeedingArguments.end())
+        {
+            // A compiler option is found.
+            if (optionsFilteredOut.find(arg) == optionsFilteredOut.end())
+            {
+                const char **opt;
+                for (opt = DIR_OPTIONS; *opt; opt++)
+                {
+                    int l = strlen(*opt);
+                    if (strncmp(*opt, arg, l) == 0)
+                    {
+                        compilerOpts.append(arg, l);
+                        appendPath(compilerOpts, cwd, arg + l, cp);
+                        break;
+                    }
+                }
+                if (!*opt)
+                    compilerOpts.append(arg, cp - arg);
+            }
+        }
+        else
+        {
+            // This compiler option requires an argument.
+            const char *arg2 = cp;
+            if (!(next = nextField(cp, end)))
+                return false;
+            cp = next;
+            // The terminating "".
+            if (cp == arg2 + 1)
+                return false;
+
+            if (optionsFilteredOut.find(arg) == optionsFilteredOut.end())
+            {
+                const char **opt;
+                for (opt = DIR_OPTIONS; *opt; opt++)
+                {
+                    if (strcmp(*opt, arg) == 0)
+                    {
+                        compilerOpts.append(arg, arg2 - arg);
+                        appendPath(compilerOpts, cwd, arg2, cp);
+                        break;
+                    }
+                }
+                if (!*opt)
+                    compilerOpts.append(arg, cp - arg);
+            }
+        }
+    }
+}
+
+CompilerOptionsCollector::CompilerOptionsCollector(
+    Scheduler &scheduler,
+    unsigned int priority,
+    Project &project,
+    const char *configName,
+    const char *inputFileName,
+    bool following):
+        Worker(scheduler, priority),
+        m_projectDb(project.db()),
+        m_configName(configName),
+        m_inputFileName(inputFileName),
+        m_stream(NULL),
+        m_readBuffer(NULL),
+        m_readPointer(NULL),
+        m_readBufferSize(0),
+        m_following(following),
+        m_compileCommandsFileName(inputFileName),
+        m_compileCommandsFile(NULL),
+        m_compileCommandExported(false)
+{
+    m_compileCommandsFileName += ".json";
+
+    char *desc =
+        g_strdup_printf(_("Collecting compiler options from file \"%s\" for "
+                          "project \"%s\"."),
+                        inputFileName, project.uri());
+    setDescription(desc);
+    g_free(desc);
+
+    initialize();
+}
+
 CompilerOptionsCollector::~CompilerOptionsCollector()
 {
     if (m_stream)
         g_object_unref(m_stream);
     delete[] m_readBuffer;
+    if (m_compileCommandsFile)
+    {
+        // The collection is not finished.  Discard the incomplete export.
+        fclose(m_compileCommandsFile);
+        g_unlink((m_compileCommandsFileName + ".tmp").c_str());
+    }
+}
+
+void CompilerOptionsCollector::stopFollowing()
+{
+    boost::mutex::scoped_lock lock(m_sharedDataMutex);
+    m_following = false;
+}
+
+void CompilerOptionsCollector::takeChangedFileUris(
+    std::set<std::string> &fileUris)
+{
+    boost::mutex::scoped_lock lock(m_sharedDataMutex);
+    fileUris.swap(m_changedFileUris);
+    m_changedFileUris.clear();
+}
+
+void CompilerOptionsCollector::takeCompilations(
+    std::vector<Compilation> &compilations)
+{
+    boost::mutex::scoped_lock lock(m_sharedDataMutex);
+    compilations.swap(m_newCompilations);
+    m_newCompilations.clear();
+}
+
+// Block until more compiler invocations are recorded if the build is still
+// running.  Check and block atomically so that the unblocking request following
+// 'stopFollowing()' is not missed.
+bool CompilerOptionsCollector::blockIfFollowing()
+{
+    boost::mutex::scoped_lock lock(m_sharedDataMutex);
+    if (!m_following)
+        return false;
+    blockAfterStep();
+    return true;
 }
 
 bool CompilerOptionsCollector::step()
@@ -170,64 +397,76 @@ bool CompilerOptionsCollector::step()
         if (!fileStream)
         {
             g_error_free(error);
-            return true;
+            // The input file is created when the first compiler invocation is
+            // recorded.
+            return !blockIfFollowing();
         }
+        m_stream = G_INPUT_STREAM(fileStream);
 
+        // The records are in the encoding of the build process and are
+        // converted into UTF-8 one by one, because the record lengths are
+        // binary.
 #ifdef OS_WINDOWS
-        const char *encoding = "UTF-16";
+        m_encoding = "UTF-16LE";
 #else
         const char *encoding;
-        if (g_get_charset(&encoding))
-            m_stream = G_INPUT_STREAM(fileStream);
-        else
-        {
-#endif
-        GCharsetConverter *encodingConverter =
-            g_charset_converter_new("UTF-8", encoding, &error);
-        if (!encodingConverter)
-        {
-            g_object_unref(fileStream);
-            return true;
-        }
-        m_stream =
-            g_converter_input_stream_new(G_INPUT_STREAM(fileStream),
-                                         G_CONVERTER(encodingConverter));
-        g_object_unref(fileStream);
-        g_object_unref(encodingConverter);
-#ifndef OS_WINDOWS
-        }
+        if (!g_get_charset(&encoding))
+            m_encoding = encoding;
 #endif
 
-        m_readBuffer = new char[BUFFER_SIZE];
+        m_readBufferSize = BUFFER_SIZE;
+        m_readBuffer = new char[m_readBufferSize];
         m_readPointer = m_readBuffer;
+
+        m_compileCommandsFile =
+            g_fopen((m_compileCommandsFileName + ".tmp").c_str(), "w");
+        if (m_compileCommandsFile)
+            fputs("[", m_compileCommandsFile);
+    }
+
+    // If the buffer is filled with an incomplete record, enlarge it.
+    if (m_readPointer == m_readBuffer + m_readBufferSize)
+    {
+        char *buffer = new char[m_readBufferSize * 2];
+        memcpy(buffer, m_readBuffer, m_readBufferSize);
+        delete[] m_readBuffer;
+        m_readBuffer = buffer;
+        m_readPointer = m_readBuffer + m_readBufferSize;
+        m_readBufferSize *= 2;
     }
 
     int size = g_input_stream_read(m_stream,
                                    m_readPointer,
-                                   m_readBuffer + BUFFER_SIZE - m_readPointer,
+                                   m_readBuffer + m_readBufferSize -
+                                   m_readPointer,
                                    NULL,
                                    &error);
     if (size == -1)
     {
         g_error_free(error);
+        finish();
         return true;
     }
     if (size == 0)
     {
-        if (m_readPointer != m_readBuffer)
-            return true;
+        // Write the compiler options collected so far and wait for more.
+        writeCompilerOptions();
+        writeCompileStatistics();
+        if (blockIfFollowing())
+            return false;
         if (!g_input_stream_close(m_stream, NULL, &error))
-        {
             g_error_free(error);
-            return true;
-        }
+        finish();
         return true;
     }
     m_readPointer += size;
 
     const char *parsePointer = m_readBuffer;
     if (!parse(parsePointer, m_readPointer))
+    {
+        finish();
         return true;
+    }
 
     size = m_readPointer - parsePointer;
     memmove(m_readBuffer, parsePointer, size);
@@ -235,203 +474,413 @@ bool CompilerOptionsCollector::step()
     return false;
 }
 
+// Each record consists of a 32-bit little-endian payload length and the
+// payload.  A record that is not completely read yet is left for the next
+// call.
 bool CompilerOptionsCollector::parse(const char *&begin, const char *end)
 {
-    for (const char *cp = begin; begin < end; begin = cp)
+    while (end - begin >= 4)
     {
-        const char *cwd;
-        std::list<const char *> fileNames;
-        std::string compilerOpts;
-
-        // "EXE:"
-        if (end - cp < 5)
-            return true;
-        if (strcmp(begin, "EXE:") != 0)
+        guint32 length;
+        memcpy(&length, begin, 4);
+        length = GUINT32_FROM_LE(length);
+        if (length > MAX_RECORD_SIZE)
             return false;
-        cp += 5;
-
-        // "..."
-        while (cp < end && *cp)
-            cp++;
-        if (cp == end)
+        if (static_cast<guint32>(end - begin - 4) < length)
             return true;
-        cp++;
+        const char *payload = begin + 4;
 
-        // ""
-        if (cp == end)
-            return true;
-        if (*cp)
-            return false;
-        cp++;
+        if (m_encoding.empty())
+        {
+            if (!parseRecord(payload, payload + length))
+                return false;
+        }
+        else
+        {
+            gsize convertedLength;
+            char *converted = g_convert(payload, length,
+                                        "UTF-8", m_encoding.c_str(),
+                                        NULL, &convertedLength, NULL);
+            if (!converted)
+                return false;
+            bool successful =
+                parseRecord(converted, converted + convertedLength);
+            g_free(converted);
+            if (!successful)
+                return false;
+        }
 
-        // "CWD:"
-        if (end - cp < 5)
-            return true;
-        if (strcmp(cp, "CWD:") != 0)
-            return false;
-        cp += 5;
+        begin = payload + length;
+    }
+    return true;
+}
 
+// The payload consists of NUL-terminated fields:
+// "EXE:" "..." "" "CWD:" "..." "" "CC ARGV:"|"CXX ARGV:" "..."... "" "", or
+// "PERF:" START END STATUS PEAK-RSS "" "CWD:" "..." "" ... for a profile record
+// written after the compiler exits.  The parser works on the payload in place.
+bool CompilerOptionsCollector::parseRecord(const char *begin, const char *end)
+{
+    const char *cp = begin, *next;
+    Compilation compilation;
+
+    // "EXE:" or "PERF:"
+    if (!(next = nextField(cp, end)))
+        return false;
+    bool profile = fieldEquals(cp, next, "PERF:", 5);
+    if (!profile && !fieldEquals(cp, next, "EXE:", 4))
+        return false;
+    cp = next;
+
+    if (profile)
+    {
+        // START END STATUS PEAK-RSS
+        gint64 numbers[4];
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(next = nextField(cp, end)) ||
+                !parseNumber(cp, next, numbers[i]))
+                return false;
+            cp = next;
+        }
+        compilation.startTime = numbers[0];
+        compilation.endTime = numbers[1];
+        compilation.exitStatus = numbers[2];
+        compilation.peakMemory = numbers[3];
+        compilation.previousDuration = -1;
+    }
+    else
+    {
         // "..."
-        cwd = cp;
-        while (*cp && cp < end)
-            cp++;
-        if (cp == end)
-            return true;
-        cp++;
-
-        // ""
-        if (cp == end)
-            return true;
-        if (*cp)
+        if (!(next = nextField(cp, end)))
             return false;
-        cp++;
+        cp = next;
+    }
 
-        // "CC ARGV:" or "CXX ARGV:"
-        if (end - cp < 10)
-            return true;
-        if (strcmp(cp, "CC ARGV:") == 0)
-            cp += 9;
-        else if (strcmp(cp, "CXX ARGV:") == 0)
-            cp += 10;
-        else
-            return false;
+    // ""
+    if (!(next = nextField(cp, end)) || next != cp + 1)
+        return false;
+    cp = next;
+
+    // "CWD:"
+    if (!(next = nextField(cp, end)) || !fieldEquals(cp, next, "CWD:", 4))
+        return false;
+    cp = next;
+
+    // "..."
+    const char *cwd = cp;
+    if (!(next = nextField(cp, end)))
+        return false;
+    cp = next;
+
+    // ""
+    if (!(next = nextField(cp, end)) || next != cp + 1)
+        return false;
+    cp = next;
+
+    // "CC ARGV:" or "CXX ARGV:"
+    if (!(next = nextField(cp, end)) ||
+        (!fieldEquals(cp, next, "CC ARGV:", 8) &&
+         !fieldEquals(cp, next, "CXX ARGV:", 9)))
+        return false;
+    cp = next;
+
+    // Scan the arguments and find the source file names.  The first argument
+    // is the compiler.
+    const char *argv = cp;
+    m_fileNames.clear();
+    m_compilerOpts.clear();
+    if (!(next = nextField(cp, end)))
+        return false;
+    cp = next;
+    if (cp != argv + 1 &&
+        !extractCompilerOptions(cwd, cp, end, m_compilerOpts, m_fileNames))
+        return false;
+    const char *argvEnd = cp - 1;
+
+    // ""
+    if (!(next = nextField(cp, end)) || next != cp + 1)
+        return false;
+    cp = next;
+    if (cp != end)
+        return false;
+
+    const std::string *compilerOpts = NULL;
+    for (std::vector<const char *>::const_iterator it = m_fileNames.begin();
+         it != m_fileNames.end();
+         ++it)
+    {
+        if (!isSourceFile(*it))
+            continue;
 
-        // Scan the arguments and find the source file names.
-        bool first = true;
-        for (;;)
+        char *buf = NULL;
+        const char *fn;
+        if (g_path_is_absolute(*it))
+            fn = *it;
+        else
         {
-            const char *arg = cp;
-            while (*cp && cp < end)
-                cp++;
-            if (cp == end)
-                return true;
-            // The terminating "".
-            if (cp == arg)
-            {
-                cp++;
-                break;
-            }
-            cp++;
+            buf = g_build_filename(cwd, *it, NULL);
+            fn = buf;
+        }
 
-            if (first)
+        if (profile)
+        {
+            char *uri = g_filename_to_uri(fn, NULL, NULL);
+            if (uri)
             {
-                first = false;
-                continue;
+                m_profiledCompilations.push_back(compilation);
+                m_profiledCompilations.back().fileUri = uri;
+                g_free(uri);
             }
+            if (m_profiledCompilations.size() >= BATCH_SIZE)
+                writeCompileStatistics();
+            g_free(buf);
+            continue;
+        }
 
-            if (arg[0] != '-')
-            {
-                // A source file name is found.
-                fileNames.push_back(arg);
-            }
-            else if (optionsNeedingArguments.find(arg) ==
-                     optionsNeedingArguments.end())
-            {
-                // A compiler option is found.
-                if (optionsFilteredOut.find(arg) == optionsFilteredOut.end())
-                {
-                    const char **opt;
-                    for (opt = DIR_OPTIONS; *opt; opt++)
-                    {
-                        int l = strlen(*opt);
-                        if (strncmp(*opt, arg, l) == 0)
-                        {
-                            compilerOpts.append(arg, l);
-                            arg += l;
-                            if (g_path_is_absolute(arg))
-                                compilerOpts.append(arg, cp - arg);
-                            else
-                            {
-                                char *fn = g_build_filename(cwd, arg, NULL);
-                                compilerOpts.append(fn, strlen(fn) + 1);
-                                g_free(fn);
-                            }
-                            break;
-                        }
-                    }
-                    if (!*opt)
-                        compilerOpts.append(arg, cp - arg);
-                }
-            }
-            else
-            {
-                // This compiler option requires an argument.
-                const char *arg2 = cp;
-                while (*cp && cp < end)
-                    cp++;
-                if (cp == end)
-                    return true;
-                // The terminating "".
-                if (cp == arg2)
-                    return false;
-                cp++;
-
-                if (optionsFilteredOut.find(arg) == optionsFilteredOut.end())
-                {
-                    const char **opt;
-                    for (opt = DIR_OPTIONS; *opt; opt++)
-                    {
-                        if (strcmp(*opt, arg) == 0)
-                        {
-                            compilerOpts.append(arg, arg2 - arg);
-                            if (g_path_is_absolute(arg2))
-                                compilerOpts.append(arg2, cp - arg2);
-                            else
-                            {
-                                char *fn = g_build_filename(cwd, arg2, NULL);
-                                compilerOpts.append(fn, strlen(fn) + 1);
-                                g_free(fn);
-                            }
-                            break;
-                        }
-                    }
-                    if (!*opt)
-                        compilerOpts.append(arg, cp - arg);
-                }
-            }
+        // Record the compiler options, which are shared by all the source
+        // files compiled with the same options.  Only the last compilation of
+        // a source file counts.
+        if (!compilerOpts)
+            compilerOpts = &*m_compilerOptsPool.insert(m_compilerOpts).first;
+        char *uri = g_filename_to_uri(fn, NULL, NULL);
+        if (uri)
+        {
+            m_collectedCompilerOpts[uri] = compilerOpts;
+            g_free(uri);
         }
+        if (m_collectedCompilerOpts.size() >= BATCH_SIZE)
+            writeCompilerOptions();
 
-        // ""
-        if (cp == end)
-            return true;
-        if (*cp)
-            return false;
-        cp++;
+        if (m_compileCommandsFile)
+            exportCompileCommand(cwd, argv, argvEnd, fn);
+        g_free(buf);
+    }
+
+    return true;
+}
+
+void CompilerOptionsCollector::exportCompileCommand(const char *cwd,
+                                                    const char *argv,
+                                                    const char *argvEnd,
+                                                    const char *fileName)
+{
+    FILE *file = m_compileCommandsFile;
+    fputs(m_compileCommandExported ? ",\n" : "\n", file);
+    m_compileCommandExported = true;
+    fputs("  {\n    \"directory\": ", file);
+    writeJsonString(file, cwd);
+    fputs(",\n    \"arguments\": [", file);
+    for (const char *arg = argv; arg < argvEnd; arg += strlen(arg) + 1)
+    {
+        if (arg != argv)
+            fputs(", ", file);
+        writeJsonString(file, arg);
+    }
+    fputs("],\n    \"file\": ", file);
+    std::string jsonFileName;
+    appendJsonString(jsonFileName, fileName);
+    fputs(jsonFileName.c_str(), file);
+    fputs("\n  }", file);
+    m_exportedFileNames.insert(jsonFileName);
+}
+
+bool CompilerOptionsCollector::compilerOptionsChanged(
+    ProjectDb &projectDb,
+    const char *uri,
+    const std::string &compilerOpts)
+{
+    boost::shared_ptr<char> oldCompilerOpts;
+    int oldCompilerOptsLength;
+    ProjectDb::Error error =
+        projectDb.readCompilerOptions(uri,
+                                        oldCompilerOpts,
+                                        oldCompilerOptsLength);
+    return error.code ||
+        oldCompilerOptsLength != static_cast<int>(compilerOpts.length()) ||
+        memcmp(oldCompilerOpts.get(),
+               compilerOpts.data(),
+               compilerOpts.length()) != 0;
+}
+
+void CompilerOptionsCollector::writeCompilerOptions()
+{
+    // Skip the source files whose compiler options are not changed, which are
+    // most of the rebuilt ones.
+    std::vector<CompilerOptionsTable::const_iterator> changed;
+    for (CompilerOptionsTable::const_iterator it =
+            m_collectedCompilerOpts.begin();
+         it != m_collectedCompilerOpts.end();
+         ++it)
+    {
+        if (compilerOptionsChanged(m_projectDb,
+                                   it->first.c_str(),
+                                   *it->second))
+            changed.push_back(it);
+    }
+    if (changed.empty())
+    {
+        m_collectedCompilerOpts.clear();
+        return;
+    }
 
-        for (std::list<const char *>::const_iterator it = fileNames.begin();
-             it != fileNames.end();
+    // Write the compiler options in one transaction.
+    ProjectDb::Error error =
+        m_projectDb.runTransaction(boost::bind(storeCompilerOptions,
+                                               boost::ref(m_projectDb),
+                                               boost::cref(changed),
+                                               _1));
+    if (!error.code)
+    {
+        boost::mutex::scoped_lock lock(m_sharedDataMutex);
+        for (std::vector<CompilerOptionsTable::const_iterator>::const_iterator
+                it = changed.begin();
+             it != changed.end();
              ++it)
-        {
-            char *buf = NULL;
-            const char *fn;
-            if (g_path_is_absolute(*it))
-                fn = *it;
-            else
-            {
-                buf = g_build_filename(cwd, *it, NULL);
-                fn = buf;
-            }
+            m_changedFileUris.insert((*it)->first);
+    }
+    m_collectedCompilerOpts.clear();
+}
 
-            // Check to see if this is a source file.
-            char *ext = strrchr(fn, '.');
-            if (!ext ||
-                sourceFileNameSuffixes.find(ext + 1) ==
-                sourceFileNameSuffixes.end())
+ProjectDb::Error CompilerOptionsCollector::storeCompilerOptions(
+    ProjectDb &projectDb,
+    const std::vector<CompilerOptionsTable::const_iterator> &compilerOpts,
+    DB_TXN *txn)
+{
+    ProjectDb::Error error;
+    for (std::vector<CompilerOptionsTable::const_iterator>::const_iterator it =
+            compilerOpts.begin();
+         it != compilerOpts.end();
+         ++it)
+    {
+        error = projectDb.writeCompilerOptions((*it)->first.c_str(),
+                                               (*it)->second->c_str(),
+                                               (*it)->second->length(),
+                                               txn);
+        if (error.code)
+            break;
+    }
+    return error;
+}
+
+// Write the statistics of the profiled compilations and read those of the
+// previous ones for comparison.
+void CompilerOptionsCollector::writeCompileStatistics()
+{
+    if (m_profiledCompilations.empty())
+        return;
+
+    m_projectDb.runTransaction(boost::bind(updateCompileStatistics, this, _1));
+
+    // Show the compilations even if failed to write their statistics.
+    boost::mutex::scoped_lock lock(m_sharedDataMutex);
+    m_newCompilations.insert(m_newCompilations.end(),
+                             m_profiledCompilations.begin(),
+                             m_profiledCompilations.end());
+    m_profiledCompilations.clear();
+}
+
+ProjectDb::Error CompilerOptionsCollector::updateCompileStatistics(DB_TXN *txn)
+{
+    ProjectDb::Error error;
+    for (std::vector<Compilation>::iterator it =
+            m_profiledCompilations.begin();
+         it != m_profiledCompilations.end();
+         ++it)
+    {
+        ProjectDb::CompileStatistics stats;
+        error = m_projectDb.readCompileStatistics(m_configName.c_str(),
+                                                  it->fileUri.c_str(),
+                                                  stats,
+                                                  txn);
+        if (error.code == 0)
+            it->previousDuration = stats.duration;
+        else if (error.code == DB_NOTFOUND)
+            it->previousDuration = -1;
+        else
+            break;
+        stats.duration = it->endTime - it->startTime;
+        stats.peakMemory = it->peakMemory;
+        stats.exitStatus = it->exitStatus;
+        error = m_projectDb.writeCompileStatistics(m_configName.c_str(),
+                                                   it->fileUri.c_str(),
+                                                   stats,
+                                                   txn);
+        if (error.code)
+            break;
+    }
+    return error;
+}
+
+// Copy the entries of the source files not compiled by this build from the
+// previously exported compilation database, which is in the format written by
+// 'exportCompileCommand()'.
+void CompilerOptionsCollector::mergeCompileCommands()
+{
+    char *contents;
+    gsize length;
+    if (!g_file_get_contents(m_compileCommandsFileName.c_str(),
+                             &contents, &length, NULL))
+        return;
+
+    static const char ENTRY_BEGIN[] = "  {\n";
+    static const char FILE_KEY[] = "    \"file\": ";
+    const char *end = contents + length;
+    const char *entry = NULL, *fileName = NULL;
+    for (const char *line = contents; line < end; )
+    {
+        const char *lineEnd =
+            static_cast<const char *>(memchr(line, '\n', end - line));
+        if (!lineEnd)
+            break;
+        lineEnd++;
+        if (lineEnd - line == sizeof(ENTRY_BEGIN) - 1 &&
+            memcmp(line, ENTRY_BEGIN, lineEnd - line) == 0)
+        {
+            entry = line;
+            fileName = NULL;
+        }
+        else if (entry &&
+                 lineEnd - line > static_cast<int>(sizeof(FILE_KEY)) &&
+                 memcmp(line, FILE_KEY, sizeof(FILE_KEY) - 1) == 0)
+            fileName = line + sizeof(FILE_KEY) - 1;
+        else if (entry && fileName && line[0] == ' ' && line[1] == ' ' &&
+                 line[2] == '}')
+        {
+            // The file name line is followed by the entry end line.
+            std::string jsonFileName(fileName, line - 1 - fileName);
+            if (m_exportedFileNames.find(jsonFileName) ==
+                m_exportedFileNames.end())
             {
-                g_free(buf);
-                continue;
+                fputs(m_compileCommandExported ? ",\n" : "\n",
+                      m_compileCommandsFile);
+                m_compileCommandExported = true;
+                fwrite(entry, 1, line + 3 - entry, m_compileCommandsFile);
             }
-
-            // Write the compiler options.
-            char *uri = g_filename_to_uri(fn, NULL, NULL);
-            m_projectDb.writeCompilerOptions(uri,
-                                             compilerOpts.c_str(),
-                                             compilerOpts.length());
-            g_free(uri);
+            entry = NULL;
         }
+        line = lineEnd;
     }
+    g_free(contents);
+}
 
-    return true;
+void CompilerOptionsCollector::finish()
+{
+    writeCompilerOptions();
+    writeCompileStatistics();
+
+    if (m_compileCommandsFile)
+    {
+        mergeCompileCommands();
+        fputs(m_compileCommandExported ? "\n]\n" : "]\n",
+              m_compileCommandsFile);
+        bool successful = fclose(m_compileCommandsFile) == 0;
+        m_compileCommandsFile = NULL;
+        std::string tmpFileName(m_compileCommandsFileName + ".tmp");
+        if (!successful ||
+            g_rename(tmpFileName.c_str(), m_compileCommandsFileName.c_str()))
+            g_unlink(tmpFileName.c_str());
+    }
 }
 
 }
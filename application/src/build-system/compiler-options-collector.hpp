@@ -5,38 +5,218 @@
 #define SMYD_COMPILER_OPTIONS_COLLECTOR_HPP
 
 #include "utilities/worker.hpp"
+#include "project/project-db.hpp"
+#include <stdio.h>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
 #include <gio/gio.h>
 
 namespace Samoyed
 {
 
 class Project;
-class ProjectDb;
 
+/**
+ * A compiler options collector reads the compiler invocations recorded by the
+ * compiler invocation interceptor during a build, and writes the compiler
+ * options of the compiled source files to the project database.  It also
+ * exports the compiler invocations to a JSON compilation database, whose file
+ * name is the input file name with suffix ".json".
+ *
+ * Only the source files compiled by the build are recorded, so the collected
+ * compiler options are merged into the existing ones.  The compiler options
+ * that are not changed are not written, and the entries of the files not
+ * compiled are kept in the exported compilation database.
+ *
+ * A collector can follow the input file while the build is running, like
+ * "tail -f".  When reaching the end of the input file, it writes the collected
+ * compiler options and blocks itself until unblocked to read the newly
+ * recorded compiler invocations, so that the compiler options of the newly
+ * compiled source files are available during a long build.
+ *
+ * The interceptor also profiles each compiler invocation.  The collector
+ * records the statistics of each profiled compilation in the project database
+ * per configuration, and passes the compilations, along with the durations of
+ * the previous compilations of the same source files, to the build log view.
+ */
 class CompilerOptionsCollector: public Worker
 {
 public:
+    /**
+     * A profiled compilation of a source file.
+     */
+    struct Compilation
+    {
+        std::string fileUri;
+        // The start and end times, in microseconds since the epoch.
+        gint64 startTime;
+        gint64 endTime;
+        // The peak resident set size of the compiler, in kilobytes.
+        gint64 peakMemory;
+        // The exit status of the compiler, or -1 if killed by a signal.
+        int exitStatus;
+        // The duration of the previous compilation of the source file with
+        // the same configuration, in microseconds, or -1 if unknown.
+        gint64 previousDuration;
+    };
+
     CompilerOptionsCollector(Scheduler &scheduler,
                              unsigned int priority,
                              Project &project,
-                             const char *inputFileName);
+                             const char *configName,
+                             const char *inputFileName,
+                             bool following);
 
     virtual ~CompilerOptionsCollector();
 
+    static void initialize();
+
+    static bool isSourceFile(const char *fileName);
+
+    /**
+     * Extract the compiler options and the source file names from compiler
+     * arguments.
+     * @param cwd The working directory of the compiler, against which
+     * relative directories in the compiler options are resolved.
+     * @param cp The NUL-terminated compiler arguments, excluding the
+     * compiler itself, terminated by an empty string.  Will be moved past the
+     * terminating empty string.
+     * @param end The end of the compiler arguments.
+     * @param compilerOpts The string to which the NUL-terminated compiler
+     * options are appended.
+     * @param fileNames The vector to which the file names are appended.
+     * @return False iff the compiler arguments are malformed.
+     */
+    static bool extractCompilerOptions(const char *cwd,
+                                       const char *&cp,
+                                       const char *end,
+                                       std::string &compilerOpts,
+                                       std::vector<const char *> &fileNames);
+
+    /**
+     * @return True iff the compiler options of a source file differ from
+     * those stored in the project database.
+     */
+    static bool compilerOptionsChanged(ProjectDb &projectDb,
+                                       const char *uri,
+                                       const std::string &compilerOpts);
+
+    /**
+     * The compiler options of source files, keyed by the URIs of the source
+     * files.
+     */
+    typedef std::map<std::string, const std::string *> CompilerOptionsTable;
+
+    /**
+     * Write the compiler options of source files to the project database in a
+     * transaction.
+     */
+    static ProjectDb::Error
+    storeCompilerOptions(
+        ProjectDb &projectDb,
+        const std::vector<CompilerOptionsTable::const_iterator> &compilerOpts,
+        DB_TXN *txn);
+
+    /**
+     * Stop following the input file after the build finishes.  The collector
+     * will finish when reaching the end of the input file.  The caller should
+     * unblock the collector after calling this function.
+     */
+    void stopFollowing();
+
+    /**
+     * Take the URIs of the source files whose compiler options are changed
+     * since the last call.  This function can be called while the collector
+     * is running.
+     */
+    void takeChangedFileUris(std::set<std::string> &fileUris);
+
+    /**
+     * Take the compilations profiled since the last call.  This function can
+     * be called while the collector is running.
+     */
+    void takeCompilations(std::vector<Compilation> &compilations);
+
+    const char *configurationName() const { return m_configName.c_str(); }
+
 protected:
     virtual bool step();
 
 private:
     bool parse(const char *&begin, const char *end);
 
+    bool parseRecord(const char *begin, const char *end);
+
+    void exportCompileCommand(const char *cwd,
+                              const char *argv,
+                              const char *argvEnd,
+                              const char *fileName);
+
+    void writeCompilerOptions();
+
+    void writeCompileStatistics();
+
+    ProjectDb::Error updateCompileStatistics(DB_TXN *txn);
+
+    void mergeCompileCommands();
+
+    void finish();
+
+    bool blockIfFollowing();
+
     ProjectDb &m_projectDb;
 
+    std::string m_configName;
+
     std::string m_inputFileName;
 
     GInputStream *m_stream;
+    std::string m_encoding;
     char *m_readBuffer;
     char *m_readPointer;
+    int m_readBufferSize;
+
+    // Scratch storage reused by all the parsed records.
+    std::vector<const char *> m_fileNames;
+    std::string m_compilerOpts;
+
+    /**
+     * The distinct compiler option strings.  Source files compiled with the
+     * same options share one string.
+     */
+    std::set<std::string> m_compilerOptsPool;
+
+    /**
+     * The collected compiler options of the source files, keyed by the URIs
+     * of the source files, which are written to the project database in
+     * batched transactions.
+     */
+    CompilerOptionsTable m_collectedCompilerOpts;
+
+    // Whether to wait for more input at the end of the input file.
+    bool m_following;
+
+    std::set<std::string> m_changedFileUris;
+
+    // The profiled compilations whose statistics are not written yet.
+    std::vector<Compilation> m_profiledCompilations;
+
+    // The profiled compilations not taken yet.
+    std::vector<Compilation> m_newCompilations;
+
+    // Protects 'm_following', 'm_changedFileUris' and 'm_newCompilations'.
+    boost::mutex m_sharedDataMutex;
+
+    std::string m_compileCommandsFileName;
+    FILE *m_compileCommandsFile;
+    bool m_compileCommandExported;
+
+    // The JSON-escaped names of the source files whose compile commands are
+    // exported.
+    std::set<std::string> m_exportedFileNames;
 };
 
 }
@@ -0,0 +1,40 @@
+// Compiler options reader.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "compiler-options-reader.hpp"
+#include "project/project.hpp"
+#include "project/project-db.hpp"
+#include <glib.h>
+#include <glib/gi18n.h>
+
+namespace Samoyed
+{
+
+CompilerOptionsReader::CompilerOptionsReader(Scheduler &scheduler,
+                                             unsigned int priority,
+                                             Project &project,
+                                             const char *fileUri):
+    Worker(scheduler, priority),
+    m_projectDb(project.db()),
+    m_fileUri(fileUri)
+{
+    char *desc =
+        g_strdup_printf(_("Reading the compiler options of file \"%s\"."),
+                        fileUri);
+    setDescription(desc);
+    g_free(desc);
+}
+
+bool CompilerOptionsReader::step()
+{
+    ProjectDb::Error error =
+        m_projectDb.readCompilerOptions(m_fileUri.c_str(), m_compilerOpts);
+    if (error.code)
+        m_compilerOpts.reset();
+    return true;
+}
+
+}
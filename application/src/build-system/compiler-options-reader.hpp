@@ -0,0 +1,48 @@
+// Compiler options reader.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_COMPILER_OPTIONS_READER_HPP
+#define SMYD_COMPILER_OPTIONS_READER_HPP
+
+#include "utilities/worker.hpp"
+#include "project/project-db.hpp"
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+namespace Samoyed
+{
+
+class Project;
+
+/**
+ * A compiler options reader reads the compiler options of a source file from
+ * the project database in the background, so that the file can be compiled
+ * directly without waiting for the database.
+ */
+class CompilerOptionsReader: public Worker
+{
+public:
+    CompilerOptionsReader(Scheduler &scheduler,
+                          unsigned int priority,
+                          Project &project,
+                          const char *fileUri);
+
+    /**
+     * @return The compiler options of the file, or NULL if unknown.  Valid
+     * after the reader finishes.
+     */
+    const boost::shared_ptr<const ProjectDb::CompilerOptions> &
+    compilerOptions() const { return m_compilerOpts; }
+
+protected:
+    virtual bool step();
+
+private:
+    ProjectDb &m_projectDb;
+    std::string m_fileUri;
+    boost::shared_ptr<const ProjectDb::CompilerOptions> m_compilerOpts;
+};
+
+}
+
+#endif
@@ -0,0 +1,465 @@
+// Directory importer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "directory-importer.hpp"
+#include "build-system.hpp"
+#include "project/project.hpp"
+#include "project/project-db.hpp"
+#include "project/project-file.hpp"
+#include "window/window.hpp"
+#include "utilities/miscellaneous.hpp"
+#include "application.hpp"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+namespace
+{
+
+// The number of files written to the project database in one transaction.
+const size_t BATCH_SIZE = 4096;
+
+}
+
+namespace Samoyed
+{
+
+/**
+ * A walker lists one directory in each step.  The subdirectories are queued
+ * for all the walkers, and the classified files are queued for the importer.
+ * A walker finding no queued directory blocks itself until another walker
+ * queues more or finishes.
+ */
+class DirectoryImporter::Walker: public Worker
+{
+public:
+    static void start(Scheduler &scheduler,
+                      unsigned int priority,
+                      const boost::shared_ptr<Pipeline> &pipeline)
+    {
+        boost::shared_ptr<Walker> walker(new Walker(scheduler,
+                                                    priority,
+                                                    pipeline));
+        walker->m_self = walker;
+        walker->submit(walker);
+    }
+
+protected:
+    virtual bool step();
+
+private:
+    Walker(Scheduler &scheduler,
+           unsigned int priority,
+           const boost::shared_ptr<Pipeline> &pipeline):
+        Worker(scheduler, priority),
+        m_pipeline(pipeline)
+    {
+        setDescription(_("Walking directories."));
+    }
+
+    void walk(const char *dirName);
+
+    boost::weak_ptr<Worker> m_self;
+
+    boost::shared_ptr<Pipeline> m_pipeline;
+
+    std::vector<std::string> m_dirs;
+    std::vector<File> m_files;
+};
+
+bool DirectoryImporter::Walker::step()
+{
+    // The workers to be unblocked after the pipeline is unlocked.
+    std::vector<boost::shared_ptr<Worker> > idle;
+
+    std::string dirName;
+    {
+        boost::mutex::scoped_lock lock(m_pipeline->mutex);
+        if (m_pipeline->dirs.empty() && !m_pipeline->canceled &&
+            m_pipeline->numBusyWalkers > 0)
+        {
+            // Block until a busy walker queues more directories or finds none.
+            m_pipeline->idleWalkers.push_back(m_self.lock());
+            blockAfterStep();
+            return false;
+        }
+        if (m_pipeline->dirs.empty() || m_pipeline->canceled)
+        {
+            // Finish if canceled or no walker can produce more directories.
+            // Let the idle walkers finish, and the importer finish after the
+            // last walker.
+            m_pipeline->numWalkers--;
+            idle.swap(m_pipeline->idleWalkers);
+            if (m_pipeline->numWalkers == 0 && m_pipeline->importerIdle)
+            {
+                m_pipeline->importerIdle = false;
+                idle.push_back(m_pipeline->importer.lock());
+            }
+            lock.unlock();
+            wake(idle);
+            return true;
+        }
+        dirName.swap(m_pipeline->dirs.front());
+        m_pipeline->dirs.pop_front();
+        m_pipeline->numBusyWalkers++;
+    }
+
+    walk(dirName.c_str());
+
+    {
+        boost::mutex::scoped_lock lock(m_pipeline->mutex);
+        m_pipeline->dirs.insert(m_pipeline->dirs.end(),
+                                m_dirs.begin(), m_dirs.end());
+        m_pipeline->files.insert(m_pipeline->files.end(),
+                                 m_files.begin(), m_files.end());
+        m_pipeline->numBusyWalkers--;
+        if (!m_dirs.empty() || m_pipeline->numBusyWalkers == 0)
+            idle.swap(m_pipeline->idleWalkers);
+        if (!m_files.empty() && m_pipeline->importerIdle)
+        {
+            m_pipeline->importerIdle = false;
+            idle.push_back(m_pipeline->importer.lock());
+        }
+    }
+    wake(idle);
+    m_dirs.clear();
+    m_files.clear();
+    return false;
+}
+
+void DirectoryImporter::Walker::walk(const char *dirName)
+{
+    GDir *dir = g_dir_open(dirName, 0, NULL);
+    if (!dir)
+        return;
+    std::string name;
+    const char *entry;
+    while ((entry = g_dir_read_name(dir)) != NULL)
+    {
+        if (entry[0] == '.')
+            continue;
+        name = dirName;
+        name += G_DIR_SEPARATOR;
+        name += entry;
+
+        // Stat each entry once.  Do not follow symbolic links to directories,
+        // which may form cycles.
+        GStatBuf st;
+        if (g_lstat(name.c_str(), &st))
+            continue;
+#ifdef S_ISLNK
+        if (S_ISLNK(st.st_mode))
+        {
+            if (g_stat(name.c_str(), &st) || !S_ISREG(st.st_mode))
+                continue;
+        }
+#endif
+        if (S_ISDIR(st.st_mode))
+            m_dirs.push_back(name);
+        else if (S_ISREG(st.st_mode))
+        {
+            int type = m_pipeline->classifier(name.c_str(), entry);
+            if (type < 0)
+                continue;
+            char *uri = g_filename_to_uri(name.c_str(), NULL, NULL);
+            if (!uri)
+                continue;
+            m_files.push_back(File());
+            m_files.back().uri = uri;
+            m_files.back().type = type;
+            g_free(uri);
+        }
+    }
+    g_dir_close(dir);
+}
+
+DirectoryImporter::DirectoryImporter(Scheduler &scheduler,
+                                     unsigned int priority,
+                                     Project &project,
+                                     const char *dirName,
+                                     const Classifier &classifier):
+    Worker(scheduler, priority),
+    m_project(project),
+    m_projectDb(project.db()),
+    m_dirName(dirName),
+    m_pipeline(new Pipeline),
+    m_walkersStarted(false),
+    m_numImportedFiles(0),
+    m_notifierId(0)
+{
+    char *desc =
+        g_strdup_printf(_("Importing files in directory \"%s\" into project "
+                          "\"%s\"."),
+                        dirName, project.uri());
+    setDescription(desc);
+    g_free(desc);
+
+    for (int type = 0; type < ProjectFile::N_TYPES; type++)
+        m_fileData.push_back(project.createFile(type));
+
+    m_pipeline->classifier = classifier;
+    m_pipeline->dirs.push_back(m_dirName);
+    m_pipeline->numWalkers = 0;
+    m_pipeline->numBusyWalkers = 0;
+    m_pipeline->canceled = false;
+    m_pipeline->importerIdle = false;
+}
+
+DirectoryImporter::~DirectoryImporter()
+{
+    // The importer may be canceled while blocked, without being notified.
+    cancelWalkers();
+    for (std::vector<ProjectFile *>::iterator it = m_fileData.begin();
+         it != m_fileData.end();
+         ++it)
+        delete *it;
+}
+
+void DirectoryImporter::submit(const boost::shared_ptr<DirectoryImporter> &self)
+{
+    m_pipeline->importer = self;
+    Worker::submit(self);
+}
+
+void DirectoryImporter::wake(std::vector<boost::shared_ptr<Worker> > &workers)
+{
+    for (std::vector<boost::shared_ptr<Worker> >::iterator it =
+            workers.begin();
+         it != workers.end();
+         ++it)
+    {
+        // The importer may have been destroyed.
+        if (*it)
+            (*it)->unblock(*it);
+    }
+}
+
+void DirectoryImporter::cancelWalkers()
+{
+    std::vector<boost::shared_ptr<Worker> > idle;
+    {
+        boost::mutex::scoped_lock lock(m_pipeline->mutex);
+        m_pipeline->canceled = true;
+        idle.swap(m_pipeline->idleWalkers);
+    }
+    wake(idle);
+}
+
+void DirectoryImporter::cancelInternally()
+{
+    cancelWalkers();
+}
+
+bool DirectoryImporter::step()
+{
+    if (!m_walkersStarted)
+    {
+        m_walkersStarted = true;
+        int n = numberOfProcessors();
+        m_pipeline->numWalkers = n;
+        for (int i = 0; i < n; i++)
+            Walker::start(Application::instance().scheduler(),
+                          priority(),
+                          m_pipeline);
+    }
+
+    std::vector<File> files;
+    bool done;
+    {
+        boost::mutex::scoped_lock lock(m_pipeline->mutex);
+        if (m_pipeline->files.empty() && m_pipeline->numWalkers > 0)
+        {
+            // Block until a walker queues more files or the last walker
+            // finishes.
+            m_pipeline->importerIdle = true;
+            blockAfterStep();
+            return false;
+        }
+        if (m_pipeline->files.size() <= BATCH_SIZE)
+            files.swap(m_pipeline->files);
+        else
+        {
+            files.assign(m_pipeline->files.end() - BATCH_SIZE,
+                         m_pipeline->files.end());
+            m_pipeline->files.resize(m_pipeline->files.size() - BATCH_SIZE);
+        }
+        done = m_pipeline->files.empty() && m_pipeline->numWalkers == 0;
+    }
+
+    if (!files.empty() && !writeFiles(files))
+    {
+        cancelWalkers();
+        return true;
+    }
+    return done;
+}
+
+bool DirectoryImporter::writeFiles(const std::vector<File> &files)
+{
+    std::vector<File> added;
+    ProjectDb::Error error =
+        m_projectDb.runTransaction(boost::bind(addFiles, this,
+                                               boost::cref(files),
+                                               boost::ref(added),
+                                               _1));
+    if (error.code)
+    {
+        char *msg = g_strdup_printf(
+            _("Samoyed failed to add files to project database. \"%s\": %s."),
+            error.dbUri, db_strerror(error.code));
+        m_error = msg;
+        g_free(msg);
+        return false;
+    }
+
+    // Notify the project of the added files in bulk.  If a notification is
+    // pending, the files are merged into it.
+    boost::mutex::scoped_lock lock(m_addedFilesMutex);
+    m_numImportedFiles += added.size();
+    m_addedFiles.insert(m_addedFiles.end(), added.begin(), added.end());
+    if (!m_notifierId && !m_addedFiles.empty())
+    {
+        // The notification holds the importer.  It is removed and delivered
+        // at once when the importer finished or was canceled.
+        m_notifierId = g_idle_add_full(
+            G_PRIORITY_HIGH,
+            onFilesAddedInMainThread,
+            new boost::shared_ptr<Worker>(m_pipeline->importer.lock()),
+            destroyNotificationData);
+    }
+    return true;
+}
+
+ProjectDb::Error DirectoryImporter::addFiles(const std::vector<File> &files,
+                                             std::vector<File> &added,
+                                             DB_TXN *txn)
+{
+    ProjectDb::Error error;
+    added.clear();
+    for (std::vector<File>::const_iterator it = files.begin();
+         it != files.end();
+         ++it)
+    {
+        error = m_projectDb.addFile(it->uri.c_str(),
+                                    *m_fileData[it->type],
+                                    txn);
+        // Skip the files already in the project.
+        if (error.code == DB_KEYEXIST)
+        {
+            error.code = 0;
+            continue;
+        }
+        if (error.code)
+            break;
+        added.push_back(*it);
+    }
+    return error;
+}
+
+ProjectDb::Error DirectoryImporter::removeFiles(const std::vector<File> &files,
+                                                DB_TXN *txn)
+{
+    ProjectDb::Error error;
+    for (std::vector<File>::const_iterator it = files.begin();
+         it != files.end();
+         ++it)
+    {
+        error = m_projectDb.removeFile(it->uri.c_str(), txn);
+        if (error.code)
+            break;
+    }
+    return error;
+}
+
+void DirectoryImporter::notifyImportedFiles()
+{
+    std::vector<File> files;
+    int numImportedFiles;
+    {
+        boost::mutex::scoped_lock lock(m_addedFilesMutex);
+        if (m_notifierId)
+        {
+            g_source_remove(m_notifierId);
+            m_notifierId = 0;
+        }
+        files.swap(m_addedFiles);
+        numImportedFiles = m_numImportedFiles;
+    }
+    if (files.empty())
+        return;
+
+    // Add the files to the build system, and remove the ones it rejects from
+    // the project database again.
+    std::vector<File> accepted, rejected;
+    for (std::vector<File>::const_iterator it = files.begin();
+         it != files.end();
+         ++it)
+    {
+        if (m_project.buildSystem().addFile(
+                it->uri.c_str(),
+                m_fileData[it->type]->buildSystemData()))
+            accepted.push_back(*it);
+        else
+            rejected.push_back(*it);
+    }
+    if (!rejected.empty())
+    {
+        m_projectDb.runTransaction(boost::bind(removeFiles, this,
+                                               boost::cref(rejected),
+                                               _1));
+        numImportedFiles -= rejected.size();
+        boost::mutex::scoped_lock lock(m_addedFilesMutex);
+        m_numImportedFiles -= rejected.size();
+    }
+
+    std::vector<const char *> uris;
+    std::vector<const ProjectFile *> data;
+    uris.reserve(accepted.size());
+    data.reserve(accepted.size());
+    for (std::vector<File>::const_iterator it = accepted.begin();
+         it != accepted.end();
+         ++it)
+    {
+        uris.push_back(it->uri.c_str());
+        data.push_back(m_fileData[it->type]);
+    }
+    m_project.onFilesAdded(uris, data);
+
+    char *msg = g_strdup_printf(_("Imported %d files into project \"%s\"."),
+                                numImportedFiles, m_project.uri());
+    Window::addMessage(msg);
+    g_free(msg);
+}
+
+gboolean DirectoryImporter::onFilesAddedInMainThread(gpointer importer)
+{
+    DirectoryImporter &imp = static_cast<DirectoryImporter &>(
+        **static_cast<boost::shared_ptr<Worker> *>(importer));
+    {
+        // The source is destroyed after this callback returns.
+        boost::mutex::scoped_lock lock(imp.m_addedFilesMutex);
+        imp.m_notifierId = 0;
+    }
+    imp.notifyImportedFiles();
+    return FALSE;
+}
+
+void DirectoryImporter::destroyNotificationData(gpointer importer)
+{
+    delete static_cast<boost::shared_ptr<Worker> *>(importer);
+}
+
+}
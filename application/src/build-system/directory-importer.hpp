@@ -0,0 +1,149 @@
+// Directory importer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_DIRECTORY_IMPORTER_HPP
+#define SMYD_DIRECTORY_IMPORTER_HPP
+
+#include "utilities/worker.hpp"
+#include "project/project-db.hpp"
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+class Project;
+class ProjectFile;
+
+/**
+ * A directory importer recursively imports the files in a directory into a
+ * project in the background.  Directory walkers running in parallel list the
+ * directories and classify the files, and the importer writes the classified
+ * files to the project database in batched transactions.  The project is
+ * notified of the added files in bulk.
+ */
+class DirectoryImporter: public Worker
+{
+public:
+    /**
+     * The file classifier, which is called in background threads.
+     * @param fileName The name of the file.
+     * @param baseName The base name of the file.
+     * @return The type of the project file, or -1 if the file should not be
+     * imported.
+     */
+    typedef boost::function<int (const char *fileName, const char *baseName)>
+        Classifier;
+
+    DirectoryImporter(Scheduler &scheduler,
+                      unsigned int priority,
+                      Project &project,
+                      const char *dirName,
+                      const Classifier &classifier);
+
+    virtual ~DirectoryImporter();
+
+    /**
+     * Submit the importer.  The importer and the walkers block themselves
+     * while waiting for each other, and are unblocked by the ones queuing more
+     * work.
+     */
+    void submit(const boost::shared_ptr<DirectoryImporter> &self);
+
+    /**
+     * Deliver the pending notification of the imported files at once.  Called
+     * in the main thread when the importer finished or was canceled, so that
+     * no notification is delivered after the project is closed.
+     */
+    void notifyImportedFiles();
+
+    /**
+     * @return The error message if the import failed, or an empty string.
+     * This function can be called after the importer finished or was canceled
+     * only.
+     */
+    const char *error() const { return m_error.c_str(); }
+
+protected:
+    virtual bool step();
+
+    virtual void cancelInternally();
+
+private:
+    class Walker;
+
+    struct File
+    {
+        std::string uri;
+        int type;
+    };
+
+    /**
+     * The state shared by the importer and the walkers.
+     */
+    struct Pipeline
+    {
+        Classifier classifier;
+        boost::mutex mutex;
+        std::deque<std::string> dirs;
+        std::vector<File> files;
+        int numWalkers;
+        int numBusyWalkers;
+        bool canceled;
+
+        // The walkers blocked waiting for more directories.
+        std::vector<boost::shared_ptr<Worker> > idleWalkers;
+
+        boost::weak_ptr<Worker> importer;
+
+        // True if the importer is blocked waiting for more files.
+        bool importerIdle;
+    };
+
+    static void wake(std::vector<boost::shared_ptr<Worker> > &workers);
+
+    void cancelWalkers();
+
+    bool writeFiles(const std::vector<File> &files);
+
+    ProjectDb::Error addFiles(const std::vector<File> &files,
+                              std::vector<File> &added,
+                              DB_TXN *txn);
+
+    ProjectDb::Error removeFiles(const std::vector<File> &files, DB_TXN *txn);
+
+    static gboolean onFilesAddedInMainThread(gpointer importer);
+    static void destroyNotificationData(gpointer importer);
+
+    Project &m_project;
+
+    ProjectDb &m_projectDb;
+
+    std::string m_dirName;
+
+    // The project file data shared by all the imported files of each type.
+    std::vector<ProjectFile *> m_fileData;
+
+    boost::shared_ptr<Pipeline> m_pipeline;
+
+    bool m_walkersStarted;
+
+    int m_numImportedFiles;
+
+    // The imported files of which the project is not notified yet.
+    std::vector<File> m_addedFiles;
+    guint m_notifierId;
+    boost::mutex m_addedFilesMutex;
+
+    std::string m_error;
+};
+
+}
+
+#endif
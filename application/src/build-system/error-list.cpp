@@ -0,0 +1,264 @@
+// Error list.
+// Copyright (C) 2015 Gang Chen.
+
+/*
+UNIT TEST BUILD
+g++ error-list.cpp build-log-scanner.cpp -DSMYD_ERROR_LIST_UNIT_TEST \
+`pkg-config --cflags --libs glib-2.0` -Werror -Wall -O2 -o error-list
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "error-list.hpp"
+#ifdef SMYD_ERROR_LIST_UNIT_TEST
+# include <assert.h>
+#endif
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace Samoyed
+{
+
+bool ErrorList::Compare::operator()(int diag1, int diag2) const
+{
+    // The diagnostics are stored in the order of their lines in the build log.
+    if (m_list.m_order == ORDER_BY_LOG_LINE)
+        return diag1 < diag2;
+    const Diagnostic &d1 = m_list.m_scanner.diagnostics()[diag1];
+    const Diagnostic &d2 = m_list.m_scanner.diagnostics()[diag2];
+    if (d1.fileName != d2.fileName)
+        return strcmp(m_list.m_scanner.fileName(d1.fileName),
+                      m_list.m_scanner.fileName(d2.fileName)) < 0;
+    if (d1.line != d2.line)
+        return d1.line < d2.line;
+    if (d1.column != d2.column)
+        return d1.column < d2.column;
+    return diag1 < diag2;
+}
+
+ErrorList::ErrorList(const BuildLogScanner &scanner):
+    m_scanner(scanner),
+    m_order(ORDER_BY_LOG_LINE),
+    m_diagnosticCount(0)
+{
+    for (int i = 0; i < Diagnostic::N_TYPES; i++)
+    {
+        m_typesShown[i] = true;
+        m_counts[i] = 0;
+    }
+}
+
+void ErrorList::setOrder(Order order)
+{
+    if (m_order == order)
+        return;
+    m_order = order;
+    rebuild();
+}
+
+void ErrorList::setTypeShown(Diagnostic::Type type, bool shown)
+{
+    if (m_typesShown[type] == shown)
+        return;
+    m_typesShown[type] = shown;
+    rebuild();
+}
+
+void ErrorList::setFilterText(const char *text)
+{
+    if (m_filterText == text)
+        return;
+    m_filterText = text;
+    rebuild();
+}
+
+bool ErrorList::shown(int diag) const
+{
+    const Diagnostic &d = m_scanner.diagnostics()[diag];
+    if (!m_typesShown[d.type])
+        return false;
+    if (m_filterText.empty())
+        return true;
+    return strstr(m_scanner.fileName(d.fileName), m_filterText.c_str()) ||
+        strstr(m_scanner.message(d), m_filterText.c_str());
+}
+
+void ErrorList::updatePositions(std::vector<int>::size_type begin)
+{
+    for (std::vector<int>::size_type row = begin; row < m_rows.size(); row++)
+        m_positions[m_rows[row]] = row;
+}
+
+void ErrorList::rebuild()
+{
+    m_rows.clear();
+    for (int i = 0; i < m_diagnosticCount; i++)
+    {
+        m_positions[i] = -1;
+        if (shown(i))
+            m_rows.push_back(i);
+    }
+    if (m_order != ORDER_BY_LOG_LINE)
+        std::sort(m_rows.begin(), m_rows.end(), Compare(*this));
+    updatePositions(0);
+}
+
+void ErrorList::update(std::vector<int> &insertedRows)
+{
+    insertedRows.clear();
+    const std::vector<Diagnostic> &diags = m_scanner.diagnostics();
+    std::vector<int> added;
+    for (int i = m_diagnosticCount; i < static_cast<int>(diags.size()); i++)
+    {
+        m_counts[diags[i].type]++;
+        m_positions.push_back(-1);
+        if (shown(i))
+            added.push_back(i);
+    }
+    m_diagnosticCount = diags.size();
+    if (added.empty())
+        return;
+
+    // The new diagnostics follow the existing ones in the build log.
+    if (m_order == ORDER_BY_LOG_LINE)
+    {
+        for (std::vector<int>::const_iterator it = added.begin();
+             it != added.end();
+             ++it)
+        {
+            m_positions[*it] = m_rows.size();
+            insertedRows.push_back(m_rows.size());
+            m_rows.push_back(*it);
+        }
+        return;
+    }
+
+    // Sort the new diagnostics and merge them into the list.
+    Compare compare(*this);
+    std::sort(added.begin(), added.end(), compare);
+    std::vector<int> rows;
+    rows.reserve(m_rows.size() + added.size());
+    std::vector<int>::const_iterator it1 = m_rows.begin(), it2 = added.begin();
+    while (it1 != m_rows.end() || it2 != added.end())
+    {
+        if (it2 != added.end() && (it1 == m_rows.end() || compare(*it2, *it1)))
+        {
+            insertedRows.push_back(rows.size());
+            rows.push_back(*it2++);
+        }
+        else
+            rows.push_back(*it1++);
+    }
+    m_rows.swap(rows);
+    updatePositions(insertedRows.front());
+}
+
+void ErrorList::clear()
+{
+    m_diagnosticCount = 0;
+    for (int i = 0; i < Diagnostic::N_TYPES; i++)
+        m_counts[i] = 0;
+    m_rows.clear();
+    m_positions.clear();
+}
+
+}
+
+#ifdef SMYD_ERROR_LIST_UNIT_TEST
+
+namespace
+{
+
+const char TEST_LOG_1[] =
+    "b.c:5:1: warning: unused variable 'y'\n"
+    "a.c:9:2: error: expected ';'\n"
+    "a.c:9:2: note: to match this '('\n";
+
+const char TEST_LOG_2[] =
+    "a.c:3:4: warning: unused variable 'x'\n"
+    "c.c:1:1: error: unknown type 'y_t'\n"
+    "b.c:2:7: error: expected ';'\n";
+
+// Check that the rows inserted one by one make the list.
+void checkInsertion(const Samoyed::ErrorList &list,
+                    std::vector<int> &view,
+                    const std::vector<int> &insertedRows)
+{
+    for (std::vector<int>::const_iterator it = insertedRows.begin();
+         it != insertedRows.end();
+         ++it)
+        view.insert(view.begin() + *it, -1);
+    assert(static_cast<int>(view.size()) == list.rowCount());
+    for (int row = 0; row < list.rowCount(); row++)
+    {
+        if (view[row] == -1)
+            view[row] = list.diagnostic(row);
+        assert(view[row] == list.diagnostic(row));
+        assert(list.row(list.diagnostic(row)) == row);
+    }
+}
+
+}
+
+int main()
+{
+    typedef Samoyed::BuildLogScanner::Diagnostic Diagnostic;
+    Samoyed::BuildLogScanner scanner("/proj");
+    Samoyed::ErrorList list(scanner);
+    std::vector<int> insertedRows, view;
+
+    // Listed in the order of the build log.
+    scanner.scan(TEST_LOG_1, strlen(TEST_LOG_1));
+    list.update(insertedRows);
+    checkInsertion(list, view, insertedRows);
+    assert(list.rowCount() == 3);
+    assert(list.diagnostic(0) == 0 && list.diagnostic(2) == 2);
+
+    // Grouped by file.
+    list.setOrder(Samoyed::ErrorList::ORDER_BY_FILE);
+    assert(list.diagnostic(0) == 1 && list.diagnostic(1) == 2);
+    assert(list.diagnostic(2) == 0);
+    view.clear();
+    for (int row = 0; row < list.rowCount(); row++)
+        view.push_back(list.diagnostic(row));
+
+    // The diagnostics found later are merged.
+    scanner.scan(TEST_LOG_2, strlen(TEST_LOG_2));
+    list.update(insertedRows);
+    checkInsertion(list, view, insertedRows);
+    assert(insertedRows.size() == 3);
+    const int byFile[] = { 3, 1, 2, 5, 0, 4 };
+    for (int row = 0; row < 6; row++)
+        assert(list.diagnostic(row) == byFile[row]);
+    assert(list.count(Diagnostic::TYPE_ERROR) == 3);
+    assert(list.count(Diagnostic::TYPE_WARNING) == 2);
+    assert(list.count(Diagnostic::TYPE_NOTE) == 1);
+
+    // Filtered by type and text.
+    list.setTypeShown(Diagnostic::TYPE_NOTE, false);
+    assert(list.rowCount() == 5);
+    assert(list.row(2) == -1);
+    assert(list.row(5) == 2);
+    list.setFilterText("unused");
+    assert(list.rowCount() == 2);
+    assert(list.diagnostic(0) == 3 && list.diagnostic(1) == 0);
+    list.setFilterText("/proj/b.c");
+    assert(list.rowCount() == 2);
+    assert(list.diagnostic(0) == 5 && list.diagnostic(1) == 0);
+    list.setFilterText("");
+    list.setTypeShown(Diagnostic::TYPE_NOTE, true);
+    list.setOrder(Samoyed::ErrorList::ORDER_BY_LOG_LINE);
+    for (int row = 0; row < 6; row++)
+        assert(list.diagnostic(row) == row);
+
+    scanner.clear();
+    list.clear();
+    list.update(insertedRows);
+    assert(list.rowCount() == 0 && insertedRows.empty());
+    return 0;
+}
+
+#endif // #ifdef SMYD_ERROR_LIST_UNIT_TEST
@@ -0,0 +1,120 @@
+// Error list.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_ERROR_LIST_HPP
+#define SMYD_ERROR_LIST_HPP
+
+#include "build-log-scanner.hpp"
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+
+namespace Samoyed
+{
+
+/**
+ * An error list is a sorted and filtered view of the compiler diagnostics found
+ * by a build log scanner.  It is a flat array of the indices of the
+ * diagnostics in the scanner, so sorting and filtering move integers only and
+ * the diagnostics keep referring to their interned file names.  The row of
+ * each diagnostic is recorded as well, so that the diagnostics next to any one
+ * are found in constant time, without scanning the build log again.
+ *
+ * The diagnostics are listed in the order of their lines in the build log, or
+ * grouped by file and listed in the order of their lines in each file.  The
+ * diagnostics found later are merged into the list in linear time.
+ */
+class ErrorList: public boost::noncopyable
+{
+public:
+    typedef BuildLogScanner::Diagnostic Diagnostic;
+
+    enum Order
+    {
+        ORDER_BY_LOG_LINE,
+        ORDER_BY_FILE
+    };
+
+    ErrorList(const BuildLogScanner &scanner);
+
+    Order order() const { return m_order; }
+    void setOrder(Order order);
+
+    bool typeShown(Diagnostic::Type type) const { return m_typesShown[type]; }
+    void setTypeShown(Diagnostic::Type type, bool shown);
+
+    const char *filterText() const { return m_filterText.c_str(); }
+
+    /**
+     * Show only the diagnostics whose file names or messages contain a text.
+     */
+    void setFilterText(const char *text);
+
+    /**
+     * Add the diagnostics newly found by the scanner.
+     * @param insertedRows The rows of the added diagnostics, in ascending
+     * order.  The rows can be inserted into a view one by one in this order.
+     */
+    void update(std::vector<int> &insertedRows);
+
+    /**
+     * Called after the scanner is cleared.
+     */
+    void clear();
+
+    /**
+     * @return The number of the rows, i.e., the shown diagnostics.
+     */
+    int rowCount() const { return m_rows.size(); }
+
+    /**
+     * @return The index of the diagnostic shown in a row.
+     */
+    int diagnostic(int row) const { return m_rows[row]; }
+
+    /**
+     * @return The row showing a diagnostic, or -1 if it is filtered out.
+     */
+    int row(int diagnostic) const { return m_positions[diagnostic]; }
+
+    /**
+     * @return The number of all the diagnostics of a type, including the
+     * filtered out ones.
+     */
+    int count(Diagnostic::Type type) const { return m_counts[type]; }
+
+private:
+    class Compare
+    {
+    public:
+        Compare(const ErrorList &list): m_list(list) {}
+        bool operator()(int diag1, int diag2) const;
+    private:
+        const ErrorList &m_list;
+    };
+
+    bool shown(int diag) const;
+
+    void rebuild();
+
+    void updatePositions(std::vector<int>::size_type begin);
+
+    const BuildLogScanner &m_scanner;
+
+    Order m_order;
+    bool m_typesShown[Diagnostic::N_TYPES];
+    std::string m_filterText;
+
+    // The number of the diagnostics of the scanner already added.
+    int m_diagnosticCount;
+    int m_counts[Diagnostic::N_TYPES];
+
+    std::vector<int> m_rows;
+
+    // The rows of all the diagnostics, or -1 for the filtered out ones.
+    std::vector<int> m_positions;
+};
+
+}
+
+#endif
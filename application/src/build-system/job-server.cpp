@@ -0,0 +1,144 @@
+// Job server.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "job-server.hpp"
+#include "utilities/miscellaneous.hpp"
+#include "utilities/property-tree.hpp"
+#include "utilities/scheduler.hpp"
+#include "application.hpp"
+#include <errno.h>
+#include <string.h>
+#ifndef OS_WINDOWS
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#include <algorithm>
+#include <string>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+#define BUILD_SYSTEM "build-system"
+#define BUILD_JOBS "build-jobs"
+#define BACKGROUND_JOBS "background-jobs"
+
+namespace
+{
+
+// The default total number of the job slots for builds and background workers.
+// Zero means the number of the processors.
+const int DEFAULT_BUILD_JOBS = 0;
+
+// The default number of the job slots reserved for background workers while
+// building.
+const int DEFAULT_BACKGROUND_JOBS = 1;
+
+}
+
+namespace Samoyed
+{
+
+void JobServer::installPreferences()
+{
+    PropertyTree &prefs =
+        Application::instance().preferences().addChild(BUILD_SYSTEM);
+    prefs.addChild(BUILD_JOBS, DEFAULT_BUILD_JOBS);
+    prefs.addChild(BACKGROUND_JOBS, DEFAULT_BACKGROUND_JOBS);
+}
+
+JobServer::JobServer():
+    m_runningBuildCount(0)
+{
+    m_fds[0] = m_fds[1] = m_fds[2] = -1;
+
+    const PropertyTree &prefs =
+        Application::instance().preferences().child(BUILD_SYSTEM);
+    int totalJobs = prefs.get<int>(BUILD_JOBS);
+    if (totalJobs <= 0)
+        totalJobs = numberOfProcessors();
+    m_backgroundJobs = std::max(prefs.get<int>(BACKGROUND_JOBS), 0);
+    m_buildJobs = std::max(totalJobs - m_backgroundJobs, 1);
+
+    createPipe();
+}
+
+JobServer::~JobServer()
+{
+    destroyPipe();
+}
+
+void JobServer::createPipe()
+{
+#ifndef OS_WINDOWS
+    int fds[2];
+    if (pipe(fds))
+    {
+        g_warning(_("Samoyed failed to create a pipe for the job server: %s."),
+                  g_strerror(errno));
+        return;
+    }
+    // Only make inherits the pipe.
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    // Put a token for each job slot beyond the first one.
+    std::string tokens(m_buildJobs - 1, '+');
+    if (!tokens.empty() &&
+        write(fds[1], tokens.data(), tokens.length()) !=
+        static_cast<ssize_t>(tokens.length()))
+    {
+        g_warning(_("Samoyed failed to write tokens to the job server: %s."),
+                  g_strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+    m_fds[0] = fds[0];
+    m_fds[1] = fds[1];
+
+    // "--jobserver-fds" is for make older than 4.2.
+    char *flags = g_strdup_printf(" -j --jobserver-fds=%d,%d"
+                                  " --jobserver-auth=%d,%d",
+                                  fds[0], fds[1], fds[0], fds[1]);
+    m_makeFlags = flags;
+    g_free(flags);
+#endif
+}
+
+void JobServer::destroyPipe()
+{
+#ifndef OS_WINDOWS
+    if (m_fds[0] != -1)
+    {
+        close(m_fds[0]);
+        close(m_fds[1]);
+        m_fds[0] = m_fds[1] = -1;
+        m_makeFlags.clear();
+    }
+#endif
+}
+
+void JobServer::onBuildStarted()
+{
+    if (m_runningBuildCount++ == 0 && m_backgroundJobs > 0)
+        Application::instance().scheduler().
+            setBackgroundWorkerLimit(m_backgroundJobs);
+}
+
+void JobServer::onBuildFinished()
+{
+    if (--m_runningBuildCount == 0)
+    {
+        Application::instance().scheduler().setBackgroundWorkerLimit(0);
+
+        // The tokens held by the jobs of a killed make are never written back,
+        // and its orphaned children may write back tokens later.  Recreate the
+        // pipe while no build is running, leaving the old one to the orphans.
+        destroyPipe();
+        createPipe();
+    }
+}
+
+}
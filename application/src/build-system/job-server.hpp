@@ -0,0 +1,79 @@
+// Job server.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_JOB_SERVER_HPP
+#define SMYD_JOB_SERVER_HPP
+
+#include <string>
+#include <boost/utility.hpp>
+
+namespace Samoyed
+{
+
+/**
+ * A job server limits the total concurrency of the builds run by Samoyed and of
+ * Samoyed's own background workers to the number of the processors.  It is a
+ * GNU make job server, i.e., a pipe holding a token for each job slot beyond
+ * the first one, shared by all the concurrently running builds.  Each make
+ * process reads a token from the pipe before starting a job and writes it back
+ * after the job finishes.  Note that the top-level make process of each build
+ * has an implicit job slot, so each additional concurrent build may run one
+ * more job.
+ *
+ * The processors are split between builds and background workers.  While any
+ * build is running, the scheduler runs at most the configured number of
+ * background workers concurrently and the builds get the other job slots.
+ *
+ * Make picks up the job server from the "MAKEFLAGS" environment variable.  A
+ * build command passing an explicit "-j" option to make overrides it.  Job
+ * servers are not supported on Windows.
+ */
+class JobServer: public boost::noncopyable
+{
+public:
+    static void installPreferences();
+
+    JobServer();
+
+    ~JobServer();
+
+    /**
+     * @return True iff the job server is available.
+     */
+    bool available() const { return m_fds[0] != -1; }
+
+    /**
+     * @return The file descriptors of the pipe, terminated by -1, to be
+     * inherited by make.
+     */
+    const int *fds() const { return m_fds; }
+
+    /**
+     * @return The options to be added to "MAKEFLAGS".
+     */
+    const char *makeFlags() const { return m_makeFlags.c_str(); }
+
+    /**
+     * Called when a build starts.
+     */
+    void onBuildStarted();
+
+    /**
+     * Called when a build finishes or is stopped.
+     */
+    void onBuildFinished();
+
+private:
+    void createPipe();
+    void destroyPipe();
+
+    int m_fds[3];
+    std::string m_makeFlags;
+    int m_buildJobs;
+    int m_backgroundJobs;
+    int m_runningBuildCount;
+};
+
+}
+
+#endif
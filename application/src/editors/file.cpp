@@ -12,6 +12,9 @@
 #include "utilities/file-loader.hpp"
 #include "utilities/file-saver.hpp"
 #include "utilities/property-tree.hpp"
+#include "project/project.hpp"
+#include "project/project-db.hpp"
+#include "project/trigram-indexer.hpp"
 #include "application.hpp"
 #include <assert.h>
 #include <string.h>
@@ -19,6 +22,8 @@
 #include <list>
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/bind.hpp>
 #include <glib.h>
@@ -691,6 +696,7 @@ File::File(const char *uri,
     m_type(type),
     m_mimeType(mimeType),
     m_closing(false),
+    m_contentHash(0),
     m_superUndo(NULL),
     m_editCount(0),
     m_firstEditor(NULL),
@@ -712,6 +718,29 @@ File::~File()
     Application::instance().removeFile(*this);
 }
 
+// Record the content hash in the databases of the projects managing this file
+// so that the project watchers can tell whether the file is really changed.
+// Reindex the saved contents without waiting for the project watchers, which
+// may be polling.
+void File::updateProjects(bool saved)
+{
+    std::set<Project *> projects;
+    for (Editor *editor = m_firstEditor; editor; editor = editor->nextInFile())
+    {
+        Project *project = editor->project();
+        if (!project || !projects.insert(project).second)
+            continue;
+        bool managed;
+        if (project->db().hasFile(uri(), managed).code || !managed)
+            continue;
+        if (m_contentHash)
+            project->db().writeContentHash(uri(), m_contentHash);
+        if (saved && project->trigramIndexer())
+            project->trigramIndexer()->updateFiles(
+                std::vector<std::string>(1, uri()));
+    }
+}
+
 void File::onLoaderFinished(const boost::shared_ptr<Worker> &worker)
 {
     assert(m_loader == worker);
@@ -719,6 +748,8 @@ void File::onLoaderFinished(const boost::shared_ptr<Worker> &worker)
 
     // Overwrite the contents with the loaded contents.
     m_modifiedTime = m_loader->modifiedTime();
+    m_contentHash = m_loader->contentHash();
+    updateProjects(false);
     resetEditCount();
     m_undoHistory.clear();
     m_redoHistory.clear();
@@ -832,6 +863,8 @@ void File::onSaverFinished(const boost::shared_ptr<Worker> &worker)
     else
     {
         m_modifiedTime = m_saver->modifiedTime();
+        m_contentHash = m_saver->contentHash();
+        updateProjects(true);
         resetEditCount();
     }
 
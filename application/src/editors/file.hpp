@@ -150,6 +150,12 @@ public:
 
     const Time &modifiedTime() const { return m_modifiedTime; }
 
+    /**
+     * @return The hash of the contents when the file was last loaded or saved,
+     * or 0 if unknown.
+     */
+    guint64 contentHash() const { return m_contentHash; }
+
     /**
      * @return The options, which must be deleted by the caller.
      */
@@ -466,6 +472,8 @@ private:
 
     void decreaseEditCount();
 
+    void updateProjects(bool saved);
+
     void onLoaderFinished(const boost::shared_ptr<Worker> &worker);
     void onLoaderCanceled(const boost::shared_ptr<Worker> &worker);
 
@@ -492,6 +500,8 @@ private:
 
     Time m_modifiedTime;
 
+    guint64 m_contentHash;
+
     EditStack m_undoHistory;
 
     EditStack m_redoHistory;
@@ -563,6 +563,7 @@ SourceFile::SourceFile(const char *uri,
              options.child(TEXT_FILE_OPTIONS) : options),
     m_parsing(false),
     m_parsePending(true),
+    m_compilerOptionsChanged(false),
     m_cursorIndentLine(-1),
     m_structureUpdated(false),
     m_structureRoot(NULL)
@@ -645,6 +646,11 @@ bool SourceFile::parse()
                 project = editor->project();
                 break;
             }
+        if (m_compilerOptionsChanged)
+        {
+            m_compilerOptionsChanged = false;
+            m_tu.reset();
+        }
         if (m_tu)
         {
             boost::shared_ptr<CXTranslationUnitImpl> tu;
@@ -663,6 +669,20 @@ bool SourceFile::parse()
     return false;
 }
 
+void SourceFile::reparse()
+{
+    m_parsePending = true;
+    m_structureUpdated = false;
+    if (!loading())
+        parse();
+}
+
+void SourceFile::onCompilerOptionsChanged()
+{
+    m_compilerOptionsChanged = true;
+    reparse();
+}
+
 void SourceFile::onLoaded()
 {
     TextFile::onLoaded();
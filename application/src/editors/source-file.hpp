@@ -96,6 +96,18 @@ public:
 
     bool parsed() const { return !m_parsing && !m_parsePending; }
 
+    /**
+     * Request to reparse the file, e.g., when a file included by it is changed
+     * outside.
+     */
+    void reparse();
+
+    /**
+     * Request to parse the file from scratch, because its compiler options are
+     * changed and the translation unit can't be reparsed with new ones.
+     */
+    void onCompilerOptionsChanged();
+
     const boost::shared_ptr<CXTranslationUnitImpl> parsedTranslationUnit() const
     { return m_tu; }
 
@@ -173,6 +185,7 @@ private:
 
     bool m_parsing;
     bool m_parsePending;
+    bool m_compilerOptionsChanged;
 
     boost::shared_ptr<CXTranslationUnitImpl> m_tu;
 
@@ -101,44 +101,21 @@ void ForegroundFileParser::Procedure::Job::doIt(CXIndex index)
     {
         Window::addMessage(desc);
         CXTranslationUnit tu;
-        boost::shared_ptr<char> compilerOptsStr;
-        int compilerOptsStrLength;
-        const char **compilerOpts = NULL;
-        int numCompilerOpts = 0;
+        boost::shared_ptr<const ProjectDb::CompilerOptions> compilerOpts;
         if (m_project)
         {
             ProjectDb::Error dbError =
                 m_project->db().readCompilerOptions(m_fileUri.c_str(),
-                                                    compilerOptsStr,
-                                                    compilerOptsStrLength);
-            if (!dbError.code)
-            {
-                for (const char *cp = compilerOptsStr.get();
-                     cp < compilerOptsStr.get() + compilerOptsStrLength;
-                     cp++)
-                    if (*cp == '\0')
-                        numCompilerOpts++;
-                if (numCompilerOpts)
-                {
-                    compilerOpts = new const char *[numCompilerOpts];
-                    const char **cpp = compilerOpts;
-                    for (const char *cp = compilerOptsStr.get(),
-                                    *opt = compilerOptsStr.get();
-                         cp < compilerOptsStr.get() + compilerOptsStrLength;
-                         cp++)
-                        if (*cp == '\0')
-                        {
-                            *cpp++ = opt;
-                            opt = cp + 1;
-                        }
-                }
-            }
+                                                    compilerOpts);
+            if (dbError.code)
+                compilerOpts.reset();
         }
         int error = clang_parseTranslationUnit2(
             index,
             fileName,
-            compilerOpts,
-            numCompilerOpts,
+            compilerOpts && !compilerOpts->options.empty() ?
+            &compilerOpts->options[0] : NULL,
+            compilerOpts ? compilerOpts->options.size() : 0,
             m_unsavedFiles->unsavedFiles(),
             m_unsavedFiles->numUnsavedFiles(),
             clang_defaultEditingTranslationUnitOptions() |
@@ -147,7 +124,6 @@ void ForegroundFileParser::Procedure::Job::doIt(CXIndex index)
             CXTranslationUnit_DetailedPreprocessingRecord |
             CXTranslationUnit_IncludeBriefCommentsInCodeCompletion,
             &tu);
-        delete[] compilerOpts;
         m_tu.reset(tu, clang_disposeTranslationUnit);
         if (error)
             m_tu.reset();
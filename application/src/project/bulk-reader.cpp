@@ -0,0 +1,170 @@
+// Bulk reader.
+// Copyright (C) 2015 Gang Chen.
+
+/*
+UNIT TEST BUILD
+g++ bulk-reader.cpp -DSMYD_BULK_READER_UNIT_TEST -I../../../libs -ldb \
+-Werror -Wall -O2 -o bulk-reader
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "bulk-reader.hpp"
+#ifdef SMYD_BULK_READER_UNIT_TEST
+# include <assert.h>
+# include <string>
+# include <vector>
+# include <boost/bind.hpp>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <db.h>
+
+namespace Samoyed
+{
+
+int readRecordsInBulk(DB *db,
+                      DB_TXN *txn,
+                      const char *keyPrefix,
+                      const BulkRecordVisitor &visitor,
+                      u_int32_t cursorFlags,
+                      u_int32_t bufferSize)
+{
+    DBC *cursor;
+    int code = db->cursor(db, txn, &cursor, cursorFlags);
+    if (code)
+        return code;
+
+    // The cursor writes the found key back into the key, so the key needs its
+    // own buffer, which is seeded with the prefix to position the cursor and
+    // then reallocated by Berkeley DB to hold any longer key.
+    int keyPrefixLen = strlen(keyPrefix);
+    DBT key, dat;
+    memset(&key, 0, sizeof(DBT));
+    memset(&dat, 0, sizeof(DBT));
+    key.data = malloc(keyPrefixLen + 1);
+    memcpy(key.data, keyPrefix, keyPrefixLen);
+    key.size = keyPrefixLen;
+    key.flags = DB_DBT_REALLOC;
+    dat.ulen = bufferSize;
+    dat.data = malloc(dat.ulen);
+    dat.flags = DB_DBT_USERMEM;
+    u_int32_t op = DB_SET_RANGE;
+    for (;;)
+    {
+        code = cursor->get(cursor, &key, &dat, op | DB_MULTIPLE_KEY);
+        if (code == DB_BUFFER_SMALL && dat.size > dat.ulen)
+        {
+            // A single record does not fit in the buffer.  Enlarge the buffer
+            // to a multiple of 1024 bytes, as required, and retry.
+            dat.ulen = (dat.size + 1023) & ~1023;
+            dat.data = realloc(dat.data, dat.ulen);
+            continue;
+        }
+        if (code)
+        {
+            if (code == DB_NOTFOUND)
+                code = 0;
+            goto END;
+        }
+        op = DB_NEXT;
+
+        void *p;
+        DB_MULTIPLE_INIT(p, &dat);
+        for (;;)
+        {
+            void *k, *d;
+            u_int32_t kLen, dLen;
+            DB_MULTIPLE_KEY_NEXT(p, &dat, k, kLen, d, dLen);
+            if (!p)
+                break;
+            if (kLen < static_cast<u_int32_t>(keyPrefixLen) ||
+                memcmp(keyPrefix, k, keyPrefixLen) != 0)
+                goto END;
+            if (visitor(static_cast<char *>(k), kLen,
+                        static_cast<char *>(d), dLen))
+                goto END;
+        }
+    }
+
+END:
+    cursor->close(cursor);
+    free(key.data);
+    free(dat.data);
+    return code;
+}
+
+}
+
+#ifdef SMYD_BULK_READER_UNIT_TEST
+
+namespace
+{
+
+bool collect(std::vector<std::string> &keys,
+             const char *key,
+             int keyLength,
+             const char *data,
+             int dataLength)
+{
+    keys.push_back(std::string(key, keyLength));
+    return false;
+}
+
+void put(DB *db, const char *k, const std::string &d)
+{
+    DBT key, dat;
+    memset(&key, 0, sizeof(DBT));
+    memset(&dat, 0, sizeof(DBT));
+    key.data = const_cast<char *>(k);
+    key.size = strlen(k);
+    dat.data = const_cast<char *>(d.data());
+    dat.size = d.length();
+    int code = db->put(db, NULL, &key, &dat, 0);
+    assert(code == 0);
+}
+
+}
+
+int main()
+{
+    DB *db;
+    int code = db_create(&db, NULL, 0);
+    assert(code == 0);
+    code = db->open(db, NULL, NULL, NULL, DB_BTREE, DB_CREATE, 0);
+    assert(code == 0);
+
+    // The keys are longer than the prefix, and a record is larger than the
+    // initial buffer.
+    put(db, "file:///a", "0");
+    put(db, "file:///a/b/a-long-file-name.c", "1");
+    put(db, "file:///a/c/d/an-even-longer-file-name.c", std::string(5000, '2'));
+    put(db, "file:///a/e.c", "3");
+    put(db, "file:///b/f.c", "4");
+
+    const char prefix[] = "file:///a/";
+    std::vector<std::string> keys;
+    code = Samoyed::readRecordsInBulk(db, NULL, prefix,
+                                      boost::bind(collect, boost::ref(keys),
+                                                  _1, _2, _3, _4),
+                                      0, 1024);
+    assert(code == 0);
+    assert(keys.size() == 3);
+    assert(keys[0] == "file:///a/b/a-long-file-name.c");
+    assert(keys[1] == "file:///a/c/d/an-even-longer-file-name.c");
+    assert(keys[2] == "file:///a/e.c");
+    assert(strcmp(prefix, "file:///a/") == 0);
+
+    keys.clear();
+    code = Samoyed::readRecordsInBulk(db, NULL, "file:///c/",
+                                      boost::bind(collect, boost::ref(keys),
+                                                  _1, _2, _3, _4),
+                                      0, 1024);
+    assert(code == 0 && keys.empty());
+
+    db->close(db, 0);
+    return 0;
+}
+
+#endif // #ifdef SMYD_BULK_READER_UNIT_TEST
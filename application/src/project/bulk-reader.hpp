@@ -0,0 +1,43 @@
+// Bulk reader.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_BULK_READER_HPP
+#define SMYD_BULK_READER_HPP
+
+#include <boost/function.hpp>
+#include <db.h>
+
+namespace Samoyed
+{
+
+/**
+ * The record visitor callback function.
+ * @param key The key of the visited record, not terminated with '\0'.
+ * @param data The data of the visited record.  The key and the data are valid
+ * during the call only.
+ * @return True to stop visiting the left records.
+ */
+typedef boost::function<bool (const char *key,
+                              int keyLength,
+                              const char *data,
+                              int dataLength)> BulkRecordVisitor;
+
+/**
+ * Visit the records whose keys have a common prefix in a B-tree database, in
+ * the order of their keys.  As many records as a buffer can hold are read in
+ * each call, and the visitor views them in place.
+ * @param cursorFlags The flags for opening the cursor.
+ * @param bufferSize The initial size of the buffer, which must be a multiple
+ * of 1024 bytes.  The buffer is enlarged if a single record does not fit.
+ * @return The error code of Berkeley DB.
+ */
+int readRecordsInBulk(DB *db,
+                      DB_TXN *txn,
+                      const char *keyPrefix,
+                      const BulkRecordVisitor &visitor,
+                      u_int32_t cursorFlags,
+                      u_int32_t bufferSize);
+
+}
+
+#endif
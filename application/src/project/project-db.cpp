@@ -5,77 +5,273 @@
 # include <config.h>
 #endif
 #include "project-db.hpp"
+#include "bulk-reader.hpp"
 #include "project.hpp"
 #include "project-file.hpp"
+#include "trigram-index.hpp"
+#include "utilities/property-tree.hpp"
+#include "application.hpp"
 #include <string.h>
 #include <stdlib.h>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/thread/mutex.hpp>
 #include <glib.h>
 #include <db.h>
 
+#define PROJECT_DATABASE "project-database"
+#define CACHE_SIZE "cache-size"
+#define TRIGRAM_INDEX "trigram-index"
+
+namespace
+{
+
+// The default size of the memory pool cache, in megabytes.
+const int DEFAULT_CACHE_SIZE = 64;
+
+const u_int32_t MAX_LOCKS = 100000;
+
+const u_int32_t ENV_FLAGS =
+    DB_INIT_TXN | DB_INIT_LOCK | DB_INIT_LOG | DB_INIT_MPOOL | DB_THREAD;
+
+const u_int32_t TABLE_FLAGS = DB_AUTO_COMMIT | DB_THREAD;
+
+const int MAX_TRANSACTION_ATTEMPTS = 3;
+
+// The maximum number of the compiler option sets cached in memory.
+const size_t MAX_CACHED_COMPILER_OPTION_SETS = 1024;
+
+const char *COMPILER_OPTION_SET_TABLE = "compiler-option-set-table.db";
+const char *FILE_COMPILER_OPTION_SET_TABLE =
+    "file-compiler-option-set-table.db";
+const char *FILE_CONTENT_HASH_TABLE = "file-content-hash-table.db";
+const char *COMPILE_STATISTICS_TABLE = "compile-statistics-table.db";
+
+// The table of the full compiler options of each file, replaced by the
+// deduplicated compiler option sets.
+const char *OBSOLETE_COMPILER_OPTIONS_TABLE = "compiler-options-table.db";
+
+// 64-bit FNV-1a hash.
+guint64 hash(const char *data, int length)
+{
+    guint64 h = G_GUINT64_CONSTANT(14695981039346656037);
+    for (const char *cp = data; cp < data + length; cp++)
+    {
+        h ^= static_cast<unsigned char>(*cp);
+        h *= G_GUINT64_CONSTANT(1099511628211);
+    }
+    return h;
+}
+
+// The size of the buffer for reading files in bulk, which must be a multiple of
+// 1024 bytes.
+const u_int32_t BULK_BUFFER_SIZE = 256 * 1024;
+
+bool visitDecodedFile(const Samoyed::Project &project,
+                      const Samoyed::ProjectDb::Visitor &visitor,
+                      const char *uri,
+                      int uriLength,
+                      const Samoyed::ProjectFile::View &data)
+{
+    Samoyed::ProjectFile *file = data.read(project);
+    if (!file)
+        return true;
+    return visitor(uri,
+                   uriLength,
+                   boost::shared_ptr<Samoyed::ProjectFile>(file));
+}
+
+// Pass the view of the stored data of a file, or an invalid view if visiting
+// the keys only.
+bool visitFileView(const Samoyed::ProjectDb::BulkVisitor &visitor,
+                   bool keysOnly,
+                   const char *uri,
+                   int uriLength,
+                   const char *data,
+                   int dataLength)
+{
+    if (keysOnly)
+        return visitor(uri, uriLength, Samoyed::ProjectFile::View());
+    return visitor(uri, uriLength,
+                   Samoyed::ProjectFile::View(data, dataLength));
+}
+
+int openTable(DB_ENV *dbEnv, DB *&table, const char *name, u_int32_t flags)
+{
+    int code = db_create(&table, dbEnv, 0);
+    if (code)
+        return code;
+    return table->open(table, NULL, name, NULL, DB_BTREE,
+                       flags | TABLE_FLAGS, 0);
+}
+
+}
+
 namespace Samoyed
 {
 
 ProjectDb::ProjectDb(const char *uri):
     m_dbEnv(NULL),
     m_fileTable(NULL),
-    m_compilerOptionsTable(NULL),
+    m_compilerOptionSetTable(NULL),
+    m_fileCompilerOptionSetTable(NULL),
+    m_fileContentHashTable(NULL),
+    m_compileStatisticsTable(NULL),
+    m_trigramIndex(new TrigramIndex(uri)),
     m_dbEnvUri(uri),
     m_fileTableDbUri(uri),
-    m_compilerOptionsTableDbUri(uri)
+    m_compilerOptionSetTableDbUri(uri),
+    m_fileCompilerOptionSetTableDbUri(uri),
+    m_fileContentHashTableDbUri(uri),
+    m_compileStatisticsTableDbUri(uri),
+    m_compilerOptsCacheGeneration(0)
 {
     m_fileTableDbUri += "/file-table.db";
-    m_compilerOptionsTableDbUri += "/compiler-options-table.db";
+    m_compilerOptionSetTableDbUri += '/';
+    m_compilerOptionSetTableDbUri += COMPILER_OPTION_SET_TABLE;
+    m_fileCompilerOptionSetTableDbUri += '/';
+    m_fileCompilerOptionSetTableDbUri += FILE_COMPILER_OPTION_SET_TABLE;
+    m_fileContentHashTableDbUri += '/';
+    m_fileContentHashTableDbUri += FILE_CONTENT_HASH_TABLE;
+    m_compileStatisticsTableDbUri += '/';
+    m_compileStatisticsTableDbUri += COMPILE_STATISTICS_TABLE;
 }
 
 ProjectDb::~ProjectDb()
 {
     if (m_fileTable)
         m_fileTable->close(m_fileTable, 0);
-    if (m_compilerOptionsTable)
-        m_compilerOptionsTable->close(m_compilerOptionsTable, 0);
+    if (m_compilerOptionSetTable)
+        m_compilerOptionSetTable->close(m_compilerOptionSetTable, 0);
+    if (m_fileCompilerOptionSetTable)
+        m_fileCompilerOptionSetTable->close(m_fileCompilerOptionSetTable, 0);
+    if (m_fileContentHashTable)
+        m_fileContentHashTable->close(m_fileContentHashTable, 0);
+    if (m_compileStatisticsTable)
+        m_compileStatisticsTable->close(m_compileStatisticsTable, 0);
+    delete m_trigramIndex;
     if (m_dbEnv)
         m_dbEnv->close(m_dbEnv, 0);
 }
 
-ProjectDb::Error ProjectDb::create()
+void ProjectDb::installPreferences()
 {
-    Error error;
+    PropertyTree &prefs =
+        Application::instance().preferences().addChild(PROJECT_DATABASE);
+    prefs.addChild(CACHE_SIZE, DEFAULT_CACHE_SIZE);
+    prefs.addChild(TRIGRAM_INDEX, false);
+}
 
+bool ProjectDb::trigramIndexEnabled()
+{
+    return Application::instance().preferences().
+        child(PROJECT_DATABASE).get<bool>(TRIGRAM_INDEX);
+}
+
+// Open the transactional environment, which lets the readers proceed
+// concurrently with the writers, and the writers of different pages proceed
+// concurrently.
+ProjectDb::Error ProjectDb::openEnvironment(u_int32_t flags)
+{
+    Error error;
     error.dbUri = m_dbEnvUri.c_str();
     error.code = db_env_create(&m_dbEnv, 0);
     if (error.code)
         return error;
+
+    int cacheSize = Application::instance().preferences().
+        child(PROJECT_DATABASE).get<int>(CACHE_SIZE);
+    if (cacheSize > 0)
+    {
+        error.code = m_dbEnv->set_cachesize(m_dbEnv,
+                                            cacheSize >> 10,
+                                            (cacheSize & 1023) << 20,
+                                            1);
+        if (error.code)
+            return error;
+    }
+
+    // Abort one of the transactions waiting for each other.
+    error.code = m_dbEnv->set_lk_detect(m_dbEnv, DB_LOCK_DEFAULT);
+    if (error.code)
+        return error;
+
+    // Allow batch transactions to lock many pages.
+    error.code = m_dbEnv->set_lk_max_locks(m_dbEnv, MAX_LOCKS);
+    if (error.code)
+        return error;
+    error.code = m_dbEnv->set_lk_max_objects(m_dbEnv, MAX_LOCKS);
+    if (error.code)
+        return error;
+
+    // The updates not in explicit transactions are committed automatically.
+    error.code = m_dbEnv->set_flags(m_dbEnv, DB_AUTO_COMMIT, 1);
+    if (error.code)
+        return error;
+
+    // The database can be rebuilt from the project files, so trade the
+    // durability for the throughput: a commit writes the log buffer without
+    // synchronizing it, and the commits of concurrent transactions are written
+    // together.  The log is flushed at checkpoints.
+    error.code = m_dbEnv->set_flags(m_dbEnv, DB_TXN_WRITE_NOSYNC, 1);
+    if (error.code)
+        return error;
+    error.code = m_dbEnv->log_set_config(m_dbEnv, DB_LOG_AUTO_REMOVE, 1);
+    if (error.code)
+        return error;
+
     char *fileName = g_filename_from_uri(m_dbEnvUri.c_str(), NULL, NULL);
-    error.code = m_dbEnv->open(m_dbEnv, fileName,
-                               DB_INIT_CDB | DB_INIT_MPOOL | DB_CREATE,
-                               0);
+    error.code = m_dbEnv->open(m_dbEnv, fileName, ENV_FLAGS | flags, 0);
     g_free(fileName);
+    return error;
+}
+
+ProjectDb::Error ProjectDb::create()
+{
+    Error error;
+
+    error = openEnvironment(DB_CREATE);
     if (error.code)
         return error;
 
     error.dbUri = m_fileTableDbUri.c_str();
-    error.code = db_create(&m_fileTable, m_dbEnv, 0);
+    error.code = openTable(m_dbEnv, m_fileTable,
+                           "file-table.db",
+                           DB_CREATE | DB_EXCL);
     if (error.code)
         return error;
-    error.code = m_fileTable->open(m_fileTable, NULL,
-                                   "file-table.db", NULL,
-                                   DB_BTREE,
-                                   DB_CREATE | DB_EXCL, 0);
+
+    error.dbUri = m_compilerOptionSetTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_compilerOptionSetTable,
+                           COMPILER_OPTION_SET_TABLE,
+                           DB_CREATE | DB_EXCL);
     if (error.code)
         return error;
 
-    error.dbUri = m_compilerOptionsTableDbUri.c_str();
-    error.code = db_create(&m_compilerOptionsTable, m_dbEnv, 0);
+    error.dbUri = m_fileCompilerOptionSetTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_fileCompilerOptionSetTable,
+                           FILE_COMPILER_OPTION_SET_TABLE,
+                           DB_CREATE | DB_EXCL);
     if (error.code)
         return error;
-    error.code = m_compilerOptionsTable->open(m_compilerOptionsTable,
-                                              NULL,
-                                              "compiler-options-table.db",
-                                              NULL,
-                                              DB_BTREE,
-                                              DB_CREATE | DB_EXCL, 0);
+
+    error.dbUri = m_fileContentHashTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_fileContentHashTable,
+                           FILE_CONTENT_HASH_TABLE,
+                           DB_CREATE | DB_EXCL);
+    if (error.code)
+        return error;
+
+    error.dbUri = m_compileStatisticsTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_compileStatisticsTable,
+                           COMPILE_STATISTICS_TABLE,
+                           DB_CREATE | DB_EXCL);
+    if (error.code)
+        return error;
+
+    error = m_trigramIndex->create(m_dbEnv);
     if (error.code)
         return error;
 
@@ -86,36 +282,55 @@ ProjectDb::Error ProjectDb::open()
 {
     Error error;
 
-    error.dbUri = m_dbEnvUri.c_str();
-    error.code = db_env_create(&m_dbEnv, 0);
+    // Run the recovery in case the application crashed, which also upgrades
+    // the environments created before the transactional data store was used.
+    error = openEnvironment(DB_CREATE | DB_RECOVER);
     if (error.code)
         return error;
-    char *fileName = g_filename_from_uri(m_dbEnvUri.c_str(), NULL, NULL);
-    error.code = m_dbEnv->open(m_dbEnv, fileName,
-                               DB_INIT_CDB | DB_INIT_MPOOL, 0);
-    g_free(fileName);
+
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_fileTable, "file-table.db", 0);
     if (error.code)
         return error;
 
-    error.dbUri = m_fileTableDbUri.c_str();
-    error.code = db_create(&m_fileTable, m_dbEnv, 0);
+    // Projects created before the compiler option sets were deduplicated
+    // have the obsolete compiler options table.  Remove it and create the new
+    // tables.  The compiler options will be collected again.
+    m_dbEnv->dbremove(m_dbEnv, NULL, OBSOLETE_COMPILER_OPTIONS_TABLE, NULL,
+                      DB_AUTO_COMMIT);
+
+    error.dbUri = m_compilerOptionSetTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_compilerOptionSetTable,
+                           COMPILER_OPTION_SET_TABLE,
+                           DB_CREATE);
     if (error.code)
         return error;
-    error.code = m_fileTable->open(m_fileTable, NULL,
-                                   "file-table.db", NULL,
-                                   DB_BTREE, 0, 0);
+
+    error.dbUri = m_fileCompilerOptionSetTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_fileCompilerOptionSetTable,
+                           FILE_COMPILER_OPTION_SET_TABLE,
+                           DB_CREATE);
     if (error.code)
         return error;
 
-    error.dbUri = m_compilerOptionsTableDbUri.c_str();
-    error.code = db_create(&m_compilerOptionsTable, m_dbEnv, 0);
+    // Projects created before the content hashes were recorded lack the
+    // table.  Create it and the content hashes will be recorded on demand.
+    error.dbUri = m_fileContentHashTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_fileContentHashTable,
+                           FILE_CONTENT_HASH_TABLE,
+                           DB_CREATE);
     if (error.code)
         return error;
-    error.code = m_compilerOptionsTable->open(m_compilerOptionsTable,
-                                              NULL,
-                                              "compiler-options-table.db",
-                                              NULL,
-                                              DB_BTREE, 0, 0);
+
+    // Likewise for the compile statistics.
+    error.dbUri = m_compileStatisticsTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_compileStatisticsTable,
+                           COMPILE_STATISTICS_TABLE,
+                           DB_CREATE);
+    if (error.code)
+        return error;
+
+    error = m_trigramIndex->open(m_dbEnv);
     if (error.code)
         return error;
 
@@ -133,17 +348,51 @@ ProjectDb::Error ProjectDb::close()
             return error;
         m_fileTable = NULL;
     }
-    if (m_compilerOptionsTable)
+    if (m_compilerOptionSetTable)
     {
-        error.dbUri = m_compilerOptionsTableDbUri.c_str();
-        error.code = m_compilerOptionsTable->close(m_compilerOptionsTable, 0);
+        error.dbUri = m_compilerOptionSetTableDbUri.c_str();
+        error.code = m_compilerOptionSetTable->close(m_compilerOptionSetTable,
+                                                     0);
         if (error.code)
             return error;
-        m_compilerOptionsTable = NULL;
+        m_compilerOptionSetTable = NULL;
     }
+    if (m_fileCompilerOptionSetTable)
+    {
+        error.dbUri = m_fileCompilerOptionSetTableDbUri.c_str();
+        error.code =
+            m_fileCompilerOptionSetTable->close(m_fileCompilerOptionSetTable,
+                                                0);
+        if (error.code)
+            return error;
+        m_fileCompilerOptionSetTable = NULL;
+    }
+    if (m_fileContentHashTable)
+    {
+        error.dbUri = m_fileContentHashTableDbUri.c_str();
+        error.code = m_fileContentHashTable->close(m_fileContentHashTable, 0);
+        if (error.code)
+            return error;
+        m_fileContentHashTable = NULL;
+    }
+    if (m_compileStatisticsTable)
+    {
+        error.dbUri = m_compileStatisticsTableDbUri.c_str();
+        error.code = m_compileStatisticsTable->close(m_compileStatisticsTable,
+                                                     0);
+        if (error.code)
+            return error;
+        m_compileStatisticsTable = NULL;
+    }
+    error = m_trigramIndex->close();
+    if (error.code)
+        return error;
     if (m_dbEnv)
     {
         error.dbUri = m_dbEnvUri.c_str();
+        error.code = m_dbEnv->txn_checkpoint(m_dbEnv, 0, 0, 0);
+        if (error.code)
+            return error;
         error.code = m_dbEnv->close(m_dbEnv, 0);
         if (error.code)
             return error;
@@ -152,7 +401,106 @@ ProjectDb::Error ProjectDb::close()
     return error;
 }
 
-ProjectDb::Error ProjectDb::addFile(const char *uri, const ProjectFile &data)
+ProjectDb::Error ProjectDb::beginTransaction(DB_TXN *&txn)
+{
+    Error error;
+    error.dbUri = m_dbEnvUri.c_str();
+    error.code = m_dbEnv->txn_begin(m_dbEnv, NULL, &txn, 0);
+    return error;
+}
+
+ProjectDb::Error ProjectDb::commitTransaction(DB_TXN *txn)
+{
+    Error error;
+    error.dbUri = m_dbEnvUri.c_str();
+    error.code = txn->commit(txn, 0);
+    onTransactionEnded(txn, error.code == 0);
+    return error;
+}
+
+ProjectDb::Error ProjectDb::abortTransaction(DB_TXN *txn)
+{
+    Error error;
+    error.dbUri = m_dbEnvUri.c_str();
+    error.code = txn->abort(txn);
+    onTransactionEnded(txn, false);
+    return error;
+}
+
+ProjectDb::Error ProjectDb::runTransaction(const Transaction &transaction)
+{
+    return runTransactionInternally(this, m_dbEnv, m_dbEnvUri.c_str(),
+                                    transaction);
+}
+
+ProjectDb::Error ProjectDb::runTransaction(DB_ENV *dbEnv,
+                                           const char *dbEnvUri,
+                                           const Transaction &transaction)
+{
+    return runTransactionInternally(NULL, dbEnv, dbEnvUri, transaction);
+}
+
+ProjectDb::Error
+ProjectDb::runTransactionInternally(ProjectDb *db,
+                                    DB_ENV *dbEnv,
+                                    const char *dbEnvUri,
+                                    const Transaction &transaction)
+{
+    Error error;
+    for (int attempt = 0; attempt < MAX_TRANSACTION_ATTEMPTS; attempt++)
+    {
+        DB_TXN *txn;
+        error.dbUri = dbEnvUri;
+        error.code = dbEnv->txn_begin(dbEnv, NULL, &txn, 0);
+        if (error.code)
+            break;
+        error = transaction(txn);
+        if (!error.code)
+        {
+            error.dbUri = dbEnvUri;
+            error.code = txn->commit(txn, 0);
+            if (db)
+                db->onTransactionEnded(txn, error.code == 0);
+            break;
+        }
+        txn->abort(txn);
+        if (db)
+            db->onTransactionEnded(txn, false);
+        if (error.code != DB_LOCK_DEADLOCK)
+            break;
+    }
+    return error;
+}
+
+void ProjectDb::onTransactionEnded(DB_TXN *txn, bool committed)
+{
+    boost::mutex::scoped_lock lock(m_compilerOptsCacheMutex);
+    std::pair<std::multimap<DB_TXN *, guint64>::iterator,
+              std::multimap<DB_TXN *, guint64>::iterator> range =
+        m_removedCompilerOptionSets.equal_range(txn);
+    if (committed)
+    {
+        for (std::multimap<DB_TXN *, guint64>::iterator it = range.first;
+             it != range.second;
+             ++it)
+            uncacheCompilerOptions(it->second);
+    }
+    m_removedCompilerOptionSets.erase(range.first, range.second);
+}
+
+// Evict a compiler option set from the cache.  The cache must be locked.
+void ProjectDb::uncacheCompilerOptions(guint64 id)
+{
+    m_compilerOptsCacheGeneration++;
+    CompilerOptionsCache::iterator it = m_compilerOptsCache.find(id);
+    if (it == m_compilerOptsCache.end())
+        return;
+    m_cachedCompilerOptsIds.erase(it->second.position);
+    m_compilerOptsCache.erase(it);
+}
+
+ProjectDb::Error ProjectDb::addFile(const char *uri, const ProjectFile &data,
+                                   DB_TXN *txn)
 {
     Error error;
     boost::shared_array<char> dataMem;
@@ -166,13 +514,39 @@ ProjectDb::Error ProjectDb::addFile(const char *uri, const ProjectFile &data)
     dat.data = dataMem.get();
     dat.size = dataLen;
     error.dbUri = m_fileTableDbUri.c_str();
-    error.code = m_fileTable->put(m_fileTable, NULL,
+    error.code = m_fileTable->put(m_fileTable, txn,
                                   &key, &dat,
                                   DB_NOOVERWRITE);
     return error;
 }
 
-ProjectDb::Error ProjectDb::removeFile(const char *uri)
+ProjectDb::Error ProjectDb::removeFile(const char *uri, DB_TXN *txn)
+{
+    Error error;
+    DBT key;
+    memset(&key, 0, sizeof(DBT));
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = m_fileTable->del(m_fileTable, txn, &key, 0);
+    if (error.code)
+        return error;
+    Error optsError = removeCompilerOptions(uri, txn);
+    if (optsError.code && optsError.code != DB_NOTFOUND)
+        return optsError;
+    Error hashError;
+    hashError.dbUri = m_fileContentHashTableDbUri.c_str();
+    hashError.code = m_fileContentHashTable->del(m_fileContentHashTable, txn,
+                                                 &key, 0);
+    if (hashError.code && hashError.code != DB_NOTFOUND)
+        return hashError;
+    Error indexError = m_trigramIndex->removeFile(uri, txn);
+    if (indexError.code && indexError.code != DB_NOTFOUND)
+        return indexError;
+    return error;
+}
+
+ProjectDb::Error ProjectDb::hasFile(const char *uri, bool &exists)
 {
     Error error;
     DBT key;
@@ -180,7 +554,10 @@ ProjectDb::Error ProjectDb::removeFile(const char *uri)
     key.data = const_cast<char *>(uri);
     key.size = strlen(uri);
     error.dbUri = m_fileTableDbUri.c_str();
-    error.code = m_fileTable->del(m_fileTable, NULL, &key, 0);
+    error.code = m_fileTable->exists(m_fileTable, NULL, &key, 0);
+    exists = !error.code;
+    if (error.code == DB_NOTFOUND)
+        error.code = 0;
     return error;
 }
 
@@ -206,7 +583,8 @@ ProjectDb::Error ProjectDb::readFile(const Project &project,
     return error;
 }
 
-ProjectDb::Error ProjectDb::writeFile(const char *uri, const ProjectFile &data)
+ProjectDb::Error ProjectDb::writeFile(const char *uri, const ProjectFile &data,
+                                     DB_TXN *txn)
 {
     Error error;
     boost::shared_array<char> dataMem;
@@ -220,70 +598,247 @@ ProjectDb::Error ProjectDb::writeFile(const char *uri, const ProjectFile &data)
     dat.data = dataMem.get();
     dat.size = dataLen;
     error.dbUri = m_fileTableDbUri.c_str();
-    error.code = m_fileTable->put(m_fileTable, NULL, &key, &dat, 0);
+    error.code = m_fileTable->put(m_fileTable, txn, &key, &dat, 0);
     return error;
 }
 
 ProjectDb::Error ProjectDb::visitFiles(const Project &project,
                                        const char *uriPrefix,
                                        const Visitor &visitor)
+{
+    return visitFilesInBulk(uriPrefix,
+                            boost::bind(visitDecodedFile,
+                                        boost::cref(project),
+                                        boost::cref(visitor),
+                                        _1, _2, _3));
+}
+
+ProjectDb::Error ProjectDb::visitFilesInBulk(const char *uriPrefix,
+                                             const BulkVisitor &visitor,
+                                             int flags)
 {
     Error error;
-    int uriPrefixLen = strlen(uriPrefix);
-    DBC *cursor;
     error.dbUri = m_fileTableDbUri.c_str();
-    error.code = m_fileTable->cursor(m_fileTable, NULL, &cursor, 0);
+    // Release the read locks once the cursor moves, so that the writers are
+    // not blocked during the visit.
+    error.code = readRecordsInBulk(m_fileTable,
+                                   NULL,
+                                   uriPrefix,
+                                   boost::bind(visitFileView,
+                                               boost::cref(visitor),
+                                               (flags & VISIT_KEYS_ONLY) != 0,
+                                               _1, _2, _3, _4),
+                                   DB_READ_COMMITTED,
+                                   BULK_BUFFER_SIZE);
+    return error;
+}
+
+ProjectDb::Error ProjectDb::readCompilerOptionSetId(const char *uri,
+                                                    DB_TXN *txn,
+                                                    guint64 &id)
+{
+    Error error;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    data.data = &id;
+    data.ulen = sizeof(id);
+    data.flags = DB_DBT_USERMEM;
+    error.dbUri = m_fileCompilerOptionSetTableDbUri.c_str();
+    error.code = m_fileCompilerOptionSetTable->get(m_fileCompilerOptionSetTable,
+                                                   txn, &key, &data,
+                                                   txn ? DB_RMW : 0);
+    return error;
+}
+
+// Find the compiler option set with the given compiler options, or add it
+// with no reference if not found.  The ID of a compiler option set is the hash
+// of its content, and is probed linearly in case of hash collisions.  A
+// removed compiler option set may be left as a tombstone, a record with no
+// reference and no compiler options, to keep the probe sequences through it
+// unbroken.  A new compiler option set takes the first tombstone probed.
+ProjectDb::Error ProjectDb::addCompilerOptionSet(const char *compilerOpts,
+                                                 int compilerOptsLength,
+                                                 DB_TXN *txn,
+                                                 guint64 &id)
+{
+    Error error;
+    error.dbUri = m_compilerOptionSetTableDbUri.c_str();
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = &id;
+    key.size = sizeof(id);
+    data.flags = DB_DBT_REALLOC;
+    bool tombstoneFound = false;
+    guint64 tombstone = 0;
+    for (id = hash(compilerOpts, compilerOptsLength); ; id++)
+    {
+        error.code = m_compilerOptionSetTable->get(m_compilerOptionSetTable,
+                                                   txn, &key, &data,
+                                                   txn ? DB_RMW : 0);
+        if (error.code == DB_NOTFOUND)
+            break;
+        if (error.code)
+        {
+            free(data.data);
+            return error;
+        }
+        if (data.size == sizeof(guint32))
+        {
+            guint32 refCount;
+            memcpy(&refCount, data.data, sizeof(guint32));
+            if (refCount == 0)
+            {
+                if (!tombstoneFound)
+                {
+                    tombstoneFound = true;
+                    tombstone = id;
+                }
+                continue;
+            }
+        }
+        if (data.size == sizeof(guint32) + compilerOptsLength &&
+            memcmp(static_cast<char *>(data.data) + sizeof(guint32),
+                   compilerOpts,
+                   compilerOptsLength) == 0)
+        {
+            free(data.data);
+            return error;
+        }
+    }
+    free(data.data);
+    if (tombstoneFound)
+    {
+        // The options of the removed compiler option set may still be cached,
+        // or be cached by a reader that raced with the removal.
+        id = tombstone;
+        boost::mutex::scoped_lock lock(m_compilerOptsCacheMutex);
+        if (txn)
+            m_removedCompilerOptionSets.insert(std::make_pair(txn, id));
+        else
+            uncacheCompilerOptions(id);
+    }
+
+    char *buffer = static_cast<char *>(malloc(sizeof(guint32) +
+                                              compilerOptsLength));
+    guint32 refCount = 0;
+    memcpy(buffer, &refCount, sizeof(guint32));
+    memcpy(buffer + sizeof(guint32), compilerOpts, compilerOptsLength);
+    memset(&data, 0, sizeof(DBT));
+    data.data = buffer;
+    data.size = sizeof(guint32) + compilerOptsLength;
+    error.code = m_compilerOptionSetTable->put(m_compilerOptionSetTable, txn,
+                                               &key, &data, 0);
+    free(buffer);
+    return error;
+}
+
+ProjectDb::Error
+ProjectDb::readCompilerOptionSet(guint64 id,
+                                 boost::shared_ptr<char> &compilerOpts,
+                                 int &compilerOptsLength)
+{
+    Error error;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = &id;
+    key.size = sizeof(id);
+    data.flags = DB_DBT_MALLOC;
+    error.dbUri = m_compilerOptionSetTableDbUri.c_str();
+    error.code = m_compilerOptionSetTable->get(m_compilerOptionSetTable, NULL,
+                                               &key, &data, 0);
     if (error.code)
         return error;
-    DBT key, dat;
-    ProjectFile *data;
+
+    // A tombstone, which the referring file was moved off concurrently, has
+    // no compiler options.
+    guint32 refCount = 0;
+    if (data.size >= sizeof(guint32))
+        memcpy(&refCount, data.data, sizeof(guint32));
+    if (refCount == 0)
+    {
+        free(data.data);
+        error.code = DB_NOTFOUND;
+        return error;
+    }
+
+    // Skip the reference count.
+    compilerOptsLength = data.size - sizeof(guint32);
+    memmove(data.data,
+            static_cast<char *>(data.data) + sizeof(guint32),
+            compilerOptsLength);
+    compilerOpts.reset(static_cast<char *>(data.data), free);
+    return error;
+}
+
+// Add 'delta' to the reference count of a compiler option set, and remove it
+// if no longer referred to.  The removed compiler option set is left as a
+// tombstone unless it ends its probe sequence, i.e., the next ID is free.  It
+// is evicted from the cache once the removal is committed.
+ProjectDb::Error ProjectDb::referCompilerOptionSet(guint64 id,
+                                                   int delta,
+                                                   DB_TXN *txn)
+{
+    Error error;
+    guint32 refCount;
+    DBT key, data;
     memset(&key, 0, sizeof(DBT));
-    memset(&dat, 0, sizeof(DBT));
-    key.data = const_cast<char *>(uriPrefix);
-    key.size = uriPrefixLen;
-    key.flags = DB_DBT_MALLOC;
-    dat.flags = DB_DBT_MALLOC;
-    error.code = cursor->get(cursor, &key, &dat, DB_SET_RANGE);
-    if (error.code)
-        goto END;
-    if (key.size < uriPrefixLen ||
-        memcmp(uriPrefix, key.data, uriPrefixLen) != 0)
-        goto END;
-    data = ProjectFile::read(project,
-                             static_cast<char *>(dat.data),
-                             dat.size);
-    if (!data)
-        goto END;
-    if (visitor(static_cast<char *>(key.data),
-                key.size,
-                boost::shared_ptr<ProjectFile>(data)))
-        goto END;
-    key.flags = DB_DBT_REALLOC;
-    dat.flags = DB_DBT_REALLOC;
-    for (;;)
+    memset(&data, 0, sizeof(DBT));
+    key.data = &id;
+    key.size = sizeof(id);
+    // Only read and write the reference count.
+    data.data = &refCount;
+    data.ulen = sizeof(refCount);
+    data.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+    data.doff = 0;
+    data.dlen = sizeof(refCount);
+    error.dbUri = m_compilerOptionSetTableDbUri.c_str();
+    error.code = m_compilerOptionSetTable->get(m_compilerOptionSetTable, txn,
+                                               &key, &data,
+                                               txn ? DB_RMW : 0);
+    if (error.code)
+        return error;
+    refCount += delta;
+    if (refCount == 0)
     {
-        error.code = cursor->get(cursor, &key, &dat, DB_NEXT);
+        guint64 nextId = id + 1;
+        DBT nextKey, nextData;
+        memset(&nextKey, 0, sizeof(DBT));
+        memset(&nextData, 0, sizeof(DBT));
+        nextKey.data = &nextId;
+        nextKey.size = sizeof(nextId);
+        nextData.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+        error.code = m_compilerOptionSetTable->get(m_compilerOptionSetTable,
+                                                   txn, &nextKey, &nextData,
+                                                   0);
+        if (error.code == DB_NOTFOUND)
+            error.code = m_compilerOptionSetTable->del(m_compilerOptionSetTable,
+                                                       txn, &key, 0);
+        else if (error.code == 0)
+        {
+            // Replace the whole record with the reference count only.
+            memset(&data, 0, sizeof(DBT));
+            data.data = &refCount;
+            data.size = sizeof(refCount);
+            error.code = m_compilerOptionSetTable->put(m_compilerOptionSetTable,
+                                                       txn, &key, &data, 0);
+        }
         if (error.code)
-            goto END;
-        if (key.size < uriPrefixLen ||
-            memcmp(uriPrefix, key.data, uriPrefixLen) != 0)
-            goto END;
-        data = ProjectFile::read(project,
-                                 static_cast<char *>(dat.data),
-                                 dat.size);
-        if (!data)
-            goto END;
-        if (visitor(static_cast<char *>(key.data),
-                    key.size,
-                    boost::shared_ptr<ProjectFile>(data)))
-            goto END;
+            return error;
+        boost::mutex::scoped_lock lock(m_compilerOptsCacheMutex);
+        if (txn)
+            m_removedCompilerOptionSets.insert(std::make_pair(txn, id));
+        else
+            uncacheCompilerOptions(id);
+        return error;
     }
-
-END:
-    cursor->close(cursor);
-    if (key.data != uriPrefix)
-        free(key.data);
-    free(dat.data);
+    data.size = sizeof(refCount);
+    error.code = m_compilerOptionSetTable->put(m_compilerOptionSetTable, txn,
+                                               &key, &data, 0);
     return error;
 }
 
@@ -292,26 +847,144 @@ ProjectDb::readCompilerOptions(const char *uri,
                                boost::shared_ptr<char> &compilerOpts,
                                int &compilerOptsLength)
 {
-    Error error;
+    guint64 id;
+    Error error = readCompilerOptionSetId(uri, NULL, id);
+    if (error.code)
+        return error;
+    return readCompilerOptionSet(id, compilerOpts, compilerOptsLength);
+}
+
+ProjectDb::Error
+ProjectDb::readCompilerOptions(const char *uri,
+                               boost::shared_ptr<const CompilerOptions> &
+                               compilerOpts)
+{
+    guint64 id;
+    Error error = readCompilerOptionSetId(uri, NULL, id);
+    if (error.code)
+        return error;
+
+    unsigned int generation;
+    {
+        boost::mutex::scoped_lock lock(m_compilerOptsCacheMutex);
+        CompilerOptionsCache::iterator it = m_compilerOptsCache.find(id);
+        if (it != m_compilerOptsCache.end())
+        {
+            m_cachedCompilerOptsIds.splice(m_cachedCompilerOptsIds.begin(),
+                                           m_cachedCompilerOptsIds,
+                                           it->second.position);
+            compilerOpts = it->second.options;
+            return error;
+        }
+        generation = m_compilerOptsCacheGeneration;
+    }
+
+    boost::shared_ptr<CompilerOptions> opts(new CompilerOptions);
+    error = readCompilerOptionSet(id, opts->string, opts->length);
+    if (error.code)
+        return error;
+    const char *opt = opts->string.get();
+    for (const char *cp = opt; cp < opts->string.get() + opts->length; cp++)
+        if (*cp == '\0')
+        {
+            opts->options.push_back(opt);
+            opt = cp + 1;
+        }
+
+    compilerOpts = opts;
+    boost::mutex::scoped_lock lock(m_compilerOptsCacheMutex);
+    if (generation != m_compilerOptsCacheGeneration ||
+        m_compilerOptsCache.find(id) != m_compilerOptsCache.end())
+        return error;
+    m_cachedCompilerOptsIds.push_front(id);
+    CachedCompilerOptions &cached = m_compilerOptsCache[id];
+    cached.options = opts;
+    cached.position = m_cachedCompilerOptsIds.begin();
+    if (m_compilerOptsCache.size() > MAX_CACHED_COMPILER_OPTION_SETS)
+    {
+        m_compilerOptsCache.erase(m_cachedCompilerOptsIds.back());
+        m_cachedCompilerOptsIds.pop_back();
+    }
+    return error;
+}
+
+ProjectDb::Error ProjectDb::writeCompilerOptions(const char *uri,
+                                                 const char *compilerOpts,
+                                                 int compilerOptsLength,
+                                                 DB_TXN *txn)
+{
+    guint64 id, oldId;
+    Error error = addCompilerOptionSet(compilerOpts, compilerOptsLength,
+                                       txn, id);
+    if (error.code)
+        return error;
+    error = readCompilerOptionSetId(uri, txn, oldId);
+    if (error.code == 0 && oldId == id)
+        return error;
+    bool referred = error.code == 0;
+    if (error.code && error.code != DB_NOTFOUND)
+        return error;
+
     DBT key, data;
     memset(&key, 0, sizeof(DBT));
     memset(&data, 0, sizeof(DBT));
     key.data = const_cast<char *>(uri);
     key.size = strlen(uri);
-    data.flags = DB_DBT_MALLOC;
-    error.dbUri = m_compilerOptionsTableDbUri.c_str();
-    error.code = m_compilerOptionsTable->get(m_compilerOptionsTable, NULL,
-                                             &key, &data, 0);
+    data.data = &id;
+    data.size = sizeof(id);
+    error.dbUri = m_fileCompilerOptionSetTableDbUri.c_str();
+    error.code = m_fileCompilerOptionSetTable->put(m_fileCompilerOptionSetTable,
+                                                   txn, &key, &data, 0);
     if (error.code)
         return error;
-    compilerOpts.reset(static_cast<char *>(data.data), free);
-    compilerOptsLength = data.size;
+    error = referCompilerOptionSet(id, 1, txn);
+    if (error.code)
+        return error;
+    if (referred)
+        error = referCompilerOptionSet(oldId, -1, txn);
     return error;
 }
 
-ProjectDb::Error ProjectDb::writeCompilerOptions(const char *uri,
-                                                 const char *compilerOpts,
-                                                 int compilerOptsLength)
+ProjectDb::Error ProjectDb::removeCompilerOptions(const char *uri,
+                                                  DB_TXN *txn)
+{
+    guint64 id;
+    Error error = readCompilerOptionSetId(uri, txn, id);
+    if (error.code)
+        return error;
+    DBT key;
+    memset(&key, 0, sizeof(DBT));
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    error.dbUri = m_fileCompilerOptionSetTableDbUri.c_str();
+    error.code = m_fileCompilerOptionSetTable->del(m_fileCompilerOptionSetTable,
+                                                   txn, &key, 0);
+    if (error.code)
+        return error;
+    return referCompilerOptionSet(id, -1, txn);
+}
+
+
+ProjectDb::Error ProjectDb::readContentHash(const char *uri, guint64 &hash)
+{
+    Error error;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    data.data = &hash;
+    data.ulen = sizeof(hash);
+    data.flags = DB_DBT_USERMEM;
+    error.dbUri = m_fileContentHashTableDbUri.c_str();
+    error.code = m_fileContentHashTable->get(m_fileContentHashTable,
+                                             NULL, &key, &data, 0);
+    return error;
+}
+
+ProjectDb::Error ProjectDb::writeContentHash(const char *uri,
+                                             guint64 hash,
+                                             DB_TXN *txn)
 {
     Error error;
     DBT key, data;
@@ -319,11 +992,58 @@ ProjectDb::Error ProjectDb::writeCompilerOptions(const char *uri,
     memset(&data, 0, sizeof(DBT));
     key.data = const_cast<char *>(uri);
     key.size = strlen(uri);
-    data.data = const_cast<char *>(compilerOpts);
-    data.size = compilerOptsLength;
-    error.dbUri = m_compilerOptionsTableDbUri.c_str();
-    error.code = m_compilerOptionsTable->put(m_compilerOptionsTable, NULL,
-                                             &key, &data, 0);
+    data.data = &hash;
+    data.size = sizeof(hash);
+    error.dbUri = m_fileContentHashTableDbUri.c_str();
+    error.code = m_fileContentHashTable->put(m_fileContentHashTable,
+                                             txn, &key, &data, 0);
+    return error;
+}
+
+ProjectDb::Error
+ProjectDb::readCompileStatistics(const char *configName,
+                                 const char *uri,
+                                 CompileStatistics &stats,
+                                 DB_TXN *txn)
+{
+    Error error;
+    std::string k(configName);
+    k += '\0';
+    k += uri;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = const_cast<char *>(k.data());
+    key.size = k.length();
+    data.data = &stats;
+    data.ulen = sizeof(stats);
+    data.flags = DB_DBT_USERMEM;
+    error.dbUri = m_compileStatisticsTableDbUri.c_str();
+    error.code = m_compileStatisticsTable->get(m_compileStatisticsTable,
+                                               txn, &key, &data, 0);
+    return error;
+}
+
+ProjectDb::Error
+ProjectDb::writeCompileStatistics(const char *configName,
+                                  const char *uri,
+                                  const CompileStatistics &stats,
+                                  DB_TXN *txn)
+{
+    Error error;
+    std::string k(configName);
+    k += '\0';
+    k += uri;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = const_cast<char *>(k.data());
+    key.size = k.length();
+    data.data = const_cast<CompileStatistics *>(&stats);
+    data.size = sizeof(stats);
+    error.dbUri = m_compileStatisticsTableDbUri.c_str();
+    error.code = m_compileStatisticsTable->put(m_compileStatisticsTable,
+                                               txn, &key, &data, 0);
     return error;
 }
 
@@ -4,18 +4,23 @@
 #ifndef SMYD_PROJECT_DB_HPP
 #define SMYD_PROJECT_DB_HPP
 
+#include "project-file.hpp"
 #include <list>
+#include <map>
 #include <string>
+#include <vector>
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glib.h>
 #include <db.h>
 
 namespace Samoyed
 {
 
 class Project;
-class ProjectFile;
+class TrigramIndex;
 
 class ProjectDb: public boost::noncopyable
 {
@@ -27,6 +32,30 @@ public:
         Error(): code(0), dbUri(NULL) {}
     };
 
+    /**
+     * A set of compiler options, split into the individual options.
+     */
+    struct CompilerOptions
+    {
+        boost::shared_ptr<char> string;
+        int length;
+        std::vector<const char *> options;
+    };
+
+    /**
+     * The statistics of the last compilation of a source file in a build with
+     * a configuration.
+     */
+    struct CompileStatistics
+    {
+        // The duration, in microseconds.
+        gint64 duration;
+        // The peak resident set size of the compiler, in kilobytes.
+        gint64 peakMemory;
+        // The exit status of the compiler, or -1 if killed by a signal.
+        gint64 exitStatus;
+    };
+
     ProjectDb(const char *uri);
 
     ~ProjectDb();
@@ -37,15 +66,62 @@ public:
 
     Error close();
 
-    Error addFile(const char *uri, const ProjectFile &data);
+    static void installPreferences();
+
+    /**
+     * Begin a transaction grouping updates that are committed together.  The
+     * returned transaction handle is passed to the updating functions and then
+     * committed by 'commitTransaction()' or aborted by 'abortTransaction()'.
+     * An update not in an explicit transaction is committed automatically.
+     * The transaction must be aborted if any update fails, including failing
+     * with 'DB_LOCK_DEADLOCK', in which case it can be retried.
+     * @param txn The returned transaction handle.
+     */
+    Error beginTransaction(DB_TXN *&txn);
+
+    Error commitTransaction(DB_TXN *txn);
+
+    Error abortTransaction(DB_TXN *txn);
+
+    /**
+     * The body of a transaction, which passes the transaction handle to the
+     * updating functions.  It may be run more than once, so it should reset
+     * whatever it records before updating.
+     */
+    typedef boost::function<Error (DB_TXN *txn)> Transaction;
+
+    /**
+     * Run a transaction, and commit it if the body succeeds or abort it
+     * otherwise.  Retry if the transaction is aborted to resolve a deadlock.
+     * @return The error returned by the body, or the error of beginning or
+     * committing the transaction.
+     */
+    Error runTransaction(const Transaction &transaction);
+
+    /**
+     * Run a transaction in a database environment.
+     */
+    static Error runTransaction(DB_ENV *dbEnv,
+                                const char *dbEnvUri,
+                                const Transaction &transaction);
+
+    Error addFile(const char *uri, const ProjectFile &data,
+                  DB_TXN *txn = NULL);
 
-    Error removeFile(const char *uri);
+    Error removeFile(const char *uri, DB_TXN *txn = NULL);
+
+    /**
+     * Check to see if a file is in the project database, without reading its
+     * data.
+     */
+    Error hasFile(const char *uri, bool &exists);
 
     Error readFile(const Project &project,
                    const char *uri,
                    boost::shared_ptr<ProjectFile> &data);
 
-    Error writeFile(const char *uri, const ProjectFile &data);
+    Error writeFile(const char *uri, const ProjectFile &data,
+                    DB_TXN *txn = NULL);
 
     /**
      * The file visitor callback function.
@@ -67,23 +143,176 @@ public:
                      const char *uriPrefix,
                      const Visitor &visitor);
 
+    enum VisitFlag
+    {
+        /**
+         * Do not pass the data of the visited files to the visitor.
+         */
+        VISIT_KEYS_ONLY = 1
+    };
+
+    /**
+     * The bulk file visitor callback function.
+     * @param uri The URI of the visited file, not terminated with '\0'.
+     * @param uriLength The length of the URI of the visited file.
+     * @param data The view of the stored data of the visited file, which is
+     * invalid when visiting the keys only.  The URI and the view are valid
+     * during the call only.
+     * @return True to stop visiting the left files.
+     */
+    typedef boost::function<bool (const char *uri,
+                                  int uriLength,
+                                  const ProjectFile::View &data)>
+        BulkVisitor;
+
+    /**
+     * Visit all files whose URI's have the common prefix.  The files are read
+     * in bulk into a buffer reused for the whole visit, and the visitor views
+     * them in place, without allocating memory for each file.
+     * @param uriPrefix The common URI prefix.
+     * @param visitor The visitor callback function.
+     * @param flags The bitwise OR of the visit flags.
+     */
+    Error visitFilesInBulk(const char *uriPrefix,
+                           const BulkVisitor &visitor,
+                           int flags = 0);
+
     Error readCompilerOptions(const char *uri,
                               boost::shared_ptr<char> &compilerOpts,
                               int &compilerOptsLength);
 
+    /**
+     * Read the compiler options of a file.  The split compiler option sets are
+     * cached and shared by all the files compiled with the same options.
+     */
+    Error readCompilerOptions(const char *uri,
+                              boost::shared_ptr<const CompilerOptions> &
+                              compilerOpts);
+
+    /**
+     * Set the compiler options of a file.  Files with the same compiler
+     * options refer to one shared compiler option set, which is removed when
+     * no longer referred to.
+     */
     Error writeCompilerOptions(const char *uri,
                                const char *compilerOpts,
-                               int compilerOptsLength);
+                               int compilerOptsLength,
+                               DB_TXN *txn = NULL);
+
+    Error removeCompilerOptions(const char *uri, DB_TXN *txn = NULL);
+
+    /**
+     * Read the hash of the contents of a file when it was last loaded, saved
+     * or parsed, which is used to tell whether the file is really changed
+     * when its modified time is changed.
+     */
+    Error readContentHash(const char *uri, guint64 &hash);
+
+    Error writeContentHash(const char *uri, guint64 hash, DB_TXN *txn = NULL);
+
+    /**
+     * Read the statistics of the last compilation of a file in a build with a
+     * configuration, which are compared with those of the next compilation to
+     * find regressions.
+     */
+    Error readCompileStatistics(const char *configName,
+                                const char *uri,
+                                CompileStatistics &stats,
+                                DB_TXN *txn = NULL);
+
+    Error writeCompileStatistics(const char *configName,
+                                 const char *uri,
+                                 const CompileStatistics &stats,
+                                 DB_TXN *txn = NULL);
+
+    /**
+     * @return The trigram index of the file contents, which is kept up to date
+     * by the project if enabled.
+     */
+    TrigramIndex &trigramIndex() { return *m_trigramIndex; }
+
+    /**
+     * @return True iff the project file contents are indexed by trigrams.
+     */
+    static bool trigramIndexEnabled();
 
 private:
+    struct CachedCompilerOptions
+    {
+        boost::shared_ptr<const CompilerOptions> options;
+        // The position in the list of the cached IDs, from the most recently
+        // used one.
+        std::list<guint64>::iterator position;
+    };
+
+    typedef std::map<guint64, CachedCompilerOptions> CompilerOptionsCache;
+
+    static Error runTransactionInternally(ProjectDb *db,
+                                          DB_ENV *dbEnv,
+                                          const char *dbEnvUri,
+                                          const Transaction &transaction);
+
+    /**
+     * Called after a transaction is committed or aborted, to evict the
+     * compiler option sets removed by it from the cache if committed.
+     */
+    void onTransactionEnded(DB_TXN *txn, bool committed);
+
+    void uncacheCompilerOptions(guint64 id);
+
+    Error openEnvironment(u_int32_t flags);
+
+    Error readCompilerOptionSetId(const char *uri, DB_TXN *txn, guint64 &id);
+
+    Error addCompilerOptionSet(const char *compilerOpts,
+                               int compilerOptsLength,
+                               DB_TXN *txn,
+                               guint64 &id);
+
+    Error readCompilerOptionSet(guint64 id,
+                                boost::shared_ptr<char> &compilerOpts,
+                                int &compilerOptsLength);
+
+    Error referCompilerOptionSet(guint64 id, int delta, DB_TXN *txn);
+
     DB_ENV *m_dbEnv;
 
     DB *m_fileTable;
-    DB *m_compilerOptionsTable;
+
+    // The compiler option sets keyed by the hashes of their contents.  Each
+    // record consists of a 32-bit reference count and the compiler options.
+    DB *m_compilerOptionSetTable;
+
+    // The IDs of the compiler option sets of files keyed by the file URIs.
+    DB *m_fileCompilerOptionSetTable;
+
+    // The content hashes of files keyed by the file URIs.
+    DB *m_fileContentHashTable;
+
+    // The compile statistics of files keyed by the configuration names and the
+    // file URIs, separated by NUL.
+    DB *m_compileStatisticsTable;
+
+    TrigramIndex *m_trigramIndex;
 
     std::string m_dbEnvUri;
     std::string m_fileTableDbUri;
-    std::string m_compilerOptionsTableDbUri;
+    std::string m_compilerOptionSetTableDbUri;
+    std::string m_fileCompilerOptionSetTableDbUri;
+    std::string m_fileContentHashTableDbUri;
+    std::string m_compileStatisticsTableDbUri;
+
+    CompilerOptionsCache m_compilerOptsCache;
+    std::list<guint64> m_cachedCompilerOptsIds;
+
+    // Incremented whenever a cached compiler option set is evicted, so that a
+    // compiler option set read before it is removed isn't cached after.
+    unsigned int m_compilerOptsCacheGeneration;
+
+    // The compiler option sets removed by the uncommitted transactions.
+    std::multimap<DB_TXN *, guint64> m_removedCompilerOptionSets;
+
+    boost::mutex m_compilerOptsCacheMutex;
 };
 
 }
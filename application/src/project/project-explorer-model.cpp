@@ -6,10 +6,20 @@
 #endif
 #include "project-explorer-model.hpp"
 #include "project.hpp"
+#include "project-db.hpp"
+#include "project-file.hpp"
+#include "utilities/abort-flag.hpp"
+#include "utilities/worker.hpp"
 #include "application.hpp"
 #include <string.h>
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <map>
 #include <string>
+#include <vector>
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
@@ -31,18 +41,159 @@ const char *ICON_NAMES[Samoyed::ProjectExplorerModel::N_TYPES] =
     ""
 };
 
+// The number of children inserted into the tree store in one idle callback.
+const size_t INSERTION_BATCH_SIZE = 256;
+
+bool isDirectoryType(int type)
+{
+    return type == Samoyed::ProjectExplorerModel::TYPE_PROJECT ||
+        type == Samoyed::ProjectExplorerModel::TYPE_DIRECTORY;
+}
+
+// Directories go before files.  Otherwise, sort by names.
+int compareChildren(int type1, const char *name1, int type2, const char *name2)
+{
+    bool dir1 = isDirectoryType(type1), dir2 = isDirectoryType(type2);
+    if (dir1 != dir2)
+        return dir1 ? -1 : 1;
+    return strcmp(name1, name2);
+}
+
 }
 
 namespace Samoyed
 {
 
-ProjectExplorerModel::ProjectExplorerModel()
+/**
+ * A loader lists the children of a directory from the project database.
+ */
+class ProjectExplorerModel::Loader: public Worker
+{
+public:
+    Loader(Scheduler &scheduler,
+           unsigned int priority,
+           Project &project,
+           const char *uri,
+           GtkTreeRowReference *row):
+        Worker(scheduler, priority),
+        m_project(project),
+        m_uri(uri),
+        m_row(row)
+    {
+        char *desc = g_strdup_printf(_("Loading directory \"%s\"."), uri);
+        setDescription(desc);
+        g_free(desc);
+    }
+
+    Project &project() { return m_project; }
+
+    const char *uri() const { return m_uri.c_str(); }
+
+    GtkTreeRowReference *row() const { return m_row; }
+
+    std::vector<Child> &children() { return m_children; }
+
+    /**
+     * Stop scanning the project database and wait until the scan stops.
+     */
+    void abort() { m_abortFlag.abort(); }
+
+protected:
+    virtual bool step();
+
+private:
+    bool visit(const char *uri,
+               int uriLength,
+               const ProjectFile::View &data);
+
+    static bool compare(const Child &child1, const Child &child2)
+    {
+        return compareChildren(child1.type, child1.name.c_str(),
+                               child2.type, child2.name.c_str()) < 0;
+    }
+
+    Project &m_project;
+    const std::string m_uri;
+    GtkTreeRowReference *m_row;
+
+    std::vector<Child> m_children;
+    int m_prefixLength;
+    int m_numVisited;
+
+    AbortFlag m_abortFlag;
+};
+
+bool ProjectExplorerModel::Loader::step()
+{
+    AbortFlag::Scope scope(m_abortFlag);
+    if (m_abortFlag.aborted())
+        return true;
+    std::string prefix(m_uri);
+    prefix += '/';
+    m_prefixLength = prefix.length();
+    m_numVisited = 0;
+    m_project.db().visitFilesInBulk(prefix.c_str(),
+                                    boost::bind(visit, this, _1, _2, _3));
+    std::sort(m_children.begin(), m_children.end(), compare);
+    return true;
+}
+
+bool ProjectExplorerModel::Loader::visit(const char *uri,
+                                         int uriLength,
+                                         const ProjectFile::View &data)
+{
+    if ((++m_numVisited & 255) == 0 && m_abortFlag.aborted())
+        return true;
+
+    // The descendants of a child directory are contiguous in the project
+    // database.  Add the child directory for the first one only.
+    const char *name = uri + m_prefixLength;
+    const char *end = uri + uriLength;
+    const char *slash =
+        static_cast<const char *>(memchr(name, '/', end - name));
+    if (slash)
+    {
+        if (!m_children.empty() &&
+            m_children.back().type == TYPE_DIRECTORY &&
+            m_children.back().name.length() ==
+            static_cast<std::string::size_type>(slash - name) &&
+            m_children.back().name.compare(0, slash - name,
+                                           name, slash - name) == 0)
+            return false;
+        m_children.push_back(Child());
+        m_children.back().name.assign(name, slash - name);
+        m_children.back().type = TYPE_DIRECTORY;
+    }
+    else
+    {
+        if (!m_children.empty() &&
+            m_children.back().type == TYPE_DIRECTORY &&
+            m_children.back().name.length() ==
+            static_cast<std::string::size_type>(end - name) &&
+            m_children.back().name.compare(0, end - name,
+                                           name, end - name) == 0)
+            return false;
+        int type = data.type();
+        if (type < 0)
+            return false;
+        m_children.push_back(Child());
+        m_children.back().name.assign(name, end - name);
+        // The project file types are in the same order as the model types
+        // following the project type.
+        m_children.back().type = type + TYPE_DIRECTORY;
+    }
+    return false;
+}
+
+ProjectExplorerModel::ProjectExplorerModel():
+    m_insertionId(0)
 {
     m_store = gtk_tree_store_new(N_COLUMNS,
                                  G_TYPE_STRING,
                                  G_TYPE_STRING,
                                  G_TYPE_INT,
-                                 G_TYPE_INT);
+                                 G_TYPE_INT,
+                                 G_TYPE_STRING);
 
     // Load the existing projects.
     for (Project *project = Application::instance().projects();
@@ -64,62 +215,127 @@ ProjectExplorerModel::~ProjectExplorerModel()
 
     m_openedConn.disconnect();
 
+    for (std::list<LoaderInfo>::iterator it2 = m_loaders.begin();
+         it2 != m_loaders.end();
+         ++it2)
+    {
+        it2->loader->abort();
+        it2->finishedConn.disconnect();
+        it2->canceledConn.disconnect();
+        gtk_tree_row_reference_free(it2->loader->row());
+    }
+
+    if (m_insertionId)
+        g_source_remove(m_insertionId);
+
     g_object_unref(m_store);
 }
 
+// Replace the children of a row with a dummy child, which lets the row be
+// expanded.
+void ProjectExplorerModel::setChildren(GtkTreeIter *parent,
+                                       const char *dummyName)
+{
+    GtkTreeIter it;
+    while (gtk_tree_model_iter_children(GTK_TREE_MODEL(m_store), &it, parent))
+        gtk_tree_store_remove(m_store, &it);
+    gtk_tree_store_append(m_store, &it, parent);
+    gtk_tree_store_set(m_store, &it,
+                       NAME_COLUMN, dummyName,
+                       ICON_COLUMN, ICON_NAMES[TYPE_DUMMY],
+                       TYPE_COLUMN, TYPE_DUMMY,
+                       FLAGS_COLUMN, 0,
+                       URI_COLUMN, NULL,
+                       -1);
+}
+
+// Forget the loaded descendants of a row, including itself, and release its
+// children.
+void ProjectExplorerModel::releaseChildren(GtkTreeIter *parent,
+                                           const char *uri)
+{
+    std::string prefix(uri);
+    prefix += '/';
+    LoadedRowTable::iterator it = m_loadedRows.find(uri);
+    if (it != m_loadedRows.end())
+    {
+        gtk_tree_row_reference_free(it->second);
+        m_loadedRows.erase(it);
+    }
+    it = m_loadedRows.lower_bound(prefix);
+    while (it != m_loadedRows.end() &&
+           it->first.compare(0, prefix.length(), prefix) == 0)
+    {
+        gtk_tree_row_reference_free(it->second);
+        m_loadedRows.erase(it++);
+    }
+
+    for (std::deque<Insertion>::iterator it2 = m_insertions.begin();
+         it2 != m_insertions.end();)
+    {
+        if (it2->uri == uri ||
+            it2->uri.compare(0, prefix.length(), prefix) == 0)
+            it2 = m_insertions.erase(it2);
+        else
+            ++it2;
+    }
+
+    if (parent)
+    {
+        setChildren(parent, _("(Empty)"));
+        gtk_tree_store_set(m_store, parent, FLAGS_COLUMN, 0, -1);
+    }
+}
+
+bool ProjectExplorerModel::findLoadedRow(const char *uri, GtkTreeIter *iter)
+{
+    LoadedRowTable::iterator it = m_loadedRows.find(uri);
+    if (it == m_loadedRows.end())
+        return false;
+    GtkTreePath *path = gtk_tree_row_reference_get_path(it->second);
+    if (!path)
+        return false;
+    bool found = gtk_tree_model_get_iter(GTK_TREE_MODEL(m_store), iter, path);
+    gtk_tree_path_free(path);
+    return found;
+}
+
 void ProjectExplorerModel::onProjectOpened(Project &project)
 {
     char *projFileName = g_filename_from_uri(project.uri(), NULL, NULL);
     char *projBaseName = g_path_get_basename(projFileName);
     std::string name = projBaseName;
     name += " (";
-    int len = name.length();
     name += project.uri();
     name += ")";
     g_free(projFileName);
     g_free(projBaseName);
 
+    // Insert the project row at the sorted position.
+    ProjectRowTable::iterator pos = m_projectRows.insert(
+        std::make_pair(name, static_cast<GtkTreeRowReference *>(NULL))).first;
     GtkTreeIter it;
-    bool added = false;
-    if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(m_store), &it))
-    {
-        do
-        {
-            char *nm;
-            gtk_tree_model_get(GTK_TREE_MODEL(m_store), &it,
-                               NAME_COLUMN, &nm, -1);
-            int cmp = strncmp(nm, name.c_str(), len);
-            if (cmp == 0)
-                cmp = strcmp(nm, name.c_str());
-            g_free(nm);
-            if (cmp > 0)
-            {
-                GtkTreeIter sibling(it);
-                gtk_tree_store_insert_before(m_store, &it, NULL, &sibling);
-                added = true;
-                break;
-            }
-        }
-        while (gtk_tree_model_iter_next(GTK_TREE_MODEL(m_store), &it));
-    }
-    if (!added)
-        gtk_tree_store_prepend(m_store, &it, NULL);
+    gtk_tree_store_insert(m_store, &it, NULL,
+                          std::distance(m_projectRows.begin(), pos));
+    char *markup = g_markup_escape_text(name.c_str(), -1);
     gtk_tree_store_set(m_store, &it,
-                       NAME_COLUMN, name.c_str(),
+                       NAME_COLUMN, markup,
                        ICON_COLUMN, ICON_NAMES[TYPE_PROJECT],
                        TYPE_COLUMN, TYPE_PROJECT,
                        FLAGS_COLUMN, 0,
+                       URI_COLUMN, project.uri(),
                        -1);
-    GtkTreeIter projIter(it);
-    gtk_tree_store_append(m_store, &it, &projIter);
-    gtk_tree_store_set(m_store, &it,
-                       NAME_COLUMN, _("(Empty)"),
-                       ICON_COLUMN, ICON_NAMES[TYPE_DUMMY],
-                       TYPE_COLUMN, TYPE_DUMMY,
-                       FLAGS_COLUMN, 0,
-                       -1);
+    g_free(markup);
+    GtkTreePath *path =
+        gtk_tree_model_get_path(GTK_TREE_MODEL(m_store), &it);
+    pos->second = gtk_tree_row_reference_new(GTK_TREE_MODEL(m_store), path);
+    gtk_tree_path_free(path);
+    setChildren(&it, _("(Empty)"));
 
     Connections conns;
+    conns.closing = project.addClosingCallback(boost::bind(onProjectClosing,
+                                                           this,
+                                                           _1));
     conns.closed = project.addClosedCallback(boost::bind(onProjectClosed,
                                                          this,
                                                          _1));
@@ -134,61 +350,394 @@ void ProjectExplorerModel::onProjectOpened(Project &project)
                                                    this,
                                                    _1,
                                                    _2));
+    conns.filesAdded =
+        project.addFilesAddedCallback(boost::bind(onProjectFilesAdded,
+                                                  this,
+                                                  _1,
+                                                  _2,
+                                                  _3));
+    conns.filesRemoved =
+        project.addFilesRemovedCallback(boost::bind(onProjectFilesRemoved,
+                                                    this,
+                                                    _1,
+                                                    _2));
     m_projConnsTable[project.uri()] = conns;
 }
 
-void ProjectExplorerModel::onProjectClosed(Project &project)
+void ProjectExplorerModel::onProjectClosing(Project &project)
 {
-    char *projFileName = g_filename_from_uri(project.uri(), NULL, NULL);
-    char *projBaseName = g_path_get_basename(projFileName);
-    std::string name = projBaseName;
-    name += " (";
-    name += project.uri();
-    name += ")";
-    g_free(projFileName);
-    g_free(projBaseName);
+    // Stop the loaders using the project database before it is closed.
+    for (std::list<LoaderInfo>::iterator it = m_loaders.begin();
+         it != m_loaders.end();
+         ++it)
+        if (&it->loader->project() == &project)
+            it->loader->abort();
+}
 
-    GtkTreeIter it;
-    bool added = false;
-    if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(m_store), &it))
+void ProjectExplorerModel::onProjectClosed(Project &project)
+{
+    for (ProjectRowTable::iterator it = m_projectRows.begin();
+         it != m_projectRows.end();
+         ++it)
     {
-        do
+        GtkTreePath *path = gtk_tree_row_reference_get_path(it->second);
+        GtkTreeIter iter;
+        if (path &&
+            gtk_tree_model_get_iter(GTK_TREE_MODEL(m_store), &iter, path))
         {
-            char *nm;
-            gtk_tree_model_get(GTK_TREE_MODEL(m_store), &it,
-                               NAME_COLUMN, &nm, -1);
-            int cmp = strcmp(nm, name.c_str());
-            g_free(nm);
-            if (cmp == 0)
+            char *uri;
+            gtk_tree_model_get(GTK_TREE_MODEL(m_store), &iter,
+                               URI_COLUMN, &uri, -1);
+            bool found = strcmp(uri, project.uri()) == 0;
+            g_free(uri);
+            if (found)
             {
-                gtk_tree_store_remove(m_store, &it);
+                gtk_tree_path_free(path);
+                releaseChildren(NULL, project.uri());
+                gtk_tree_store_remove(m_store, &iter);
+                gtk_tree_row_reference_free(it->second);
+                m_projectRows.erase(it);
                 break;
             }
         }
-        while (gtk_tree_model_iter_next(GTK_TREE_MODEL(m_store), &it));
+        if (path)
+            gtk_tree_path_free(path);
     }
 
     ProjectConnectionsTable::iterator it2;
     it2 = m_projConnsTable.find(project.uri());
+    it2->second.closing.disconnect();
     it2->second.closed.disconnect();
     it2->second.fileAdded.disconnect();
     it2->second.fileRemoved.disconnect();
+    it2->second.filesAdded.disconnect();
+    it2->second.filesRemoved.disconnect();
     m_projConnsTable.erase(it2);
 }
 
+// Add a file to the loaded rows, if its parent or one of its ancestors is
+// loaded.
+void ProjectExplorerModel::addFile(const char *uri, int type)
+{
+    // Find the nearest loaded ancestor.
+    std::string dirUri(uri);
+    GtkTreeIter parent;
+    for (;;)
+    {
+        std::string::size_type slash = dirUri.rfind('/');
+        if (slash == std::string::npos)
+            return;
+        dirUri.resize(slash);
+        if (findLoadedRow(dirUri.c_str(), &parent))
+            break;
+    }
+
+    // The child of the loaded ancestor may be the file itself or a directory
+    // containing it.
+    const char *name = uri + dirUri.length() + 1;
+    const char *slash = strchr(name, '/');
+    std::string childUri(uri, slash ? slash - uri : strlen(uri));
+    if (slash)
+        type = TYPE_DIRECTORY;
+
+    GtkTreeIter it, dummy;
+    bool hasDummy = false, hasSibling = false;
+    if (gtk_tree_model_iter_children(GTK_TREE_MODEL(m_store), &it, &parent))
+    {
+        do
+        {
+            char *u;
+            int t;
+            gtk_tree_model_get(GTK_TREE_MODEL(m_store), &it,
+                               TYPE_COLUMN, &t,
+                               URI_COLUMN, &u,
+                               -1);
+            if (t == TYPE_DUMMY)
+            {
+                dummy = it;
+                hasDummy = true;
+                g_free(u);
+                continue;
+            }
+            int cmp = compareChildren(t, u, type, childUri.c_str());
+            g_free(u);
+            if (cmp == 0)
+                return;
+            if (cmp > 0)
+            {
+                hasSibling = true;
+                break;
+            }
+        }
+        while (gtk_tree_model_iter_next(GTK_TREE_MODEL(m_store), &it));
+    }
+
+    GtkTreeIter child;
+    if (hasSibling)
+        gtk_tree_store_insert_before(m_store, &child, &parent, &it);
+    else
+        gtk_tree_store_append(m_store, &child, &parent);
+    char *markup = g_markup_escape_text(name, childUri.length() -
+                                              dirUri.length() - 1);
+    gtk_tree_store_set(m_store, &child,
+                       NAME_COLUMN, markup,
+                       ICON_COLUMN, ICON_NAMES[type],
+                       TYPE_COLUMN, type,
+                       FLAGS_COLUMN, 0,
+                       URI_COLUMN, childUri.c_str(),
+                       -1);
+    g_free(markup);
+    if (type == TYPE_DIRECTORY)
+        setChildren(&child, _("(Empty)"));
+    if (hasDummy)
+        gtk_tree_store_remove(m_store, &dummy);
+}
+
 void ProjectExplorerModel::onProjectFileAdded(Project &project,
                                               const char *uri,
                                               const ProjectFile &data)
 {
+    addFile(uri, data.type() + TYPE_DIRECTORY);
 }
 
 void ProjectExplorerModel::onProjectFileRemoved(Project &project,
                                                 const char *uri)
 {
+    std::string dirUri(uri);
+    std::string::size_type slash = dirUri.rfind('/');
+    if (slash == std::string::npos)
+        return;
+    dirUri.resize(slash);
+    GtkTreeIter parent, it;
+    if (!findLoadedRow(dirUri.c_str(), &parent))
+        return;
+    if (!gtk_tree_model_iter_children(GTK_TREE_MODEL(m_store), &it, &parent))
+        return;
+    do
+    {
+        char *u;
+        gtk_tree_model_get(GTK_TREE_MODEL(m_store), &it, URI_COLUMN, &u, -1);
+        bool found = u && strcmp(u, uri) == 0;
+        g_free(u);
+        if (found)
+        {
+            releaseChildren(NULL, uri);
+            gtk_tree_store_remove(m_store, &it);
+            if (!gtk_tree_model_iter_has_child(GTK_TREE_MODEL(m_store),
+                                               &parent))
+                setChildren(&parent, _("(Empty)"));
+            break;
+        }
+    }
+    while (gtk_tree_model_iter_next(GTK_TREE_MODEL(m_store), &it));
+}
+
+void ProjectExplorerModel::onProjectFilesAdded(
+    Project &project,
+    const std::vector<const char *> &uris,
+    const std::vector<const ProjectFile *> &data)
+{
+    // Files added into collapsed directories cost nothing.
+    if (m_loadedRows.empty())
+        return;
+    for (std::vector<const char *>::size_type i = 0; i < uris.size(); i++)
+        addFile(uris[i], data[i]->type() + TYPE_DIRECTORY);
+}
+
+void ProjectExplorerModel::onProjectFilesRemoved(
+    Project &project,
+    const std::vector<const char *> &uris)
+{
+    if (m_loadedRows.empty())
+        return;
+    for (std::vector<const char *>::size_type i = 0; i < uris.size(); i++)
+        onProjectFileRemoved(project, uris[i]);
 }
 
 void ProjectExplorerModel::onRowExpanded(GtkTreeIter *iter)
 {
+    int type, flags;
+    char *uri;
+    gtk_tree_model_get(GTK_TREE_MODEL(m_store), iter,
+                       TYPE_COLUMN, &type,
+                       FLAGS_COLUMN, &flags,
+                       URI_COLUMN, &uri,
+                       -1);
+    if (!isDirectoryType(type) || (flags & (FLAG_IS_LOADED | FLAG_IS_LOADING)))
+    {
+        g_free(uri);
+        return;
+    }
+
+    // Find the project.
+    GtkTreeIter projIter(*iter), it;
+    while (gtk_tree_model_iter_parent(GTK_TREE_MODEL(m_store), &it, &projIter))
+        projIter = it;
+    char *projUri;
+    gtk_tree_model_get(GTK_TREE_MODEL(m_store), &projIter,
+                       URI_COLUMN, &projUri, -1);
+    Project *project = Application::instance().findProject(projUri);
+    g_free(projUri);
+    if (!project || project->closing())
+    {
+        g_free(uri);
+        return;
+    }
+
+    gtk_tree_store_set(m_store, iter, FLAGS_COLUMN, FLAG_IS_LOADING, -1);
+    if (gtk_tree_model_iter_children(GTK_TREE_MODEL(m_store), &it, iter))
+        gtk_tree_store_set(m_store, &it, NAME_COLUMN, _("Loading..."), -1);
+
+    GtkTreePath *path = gtk_tree_model_get_path(GTK_TREE_MODEL(m_store), iter);
+    boost::shared_ptr<Loader> loader(
+        new Loader(Application::instance().scheduler(),
+                   Worker::PRIORITY_FOREGROUND,
+                   *project,
+                   uri,
+                   gtk_tree_row_reference_new(GTK_TREE_MODEL(m_store), path)));
+    gtk_tree_path_free(path);
+    g_free(uri);
+    m_loaders.push_back(LoaderInfo());
+    LoaderInfo &info = m_loaders.back();
+    info.loader = loader;
+    info.finishedConn = loader->addFinishedCallbackInMainThread(
+        boost::bind(onLoaderFinished, this, _1));
+    info.canceledConn = loader->addCanceledCallbackInMainThread(
+        boost::bind(onLoaderCanceled, this, _1));
+    loader->submit(loader);
+}
+
+void ProjectExplorerModel::onRowCollapsed(GtkTreeIter *iter)
+{
+    int type;
+    char *uri;
+    gtk_tree_model_get(GTK_TREE_MODEL(m_store), iter,
+                       TYPE_COLUMN, &type,
+                       URI_COLUMN, &uri,
+                       -1);
+    if (isDirectoryType(type))
+        releaseChildren(iter, uri);
+    g_free(uri);
+}
+
+void ProjectExplorerModel::onLoaderFinished(
+    const boost::shared_ptr<Worker> &worker)
+{
+    boost::shared_ptr<Loader> loader;
+    for (std::list<LoaderInfo>::iterator it = m_loaders.begin();
+         it != m_loaders.end();
+         ++it)
+        if (it->loader == worker)
+        {
+            loader = it->loader;
+            m_loaders.erase(it);
+            break;
+        }
+    if (!loader)
+        return;
+
+    // Discard the result if the row was removed or collapsed.
+    GtkTreePath *path = gtk_tree_row_reference_get_path(loader->row());
+    GtkTreeIter iter;
+    int flags = 0;
+    if (path &&
+        gtk_tree_model_get_iter(GTK_TREE_MODEL(m_store), &iter, path))
+        gtk_tree_model_get(GTK_TREE_MODEL(m_store), &iter,
+                           FLAGS_COLUMN, &flags, -1);
+    if (path)
+        gtk_tree_path_free(path);
+    if (!(flags & FLAG_IS_LOADING))
+    {
+        gtk_tree_row_reference_free(loader->row());
+        return;
+    }
+
+    gtk_tree_store_set(m_store, &iter, FLAGS_COLUMN, FLAG_IS_LOADED, -1);
+    m_loadedRows[loader->uri()] = loader->row();
+    if (loader->children().empty())
+    {
+        GtkTreeIter dummy;
+        if (gtk_tree_model_iter_children(GTK_TREE_MODEL(m_store),
+                                         &dummy, &iter))
+            gtk_tree_store_set(m_store, &dummy,
+                               NAME_COLUMN, _("(Empty)"), -1);
+        return;
+    }
+
+    // Insert the children in batches in idle time.
+    m_insertions.push_back(Insertion());
+    m_insertions.back().uri = loader->uri();
+    m_insertions.back().children.swap(loader->children());
+    m_insertions.back().next = 0;
+    if (!m_insertionId)
+        m_insertionId = g_idle_add(insertChildren, this);
+}
+
+void ProjectExplorerModel::onLoaderCanceled(
+    const boost::shared_ptr<Worker> &worker)
+{
+    for (std::list<LoaderInfo>::iterator it = m_loaders.begin();
+         it != m_loaders.end();
+         ++it)
+        if (it->loader == worker)
+        {
+            gtk_tree_row_reference_free(it->loader->row());
+            m_loaders.erase(it);
+            break;
+        }
+}
+
+gboolean ProjectExplorerModel::insertChildren(gpointer model)
+{
+    ProjectExplorerModel *m = static_cast<ProjectExplorerModel *>(model);
+    while (!m->m_insertions.empty())
+    {
+        Insertion &insertion = m->m_insertions.front();
+        GtkTreeIter parent;
+        if (!m->findLoadedRow(insertion.uri.c_str(), &parent))
+        {
+            m->m_insertions.pop_front();
+            continue;
+        }
+
+        // Keep the dummy child until the first batch is inserted so that the
+        // expanded row is not collapsed.
+        GtkTreeIter dummy;
+        bool first = insertion.next == 0 &&
+            gtk_tree_model_iter_children(GTK_TREE_MODEL(m->m_store),
+                                         &dummy, &parent);
+
+        std::string uri;
+        size_t end = std::min(insertion.next + INSERTION_BATCH_SIZE,
+                              insertion.children.size());
+        for (; insertion.next < end; insertion.next++)
+        {
+            const Child &child = insertion.children[insertion.next];
+            uri = insertion.uri;
+            uri += '/';
+            uri += child.name;
+            char *markup = g_markup_escape_text(child.name.c_str(), -1);
+            GtkTreeIter it;
+            gtk_tree_store_insert_with_values(m->m_store, &it, &parent, -1,
+                                              NAME_COLUMN, markup,
+                                              ICON_COLUMN,
+                                              ICON_NAMES[child.type],
+                                              TYPE_COLUMN, child.type,
+                                              FLAGS_COLUMN, 0,
+                                              URI_COLUMN, uri.c_str(),
+                                              -1);
+            g_free(markup);
+            if (child.type == TYPE_DIRECTORY)
+                m->setChildren(&it, _("(Empty)"));
+        }
+        if (first)
+            gtk_tree_store_remove(m->m_store, &dummy);
+        if (insertion.next == insertion.children.size())
+            m->m_insertions.pop_front();
+        return TRUE;
+    }
+    m->m_insertionId = 0;
+    return FALSE;
 }
 
 }
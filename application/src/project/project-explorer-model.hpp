@@ -5,7 +5,12 @@
 #define SMYD_PROJECT_EXPLORER_MODEL_HPP
 
 #include "utilities/miscellaneous.hpp"
+#include <deque>
+#include <list>
 #include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/connection.hpp>
 #include <gtk/gtk.h>
 
@@ -14,7 +19,14 @@ namespace Samoyed
 
 class Project;
 class ProjectFile;
-
+class Worker;
+
+/**
+ * The model of project explorers, which is populated lazily.  The children of
+ * a directory are loaded from the project database in the background when the
+ * directory is expanded, and released when it is collapsed, so that the
+ * memory usage is proportional to the expanded directories only.
+ */
 class ProjectExplorerModel
 {
 public:
@@ -24,6 +36,7 @@ public:
         ICON_COLUMN,
         TYPE_COLUMN,
         FLAGS_COLUMN,
+        URI_COLUMN,
         N_COLUMNS
     };
 
@@ -56,18 +69,55 @@ public:
 
     void onRowExpanded(GtkTreeIter *iter);
 
+    void onRowCollapsed(GtkTreeIter *iter);
+
 private:
+    class Loader;
+
+    struct LoaderInfo
+    {
+        boost::shared_ptr<Loader> loader;
+        boost::signals2::connection finishedConn;
+        boost::signals2::connection canceledConn;
+    };
+
+    struct Child
+    {
+        std::string name;
+        int type;
+    };
+
     struct Connections
     {
+        boost::signals2::connection closing;
         boost::signals2::connection closed;
         boost::signals2::connection fileAdded;
         boost::signals2::connection fileRemoved;
+        boost::signals2::connection filesAdded;
+        boost::signals2::connection filesRemoved;
+    };
+
+    /**
+     * The children of a directory waiting to be inserted.
+     */
+    struct Insertion
+    {
+        std::string uri;
+        std::vector<Child> children;
+        size_t next;
     };
 
     typedef std::map<ComparablePointer<const char>, Connections>
         ProjectConnectionsTable;
 
+    // The rows keyed by their display names, which are sorted.
+    typedef std::map<std::string, GtkTreeRowReference *> ProjectRowTable;
+
+    // The loaded rows keyed by their URIs.
+    typedef std::map<std::string, GtkTreeRowReference *> LoadedRowTable;
+
     void onProjectOpened(Project &project);
+    void onProjectClosing(Project &project);
     void onProjectClosed(Project &project);
 
     void onProjectFileAdded(Project &project,
@@ -75,11 +125,38 @@ private:
                             const ProjectFile &data);
     void onProjectFileRemoved(Project &project,
                               const char *uri);
+    void onProjectFilesAdded(Project &project,
+                             const std::vector<const char *> &uris,
+                             const std::vector<const ProjectFile *> &data);
+    void onProjectFilesRemoved(Project &project,
+                               const std::vector<const char *> &uris);
+
+    void onLoaderFinished(const boost::shared_ptr<Worker> &worker);
+    void onLoaderCanceled(const boost::shared_ptr<Worker> &worker);
+
+    static gboolean insertChildren(gpointer model);
+
+    void setChildren(GtkTreeIter *parent, const char *dummyName);
+
+    void releaseChildren(GtkTreeIter *parent, const char *uri);
+
+    bool findLoadedRow(const char *uri, GtkTreeIter *iter);
+
+    void addFile(const char *uri, int type);
 
     GtkTreeStore *m_store;
 
     boost::signals2::connection m_openedConn;
     ProjectConnectionsTable m_projConnsTable;
+
+    ProjectRowTable m_projectRows;
+
+    LoadedRowTable m_loadedRows;
+
+    std::list<LoaderInfo> m_loaders;
+
+    std::deque<Insertion> m_insertions;
+    guint m_insertionId;
 };
 
 }
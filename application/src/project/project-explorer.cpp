@@ -141,10 +141,30 @@ bool ProjectExplorer::setupProjectExplorer()
                                        ProjectExplorerModel::NAME_COLUMN);
     gtk_tree_view_append_column(GTK_TREE_VIEW(tree), column);
     gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(tree), FALSE);
+    g_signal_connect(tree, "row-expanded",
+                     G_CALLBACK(onRowExpanded), this);
+    g_signal_connect(tree, "row-collapsed",
+                     G_CALLBACK(onRowCollapsed), this);
     setGtkWidget(tree);
     return true;
 }
 
+void ProjectExplorer::onRowExpanded(GtkTreeView *tree,
+                                    GtkTreeIter *iter,
+                                    GtkTreePath *path,
+                                    gpointer explorer)
+{
+    Application::instance().projectExplorerModel().onRowExpanded(iter);
+}
+
+void ProjectExplorer::onRowCollapsed(GtkTreeView *tree,
+                                     GtkTreeIter *iter,
+                                     GtkTreePath *path,
+                                     gpointer explorer)
+{
+    Application::instance().projectExplorerModel().onRowCollapsed(iter);
+}
+
 bool ProjectExplorer::setup()
 {
     if (!Widget::setup(PROJECT_EXPLORER_ID))
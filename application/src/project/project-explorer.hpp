@@ -62,6 +62,15 @@ protected:
 private:
     static void onWindowCreated(Window &window);
     static void onWindowRestored(Window &window);
+
+    static void onRowExpanded(GtkTreeView *tree,
+                              GtkTreeIter *iter,
+                              GtkTreePath *path,
+                              gpointer explorer);
+    static void onRowCollapsed(GtkTreeView *tree,
+                               GtkTreeIter *iter,
+                               GtkTreePath *path,
+                               gpointer explorer);
 };
 
 }
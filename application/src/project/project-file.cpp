@@ -72,6 +72,18 @@ void ProjectFile::Editor::getInput(ProjectFile &file) const
     m_buildSystemDataEditor->getInput(file.buildSystemData());
 }
 
+int ProjectFile::View::type() const
+{
+    if (static_cast<size_t>(m_dataLength) < sizeof(gint32))
+        return -1;
+    gint32 type;
+    memcpy(&type, m_data, sizeof(gint32));
+    type = GINT32_FROM_LE(type);
+    if (type < 0 || type >= N_TYPES)
+        return -1;
+    return type;
+}
+
 ProjectFile::~ProjectFile()
 {
     delete m_buildSystemData;
@@ -56,6 +56,46 @@ public:
         boost::function<void (Editor &)> m_onChanged;
     };
 
+    /**
+     * A view of the stored data of a project file.  The fields are decoded
+     * lazily from the raw data, which is not copied, so that visiting many
+     * files does not allocate memory for each file.  A view is valid only as
+     * long as the raw data.
+     */
+    class View
+    {
+    public:
+        View(): m_data(NULL), m_dataLength(0) {}
+        View(const char *data, int dataLength):
+            m_data(data),
+            m_dataLength(dataLength)
+        {}
+
+        /**
+         * @return False if the view has no data, e.g., when visiting the keys
+         * only.
+         */
+        bool valid() const { return m_data != NULL; }
+
+        /**
+         * @return The type of the file, or -1 if the data is corrupted.
+         */
+        int type() const;
+
+        const char *data() const { return m_data; }
+        int dataLength() const { return m_dataLength; }
+
+        /**
+         * Decode the full data into a newly allocated project file.
+         */
+        ProjectFile *read(const Project &project) const
+        { return ProjectFile::read(project, m_data, m_dataLength); }
+
+    private:
+        const char *m_data;
+        int m_dataLength;
+    };
+
     ProjectFile(int type, BuildSystemFile *buildSystemData):
         m_type(type),
         m_buildSystemData(buildSystemData)
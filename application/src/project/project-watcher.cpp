@@ -0,0 +1,1108 @@
+// Project file watcher.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "project-watcher.hpp"
+#include "project.hpp"
+#include "project-db.hpp"
+#include "project-file.hpp"
+#include "trigram-indexer.hpp"
+#include "build-system/build-system.hpp"
+#include "editors/file.hpp"
+#include "editors/text-file.hpp"
+#include "editors/source-file.hpp"
+#include "window/window.hpp"
+#include "utilities/content-hash.hpp"
+#include "utilities/miscellaneous.hpp"
+#include "utilities/property-tree.hpp"
+#include "utilities/worker.hpp"
+#include "application.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+#include <clang-c/Index.h>
+
+#define PROJECT_WATCHER "project-watcher"
+#define QUIET_PERIOD "quiet-period"
+#define POLLING_INTERVAL "polling-interval"
+
+namespace
+{
+
+// The default period without changes after which the pending changes are
+// processed, in milliseconds.
+const int DEFAULT_QUIET_PERIOD = 300;
+
+// The maximum delay of processing the pending changes during continuous
+// changes, in milliseconds.
+const int MAX_DELAY = 3000;
+
+// The default interval of scanning the project directory when polling, in
+// seconds.
+const int DEFAULT_POLLING_INTERVAL = 10;
+
+// The number of directories to start monitoring in one idle callback.
+const size_t MONITOR_BATCH_SIZE = 256;
+
+bool isHidden(const char *fileName)
+{
+    const char *baseName = strrchr(fileName, G_DIR_SEPARATOR);
+    baseName = baseName ? baseName + 1 : fileName;
+    return baseName[0] == '.';
+}
+
+// Get the number of directories that can be monitored.  Leave half of the
+// system limit of inotify watches for other applications.
+int maxMonitors()
+{
+    char *text;
+    if (!g_file_get_contents("/proc/sys/fs/inotify/max_user_watches",
+                             &text, NULL, NULL))
+        return G_MAXINT;
+    int max = atoi(text) / 2;
+    g_free(text);
+    return max > 0 ? max : G_MAXINT;
+}
+
+bool collectFile(std::vector<std::string> *uris,
+                 std::vector<boost::shared_ptr<Samoyed::ProjectFile> > *data,
+                 const char *uri,
+                 int uriLength,
+                 boost::shared_ptr<Samoyed::ProjectFile> d)
+{
+    uris->push_back(std::string(uri, uriLength));
+    data->push_back(d);
+    return false;
+}
+
+struct InclusionSearch
+{
+    const std::set<std::string> *fileNames;
+    std::set<std::string> found;
+};
+
+void searchInclusion(CXFile includedFile,
+                     CXSourceLocation *inclusionStack,
+                     unsigned includeLength,
+                     CXClientData search)
+{
+    InclusionSearch *s = static_cast<InclusionSearch *>(search);
+    CXString fileName = clang_getFileName(includedFile);
+    const char *cFileName = clang_getCString(fileName);
+    if (cFileName && s->fileNames->find(cFileName) != s->fileNames->end())
+        s->found.insert(cFileName);
+    clang_disposeString(fileName);
+}
+
+// Hash the contents of a file converted from the encoding to UTF-8, which is
+// consistent with the hashes computed by the text file loaders and savers.
+bool hashFile(const char *fileName, const char *encoding, guint64 &hash)
+{
+    char *contents;
+    gsize length;
+    if (!g_file_get_contents(fileName, &contents, &length, NULL))
+        return false;
+    if (encoding && strcmp(encoding, "UTF-8") != 0)
+    {
+        gsize convertedLength;
+        char *converted = g_convert(contents, length, "UTF-8", encoding,
+                                    NULL, &convertedLength, NULL);
+        g_free(contents);
+        if (!converted)
+            return false;
+        contents = converted;
+        length = convertedLength;
+    }
+    hash = Samoyed::ContentHash::hash(contents, length);
+    g_free(contents);
+    return true;
+}
+
+// Get the encoding in which a file is hashed.  The hashes recorded by the text
+// file loaders and savers are computed from the contents converted to UTF-8,
+// so an open text file is hashed in its encoding.  Other files are hashed as
+// they are.
+const char *encodingOf(const char *fileName)
+{
+    char *uri = g_filename_to_uri(fileName, NULL, NULL);
+    if (!uri)
+        return NULL;
+    Samoyed::File *file = Samoyed::Application::instance().findFile(uri);
+    g_free(uri);
+    if (!file || !(file->type() & Samoyed::TextFile::TYPE))
+        return NULL;
+    return static_cast<Samoyed::TextFile *>(file)->encoding();
+}
+
+}
+
+namespace Samoyed
+{
+
+/**
+ * A scanner walks a directory recursively, listing one directory in each
+ * step.  It collects the subdirectories to be monitored, or takes a snapshot
+ * of the modified times of the files when polling.
+ */
+class ProjectWatcher::Scanner: public Worker
+{
+public:
+    Scanner(Scheduler &scheduler,
+            unsigned int priority,
+            const char *dirName,
+            bool takeSnapshot):
+        Worker(scheduler, priority),
+        m_takeSnapshot(takeSnapshot)
+    {
+        char *desc = g_strdup_printf(_("Scanning directory \"%s\"."), dirName);
+        setDescription(desc);
+        g_free(desc);
+        m_pendingDirs.push_back(dirName);
+    }
+
+    bool takeSnapshot() const { return m_takeSnapshot; }
+
+    std::vector<std::string> &dirs() { return m_dirs; }
+
+    Snapshot &snapshot() { return m_snapshot; }
+
+protected:
+    virtual bool step();
+
+private:
+    const bool m_takeSnapshot;
+    std::deque<std::string> m_pendingDirs;
+    std::vector<std::string> m_dirs;
+    Snapshot m_snapshot;
+};
+
+bool ProjectWatcher::Scanner::step()
+{
+    if (m_pendingDirs.empty())
+        return true;
+    std::string dirName;
+    dirName.swap(m_pendingDirs.front());
+    m_pendingDirs.pop_front();
+    if (!m_takeSnapshot)
+        m_dirs.push_back(dirName);
+
+    GDir *dir = g_dir_open(dirName.c_str(), 0, NULL);
+    if (!dir)
+        return m_pendingDirs.empty();
+    std::string name;
+    const char *entry;
+    while ((entry = g_dir_read_name(dir)) != NULL)
+    {
+        if (entry[0] == '.')
+            continue;
+        name = dirName;
+        name += G_DIR_SEPARATOR;
+        name += entry;
+        GStatBuf st;
+        if (g_lstat(name.c_str(), &st))
+            continue;
+        if (S_ISDIR(st.st_mode))
+            m_pendingDirs.push_back(name);
+        else if (S_ISREG(st.st_mode) && m_takeSnapshot)
+        {
+            Time &time = m_snapshot[name];
+            time.seconds = st.st_mtime;
+            time.microSeconds = 0;
+        }
+    }
+    g_dir_close(dir);
+    return m_pendingDirs.empty();
+}
+
+/**
+ * A hasher hashes the contents of the changed files, one file in each step, so
+ * that the watcher can tell whether they are really changed without reading
+ * them in the main thread.  It also carries the files to be reloaded or
+ * reparsed depending on the hashes.
+ */
+class ProjectWatcher::Hasher: public Worker
+{
+public:
+    Hasher(Scheduler &scheduler, unsigned int priority):
+        Worker(scheduler, priority),
+        m_next(m_hashes.end())
+    {
+        setDescription(_("Hashing changed files."));
+    }
+
+    /**
+     * Request to hash a file before submitted.
+     * @param encoding The encoding of the text file, whose contents are
+     * converted to UTF-8 before hashed, or NULL to hash the raw contents.
+     */
+    void addFile(const std::string &fileName, const char *encoding)
+    {
+        Hash &h = m_hashes[fileName];
+        if (encoding)
+            h.encoding = encoding;
+        m_next = m_hashes.begin();
+    }
+
+    bool empty() const { return m_hashes.empty(); }
+
+    /**
+     * @return False iff the file could not be hashed.
+     */
+    bool hash(const std::string &fileName, guint64 &hash) const
+    {
+        std::map<std::string, Hash>::const_iterator it =
+            m_hashes.find(fileName);
+        if (it == m_hashes.end() || !it->second.hashed)
+            return false;
+        hash = it->second.hash;
+        return true;
+    }
+
+    /**
+     * The names of the open files to be reloaded if changed.
+     */
+    std::vector<std::string> &reloadedFiles() { return m_reloadedFiles; }
+
+    /**
+     * The names of the changed files included by each open source file, keyed
+     * by the URI of the source file, which is reparsed if any is changed.
+     */
+    std::map<std::string, std::vector<std::string> > &includedFiles()
+    { return m_includedFiles; }
+
+protected:
+    virtual bool step();
+
+private:
+    struct Hash
+    {
+        std::string encoding;
+        bool hashed;
+        guint64 hash;
+        Hash(): hashed(false), hash(0) {}
+    };
+
+    std::map<std::string, Hash> m_hashes;
+    std::map<std::string, Hash>::iterator m_next;
+    std::vector<std::string> m_reloadedFiles;
+    std::map<std::string, std::vector<std::string> > m_includedFiles;
+};
+
+bool ProjectWatcher::Hasher::step()
+{
+    if (m_next == m_hashes.end())
+        return true;
+    Hash &h = m_next->second;
+    h.hashed = hashFile(m_next->first.c_str(),
+                        h.encoding.empty() ? NULL : h.encoding.c_str(),
+                        h.hash);
+    return ++m_next == m_hashes.end();
+}
+
+ProjectWatcher::ProjectWatcher(Project &project):
+    m_project(project),
+    m_monitorAdderId(0),
+    m_polling(false),
+    m_pollerId(0),
+    m_snapshotTaken(false),
+    m_flusherId(0)
+{
+    char *dirName = g_filename_from_uri(project.uri(), NULL, NULL);
+    if (dirName)
+        m_dirName = dirName;
+    g_free(dirName);
+}
+
+ProjectWatcher::~ProjectWatcher()
+{
+    for (std::vector<ScannerInfo>::iterator it = m_scanners.begin();
+         it != m_scanners.end();
+         ++it)
+    {
+        it->finishedConn.disconnect();
+        it->canceledConn.disconnect();
+        it->scanner->cancel(it->scanner);
+    }
+    for (std::vector<HasherInfo>::iterator it = m_hashers.begin();
+         it != m_hashers.end();
+         ++it)
+    {
+        it->finishedConn.disconnect();
+        it->canceledConn.disconnect();
+        it->hasher->cancel(it->hasher);
+    }
+    if (m_monitorAdderId)
+        g_source_remove(m_monitorAdderId);
+    if (m_pollerId)
+        g_source_remove(m_pollerId);
+    if (m_flusherId)
+        g_source_remove(m_flusherId);
+    for (std::map<GtkWidget *, std::string>::iterator it =
+            m_reloadDialogs.begin();
+         it != m_reloadDialogs.end();
+         ++it)
+        gtk_widget_destroy(it->first);
+    for (MonitorTable::iterator it = m_monitors.begin();
+         it != m_monitors.end();
+         ++it)
+    {
+        g_file_monitor_cancel(it->second);
+        g_object_unref(it->second);
+    }
+}
+
+void ProjectWatcher::installPreferences()
+{
+    PropertyTree &prefs =
+        Application::instance().preferences().addChild(PROJECT_WATCHER);
+    prefs.addChild(QUIET_PERIOD, DEFAULT_QUIET_PERIOD);
+    prefs.addChild(POLLING_INTERVAL, DEFAULT_POLLING_INTERVAL);
+}
+
+void ProjectWatcher::start()
+{
+    if (m_dirName.empty())
+        return;
+    startScanner(m_dirName.c_str(), false);
+}
+
+void ProjectWatcher::startScanner(const char *dirName, bool takeSnapshot)
+{
+    boost::shared_ptr<Scanner> scanner(
+        new Scanner(Application::instance().scheduler(),
+                    takeSnapshot ?
+                    Worker::PRIORITY_IDLE : Worker::PRIORITY_BACKGROUND,
+                    dirName,
+                    takeSnapshot));
+    m_scanners.push_back(ScannerInfo());
+    ScannerInfo &info = m_scanners.back();
+    info.scanner = scanner;
+    info.finishedConn = scanner->addFinishedCallbackInMainThread(
+        boost::bind(onScannerFinished, this, _1));
+    info.canceledConn = scanner->addCanceledCallbackInMainThread(
+        boost::bind(onScannerCanceled, this, _1));
+    scanner->submit(scanner);
+}
+
+void ProjectWatcher::onScannerFinished(const boost::shared_ptr<Worker> &worker)
+{
+    boost::shared_ptr<Scanner> scanner;
+    for (std::vector<ScannerInfo>::iterator it = m_scanners.begin();
+         it != m_scanners.end();
+         ++it)
+        if (it->scanner == worker)
+        {
+            scanner = it->scanner;
+            m_scanners.erase(it);
+            break;
+        }
+    if (!scanner)
+        return;
+
+    if (scanner->takeSnapshot())
+    {
+        if (!m_polling)
+            return;
+        if (!m_snapshotTaken)
+        {
+            m_snapshot.swap(scanner->snapshot());
+            m_snapshotTaken = true;
+            return;
+        }
+
+        // Compare the snapshots.
+        Snapshot &snapshot = scanner->snapshot();
+        Snapshot::const_iterator it1 = m_snapshot.begin();
+        Snapshot::const_iterator it2 = snapshot.begin();
+        while (it1 != m_snapshot.end() || it2 != snapshot.end())
+        {
+            int cmp;
+            if (it1 == m_snapshot.end())
+                cmp = 1;
+            else if (it2 == snapshot.end())
+                cmp = -1;
+            else
+                cmp = it1->first.compare(it2->first);
+            if (cmp < 0)
+            {
+                onFileRemoved(it1->first.c_str());
+                ++it1;
+            }
+            else if (cmp > 0)
+            {
+                onFileAdded(it2->first.c_str());
+                ++it2;
+            }
+            else
+            {
+                if (it1->second.seconds != it2->second.seconds)
+                    onFileModified(it1->first.c_str());
+                ++it1;
+                ++it2;
+            }
+        }
+        m_snapshot.swap(snapshot);
+        return;
+    }
+
+    if (m_polling)
+        return;
+    std::vector<std::string> &dirs = scanner->dirs();
+    if (m_monitors.size() + m_unmonitoredDirs.size() + dirs.size() >
+        static_cast<size_t>(maxMonitors()))
+    {
+        startPolling();
+        return;
+    }
+    m_unmonitoredDirs.insert(m_unmonitoredDirs.end(), dirs.begin(), dirs.end());
+    if (!m_monitorAdderId)
+        m_monitorAdderId = g_idle_add(addMonitors, this);
+}
+
+void ProjectWatcher::onScannerCanceled(const boost::shared_ptr<Worker> &worker)
+{
+    for (std::vector<ScannerInfo>::iterator it = m_scanners.begin();
+         it != m_scanners.end();
+         ++it)
+        if (it->scanner == worker)
+        {
+            m_scanners.erase(it);
+            break;
+        }
+}
+
+gboolean ProjectWatcher::addMonitors(gpointer watcher)
+{
+    ProjectWatcher *w = static_cast<ProjectWatcher *>(watcher);
+    for (size_t i = 0;
+         i < MONITOR_BATCH_SIZE && !w->m_unmonitoredDirs.empty();
+         i++)
+    {
+        std::string dirName;
+        dirName.swap(w->m_unmonitoredDirs.back());
+        w->m_unmonitoredDirs.pop_back();
+        if (w->m_monitors.find(dirName) != w->m_monitors.end())
+            continue;
+        GFile *dir = g_file_new_for_path(dirName.c_str());
+        GError *error = NULL;
+        GFileMonitor *monitor =
+            g_file_monitor_directory(dir,
+                                     G_FILE_MONITOR_WATCH_MOVES,
+                                     NULL,
+                                     &error);
+        g_object_unref(dir);
+        if (!monitor)
+        {
+            g_error_free(error);
+            w->m_monitorAdderId = 0;
+            w->startPolling();
+            return FALSE;
+        }
+        g_signal_connect(monitor, "changed",
+                         G_CALLBACK(onMonitorChanged), w);
+        w->m_monitors[dirName] = monitor;
+    }
+    if (w->m_unmonitoredDirs.empty())
+    {
+        w->m_monitorAdderId = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void ProjectWatcher::removeMonitors(const char *dirName)
+{
+    std::string prefix(dirName);
+    prefix += G_DIR_SEPARATOR;
+    MonitorTable::iterator it = m_monitors.find(dirName);
+    if (it != m_monitors.end())
+    {
+        g_file_monitor_cancel(it->second);
+        g_object_unref(it->second);
+        m_monitors.erase(it);
+    }
+    it = m_monitors.lower_bound(prefix);
+    while (it != m_monitors.end() &&
+           it->first.compare(0, prefix.length(), prefix) == 0)
+    {
+        g_file_monitor_cancel(it->second);
+        g_object_unref(it->second);
+        m_monitors.erase(it++);
+    }
+}
+
+void ProjectWatcher::startPolling()
+{
+    if (m_polling)
+        return;
+    m_polling = true;
+    if (m_monitorAdderId)
+    {
+        g_source_remove(m_monitorAdderId);
+        m_monitorAdderId = 0;
+    }
+    m_unmonitoredDirs.clear();
+    removeMonitors(m_dirName.c_str());
+
+    char *msg = g_strdup_printf(
+        _("Samoyed cannot monitor the directories of project \"%s\" for "
+          "changes and will scan them periodically."),
+        m_project.uri());
+    Window::addMessage(msg);
+    g_free(msg);
+
+    // Take the initial snapshot.
+    startScanner(m_dirName.c_str(), true);
+    int interval = Application::instance().preferences().
+        child(PROJECT_WATCHER).get<int>(POLLING_INTERVAL);
+    m_pollerId = g_timeout_add_seconds(interval > 0 ?
+                                       interval : DEFAULT_POLLING_INTERVAL,
+                                       poll,
+                                       this);
+}
+
+gboolean ProjectWatcher::poll(gpointer watcher)
+{
+    ProjectWatcher *w = static_cast<ProjectWatcher *>(watcher);
+    // Skip this round if the last scan is not finished.
+    for (std::vector<ScannerInfo>::const_iterator it = w->m_scanners.begin();
+         it != w->m_scanners.end();
+         ++it)
+        if (it->scanner->takeSnapshot())
+            return TRUE;
+    w->startScanner(w->m_dirName.c_str(), true);
+    return TRUE;
+}
+
+void ProjectWatcher::onMonitorChanged(GFileMonitor *monitor,
+                                      GFile *file,
+                                      GFile *otherFile,
+                                      GFileMonitorEvent event,
+                                      gpointer watcher)
+{
+    ProjectWatcher *w = static_cast<ProjectWatcher *>(watcher);
+    char *fileName = g_file_get_path(file);
+    if (!fileName)
+        return;
+    if (!isHidden(fileName))
+    {
+        switch (event)
+        {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_MOVED_IN:
+            w->onFileAdded(fileName);
+            break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_MOVED_OUT:
+            w->onFileRemoved(fileName);
+            break;
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+            w->onFileModified(fileName);
+            break;
+        case G_FILE_MONITOR_EVENT_RENAMED:
+            w->onFileRemoved(fileName);
+            break;
+        default:
+            break;
+        }
+    }
+    g_free(fileName);
+
+    if (event == G_FILE_MONITOR_EVENT_RENAMED && otherFile)
+    {
+        fileName = g_file_get_path(otherFile);
+        if (fileName && !isHidden(fileName))
+            w->onFileAdded(fileName);
+        g_free(fileName);
+    }
+}
+
+void ProjectWatcher::onFileAdded(const char *fileName)
+{
+    // A file removed and then added back is modified.
+    if (m_removedFiles.erase(fileName))
+        m_modifiedFiles.insert(fileName);
+    else
+        m_addedFiles.insert(fileName);
+    scheduleFlush();
+}
+
+void ProjectWatcher::onFileRemoved(const char *fileName)
+{
+    m_modifiedFiles.erase(fileName);
+    // A file added and then removed is unchanged.
+    if (!m_addedFiles.erase(fileName))
+        m_removedFiles.insert(fileName);
+    scheduleFlush();
+}
+
+void ProjectWatcher::onFileModified(const char *fileName)
+{
+    if (m_addedFiles.find(fileName) == m_addedFiles.end())
+        m_modifiedFiles.insert(fileName);
+    scheduleFlush();
+}
+
+void ProjectWatcher::scheduleFlush()
+{
+    gint64 now = g_get_monotonic_time();
+    m_lastChangeTime = now;
+    if (m_flusherId)
+        return;
+    m_firstChangeTime = now;
+    int quietPeriod = Application::instance().preferences().
+        child(PROJECT_WATCHER).get<int>(QUIET_PERIOD);
+    m_flusherId = g_timeout_add(quietPeriod > 0 ?
+                                quietPeriod : DEFAULT_QUIET_PERIOD,
+                                checkQuiet,
+                                this);
+}
+
+gboolean ProjectWatcher::checkQuiet(gpointer watcher)
+{
+    ProjectWatcher *w = static_cast<ProjectWatcher *>(watcher);
+    gint64 now = g_get_monotonic_time();
+    int quietPeriod = Application::instance().preferences().
+        child(PROJECT_WATCHER).get<int>(QUIET_PERIOD);
+    if (now - w->m_lastChangeTime < quietPeriod * G_GINT64_CONSTANT(1000) &&
+        now - w->m_firstChangeTime < MAX_DELAY * G_GINT64_CONSTANT(1000))
+        return TRUE;
+    w->m_flusherId = 0;
+    w->flush();
+    return FALSE;
+}
+
+void ProjectWatcher::flush()
+{
+    std::set<std::string> added, removed, modified;
+    added.swap(m_addedFiles);
+    removed.swap(m_removedFiles);
+    modified.swap(m_modifiedFiles);
+    if (m_project.closing())
+        return;
+
+    removeFiles(removed);
+    addFiles(added);
+
+    updateTrigramIndex(modified);
+
+    // Find the open files that may need reloading or reparsing, and hash the
+    // changed files they depend on in the background.
+    boost::shared_ptr<Hasher> hasher(
+        new Hasher(Application::instance().scheduler(),
+                   Worker::PRIORITY_FOREGROUND));
+    reloadFiles(modified, *hasher);
+    std::set<std::string> changed;
+    changed.insert(added.begin(), added.end());
+    changed.insert(removed.begin(), removed.end());
+    changed.insert(modified.begin(), modified.end());
+    reparseIncludingFiles(changed, *hasher);
+    if (hasher->empty())
+        return;
+
+    m_hashers.push_back(HasherInfo());
+    HasherInfo &info = m_hashers.back();
+    info.hasher = hasher;
+    info.finishedConn = hasher->addFinishedCallbackInMainThread(
+        boost::bind(onHasherFinished, this, _1));
+    info.canceledConn = hasher->addCanceledCallbackInMainThread(
+        boost::bind(onHasherCanceled, this, _1));
+    hasher->submit(hasher);
+}
+
+void ProjectWatcher::onHasherFinished(const boost::shared_ptr<Worker> &worker)
+{
+    boost::shared_ptr<Hasher> hasher;
+    for (std::vector<HasherInfo>::iterator it = m_hashers.begin();
+         it != m_hashers.end();
+         ++it)
+        if (it->hasher == worker)
+        {
+            hasher = it->hasher;
+            m_hashers.erase(it);
+            break;
+        }
+    if (!hasher || m_project.closing())
+        return;
+
+    // Reload the open files whose contents are changed.  The files may have
+    // been closed or become busy in the meantime.
+    for (std::vector<std::string>::const_iterator it =
+            hasher->reloadedFiles().begin();
+         it != hasher->reloadedFiles().end();
+         ++it)
+    {
+        char *uri = g_filename_to_uri(it->c_str(), NULL, NULL);
+        if (!uri)
+            continue;
+        File *file = Application::instance().findFile(uri);
+        g_free(uri);
+        if (!file || file->loading() || file->saving() || file->frozen())
+            continue;
+        guint64 hash;
+        if (hasher->hash(*it, hash) && hash == file->contentHash())
+            continue;
+        reloadFile(*file);
+    }
+
+    // Reparse the open source files including any really changed file.
+    std::map<std::string, bool> changedFiles;
+    for (std::map<std::string, std::vector<std::string> >::const_iterator it =
+            hasher->includedFiles().begin();
+         it != hasher->includedFiles().end();
+         ++it)
+    {
+        bool includingChanged = false;
+        for (std::vector<std::string>::const_iterator it2 = it->second.begin();
+             it2 != it->second.end();
+             ++it2)
+        {
+            std::map<std::string, bool>::iterator it3 =
+                changedFiles.find(*it2);
+            if (it3 == changedFiles.end())
+                it3 = changedFiles.insert(
+                    std::make_pair(*it2,
+                                   contentChanged(it2->c_str(), *hasher))).
+                    first;
+            if (it3->second)
+                includingChanged = true;
+        }
+        if (!includingChanged)
+            continue;
+        File *file = Application::instance().findFile(it->first.c_str());
+        if (!file || !(file->type() & SourceFile::TYPE))
+            continue;
+        SourceFile *sourceFile = static_cast<SourceFile *>(file);
+        if (sourceFile->parsed() && sourceFile->parsedTranslationUnit())
+            sourceFile->reparse();
+    }
+}
+
+void ProjectWatcher::onHasherCanceled(const boost::shared_ptr<Worker> &worker)
+{
+    for (std::vector<HasherInfo>::iterator it = m_hashers.begin();
+         it != m_hashers.end();
+         ++it)
+        if (it->hasher == worker)
+        {
+            m_hashers.erase(it);
+            break;
+        }
+}
+
+// The added files are indexed when added to the project, and the removed files
+// are removed from the index together with their records in the project
+// database.
+void ProjectWatcher::updateTrigramIndex(const std::set<std::string> &fileNames)
+{
+    TrigramIndexer *indexer = m_project.trigramIndexer();
+    if (!indexer)
+        return;
+    std::vector<std::string> uris;
+    for (std::set<std::string>::const_iterator it = fileNames.begin();
+         it != fileNames.end();
+         ++it)
+    {
+        char *uri = g_filename_to_uri(it->c_str(), NULL, NULL);
+        if (!uri)
+            continue;
+        uris.push_back(uri);
+        g_free(uri);
+    }
+    if (!uris.empty())
+        indexer->updateFiles(uris);
+}
+
+void ProjectWatcher::addFiles(const std::set<std::string> &fileNames)
+{
+    std::vector<std::string> uris;
+    std::vector<int> types;
+    for (std::set<std::string>::const_iterator it = fileNames.begin();
+         it != fileNames.end();
+         ++it)
+    {
+        GStatBuf st;
+        if (g_lstat(it->c_str(), &st))
+            continue;
+        if (S_ISDIR(st.st_mode))
+        {
+            // Monitor the new directory and import the files in it, which
+            // may be added before it is monitored.
+            if (!m_polling)
+                startScanner(it->c_str(), false);
+            m_project.buildSystem().importDirectory(it->c_str());
+            continue;
+        }
+        const char *baseName = strrchr(it->c_str(), G_DIR_SEPARATOR);
+        baseName = baseName ? baseName + 1 : it->c_str();
+        int type = BuildSystem::classifyFile(it->c_str(), baseName);
+        if (type < 0)
+            continue;
+        char *uri = g_filename_to_uri(it->c_str(), NULL, NULL);
+        if (!uri)
+            continue;
+        bool exists;
+        ProjectDb::Error error = m_project.db().hasFile(uri, exists);
+        if (!error.code && !exists)
+        {
+            uris.push_back(uri);
+            types.push_back(type);
+        }
+        g_free(uri);
+    }
+    if (uris.empty())
+        return;
+
+    // Share the project file data among the files of each type.
+    std::vector<ProjectFile *> fileData(ProjectFile::N_TYPES,
+                                        static_cast<ProjectFile *>(NULL));
+    std::vector<const char *> cUris;
+    std::vector<const ProjectFile *> data;
+    cUris.reserve(uris.size());
+    data.reserve(uris.size());
+    for (std::vector<std::string>::size_type i = 0; i < uris.size(); i++)
+    {
+        if (!fileData[types[i]])
+            fileData[types[i]] = m_project.createFile(types[i]);
+        cUris.push_back(uris[i].c_str());
+        data.push_back(fileData[types[i]]);
+    }
+    m_project.addFiles(cUris, data);
+    for (std::vector<ProjectFile *>::iterator it = fileData.begin();
+         it != fileData.end();
+         ++it)
+        delete *it;
+}
+
+void ProjectWatcher::removeFiles(const std::set<std::string> &fileNames)
+{
+    std::vector<std::string> uris;
+    std::vector<boost::shared_ptr<ProjectFile> > data;
+    for (std::set<std::string>::const_iterator it = fileNames.begin();
+         it != fileNames.end();
+         ++it)
+    {
+        char *uri = g_filename_to_uri(it->c_str(), NULL, NULL);
+        if (!uri)
+            continue;
+
+        // The removed file may be a directory, whose descendants are removed
+        // together.
+        removeMonitors(it->c_str());
+        std::string prefix(uri);
+        prefix += '/';
+        m_project.db().visitFiles(m_project,
+                                  prefix.c_str(),
+                                  boost::bind(collectFile, &uris, &data,
+                                              _1, _2, _3));
+
+        boost::shared_ptr<ProjectFile> d;
+        ProjectDb::Error error = m_project.db().readFile(m_project, uri, d);
+        if (!error.code && d)
+        {
+            uris.push_back(uri);
+            data.push_back(d);
+        }
+        g_free(uri);
+    }
+    if (uris.empty())
+        return;
+
+    std::vector<const char *> cUris;
+    std::vector<const ProjectFile *> cData;
+    cUris.reserve(uris.size());
+    cData.reserve(uris.size());
+    for (std::vector<std::string>::size_type i = 0; i < uris.size(); i++)
+    {
+        cUris.push_back(uris[i].c_str());
+        cData.push_back(data[i].get());
+    }
+    m_project.removeFiles(cUris, cData);
+}
+
+void ProjectWatcher::reloadFiles(const std::set<std::string> &fileNames,
+                                 Hasher &hasher)
+{
+    for (std::set<std::string>::const_iterator it = fileNames.begin();
+         it != fileNames.end();
+         ++it)
+    {
+        char *uri = g_filename_to_uri(it->c_str(), NULL, NULL);
+        if (!uri)
+            continue;
+        File *file = Application::instance().findFile(uri);
+        g_free(uri);
+        if (!file || file->loading() || file->saving() || file->frozen())
+            continue;
+
+        // Skip the file if it was saved by Samoyed.
+        GFile *f = g_file_new_for_path(it->c_str());
+        GFileInfo *info = g_file_query_info(
+            f,
+            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+            G_FILE_QUERY_INFO_NONE,
+            NULL,
+            NULL);
+        g_object_unref(f);
+        if (!info)
+            continue;
+        Time time;
+        time.seconds = g_file_info_get_attribute_uint64(
+            info,
+            G_FILE_ATTRIBUTE_TIME_MODIFIED);
+        time.microSeconds = g_file_info_get_attribute_uint32(
+            info,
+            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+        g_object_unref(info);
+        if (time.seconds == file->modifiedTime().seconds &&
+            time.microSeconds == file->modifiedTime().microSeconds)
+            continue;
+
+        // Skip the file if its contents are unchanged, e.g., when it was
+        // touched or rewritten with the same contents by a tool.  Decide after
+        // the contents are hashed.
+        if (file->contentHash() && (file->type() & TextFile::TYPE))
+        {
+            hasher.addFile(*it, static_cast<TextFile *>(file)->encoding());
+            hasher.reloadedFiles().push_back(*it);
+            continue;
+        }
+        reloadFile(*file);
+    }
+}
+
+void ProjectWatcher::reloadFile(File &file)
+{
+    if (!file.edited())
+    {
+        file.load(false);
+        return;
+    }
+
+    // Ask without blocking the flush, and at most once for each file.
+    for (std::map<GtkWidget *, std::string>::const_iterator it =
+            m_reloadDialogs.begin();
+         it != m_reloadDialogs.end();
+         ++it)
+        if (it->second == file.uri())
+            return;
+    GtkWidget *dialog = gtk_message_dialog_new(
+        Application::instance().currentWindow() ?
+        GTK_WINDOW(Application::instance().currentWindow()->gtkWidget()) :
+        NULL,
+        GTK_DIALOG_DESTROY_WITH_PARENT,
+        GTK_MESSAGE_QUESTION,
+        GTK_BUTTONS_YES_NO,
+        _("File \"%s\" was changed outside Samoyed. Your edits will be "
+          "discarded if you reload the file. Reload it?"),
+        file.uri());
+    gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_NO);
+    m_reloadDialogs[dialog] = file.uri();
+    g_signal_connect(dialog, "response",
+                     G_CALLBACK(onReloadDialogResponse), this);
+    gtk_widget_show(dialog);
+}
+
+void ProjectWatcher::onReloadDialogResponse(GtkDialog *dialog,
+                                            gint response,
+                                            gpointer watcher)
+{
+    ProjectWatcher *w = static_cast<ProjectWatcher *>(watcher);
+    std::map<GtkWidget *, std::string>::iterator it =
+        w->m_reloadDialogs.find(GTK_WIDGET(dialog));
+    std::string uri;
+    uri.swap(it->second);
+    w->m_reloadDialogs.erase(it);
+    gtk_widget_destroy(GTK_WIDGET(dialog));
+    if (response != GTK_RESPONSE_YES || w->m_project.closing())
+        return;
+
+    // The file may have been closed, or be busy, while the user was asked.
+    File *file = Application::instance().findFile(uri.c_str());
+    if (!file || file->loading() || file->saving() || file->frozen())
+        return;
+    file->load(false);
+}
+
+// Whether each included file is really changed is decided by comparing the
+// hash of its contents with the recorded one.  Only the changed files included
+// by the open source files are hashed.
+void ProjectWatcher::reparseIncludingFiles(
+    const std::set<std::string> &fileNames,
+    Hasher &hasher)
+{
+    if (fileNames.empty())
+        return;
+
+    for (File *file = Application::instance().files();
+         file;
+         file = file->next())
+    {
+        if (!(file->type() & SourceFile::TYPE))
+            continue;
+        SourceFile *sourceFile = static_cast<SourceFile *>(file);
+        if (!sourceFile->parsed() || !sourceFile->parsedTranslationUnit())
+            continue;
+
+        // The changed file itself is reparsed after reloaded.
+        char *fileName = g_filename_from_uri(file->uri(), NULL, NULL);
+        bool changed = fileName && fileNames.find(fileName) != fileNames.end();
+        g_free(fileName);
+        if (changed)
+            continue;
+
+        InclusionSearch search;
+        search.fileNames = &fileNames;
+        clang_getInclusions(sourceFile->parsedTranslationUnit().get(),
+                            searchInclusion,
+                            &search);
+        if (search.found.empty())
+            continue;
+        for (std::set<std::string>::const_iterator it = search.found.begin();
+             it != search.found.end();
+             ++it)
+            hasher.addFile(*it, encodingOf(it->c_str()));
+        hasher.includedFiles()[file->uri()].assign(search.found.begin(),
+                                                   search.found.end());
+    }
+}
+
+
+// Tell whether a file is changed since it was last hashed, and record the new
+// hash if so.  Added and removed files are always changed.
+bool ProjectWatcher::contentChanged(const char *fileName, const Hasher &hasher)
+{
+    char *uri = g_filename_to_uri(fileName, NULL, NULL);
+    if (!uri)
+        return true;
+    guint64 hash, oldHash;
+    bool changed = true;
+    if (hasher.hash(fileName, hash))
+    {
+        ProjectDb::Error error = m_project.db().readContentHash(uri, oldHash);
+        if (!error.code && oldHash == hash)
+            changed = false;
+        else
+            m_project.db().writeContentHash(uri, hash);
+    }
+    g_free(uri);
+    return changed;
+}
+
+}
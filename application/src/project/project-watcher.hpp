@@ -0,0 +1,161 @@
+// Project file watcher.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_PROJECT_WATCHER_HPP
+#define SMYD_PROJECT_WATCHER_HPP
+
+#include "utilities/miscellaneous.hpp"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2/connection.hpp>
+#include <glib.h>
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+
+namespace Samoyed
+{
+
+class Project;
+class Worker;
+class File;
+
+/**
+ * A project watcher watches the files in a project directory for changes made
+ * outside Samoyed.  Each directory is monitored by a file monitor, which is
+ * backed by inotify on Linux.  If the directories cannot be monitored, e.g.,
+ * when the system limit of watches is reached, the watcher scans the project
+ * directory periodically and compares the modified times of the files.
+ *
+ * Bursts of changes, e.g., caused by switching branches, are coalesced into
+ * sets of added, removed and modified files, which are processed together when
+ * no more change comes for a short period.  The added and removed files are
+ * added to and removed from the project in bulk.  The unedited open files that
+ * were modified are reloaded, and the user is asked whether to reload the
+ * edited ones.  The open source files including the changed files are
+ * reparsed.  The contents of the modified files are hashed in the background
+ * and compared with the recorded hashes so that files touched without real
+ * changes, e.g., by build tools or version control, cause no reloading or
+ * reparsing.
+ */
+class ProjectWatcher: public boost::noncopyable
+{
+public:
+    ProjectWatcher(Project &project);
+    ~ProjectWatcher();
+
+    static void installPreferences();
+
+    /**
+     * Start watching the project directory in the background.
+     */
+    void start();
+
+    bool polling() const { return m_polling; }
+
+private:
+    class Scanner;
+    class Hasher;
+
+    struct ScannerInfo
+    {
+        boost::shared_ptr<Scanner> scanner;
+        boost::signals2::connection finishedConn;
+        boost::signals2::connection canceledConn;
+    };
+
+    struct HasherInfo
+    {
+        boost::shared_ptr<Hasher> hasher;
+        boost::signals2::connection finishedConn;
+        boost::signals2::connection canceledConn;
+    };
+
+    // The modified time of each file, keyed by the file name.
+    typedef std::map<std::string, Time> Snapshot;
+
+    typedef std::map<std::string, GFileMonitor *> MonitorTable;
+
+    void startScanner(const char *dirName, bool takeSnapshot);
+
+    void onScannerFinished(const boost::shared_ptr<Worker> &worker);
+    void onScannerCanceled(const boost::shared_ptr<Worker> &worker);
+
+    static gboolean addMonitors(gpointer watcher);
+
+    void removeMonitors(const char *dirName);
+
+    void startPolling();
+
+    static gboolean poll(gpointer watcher);
+
+    static void onMonitorChanged(GFileMonitor *monitor,
+                                 GFile *file,
+                                 GFile *otherFile,
+                                 GFileMonitorEvent event,
+                                 gpointer watcher);
+
+    void onFileAdded(const char *fileName);
+    void onFileRemoved(const char *fileName);
+    void onFileModified(const char *fileName);
+
+    void scheduleFlush();
+
+    static gboolean checkQuiet(gpointer watcher);
+
+    void flush();
+
+    void addFiles(const std::set<std::string> &fileNames);
+    void removeFiles(const std::set<std::string> &fileNames);
+    void reloadFiles(const std::set<std::string> &fileNames, Hasher &hasher);
+    void reloadFile(File &file);
+    static void onReloadDialogResponse(GtkDialog *dialog,
+                                       gint response,
+                                       gpointer watcher);
+    void reparseIncludingFiles(const std::set<std::string> &fileNames,
+                               Hasher &hasher);
+    void updateTrigramIndex(const std::set<std::string> &fileNames);
+
+    void onHasherFinished(const boost::shared_ptr<Worker> &worker);
+    void onHasherCanceled(const boost::shared_ptr<Worker> &worker);
+
+    bool contentChanged(const char *fileName, const Hasher &hasher);
+
+    Project &m_project;
+
+    std::string m_dirName;
+
+    std::vector<ScannerInfo> m_scanners;
+
+    std::vector<HasherInfo> m_hashers;
+
+    MonitorTable m_monitors;
+
+    // The directories waiting to be monitored.
+    std::vector<std::string> m_unmonitoredDirs;
+    guint m_monitorAdderId;
+
+    bool m_polling;
+    guint m_pollerId;
+    bool m_snapshotTaken;
+    Snapshot m_snapshot;
+
+    // The pending changes.
+    std::set<std::string> m_addedFiles;
+    std::set<std::string> m_removedFiles;
+    std::set<std::string> m_modifiedFiles;
+    gint64 m_firstChangeTime;
+    gint64 m_lastChangeTime;
+    guint m_flusherId;
+
+    // The open dialogs asking whether to reload the edited files, and the URIs
+    // of the files.
+    std::map<GtkWidget *, std::string> m_reloadDialogs;
+};
+
+}
+
+#endif
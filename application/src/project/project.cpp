@@ -7,6 +7,8 @@
 #include "project.hpp"
 #include "project-db.hpp"
 #include "project-file.hpp"
+#include "project-watcher.hpp"
+#include "trigram-indexer.hpp"
 #include "build-system/build-system.hpp"
 #include "editors/editor.hpp"
 #include "window/window.hpp"
@@ -20,6 +22,9 @@
 #include <numeric>
 #include <string>
 #include <utility>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
@@ -33,6 +38,45 @@
 namespace
 {
 
+// Add files to the project database in a transaction.
+// @param n The number of the added files, i.e., the index of the file failed
+// to be added, if any.
+Samoyed::ProjectDb::Error
+addFilesToDb(Samoyed::ProjectDb &db,
+             const std::vector<const char *> &uris,
+             const std::vector<const Samoyed::ProjectFile *> &data,
+             std::vector<const char *>::size_type &n,
+             DB_TXN *txn)
+{
+    Samoyed::ProjectDb::Error error;
+    for (n = 0; n < uris.size(); n++)
+    {
+        error = db.addFile(uris[n], *data[n], txn);
+        if (error.code)
+            break;
+    }
+    return error;
+}
+
+// Remove files from the project database in a transaction.
+// @param n The number of the removed files, i.e., the index of the file failed
+// to be removed, if any.
+Samoyed::ProjectDb::Error
+removeFilesFromDb(Samoyed::ProjectDb &db,
+                  const std::vector<const char *> &uris,
+                  std::vector<const char *>::size_type &n,
+                  DB_TXN *txn)
+{
+    Samoyed::ProjectDb::Error error;
+    for (n = 0; n < uris.size(); n++)
+    {
+        error = db.removeFile(uris[n], txn);
+        if (error.code)
+            break;
+    }
+    return error;
+}
+
 void checkProjectExists(GtkFileChooser *chooser, gpointer dialog)
 {
     gboolean sensitive;
@@ -138,6 +182,8 @@ Project *Project::XmlElement::restoreProject()
 Project::Project(const char *uri):
     m_uri(uri),
     m_db(NULL),
+    m_watcher(NULL),
+    m_trigramIndexer(NULL),
     m_buildSystem(NULL),
     m_closing(false),
     m_firstEditor(NULL),
@@ -150,6 +196,8 @@ Project::~Project()
 {
     assert(!m_firstEditor);
     assert(!m_lastEditor);
+    delete m_trigramIndexer;
+    delete m_watcher;
     delete m_db;
     delete m_buildSystem;
     Application::instance().removeProject(*this);
@@ -305,6 +353,15 @@ Project *Project::create(const char *uri,
     // Setup the build system.
     project->m_buildSystem->setup();
 
+    project->m_watcher = new ProjectWatcher(*project);
+    project->m_watcher->start();
+
+    if (ProjectDb::trigramIndexEnabled())
+    {
+        project->m_trigramIndexer = new TrigramIndexer(*project);
+        project->m_trigramIndexer->start();
+    }
+
     s_opened(*project);
 
     return project;
@@ -503,6 +560,15 @@ Project *Project::open(const char *uri)
         return NULL;
     }
 
+    project->m_watcher = new ProjectWatcher(*project);
+    project->m_watcher->start();
+
+    if (ProjectDb::trigramIndexEnabled())
+    {
+        project->m_trigramIndexer = new TrigramIndexer(*project);
+        project->m_trigramIndexer->start();
+    }
+
     s_opened(*project);
     return project;
 }
@@ -591,6 +657,15 @@ bool Project::closePhase2()
 
 bool Project::closePhase3()
 {
+    m_closingSignal(*this);
+
+    // Stop watching the project directory and indexing the files, which
+    // update the project database.
+    delete m_watcher;
+    m_watcher = NULL;
+    delete m_trigramIndexer;
+    m_trigramIndexer = NULL;
+
     // Close the project database.
     ProjectDb::Error dbError = m_db->close();
     if (dbError.code)
@@ -737,6 +812,142 @@ bool Project::addFile(const char *uri, const ProjectFile &data,
     return true;
 }
 
+bool Project::addFiles(const std::vector<const char *> &uris,
+                       const std::vector<const ProjectFile *> &data)
+{
+    if (uris.empty())
+        return true;
+
+    // Add the files to the build system, and roll back the added ones if any
+    // fails.
+    std::vector<const char *>::size_type n;
+    for (n = 0; n < uris.size(); n++)
+        if (!m_buildSystem->addFile(uris[n], data[n]->buildSystemData()))
+            break;
+    if (n < uris.size())
+    {
+        while (n > 0)
+        {
+            n--;
+            m_buildSystem->removeFile(uris[n], data[n]->buildSystemData());
+        }
+        return false;
+    }
+
+    ProjectDb::Error dbError =
+        m_db->runTransaction(boost::bind(addFilesToDb,
+                                         boost::ref(*m_db),
+                                         boost::cref(uris),
+                                         boost::cref(data),
+                                         boost::ref(n),
+                                         _1));
+    if (dbError.code)
+    {
+        GtkWidget *dialog = gtk_message_dialog_new(
+            Application::instance().currentWindow() ?
+            GTK_WINDOW(Application::instance().currentWindow()->gtkWidget()) :
+            NULL,
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            _("Samoyed failed to add %d files to project \"%s\"."),
+            static_cast<int>(uris.size()), this->uri());
+        if (n < uris.size())
+            gtkMessageDialogAddDetails(
+                dialog,
+                _("Samoyed failed to add %s \"%s\" to project database. "
+                  "\"%s\": %s."),
+                data[n]->typeDescription(), uris[n],
+                dbError.dbUri, db_strerror(dbError.code));
+        else
+            gtkMessageDialogAddDetails(
+                dialog,
+                _("Samoyed failed to commit the changes to project database. "
+                  "\"%s\": %s."),
+                dbError.dbUri, db_strerror(dbError.code));
+        gtk_dialog_set_default_response(GTK_DIALOG(dialog),
+            GTK_RESPONSE_CLOSE);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        for (n = uris.size(); n > 0; n--)
+            m_buildSystem->removeFile(uris[n - 1],
+                                      data[n - 1]->buildSystemData());
+        return false;
+    }
+    m_filesAdded(*this, uris, data);
+    return true;
+}
+
+bool Project::removeFiles(const std::vector<const char *> &uris,
+                          const std::vector<const ProjectFile *> &data)
+{
+    if (uris.empty())
+        return true;
+
+    std::vector<const char *>::size_type n;
+    for (n = 0; n < uris.size(); n++)
+        if (!m_buildSystem->removeFile(uris[n], data[n]->buildSystemData()))
+            break;
+    if (n < uris.size())
+    {
+        while (n > 0)
+        {
+            n--;
+            m_buildSystem->addFile(uris[n], data[n]->buildSystemData());
+        }
+        return false;
+    }
+
+    ProjectDb::Error dbError =
+        m_db->runTransaction(boost::bind(removeFilesFromDb,
+                                         boost::ref(*m_db),
+                                         boost::cref(uris),
+                                         boost::ref(n),
+                                         _1));
+    if (dbError.code)
+    {
+        GtkWidget *dialog = gtk_message_dialog_new(
+            Application::instance().currentWindow() ?
+            GTK_WINDOW(Application::instance().currentWindow()->gtkWidget()) :
+            NULL,
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_ERROR,
+            GTK_BUTTONS_CLOSE,
+            _("Samoyed failed to remove %d files from project \"%s\"."),
+            static_cast<int>(uris.size()), this->uri());
+        if (n < uris.size())
+            gtkMessageDialogAddDetails(
+                dialog,
+                _("Samoyed failed to remove %s \"%s\" from project "
+                  "database. \"%s\": %s."),
+                data[n]->typeDescription(), uris[n],
+                dbError.dbUri, db_strerror(dbError.code));
+        else
+            gtkMessageDialogAddDetails(
+                dialog,
+                _("Samoyed failed to commit the changes to project database. "
+                  "\"%s\": %s."),
+                dbError.dbUri, db_strerror(dbError.code));
+        gtk_dialog_set_default_response(GTK_DIALOG(dialog),
+            GTK_RESPONSE_CLOSE);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        for (n = uris.size(); n > 0; n--)
+            m_buildSystem->addFile(uris[n - 1],
+                                   data[n - 1]->buildSystemData());
+        return false;
+    }
+    m_filesRemoved(*this, uris);
+    return true;
+}
+
+void Project::onFilesAdded(const std::vector<const char *> &uris,
+                           const std::vector<const ProjectFile *> &data)
+{
+    if (!uris.empty())
+        m_filesAdded(*this, uris, data);
+}
+
 bool Project::removeFile(const char *uri, const ProjectFile &data,
                          bool removeFromStorage)
 {
@@ -747,7 +958,12 @@ bool Project::removeFile(const char *uri, const ProjectFile &data,
     }
     if (!m_buildSystem->removeFile(uri, data.buildSystemData()))
         return false;
-    ProjectDb::Error dbError = m_db->removeFile(uri);
+    // Remove the file from all the tables together.
+    ProjectDb::Error dbError =
+        m_db->runTransaction(boost::bind(&ProjectDb::removeFile,
+                                         m_db,
+                                         uri,
+                                         _1));
     if (dbError.code)
     {
         GtkWidget *dialog = gtk_message_dialog_new(
@@ -8,6 +8,7 @@
 #include <list>
 #include <map>
 #include <string>
+#include <vector>
 #include <boost/utility.hpp>
 #include <boost/signals2/signal.hpp>
 #include <libxml/tree.h>
@@ -16,6 +17,8 @@ namespace Samoyed
 {
 
 class ProjectDb;
+class ProjectWatcher;
+class TrigramIndexer;
 class BuildSystem;
 class ProjectFile;
 class Editor;
@@ -32,12 +35,20 @@ class Project: public boost::noncopyable
 {
 public:
     typedef boost::signals2::signal<void (Project &project)> Opened;
+    typedef boost::signals2::signal<void (Project &project)> Closing;
     typedef boost::signals2::signal<void (Project &project)> Closed;
     typedef boost::signals2::signal<void (Project &project,
                                           const char *uri,
                                           const ProjectFile &data)> FileAdded;
     typedef boost::signals2::signal<void (Project &project,
                                           const char *uri)> FileRemoved;
+    typedef boost::signals2::signal<void (Project &project,
+                                          const std::vector<const char *> &uris,
+                                          const std::vector<const ProjectFile *>
+                                          &data)> FilesAdded;
+    typedef boost::signals2::signal<void (Project &project,
+                                          const std::vector<const char *> &uris)>
+        FilesRemoved;
 
     class XmlElement
     {
@@ -86,6 +97,12 @@ public:
 
     ProjectDb &db() { return *m_db; }
 
+    /**
+     * @return The trigram indexer of the project files, or NULL if the files
+     * are not indexed.
+     */
+    TrigramIndexer *trigramIndexer() { return m_trigramIndexer; }
+
     BuildSystem &buildSystem() { return *m_buildSystem; }
     const BuildSystem &buildSystem() const { return *m_buildSystem; }
 
@@ -97,6 +114,33 @@ public:
     virtual bool removeFile(const char *uri, const ProjectFile &data,
                             bool removeFromStorage);
 
+    /**
+     * Add files to the project in one transaction of the project database.
+     * Either all or none of the files are added.  The observers are notified
+     * of the added files once.
+     * @param uris The URIs of the files.
+     * @param data The project-specific data of the files, in the same order.
+     */
+    virtual bool addFiles(const std::vector<const char *> &uris,
+                          const std::vector<const ProjectFile *> &data);
+
+    /**
+     * Remove files from the project in one transaction of the project
+     * database.  Either all or none of the files are removed.  The observers
+     * are notified of the removed files once.
+     * @param uris The URIs of the files.
+     * @param data The project-specific data of the files, in the same order.
+     */
+    virtual bool removeFiles(const std::vector<const char *> &uris,
+                             const std::vector<const ProjectFile *> &data);
+
+    /**
+     * Notify the observers of files that were added to the project database
+     * in bulk, e.g., by a background importer.
+     */
+    void onFilesAdded(const std::vector<const char *> &uris,
+                      const std::vector<const ProjectFile *> &data);
+
     Editor *findEditor(const char *uri);
     const Editor *findEditor(const char *uri) const;
 
@@ -116,6 +160,15 @@ public:
     addOpenedCallback(const Opened::slot_type &callback)
     { return s_opened.connect(callback); }
 
+    /**
+     * The callback is called before the project database is closed, when the
+     * project is being closed.  Users of the project database in background
+     * threads should stop.
+     */
+    boost::signals2::connection
+    addClosingCallback(const Closing::slot_type &callback)
+    { return m_closingSignal.connect(callback); }
+
     boost::signals2::connection
     addClosedCallback(const Closed::slot_type &callback)
     { return m_closed.connect(callback); }
@@ -128,6 +181,14 @@ public:
     addFileRemovedCallback(const FileRemoved::slot_type &callback)
     { return m_fileRemoved.connect(callback); }
 
+    boost::signals2::connection
+    addFilesAddedCallback(const FilesAdded::slot_type &callback)
+    { return m_filesAdded.connect(callback); }
+
+    boost::signals2::connection
+    addFilesRemovedCallback(const FilesRemoved::slot_type &callback)
+    { return m_filesRemoved.connect(callback); }
+
 protected:
     Project(const char *uri);
 
@@ -154,6 +215,10 @@ private:
 
     ProjectDb *m_db;
 
+    ProjectWatcher *m_watcher;
+
+    TrigramIndexer *m_trigramIndexer;
+
     BuildSystem *m_buildSystem;
 
     bool m_closing;
@@ -167,9 +232,12 @@ private:
     EditorTable m_editorTable;
 
     static Opened s_opened;
+    Closing m_closingSignal;
     Closed m_closed;
     FileAdded m_fileAdded;
     FileRemoved m_fileRemoved;
+    FilesAdded m_filesAdded;
+    FilesRemoved m_filesRemoved;
 
     bool m_allBuildSystemWorkersStopped;
     bool m_foregroundFileParserFinished;
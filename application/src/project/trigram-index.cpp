@@ -0,0 +1,570 @@
+// Trigram index.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "trigram-index.hpp"
+#include "project-db.hpp"
+#include "utilities/miscellaneous.hpp"
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <glib.h>
+#include <db.h>
+
+namespace
+{
+
+const u_int32_t TABLE_FLAGS = DB_AUTO_COMMIT | DB_THREAD;
+
+const char *FILE_TABLE = "trigram-index-file-table.db";
+const char *ID_TABLE = "trigram-index-id-table.db";
+const char *TRIGRAM_TABLE = "trigram-index-table.db";
+
+// The size of the header of a file record: the ID and the modified time.
+const u_int32_t FILE_RECORD_HEADER_SIZE =
+    sizeof(guint32) + sizeof(guint64) + sizeof(guint32);
+
+// The size of the buffer for reading the IDs of files in bulk, which must be
+// a multiple of 1024 bytes.
+const u_int32_t BULK_BUFFER_SIZE = 64 * 1024;
+
+int openTable(DB_ENV *dbEnv, DB *&table, const char *name,
+              u_int32_t tableFlags, u_int32_t flags)
+{
+    int code = db_create(&table, dbEnv, 0);
+    if (code)
+        return code;
+    if (tableFlags)
+    {
+        code = table->set_flags(table, tableFlags);
+        if (code)
+            return code;
+    }
+    return table->open(table, NULL, name, NULL, DB_BTREE,
+                       flags | TABLE_FLAGS, 0);
+}
+
+void packTrigram(guint32 trigram, unsigned char *bytes)
+{
+    bytes[0] = (trigram >> 16) & 0xff;
+    bytes[1] = (trigram >> 8) & 0xff;
+    bytes[2] = trigram & 0xff;
+}
+
+guint32 unpackTrigram(const unsigned char *bytes)
+{
+    return (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+}
+
+}
+
+namespace Samoyed
+{
+
+TrigramIndex::TrigramIndex(const char *dbEnvUri):
+    m_dbEnv(NULL),
+    m_fileTable(NULL),
+    m_idTable(NULL),
+    m_trigramTable(NULL),
+    m_fileTableDbUri(dbEnvUri),
+    m_idTableDbUri(dbEnvUri),
+    m_trigramTableDbUri(dbEnvUri)
+{
+    m_fileTableDbUri += '/';
+    m_fileTableDbUri += FILE_TABLE;
+    m_idTableDbUri += '/';
+    m_idTableDbUri += ID_TABLE;
+    m_trigramTableDbUri += '/';
+    m_trigramTableDbUri += TRIGRAM_TABLE;
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    if (m_fileTable)
+        m_fileTable->close(m_fileTable, 0);
+    if (m_idTable)
+        m_idTable->close(m_idTable, 0);
+    if (m_trigramTable)
+        m_trigramTable->close(m_trigramTable, 0);
+}
+
+ProjectDb::Error TrigramIndex::openTables(DB_ENV *dbEnv, u_int32_t flags)
+{
+    ProjectDb::Error error;
+    m_dbEnv = dbEnv;
+
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_fileTable, FILE_TABLE, 0, flags);
+    if (error.code)
+        return error;
+
+    error.dbUri = m_idTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_idTable, ID_TABLE, 0, flags);
+    if (error.code)
+        return error;
+
+    error.dbUri = m_trigramTableDbUri.c_str();
+    error.code = openTable(m_dbEnv, m_trigramTable, TRIGRAM_TABLE,
+                           DB_DUPSORT, flags);
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::create(DB_ENV *dbEnv)
+{
+    return openTables(dbEnv, DB_CREATE | DB_EXCL);
+}
+
+// Projects created before the index was introduced lack the tables.  Create
+// them and the files will be indexed in the background.
+ProjectDb::Error TrigramIndex::open(DB_ENV *dbEnv)
+{
+    return openTables(dbEnv, DB_CREATE);
+}
+
+ProjectDb::Error TrigramIndex::close()
+{
+    ProjectDb::Error error;
+    if (m_fileTable)
+    {
+        error.dbUri = m_fileTableDbUri.c_str();
+        error.code = m_fileTable->close(m_fileTable, 0);
+        if (error.code)
+            return error;
+        m_fileTable = NULL;
+    }
+    if (m_idTable)
+    {
+        error.dbUri = m_idTableDbUri.c_str();
+        error.code = m_idTable->close(m_idTable, 0);
+        if (error.code)
+            return error;
+        m_idTable = NULL;
+    }
+    if (m_trigramTable)
+    {
+        error.dbUri = m_trigramTableDbUri.c_str();
+        error.code = m_trigramTable->close(m_trigramTable, 0);
+        if (error.code)
+            return error;
+        m_trigramTable = NULL;
+    }
+    m_dbEnv = NULL;
+    return error;
+}
+
+void TrigramIndex::extractTrigrams(const char *text,
+                                   int length,
+                                   std::vector<guint32> &trigrams)
+{
+    trigrams.clear();
+    if (length < 3)
+        return;
+    trigrams.reserve(length - 2);
+    guint32 trigram =
+        (static_cast<unsigned char>(g_ascii_tolower(text[0])) << 8) |
+        static_cast<unsigned char>(g_ascii_tolower(text[1]));
+    for (const char *cp = text + 2; cp < text + length; cp++)
+    {
+        trigram = ((trigram << 8) |
+                   static_cast<unsigned char>(g_ascii_tolower(*cp))) &
+            0xffffff;
+        trigrams.push_back(trigram);
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                   trigrams.end());
+}
+
+ProjectDb::Error TrigramIndex::readFileRecord(const char *uri,
+                                              DB_TXN *txn,
+                                              guint32 &id,
+                                              std::vector<guint32> &trigrams)
+{
+    ProjectDb::Error error;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    data.flags = DB_DBT_MALLOC;
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = m_fileTable->get(m_fileTable, txn, &key, &data,
+                                  txn ? DB_RMW : 0);
+    if (error.code)
+        return error;
+    const unsigned char *record = static_cast<unsigned char *>(data.data);
+    memcpy(&id, record, sizeof(guint32));
+    trigrams.clear();
+    trigrams.reserve((data.size - FILE_RECORD_HEADER_SIZE) / 3);
+    for (u_int32_t offset = FILE_RECORD_HEADER_SIZE;
+         offset + 3 <= data.size;
+         offset += 3)
+        trigrams.push_back(unpackTrigram(record + offset));
+    free(data.data);
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::allocateId(DB_TXN *txn, guint32 &id)
+{
+    ProjectDb::Error error;
+    DBC *cursor;
+    error.dbUri = m_idTableDbUri.c_str();
+    error.code = m_idTable->cursor(m_idTable, txn, &cursor, 0);
+    if (error.code)
+        return error;
+    guint32 lastId;
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = &lastId;
+    key.ulen = sizeof(guint32);
+    key.flags = DB_DBT_USERMEM;
+    data.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+    // The big-endian IDs are sorted by their values.
+    error.code = cursor->get(cursor, &key, &data, DB_LAST | DB_RMW);
+    if (!error.code)
+        id = GUINT32_FROM_BE(lastId) + 1;
+    else if (error.code == DB_NOTFOUND)
+    {
+        id = 1;
+        error.code = 0;
+    }
+    cursor->close(cursor);
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::updateFile(const char *uri,
+                                          const Time &modifiedTime,
+                                          const std::vector<guint32> &trigrams,
+                                          DB_TXN *txn)
+{
+    ProjectDb::Error error;
+    guint32 id;
+    std::vector<guint32> oldTrigrams;
+    error = readFileRecord(uri, txn, id, oldTrigrams);
+    if (error.code == DB_NOTFOUND)
+    {
+        error = allocateId(txn, id);
+        if (error.code)
+            return error;
+        guint32 beId = GUINT32_TO_BE(id);
+        DBT key, data;
+        memset(&key, 0, sizeof(DBT));
+        memset(&data, 0, sizeof(DBT));
+        key.data = &beId;
+        key.size = sizeof(guint32);
+        data.data = const_cast<char *>(uri);
+        data.size = strlen(uri);
+        error.dbUri = m_idTableDbUri.c_str();
+        error.code = m_idTable->put(m_idTable, txn, &key, &data,
+                                    DB_NOOVERWRITE);
+    }
+    if (error.code)
+        return error;
+
+    // Update the trigrams added to or removed from the file only.
+    std::vector<guint32> added, removed;
+    std::set_difference(trigrams.begin(), trigrams.end(),
+                        oldTrigrams.begin(), oldTrigrams.end(),
+                        std::back_inserter(added));
+    std::set_difference(oldTrigrams.begin(), oldTrigrams.end(),
+                        trigrams.begin(), trigrams.end(),
+                        std::back_inserter(removed));
+
+    guint32 beId = GUINT32_TO_BE(id);
+    unsigned char trigramBytes[3];
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = trigramBytes;
+    key.size = 3;
+    data.data = &beId;
+    data.size = sizeof(guint32);
+    error.dbUri = m_trigramTableDbUri.c_str();
+    if (!removed.empty())
+    {
+        DBC *cursor;
+        error.code = m_trigramTable->cursor(m_trigramTable, txn, &cursor, 0);
+        if (error.code)
+            return error;
+        for (std::vector<guint32>::const_iterator it = removed.begin();
+             it != removed.end();
+             ++it)
+        {
+            packTrigram(*it, trigramBytes);
+            error.code = cursor->get(cursor, &key, &data,
+                                     DB_GET_BOTH | DB_RMW);
+            if (!error.code)
+                error.code = cursor->del(cursor, 0);
+            if (error.code == DB_NOTFOUND)
+                error.code = 0;
+            if (error.code)
+                break;
+        }
+        cursor->close(cursor);
+        if (error.code)
+            return error;
+    }
+    for (std::vector<guint32>::const_iterator it = added.begin();
+         it != added.end();
+         ++it)
+    {
+        packTrigram(*it, trigramBytes);
+        error.code = m_trigramTable->put(m_trigramTable, txn, &key, &data,
+                                         DB_NODUPDATA);
+        if (error.code == DB_KEYEXIST)
+            error.code = 0;
+        if (error.code)
+            return error;
+    }
+
+    // Write the file record.
+    u_int32_t recordSize = FILE_RECORD_HEADER_SIZE + trigrams.size() * 3;
+    unsigned char *record = static_cast<unsigned char *>(malloc(recordSize));
+    memcpy(record, &id, sizeof(guint32));
+    memcpy(record + sizeof(guint32), &modifiedTime.seconds, sizeof(guint64));
+    memcpy(record + sizeof(guint32) + sizeof(guint64),
+           &modifiedTime.microSeconds, sizeof(guint32));
+    unsigned char *p = record + FILE_RECORD_HEADER_SIZE;
+    for (std::vector<guint32>::const_iterator it = trigrams.begin();
+         it != trigrams.end();
+         ++it, p += 3)
+        packTrigram(*it, p);
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    data.data = record;
+    data.size = recordSize;
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = m_fileTable->put(m_fileTable, txn, &key, &data, 0);
+    free(record);
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::indexFile(const char *uri,
+                                         const Time &modifiedTime,
+                                         const std::vector<guint32> &trigrams)
+{
+    return ProjectDb::runTransaction(m_dbEnv,
+                                     m_fileTableDbUri.c_str(),
+                                     boost::bind(updateFile, this, uri,
+                                                 boost::cref(modifiedTime),
+                                                 boost::cref(trigrams),
+                                                 _1));
+}
+
+ProjectDb::Error TrigramIndex::removeFileInternally(const char *uri,
+                                                    DB_TXN *txn)
+{
+    ProjectDb::Error error;
+    guint32 id;
+    std::vector<guint32> trigrams;
+    error = readFileRecord(uri, txn, id, trigrams);
+    if (error.code)
+        return error;
+
+    guint32 beId = GUINT32_TO_BE(id);
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    if (!trigrams.empty())
+    {
+        unsigned char trigramBytes[3];
+        key.data = trigramBytes;
+        key.size = 3;
+        data.data = &beId;
+        data.size = sizeof(guint32);
+        DBC *cursor;
+        error.dbUri = m_trigramTableDbUri.c_str();
+        error.code = m_trigramTable->cursor(m_trigramTable, txn, &cursor, 0);
+        if (error.code)
+            return error;
+        for (std::vector<guint32>::const_iterator it = trigrams.begin();
+             it != trigrams.end();
+             ++it)
+        {
+            packTrigram(*it, trigramBytes);
+            error.code = cursor->get(cursor, &key, &data,
+                                     DB_GET_BOTH | DB_RMW);
+            if (!error.code)
+                error.code = cursor->del(cursor, 0);
+            if (error.code == DB_NOTFOUND)
+                error.code = 0;
+            if (error.code)
+                break;
+        }
+        cursor->close(cursor);
+        if (error.code)
+            return error;
+    }
+
+    key.data = &beId;
+    key.size = sizeof(guint32);
+    error.dbUri = m_idTableDbUri.c_str();
+    error.code = m_idTable->del(m_idTable, txn, &key, 0);
+    if (error.code && error.code != DB_NOTFOUND)
+        return error;
+
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = m_fileTable->del(m_fileTable, txn, &key, 0);
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::removeFile(const char *uri, DB_TXN *txn)
+{
+    if (txn)
+        return removeFileInternally(uri, txn);
+    return ProjectDb::runTransaction(m_dbEnv,
+                                     m_fileTableDbUri.c_str(),
+                                     boost::bind(removeFileInternally, this,
+                                                 uri, _1));
+}
+
+ProjectDb::Error TrigramIndex::readModifiedTime(const char *uri,
+                                                Time &modifiedTime)
+{
+    ProjectDb::Error error;
+    unsigned char header[FILE_RECORD_HEADER_SIZE];
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = const_cast<char *>(uri);
+    key.size = strlen(uri);
+    data.data = header;
+    data.ulen = FILE_RECORD_HEADER_SIZE;
+    data.dlen = FILE_RECORD_HEADER_SIZE;
+    data.doff = 0;
+    data.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+    error.dbUri = m_fileTableDbUri.c_str();
+    error.code = m_fileTable->get(m_fileTable, NULL, &key, &data, 0);
+    if (error.code)
+        return error;
+    memcpy(&modifiedTime.seconds, header + sizeof(guint32), sizeof(guint64));
+    memcpy(&modifiedTime.microSeconds,
+           header + sizeof(guint32) + sizeof(guint64),
+           sizeof(guint32));
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::readFileIds(guint32 trigram,
+                                           std::vector<guint32> &ids)
+{
+    ProjectDb::Error error;
+    ids.clear();
+    DBC *cursor;
+    error.dbUri = m_trigramTableDbUri.c_str();
+    error.code = m_trigramTable->cursor(m_trigramTable, NULL, &cursor,
+                                        DB_READ_COMMITTED);
+    if (error.code)
+        return error;
+
+    // Read the duplicate IDs in bulk.
+    unsigned char trigramBytes[3];
+    packTrigram(trigram, trigramBytes);
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    key.data = trigramBytes;
+    key.size = 3;
+    key.ulen = 3;
+    key.flags = DB_DBT_USERMEM;
+    data.ulen = BULK_BUFFER_SIZE;
+    data.data = malloc(data.ulen);
+    data.flags = DB_DBT_USERMEM;
+    u_int32_t op = DB_SET;
+    for (;;)
+    {
+        error.code = cursor->get(cursor, &key, &data, op | DB_MULTIPLE);
+        if (error.code)
+        {
+            if (error.code == DB_NOTFOUND)
+                error.code = 0;
+            break;
+        }
+        op = DB_NEXT_DUP;
+        void *p;
+        DB_MULTIPLE_INIT(p, &data);
+        for (;;)
+        {
+            void *id;
+            u_int32_t idLen;
+            DB_MULTIPLE_NEXT(p, &data, id, idLen);
+            if (!p)
+                break;
+            if (idLen != sizeof(guint32))
+                continue;
+            guint32 beId;
+            memcpy(&beId, id, sizeof(guint32));
+            ids.push_back(GUINT32_FROM_BE(beId));
+        }
+    }
+    cursor->close(cursor);
+    free(data.data);
+    return error;
+}
+
+ProjectDb::Error TrigramIndex::findFiles(const std::vector<guint32> &trigrams,
+                                         std::vector<std::string> &uris)
+{
+    ProjectDb::Error error;
+    uris.clear();
+
+    // Intersect the sorted IDs of the files containing each trigram, stopping
+    // as soon as the intersection becomes empty.
+    std::vector<guint32> ids, moreIds, intersection;
+    for (std::vector<guint32>::const_iterator it = trigrams.begin();
+         it != trigrams.end();
+         ++it)
+    {
+        error = readFileIds(*it, it == trigrams.begin() ? ids : moreIds);
+        if (error.code)
+            return error;
+        if (it != trigrams.begin())
+        {
+            intersection.clear();
+            std::set_intersection(ids.begin(), ids.end(),
+                                  moreIds.begin(), moreIds.end(),
+                                  std::back_inserter(intersection));
+            ids.swap(intersection);
+        }
+        if (ids.empty())
+            return error;
+    }
+
+    // Map the IDs to the URIs.
+    uris.reserve(ids.size());
+    DBT key, data;
+    memset(&key, 0, sizeof(DBT));
+    memset(&data, 0, sizeof(DBT));
+    data.flags = DB_DBT_REALLOC;
+    error.dbUri = m_idTableDbUri.c_str();
+    for (std::vector<guint32>::const_iterator it = ids.begin();
+         it != ids.end();
+         ++it)
+    {
+        guint32 beId = GUINT32_TO_BE(*it);
+        key.data = &beId;
+        key.size = sizeof(guint32);
+        error.code = m_idTable->get(m_idTable, NULL, &key, &data, 0);
+        if (error.code == DB_NOTFOUND)
+            continue;
+        if (error.code)
+            break;
+        uris.push_back(std::string(static_cast<char *>(data.data), data.size));
+    }
+    free(data.data);
+    if (error.code == DB_NOTFOUND)
+        error.code = 0;
+    return error;
+}
+
+}
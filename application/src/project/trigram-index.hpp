@@ -0,0 +1,124 @@
+// Trigram index.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_TRIGRAM_INDEX_HPP
+#define SMYD_TRIGRAM_INDEX_HPP
+
+#include "project-db.hpp"
+#include "utilities/miscellaneous.hpp"
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <glib.h>
+#include <db.h>
+
+namespace Samoyed
+{
+
+/**
+ * A trigram index maps each sequence of three bytes to the files containing
+ * it, so that a text search can read only the files containing all the
+ * trigrams of the searched text instead of all the files in the project.  The
+ * trigrams are extracted with ASCII letters folded to lower case, so that the
+ * index serves both case-sensitive and case-insensitive searches.  The files
+ * found by the index are candidates only and still need to be searched.
+ *
+ * The index is kept in the tables of the project database environment:
+ * - the indexed files, keyed by their URIs, each recording its ID, the
+ *   modified time when indexed and its trigrams;
+ * - the URIs of the files keyed by their IDs;
+ * - the sorted IDs of the files containing each trigram, keyed by the trigram.
+ *
+ * Updating a file replaces only the trigrams added to or removed from it.
+ */
+class TrigramIndex: public boost::noncopyable
+{
+public:
+    TrigramIndex(const char *dbEnvUri);
+
+    ~TrigramIndex();
+
+    ProjectDb::Error create(DB_ENV *dbEnv);
+
+    ProjectDb::Error open(DB_ENV *dbEnv);
+
+    ProjectDb::Error close();
+
+    /**
+     * Extract the distinct trigrams of text.
+     * @param text The text.
+     * @param length The length of the text, in bytes.
+     * @param trigrams The sorted trigrams, each of which is packed into the
+     * lowest 24 bits of an integer.
+     */
+    static void extractTrigrams(const char *text,
+                                int length,
+                                std::vector<guint32> &trigrams);
+
+    /**
+     * Index a file, replacing its indexed trigrams, if any.
+     * @param uri The URI of the file.
+     * @param modifiedTime The modified time of the indexed contents.
+     * @param trigrams The sorted distinct trigrams of the contents.
+     */
+    ProjectDb::Error indexFile(const char *uri,
+                               const Time &modifiedTime,
+                               const std::vector<guint32> &trigrams);
+
+    ProjectDb::Error removeFile(const char *uri, DB_TXN *txn = NULL);
+
+    /**
+     * Read the modified time of a file when it was indexed.
+     * @return 'DB_NOTFOUND' if the file is not indexed.
+     */
+    ProjectDb::Error readModifiedTime(const char *uri, Time &modifiedTime);
+
+    /**
+     * Find the indexed files containing all the trigrams.
+     * @param trigrams The sorted distinct trigrams, which must not be empty.
+     * @param uris The URIs of the found files.
+     */
+    ProjectDb::Error findFiles(const std::vector<guint32> &trigrams,
+                               std::vector<std::string> &uris);
+
+private:
+    ProjectDb::Error openTables(DB_ENV *dbEnv, u_int32_t flags);
+
+    ProjectDb::Error readFileRecord(const char *uri,
+                                    DB_TXN *txn,
+                                    guint32 &id,
+                                    std::vector<guint32> &trigrams);
+
+    ProjectDb::Error allocateId(DB_TXN *txn, guint32 &id);
+
+    ProjectDb::Error updateFile(const char *uri,
+                                const Time &modifiedTime,
+                                const std::vector<guint32> &trigrams,
+                                DB_TXN *txn);
+
+    ProjectDb::Error removeFileInternally(const char *uri, DB_TXN *txn);
+
+    ProjectDb::Error readFileIds(guint32 trigram, std::vector<guint32> &ids);
+
+    DB_ENV *m_dbEnv;
+
+    // The indexed files keyed by their URIs.  Each record consists of the
+    // 32-bit ID, the 64-bit seconds and the 32-bit microseconds of the modified
+    // time, and the trigrams, three bytes each.
+    DB *m_fileTable;
+
+    // The URIs of the indexed files keyed by their big-endian 32-bit IDs.
+    DB *m_idTable;
+
+    // The big-endian 32-bit IDs of the files containing each trigram, keyed by
+    // the three bytes of the trigram.  The duplicate IDs are sorted.
+    DB *m_trigramTable;
+
+    std::string m_fileTableDbUri;
+    std::string m_idTableDbUri;
+    std::string m_trigramTableDbUri;
+};
+
+}
+
+#endif
@@ -0,0 +1,276 @@
+// Trigram indexer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "trigram-indexer.hpp"
+#include "trigram-index.hpp"
+#include "project.hpp"
+#include "project-db.hpp"
+#include "project-file.hpp"
+#include "utilities/abort-flag.hpp"
+#include "utilities/miscellaneous.hpp"
+#include "utilities/worker.hpp"
+#include "application.hpp"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+namespace
+{
+
+// The number of the leading bytes checked to detect binary files, which are
+// indexed with no trigrams.
+const gsize BINARY_CHECK_SIZE = 8192;
+
+bool isIndexed(int type)
+{
+    return type == Samoyed::ProjectFile::TYPE_SOURCE_FILE ||
+        type == Samoyed::ProjectFile::TYPE_HEADER_FILE ||
+        type == Samoyed::ProjectFile::TYPE_GENERIC_FILE;
+}
+
+bool collectFile(std::vector<std::string> *uris,
+                 const char *uri,
+                 int uriLength,
+                 const Samoyed::ProjectFile::View &data)
+{
+    if (isIndexed(data.type()))
+        uris->push_back(std::string(uri, uriLength));
+    return false;
+}
+
+}
+
+namespace Samoyed
+{
+
+/**
+ * A builder indexes a list of files, one in each step.  When indexing all the
+ * files, it lists the files from the project database in the first step.
+ */
+class TrigramIndexer::Builder: public Worker
+{
+public:
+    Builder(Scheduler &scheduler,
+            unsigned int priority,
+            Project &project,
+            bool all):
+        Worker(scheduler, priority),
+        m_project(project),
+        m_all(all),
+        m_listed(!all),
+        m_next(0)
+    {
+        char *desc = g_strdup_printf(_("Indexing project \"%s\"."),
+                                     project.uri());
+        setDescription(desc);
+        g_free(desc);
+    }
+
+    bool all() const { return m_all; }
+
+    std::vector<std::string> &uris() { return m_uris; }
+
+    /**
+     * Stop indexing and wait until the project database is no longer
+     * accessed.
+     */
+    void abort() { m_abortFlag.abort(); }
+
+protected:
+    virtual bool step();
+
+private:
+    void indexFile(const char *uri);
+
+    Project &m_project;
+    const bool m_all;
+    bool m_listed;
+    std::vector<std::string> m_uris;
+    std::vector<std::string>::size_type m_next;
+
+    AbortFlag m_abortFlag;
+};
+
+bool TrigramIndexer::Builder::step()
+{
+    AbortFlag::Scope scope(m_abortFlag);
+    if (m_abortFlag.aborted())
+        return true;
+    if (!m_listed)
+    {
+        m_listed = true;
+        std::string prefix(m_project.uri());
+        prefix += '/';
+        m_project.db().visitFilesInBulk(prefix.c_str(),
+                                        boost::bind(collectFile, &m_uris,
+                                                    _1, _2, _3));
+        return m_uris.empty();
+    }
+    if (m_next < m_uris.size())
+        indexFile(m_uris[m_next++].c_str());
+    return m_next >= m_uris.size();
+}
+
+void TrigramIndexer::Builder::indexFile(const char *uri)
+{
+    TrigramIndex &index = m_project.db().trigramIndex();
+    GFile *file = g_file_new_for_uri(uri);
+    GFileInfo *fileInfo =
+        g_file_query_info(file,
+                          G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                          G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                          G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                          G_FILE_QUERY_INFO_NONE,
+                          NULL,
+                          NULL);
+    g_object_unref(file);
+    if (!fileInfo || g_file_info_get_file_type(fileInfo) != G_FILE_TYPE_REGULAR)
+    {
+        if (fileInfo)
+            g_object_unref(fileInfo);
+        index.removeFile(uri);
+        return;
+    }
+    Time modifiedTime;
+    modifiedTime.seconds = g_file_info_get_attribute_uint64(
+        fileInfo,
+        G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    modifiedTime.microSeconds = g_file_info_get_attribute_uint32(
+        fileInfo,
+        G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    g_object_unref(fileInfo);
+
+    // When indexing all the files, skip the file if unchanged since indexed.
+    // The files reported as changed are always reindexed, because a file
+    // changed twice within the resolution of the modified time looks
+    // unchanged.
+    Time indexedTime;
+    if (m_all &&
+        !index.readModifiedTime(uri, indexedTime).code &&
+        indexedTime.seconds == modifiedTime.seconds &&
+        indexedTime.microSeconds == modifiedTime.microSeconds)
+        return;
+
+    char *fileName = g_filename_from_uri(uri, NULL, NULL);
+    if (!fileName)
+        return;
+    std::vector<guint32> trigrams;
+    GMappedFile *mapped = g_mapped_file_new(fileName, FALSE, NULL);
+    g_free(fileName);
+    if (mapped)
+    {
+        const char *contents = g_mapped_file_get_contents(mapped);
+        gsize length = g_mapped_file_get_length(mapped);
+        if (contents &&
+            !memchr(contents, '\0', std::min(length, BINARY_CHECK_SIZE)))
+            TrigramIndex::extractTrigrams(contents, length, trigrams);
+        g_mapped_file_unref(mapped);
+    }
+    index.indexFile(uri, modifiedTime, trigrams);
+}
+
+TrigramIndexer::TrigramIndexer(Project &project):
+    m_project(project),
+    m_built(false)
+{
+    m_fileAddedConn = project.addFileAddedCallback(
+        boost::bind(onFileAdded, this, _1, _2, _3));
+    m_filesAddedConn = project.addFilesAddedCallback(
+        boost::bind(onFilesAdded, this, _1, _2, _3));
+}
+
+TrigramIndexer::~TrigramIndexer()
+{
+    m_fileAddedConn.disconnect();
+    m_filesAddedConn.disconnect();
+    if (m_builder)
+    {
+        m_builderFinishedConn.disconnect();
+        m_builderCanceledConn.disconnect();
+        m_builder->cancel(m_builder);
+        m_builder->abort();
+    }
+}
+
+void TrigramIndexer::start()
+{
+    startBuilder(true);
+}
+
+void TrigramIndexer::updateFiles(const std::vector<std::string> &uris)
+{
+    m_pendingUris.insert(m_pendingUris.end(), uris.begin(), uris.end());
+    if (!m_builder)
+        startBuilder(false);
+}
+
+void TrigramIndexer::onFileAdded(Project &project,
+                                 const char *uri,
+                                 const ProjectFile &data)
+{
+    if (!isIndexed(data.type()))
+        return;
+    m_pendingUris.push_back(uri);
+    if (!m_builder)
+        startBuilder(false);
+}
+
+void TrigramIndexer::onFilesAdded(Project &project,
+                                  const std::vector<const char *> &uris,
+                                  const std::vector<const ProjectFile *> &data)
+{
+    for (std::vector<const char *>::size_type i = 0; i < uris.size(); i++)
+        if (isIndexed(data[i]->type()))
+            m_pendingUris.push_back(uris[i]);
+    if (!m_pendingUris.empty() && !m_builder)
+        startBuilder(false);
+}
+
+void TrigramIndexer::startBuilder(bool all)
+{
+    m_builder.reset(new Builder(Application::instance().scheduler(),
+                                Worker::PRIORITY_IDLE,
+                                m_project,
+                                all));
+    if (!all)
+    {
+        std::sort(m_pendingUris.begin(), m_pendingUris.end());
+        m_pendingUris.erase(std::unique(m_pendingUris.begin(),
+                                        m_pendingUris.end()),
+                            m_pendingUris.end());
+        m_builder->uris().swap(m_pendingUris);
+    }
+    m_builderFinishedConn = m_builder->addFinishedCallbackInMainThread(
+        boost::bind(onBuilderFinished, this, _1));
+    m_builderCanceledConn = m_builder->addCanceledCallbackInMainThread(
+        boost::bind(onBuilderCanceled, this, _1));
+    m_builder->submit(m_builder);
+}
+
+void TrigramIndexer::onBuilderFinished(const boost::shared_ptr<Worker> &worker)
+{
+    if (worker != m_builder)
+        return;
+    if (m_builder->all())
+        m_built = true;
+    m_builder.reset();
+    if (!m_pendingUris.empty() && !m_project.closing())
+        startBuilder(false);
+}
+
+void TrigramIndexer::onBuilderCanceled(const boost::shared_ptr<Worker> &worker)
+{
+    if (worker == m_builder)
+        m_builder.reset();
+}
+
+}
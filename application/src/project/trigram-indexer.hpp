@@ -0,0 +1,87 @@
+// Trigram indexer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_TRIGRAM_INDEXER_HPP
+#define SMYD_TRIGRAM_INDEXER_HPP
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2/connection.hpp>
+
+namespace Samoyed
+{
+
+class Project;
+class ProjectFile;
+class Worker;
+
+/**
+ * A trigram indexer keeps the trigram index of a project up to date in the
+ * background.  When the project is opened, the indexer indexes the files whose
+ * modified times differ from the indexed ones.  Afterwards, the files added to
+ * the project are indexed, and the files changed on disk or saved are
+ * reindexed as they are reported.
+ */
+class TrigramIndexer: public boost::noncopyable
+{
+public:
+    TrigramIndexer(Project &project);
+
+    /**
+     * Stop indexing and wait until the project database is no longer
+     * accessed.
+     */
+    ~TrigramIndexer();
+
+    /**
+     * Start indexing all the files in the project.
+     */
+    void start();
+
+    /**
+     * Reindex the changed files.
+     * @param uris The URIs of the changed files.
+     */
+    void updateFiles(const std::vector<std::string> &uris);
+
+    /**
+     * @return True iff all the files are indexed and no file is being
+     * reindexed, i.e., the index can be used to narrow down searches.
+     */
+    bool ready() const { return m_built && !m_builder; }
+
+private:
+    class Builder;
+
+    void startBuilder(bool all);
+
+    void onFileAdded(Project &project,
+                     const char *uri,
+                     const ProjectFile &data);
+    void onFilesAdded(Project &project,
+                      const std::vector<const char *> &uris,
+                      const std::vector<const ProjectFile *> &data);
+
+    void onBuilderFinished(const boost::shared_ptr<Worker> &worker);
+    void onBuilderCanceled(const boost::shared_ptr<Worker> &worker);
+
+    Project &m_project;
+
+    boost::shared_ptr<Builder> m_builder;
+    boost::signals2::connection m_builderFinishedConn;
+    boost::signals2::connection m_builderCanceledConn;
+
+    // The files changed while the builder is running.
+    std::vector<std::string> m_pendingUris;
+
+    bool m_built;
+
+    boost::signals2::connection m_fileAddedConn;
+    boost::signals2::connection m_filesAddedConn;
+};
+
+}
+
+#endif
@@ -0,0 +1,61 @@
+// Abort flag of background workers.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_ABORT_FLAG_HPP
+#define SMYD_ABORT_FLAG_HPP
+
+#include <boost/utility.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace Samoyed
+{
+
+/**
+ * An abort flag lets the main thread stop a worker using a resource that is
+ * about to be destroyed, e.g., the project database, and wait until the
+ * resource is no longer used.  Unlike canceling, aborting interrupts the step
+ * in progress.  The worker holds a scope of the flag while using the resource
+ * in each step, and checks the flag when entering the scope and periodically
+ * in long operations.
+ */
+class AbortFlag: public boost::noncopyable
+{
+public:
+    class Scope: public boost::noncopyable
+    {
+    public:
+        Scope(AbortFlag &flag): m_lock(flag.m_useMutex) {}
+
+    private:
+        boost::mutex::scoped_lock m_lock;
+    };
+
+    AbortFlag(): m_aborted(false) {}
+
+    /**
+     * Set the flag and wait until the worker leaves the scope, if in it.
+     */
+    void abort()
+    {
+        {
+            boost::mutex::scoped_lock lock(m_abortMutex);
+            m_aborted = true;
+        }
+        boost::mutex::scoped_lock lock(m_useMutex);
+    }
+
+    bool aborted() const
+    {
+        boost::mutex::scoped_lock lock(m_abortMutex);
+        return m_aborted;
+    }
+
+private:
+    bool m_aborted;
+    mutable boost::mutex m_abortMutex;
+    boost::mutex m_useMutex;
+};
+
+}
+
+#endif
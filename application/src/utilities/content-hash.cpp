@@ -0,0 +1,195 @@
+// Content hash.
+// Copyright (C) 2015 Gang Chen.
+
+/*
+UNIT TEST BUILD
+g++ content-hash.cpp -DSMYD_CONTENT_HASH_UNIT_TEST \
+`pkg-config --cflags --libs glib-2.0` -Werror -Wall -o content-hash
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "content-hash.hpp"
+#ifdef SMYD_CONTENT_HASH_UNIT_TEST
+# include <assert.h>
+#endif
+#include <string.h>
+#include <algorithm>
+#include <glib.h>
+
+namespace
+{
+
+const guint64 PRIME1 = G_GUINT64_CONSTANT(11400714785074694791);
+const guint64 PRIME2 = G_GUINT64_CONSTANT(14029467366897019727);
+const guint64 PRIME3 = G_GUINT64_CONSTANT(1609587929392839161);
+const guint64 PRIME4 = G_GUINT64_CONSTANT(9650029242287828579);
+const guint64 PRIME5 = G_GUINT64_CONSTANT(2870177450012600261);
+
+inline guint64 rotateLeft(guint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline guint64 read64(const unsigned char *p)
+{
+    guint64 v;
+    memcpy(&v, p, sizeof(v));
+    return GUINT64_FROM_LE(v);
+}
+
+inline guint32 read32(const unsigned char *p)
+{
+    guint32 v;
+    memcpy(&v, p, sizeof(v));
+    return GUINT32_FROM_LE(v);
+}
+
+inline guint64 mixRound(guint64 acc, guint64 input)
+{
+    acc += input * PRIME2;
+    acc = rotateLeft(acc, 31);
+    return acc * PRIME1;
+}
+
+inline guint64 mergeRound(guint64 acc, guint64 val)
+{
+    acc ^= mixRound(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+}
+
+namespace Samoyed
+{
+
+ContentHash::ContentHash():
+    m_totalLength(0),
+    m_bufferLength(0)
+{
+    m_accumulators[0] = PRIME1 + PRIME2;
+    m_accumulators[1] = PRIME2;
+    m_accumulators[2] = 0;
+    m_accumulators[3] = -PRIME1;
+}
+
+void ContentHash::update(const char *data, int length)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + length;
+    m_totalLength += length;
+
+    // Fill the buffered stripe first.
+    if (m_bufferLength)
+    {
+        int n = std::min(32 - m_bufferLength, length);
+        memcpy(m_buffer + m_bufferLength, p, n);
+        m_bufferLength += n;
+        p += n;
+        if (m_bufferLength < 32)
+            return;
+        for (int i = 0; i < 4; i++)
+            m_accumulators[i] = mixRound(m_accumulators[i],
+                                      read64(m_buffer + i * 8));
+        m_bufferLength = 0;
+    }
+
+    // Consume the whole stripes in place.
+    guint64 a0 = m_accumulators[0], a1 = m_accumulators[1],
+            a2 = m_accumulators[2], a3 = m_accumulators[3];
+    for (; end - p >= 32; p += 32)
+    {
+        a0 = mixRound(a0, read64(p));
+        a1 = mixRound(a1, read64(p + 8));
+        a2 = mixRound(a2, read64(p + 16));
+        a3 = mixRound(a3, read64(p + 24));
+    }
+    m_accumulators[0] = a0;
+    m_accumulators[1] = a1;
+    m_accumulators[2] = a2;
+    m_accumulators[3] = a3;
+
+    memcpy(m_buffer, p, end - p);
+    m_bufferLength = end - p;
+}
+
+guint64 ContentHash::digest() const
+{
+    guint64 h;
+    if (m_totalLength >= 32)
+    {
+        h = rotateLeft(m_accumulators[0], 1) +
+            rotateLeft(m_accumulators[1], 7) +
+            rotateLeft(m_accumulators[2], 12) +
+            rotateLeft(m_accumulators[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = mergeRound(h, m_accumulators[i]);
+    }
+    else
+        h = m_accumulators[2] + PRIME5;
+    h += m_totalLength;
+
+    const unsigned char *p = m_buffer;
+    const unsigned char *end = m_buffer + m_bufferLength;
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= mixRound(0, read64(p));
+        h = rotateLeft(h, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4)
+    {
+        h ^= static_cast<guint64>(read32(p)) * PRIME1;
+        h = rotateLeft(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * PRIME5;
+        h = rotateLeft(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+guint64 ContentHash::hash(const char *data, int length)
+{
+    ContentHash h;
+    h.update(data, length);
+    return h.digest();
+}
+
+}
+
+#ifdef SMYD_CONTENT_HASH_UNIT_TEST
+
+int main()
+{
+    assert(Samoyed::ContentHash::hash("", 0) ==
+           G_GUINT64_CONSTANT(0xEF46DB3751D8E999));
+    assert(Samoyed::ContentHash::hash("a", 1) ==
+           G_GUINT64_CONSTANT(0xD24EC4F1A98C6E5B));
+    assert(Samoyed::ContentHash::hash("abc", 3) ==
+           G_GUINT64_CONSTANT(0x44BC2CF5AD770999));
+
+    // Hashing incrementally is the same as hashing at once.
+    char data[1000];
+    for (int i = 0; i < 1000; i++)
+        data[i] = i * 7;
+    guint64 h = Samoyed::ContentHash::hash(data, 1000);
+    for (int step = 1; step < 70; step++)
+    {
+        Samoyed::ContentHash ch;
+        for (int i = 0; i < 1000; i += step)
+            ch.update(data + i, std::min(step, 1000 - i));
+        assert(ch.digest() == h);
+    }
+    return 0;
+}
+
+#endif // #ifdef SMYD_CONTENT_HASH_UNIT_TEST
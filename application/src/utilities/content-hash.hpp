@@ -0,0 +1,41 @@
+// Content hash.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_CONTENT_HASH_HPP
+#define SMYD_CONTENT_HASH_HPP
+
+#include <glib.h>
+
+namespace Samoyed
+{
+
+/**
+ * A content hash computes the 64-bit xxHash (XXH64) of a stream of bytes
+ * incrementally.  It is fast enough to hash the contents of files while they
+ * are read or written, so that files can be compared with their previous
+ * contents without keeping the contents.
+ */
+class ContentHash
+{
+public:
+    ContentHash();
+
+    void update(const char *data, int length);
+
+    guint64 digest() const;
+
+    /**
+     * Hash a block of bytes at once.
+     */
+    static guint64 hash(const char *data, int length);
+
+private:
+    guint64 m_accumulators[4];
+    guint64 m_totalLength;
+    unsigned char m_buffer[32];
+    int m_bufferLength;
+};
+
+}
+
+#endif
@@ -19,6 +19,7 @@ public:
                unsigned int priority,
                const char *uri):
         Worker(scheduler, priority),
+        m_contentHash(0),
         m_error(NULL),
         m_uri(uri)
     {}
@@ -33,10 +34,16 @@ public:
 
     const Time &modifiedTime() const { return m_modifiedTime; }
 
+    /**
+     * @return The content hash of the text, or 0 if not computed.
+     */
+    guint64 contentHash() const { return m_contentHash; }
+
     const GError *error() const { return m_error; }
 
 protected:
     Time m_modifiedTime;
+    guint64 m_contentHash;
     GError *m_error;
 
 private:
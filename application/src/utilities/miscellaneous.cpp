@@ -29,6 +29,7 @@ g++ miscellaneous.cpp -DSMYD_MISCELLANEOUS_UNIT_TEST \
 # include <gio/gwin32inputstream.h>
 # include <gio/gwin32outputstream.h>
 #else
+# include <fcntl.h>
 # include <unistd.h>
 #endif
 #include <glib.h>
@@ -191,12 +192,33 @@ protect_argv (const gchar  **argv,
 
 #else
 
-void mergeStderr(gpointer d)
+struct ChildSetupData
 {
-    gint result;
-    do
-        result = dup2(1, 2);
-    while (result == -1 && errno == EINTR);
+    bool mergeStderr;
+    const int *inheritedFds;
+};
+
+// Called in the child process after the file descriptors other than the
+// standard ones are marked close-on-exec.
+void setupChild(gpointer data)
+{
+    ChildSetupData *d = static_cast<ChildSetupData *>(data);
+    if (d->mergeStderr)
+    {
+        gint result;
+        do
+            result = dup2(1, 2);
+        while (result == -1 && errno == EINTR);
+    }
+    if (d->inheritedFds)
+    {
+        for (const int *fd = d->inheritedFds; *fd != -1; fd++)
+        {
+            int fdFlags = fcntl(*fd, F_GETFD);
+            if (fdFlags != -1)
+                fcntl(*fd, F_SETFD, fdFlags & ~FD_CLOEXEC);
+        }
+    }
 }
 
 #endif
@@ -309,7 +331,8 @@ bool spawnSubprocess(const char *cwd,
                      GOutputStream **stdinPipe,
                      GInputStream **stdoutPipe,
                      GInputStream **stderrPipe,
-                     GError **error)
+                     GError **error,
+                     const int *inheritedFds)
 {
 #ifdef OS_WINDOWS
 
@@ -562,13 +585,20 @@ ERROR_OUT:
     if (flags & SPAWN_SUBPROCESS_FLAG_STDERR_SILENCE)
         spawnFlags |= G_SPAWN_STDERR_TO_DEV_NULL;
     int stdinFd, stdoutFd, stderrFd;
+    ChildSetupData childSetupData;
+    childSetupData.mergeStderr = flags & SPAWN_SUBPROCESS_FLAG_STDERR_MERGE;
+    childSetupData.inheritedFds = inheritedFds;
+    // A child setup function forces GLib to fork and exec by itself instead of
+    // using posix_spawn(), so pass it only if needed.
+    bool childSetupNeeded =
+        childSetupData.mergeStderr || childSetupData.inheritedFds;
     if (!g_spawn_async_with_pipes(
             cwd,
             const_cast<char **>(argv),
             const_cast<char **>(env),
             static_cast<GSpawnFlags>(spawnFlags),
-            (flags & SPAWN_SUBPROCESS_FLAG_STDERR_MERGE) ? mergeStderr : NULL,
-            NULL,
+            childSetupNeeded ? setupChild : NULL,
+            childSetupNeeded ? &childSetupData : NULL,
             subprocessId,
             (flags & SPAWN_SUBPROCESS_FLAG_STDIN_PIPE) ? &stdinFd : NULL,
             (flags & SPAWN_SUBPROCESS_FLAG_STDOUT_PIPE) ? &stdoutFd : NULL,
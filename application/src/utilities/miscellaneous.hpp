@@ -160,6 +160,10 @@ enum SpawnSubprocessFlag
     SPAWN_SUBPROCESS_FLAG_STDERR_MERGE      = 1 << 5
 };
 
+/**
+ * @param inheritedFds The file descriptors, other than the standard ones, to be
+ * inherited by the subprocess, terminated by -1, or NULL.  Ignored on Windows.
+ */
 bool spawnSubprocess(const char *cwd,
                      const char **argv,
                      const char **env,
@@ -168,7 +172,8 @@ bool spawnSubprocess(const char *cwd,
                      GOutputStream **stdinPipe,
                      GInputStream **stdoutPipe,
                      GInputStream **stderrPipe,
-                     GError **error);
+                     GError **error,
+                     const int *inheritedFds = NULL);
 
 }
 
@@ -7,7 +7,9 @@
 #include "worker.hpp"
 #include "boost/threadpool.hpp"
 #include <stddef.h>
+#include <queue>
 #include <set>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 
@@ -35,6 +37,11 @@ private:
 /**
  * A scheduler schedules workers to run in background threads based on workers'
  * priorities.  It is implemented by a prioritized thread pool.
+ *
+ * The number of the concurrently running workers whose priorities are not
+ * higher than the background priority can be limited, e.g., to leave the
+ * processors to builds.  The workers exceeding the limit are held by the
+ * scheduler, in the queued state, until other such workers stop running.
  */
 class Scheduler:
     public boost::threadpool::thread_pool<WorkerAdapter,
@@ -50,15 +57,92 @@ public:
                                        boost::threadpool::static_size,
                                        boost::threadpool::resize_controller,
                                        boost::threadpool::wait_for_all_tasks>
-            (nThreads)
+            (nThreads),
+        m_backgroundWorkerLimit(0),
+        m_runningBackgroundWorkerCount(0)
     {}
 
+    ~Scheduler()
+    {
+        // Release the held workers so that they are waited for.
+        setBackgroundWorkerLimit(0);
+    }
+
+    /**
+     * @param limit The maximum number of the concurrently running workers whose
+     * priorities are not higher than the background priority, or 0 for no
+     * limit.
+     */
+    void setBackgroundWorkerLimit(int limit)
+    {
+        std::vector<WorkerAdapter> released;
+        {
+            boost::mutex::scoped_lock lock(m_throttleMutex);
+            m_backgroundWorkerLimit = limit;
+            while (!m_heldWorkers.empty())
+            {
+                released.push_back(m_heldWorkers.top());
+                m_heldWorkers.pop();
+            }
+        }
+        // The released workers will be held again if exceeding the new limit.
+        for (std::vector<WorkerAdapter>::const_iterator it = released.begin();
+             it != released.end();
+             ++it)
+            schedule(*it);
+    }
+
 private:
     unsigned int highestPendingWorkerPriority() const
     {
         return m_core->highest_pending_priority();
     }
 
+    /**
+     * Called before a worker starts running.
+     * @return False iff the worker is held.
+     */
+    bool admitWorker(const boost::shared_ptr<Worker> &worker)
+    {
+        if (worker->priority() > Worker::PRIORITY_BACKGROUND)
+            return true;
+        boost::mutex::scoped_lock lock(m_throttleMutex);
+        if (m_backgroundWorkerLimit > 0 &&
+            m_runningBackgroundWorkerCount >= m_backgroundWorkerLimit)
+        {
+            m_heldWorkers.push(WorkerAdapter(worker));
+            return false;
+        }
+        m_runningBackgroundWorkerCount++;
+        return true;
+    }
+
+    /**
+     * Called after an admitted worker stops running.
+     */
+    void releaseWorker(unsigned int priority)
+    {
+        if (priority > Worker::PRIORITY_BACKGROUND)
+            return;
+        std::vector<WorkerAdapter> released;
+        {
+            boost::mutex::scoped_lock lock(m_throttleMutex);
+            m_runningBackgroundWorkerCount--;
+            if (!m_heldWorkers.empty())
+            {
+                released.push_back(m_heldWorkers.top());
+                m_heldWorkers.pop();
+            }
+        }
+        if (!released.empty())
+            schedule(released.front());
+    }
+
+    int m_backgroundWorkerLimit;
+    int m_runningBackgroundWorkerCount;
+    std::priority_queue<WorkerAdapter> m_heldWorkers;
+    boost::mutex m_throttleMutex;
+
     friend class Worker;
 };
 
@@ -3,7 +3,7 @@
 
 /*
 UNIT TEST BUILD
-g++ text-file-loader.cpp worker.cpp utf8.cpp \
+g++ text-file-loader.cpp worker.cpp utf8.cpp content-hash.cpp \
 -DSMYD_TEXT_FILE_LOADER_UNIT_TEST `pkg-config --cflags --libs gtk+-3.0` \
 -I../../../libs -lboost_thread -pthread -Werror -Wall -o text-file-loader
 */
@@ -157,6 +157,7 @@ bool TextFileLoader::step()
             return true;
         }
         g_input_stream_close(m_stream, NULL, &m_error);
+        m_contentHash = m_hash.digest();
         return true;
     }
     size += m_readPointer - m_readBuffer;
@@ -172,6 +173,7 @@ bool TextFileLoader::step()
         return true;
     }
     m_buffer.push_back(std::string(m_readBuffer, valid - m_readBuffer));
+    m_hash.update(m_readBuffer, valid - m_readBuffer);
     size -= valid - m_readBuffer;
     memmove(m_readBuffer, valid, size);
     m_readPointer = m_readBuffer + size;
@@ -5,6 +5,7 @@
 #define SMYD_TEXT_FILE_LOADER_HPP
 
 #include "file-loader.hpp"
+#include "content-hash.hpp"
 #include <list>
 #include <string>
 #include <gio/gio.h>
@@ -39,6 +40,9 @@ private:
     GInputStream *m_stream;
     char *m_readBuffer;
     char *m_readPointer;
+
+    // The hash of the UTF-8 encoded text.
+    ContentHash m_hash;
 };
 
 }
@@ -3,7 +3,7 @@
 
 /*
 UNIT TEST BUILD
-g++ text-file-saver.cpp worker.cpp \
+g++ text-file-saver.cpp worker.cpp content-hash.cpp \
 -DSMYD_TEXT_FILE_SAVER_UNIT_TEST `pkg-config --cflags --libs gtk+-3.0` \
 -I../../../libs -lboost_thread -pthread -Werror -Wall -o text-file-saver
 */
@@ -12,6 +12,7 @@ g++ text-file-saver.cpp worker.cpp \
 # include <config.h>
 #endif
 #include "text-file-saver.hpp"
+#include "content-hash.hpp"
 #include "scheduler.hpp"
 #ifdef SMYD_TEXT_FILE_SAVER_UNIT_TEST
 # include <stdio.h>
@@ -87,10 +88,11 @@ bool TextFileSaver::step()
     }
 
     // Convert and write.
+    int length = m_length == -1 ? strlen(m_text.get()) : m_length;
     int size =
         g_output_stream_write(stream,
                               m_text.get(),
-                              m_length == -1 ? strlen(m_text.get()) : m_length,
+                              length,
                               NULL,
                               &m_error);
     if (size == -1)
@@ -107,6 +109,7 @@ bool TextFileSaver::step()
         return true;
     }
     g_object_unref(stream);
+    m_contentHash = ContentHash::hash(m_text.get(), length);
 
     // Get the time when the file was last modified.
     GFileInfo *fileInfo;
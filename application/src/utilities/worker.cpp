@@ -47,6 +47,11 @@ Worker::ExecutionWrapper::~ExecutionWrapper()
     s_ended(m_worker);
 }
 
+Worker::AdmissionReleaser::~AdmissionReleaser()
+{
+    m_worker.m_scheduler.releaseWorker(m_worker.m_priority);
+}
+
 void Worker::addDependency(const boost::shared_ptr<Worker> &dependency)
 {
     boost::mutex::scoped_lock lock(m_mutex);
@@ -124,10 +129,16 @@ void Worker::operator()(const boost::shared_ptr<Worker> &self)
 #endif
             return;
         }
+        if (!m_scheduler.admitWorker(self))
+        {
+            // The scheduler holds the worker and will schedule it again.
+            return;
+        }
         m_state = STATE_RUNNING;
     }
 
     {
+        AdmissionReleaser admission(*this);
         ExecutionWrapper wrapper(self);
         m_bypassWrapper = false;
         {
@@ -353,12 +364,19 @@ void Worker::unblock(const boost::shared_ptr<Worker> &self)
     // If the worker was blocked, unblock it and re-submit it.
     else if (m_state == STATE_BLOCKED)
     {
-        m_state = STATE_UNSUBMITTED;
+        m_state = STATE_QUEUED;
         m_scheduler.schedule(WorkerAdapter(self));
     }
     // If the worker was finished or canceled, do nothing.
 }
 
+void Worker::blockAfterStep()
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    assert(m_state == STATE_RUNNING);
+    m_block = true;
+}
+
 gboolean Worker::onFinishedInMainThread(gpointer param)
 {
     boost::scoped_ptr<boost::shared_ptr<Worker> > worker(
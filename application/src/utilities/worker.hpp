@@ -230,6 +230,13 @@ protected:
     void setDescription(const char *description)
     { m_description = description; }
 
+    /**
+     * Request to block the worker after the current step, e.g., to wait for
+     * more input.  This function can be called in 'step()' only.  The worker
+     * stays blocked until 'unblock()' is called.
+     */
+    void blockAfterStep();
+
     // The following three functions are called sequentially.
     /**
      * Begin execution.  Used to prepare the worker for execution.
@@ -290,6 +297,19 @@ private:
         boost::shared_ptr<Worker> m_worker;
     };
 
+    /**
+     * Tells the scheduler when the worker admitted to run stops running.
+     */
+    class AdmissionReleaser
+    {
+    public:
+        AdmissionReleaser(Worker &worker): m_worker(worker) {}
+        ~AdmissionReleaser();
+
+    private:
+        Worker &m_worker;
+    };
+
     Scheduler &m_scheduler;
 
     const unsigned int m_priority;
@@ -13,6 +13,8 @@
 #include "project/project-file.hpp"
 #include "project/project-file-creator-dialog.hpp"
 #include "build-system/active-configuration-setter-dialog.hpp"
+#include "build-system/build-log-view.hpp"
+#include "build-system/build-log-view-group.hpp"
 #include "build-system/build-system.hpp"
 #include "build-system/configuration-creator-dialog.hpp"
 #include "build-system/configuration-management-window.hpp"
@@ -327,6 +329,26 @@ void buildProject(GtkAction *action, Samoyed::Window *window)
         project->buildSystem().build();
 }
 
+void buildTarget(GtkAction *action, Samoyed::Window *window)
+{
+    Samoyed::Project *project = window->currentProject();
+    Samoyed::Notebook &editorGroup = window->currentEditorGroup();
+    if (project && editorGroup.childCount() > 0)
+        project->buildSystem().buildTarget(
+            static_cast<Samoyed::Editor &>(editorGroup.currentChild()).
+            file().uri());
+}
+
+void compileFile(GtkAction *action, Samoyed::Window *window)
+{
+    Samoyed::Project *project = window->currentProject();
+    Samoyed::Notebook &editorGroup = window->currentEditorGroup();
+    if (project && editorGroup.childCount() > 0)
+        project->buildSystem().compileFile(
+            static_cast<Samoyed::Editor &>(editorGroup.currentChild()).
+            file().uri());
+}
+
 void installProject(GtkAction *action, Samoyed::Window *window)
 {
     Samoyed::Project *project = window->currentProject();
@@ -341,6 +363,22 @@ void cleanProject(GtkAction *action, Samoyed::Window *window)
         project->buildSystem().clean();
 }
 
+void showNextDiagnostic(GtkAction *action, Samoyed::Window *window)
+{
+    Samoyed::BuildLogViewGroup *group = window->buildLogViewGroup();
+    if (group && group->childCount() > 0)
+        static_cast<Samoyed::BuildLogView &>(group->currentChild()).
+            showNextDiagnostic();
+}
+
+void showPreviousDiagnostic(GtkAction *action, Samoyed::Window *window)
+{
+    Samoyed::BuildLogViewGroup *group = window->buildLogViewGroup();
+    if (group && group->childCount() > 0)
+        static_cast<Samoyed::BuildLogView &>(group->currentChild()).
+            showPreviousDiagnostic();
+}
+
 void createConfiguration(GtkAction *action, Samoyed::Window *window)
 {
     Samoyed::Project *project = window->currentProject();
@@ -600,10 +638,21 @@ const GtkActionEntry actionEntries[Samoyed::Actions::N_ACTIONS] =
       N_("Configure the current project"), G_CALLBACK(configureProject) },
     { "build-project", NULL, N_("_Build"), NULL,
       N_("Build the current project"), G_CALLBACK(buildProject) },
+    { "build-target", NULL, N_("Build _Target"), NULL,
+      N_("Build the target containing the current file"),
+      G_CALLBACK(buildTarget) },
+    { "compile-file", NULL, N_("C_ompile File"), NULL,
+      N_("Compile the current file"), G_CALLBACK(compileFile) },
     { "install-project", NULL, N_("_Install"), NULL,
       N_("Install the current project"), G_CALLBACK(installProject) },
     { "clean-project", NULL, N_("C_lean"), NULL,
       N_("Clean the current project"), G_CALLBACK(cleanProject) },
+    { "next-diagnostic", NULL, N_("Ne_xt Diagnostic"), "F4",
+      N_("Go to the next diagnostic in the build log"),
+      G_CALLBACK(showNextDiagnostic) },
+    { "previous-diagnostic", NULL, N_("Pre_vious Diagnostic"), "<Shift>F4",
+      N_("Go to the previous diagnostic in the build log"),
+      G_CALLBACK(showPreviousDiagnostic) },
     { "create-configuration", NULL, N_("_New Configuration"), NULL,
       N_("Create a configuration for the current project"),
       G_CALLBACK(createConfiguration) },
@@ -65,8 +65,12 @@ public:
 
         ACTION_CONFIGURE_PROJECT,
         ACTION_BUILD_PROJECT,
+        ACTION_BUILD_TARGET,
+        ACTION_COMPILE_FILE,
         ACTION_INSTALL_PROJECT,
         ACTION_CLEAN_PROJECT,
+        ACTION_NEXT_DIAGNOSTIC,
+        ACTION_PREVIOUS_DIAGNOSTIC,
         ACTION_CREATE_CONFIGURATION,
         ACTION_SET_ACTIVE_CONFIGURATION,
         ACTION_MANAGE_CONFIGURATIONS,
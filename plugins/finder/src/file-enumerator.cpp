@@ -0,0 +1,146 @@
+// File enumerator.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "file-enumerator.hpp"
+#include "text-matcher.hpp"
+#include "project/project.hpp"
+#include "project/project-db.hpp"
+#include "project/trigram-index.hpp"
+#include "project/trigram-indexer.hpp"
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+FileEnumerator::FileEnumerator(Scheduler &scheduler,
+                               unsigned int priority,
+                               Project &project,
+                               const char *pattern,
+                               int flags,
+                               const TextTable &texts):
+    Worker(scheduler, priority),
+    m_project(project),
+    m_pattern(pattern),
+    m_flags(flags),
+    m_texts(texts)
+{
+    TrigramIndexer *indexer = project.trigramIndexer();
+    m_indexed = indexer && indexer->ready();
+    char *desc = g_strdup_printf(_("Enumerating files in project \"%s\""),
+                                 project.uri());
+    setDescription(desc);
+    g_free(desc);
+}
+
+void FileEnumerator::addFile(const char *uri,
+                             const boost::shared_ptr<char> &text)
+{
+    m_files.push_back(File());
+    m_files.back().uri = uri;
+    m_files.back().text = text;
+}
+
+bool FileEnumerator::visit(const char *uri,
+                           int uriLength,
+                           const ProjectFile::View &data)
+{
+    if ((++m_numVisited & 255) == 0 && m_abortFlag.aborted())
+        return true;
+    int type = data.type();
+    if (type != ProjectFile::TYPE_SOURCE_FILE &&
+        type != ProjectFile::TYPE_HEADER_FILE &&
+        type != ProjectFile::TYPE_GENERIC_FILE)
+        return false;
+    std::string u(uri, uriLength);
+    TextTable::const_iterator it = m_texts.find(u);
+    addFile(u.c_str(),
+            it == m_texts.end() ? boost::shared_ptr<char>() : it->second);
+    return false;
+}
+
+// Find the files that may contain the matches by the trigram index of the
+// project, if the index is up to date and the pattern contains literal strings.
+bool FileEnumerator::findCandidateFiles(std::vector<std::string> &uris)
+{
+    if (!m_indexed)
+        return false;
+    std::vector<std::string> literals;
+    TextMatcher::requiredLiterals(m_pattern.c_str(), m_flags, literals);
+    std::vector<guint32> trigrams, literalTrigrams;
+    for (std::vector<std::string>::const_iterator it = literals.begin();
+         it != literals.end();
+         ++it)
+    {
+        TrigramIndex::extractTrigrams(it->c_str(), it->length(),
+                                      literalTrigrams);
+        trigrams.insert(trigrams.end(),
+                        literalTrigrams.begin(), literalTrigrams.end());
+    }
+    if (trigrams.empty())
+        return false;
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                   trigrams.end());
+    return !m_project.db().trigramIndex().findFiles(trigrams, uris).code;
+}
+
+bool FileEnumerator::step()
+{
+    AbortFlag::Scope scope(m_abortFlag);
+    if (m_abortFlag.aborted())
+        return true;
+    std::string prefix(m_project.uri());
+    prefix += '/';
+    std::vector<std::string> candidates;
+    if (findCandidateFiles(candidates))
+    {
+        // The in-memory text of the open files is not indexed, so add all of
+        // them in the project in addition to the candidates.
+        std::set<std::string> added;
+        for (std::vector<std::string>::const_iterator it = candidates.begin();
+             it != candidates.end();
+             ++it)
+        {
+            TextTable::const_iterator it2 = m_texts.find(*it);
+            addFile(it->c_str(),
+                    it2 == m_texts.end() ?
+                    boost::shared_ptr<char>() : it2->second);
+            added.insert(*it);
+        }
+        for (TextTable::const_iterator it = m_texts.begin();
+             it != m_texts.end();
+             ++it)
+        {
+            bool exists;
+            if (it->first.compare(0, prefix.length(), prefix) == 0 &&
+                added.find(it->first) == added.end() &&
+                !m_project.db().hasFile(it->first.c_str(), exists).code &&
+                exists)
+                addFile(it->first.c_str(), it->second);
+        }
+    }
+    else
+    {
+        m_numVisited = 0;
+        m_project.db().visitFilesInBulk(prefix.c_str(),
+                                        boost::bind(visit, this, _1, _2, _3));
+    }
+    return true;
+}
+
+}
+
+}
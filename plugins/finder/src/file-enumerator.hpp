@@ -0,0 +1,88 @@
+// File enumerator.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_FIND_FILE_ENUMERATOR_HPP
+#define SMYD_FIND_FILE_ENUMERATOR_HPP
+
+#include "project/project-file.hpp"
+#include "utilities/abort-flag.hpp"
+#include "utilities/worker.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+namespace Samoyed
+{
+
+class Project;
+
+namespace Finder
+{
+
+/**
+ * A file enumerator enumerates the text files in a project that may contain
+ * the matches of a pattern from the project database, as the first step of
+ * searching or replacing the pattern in the files.  If the trigram index of
+ * the project is up to date and the pattern contains literal strings, only the
+ * files indexed with the trigrams of the literal strings and the open files
+ * are enumerated.
+ */
+class FileEnumerator: public Worker
+{
+public:
+    typedef std::map<std::string, boost::shared_ptr<char> > TextTable;
+
+    struct File
+    {
+        std::string uri;
+        boost::shared_ptr<char> text;
+    };
+
+    /**
+     * @param texts The snapshot of the in-memory text of the open files, taken
+     * in the main thread, which is attached to the enumerated files.
+     */
+    FileEnumerator(Scheduler &scheduler,
+                   unsigned int priority,
+                   Project &project,
+                   const char *pattern,
+                   int flags,
+                   const TextTable &texts);
+
+    /**
+     * Stop reading the project database and wait until the read stops.
+     */
+    void abort() { m_abortFlag.abort(); }
+
+    const std::vector<File> &files() const { return m_files; }
+
+protected:
+    virtual bool step();
+
+private:
+    void addFile(const char *uri, const boost::shared_ptr<char> &text);
+
+    bool visit(const char *uri,
+               int uriLength,
+               const ProjectFile::View &data);
+
+    bool findCandidateFiles(std::vector<std::string> &uris);
+
+    Project &m_project;
+    const std::string m_pattern;
+    const int m_flags;
+    const TextTable m_texts;
+    bool m_indexed;
+
+    std::vector<File> m_files;
+    int m_numVisited;
+
+    AbortFlag m_abortFlag;
+};
+
+}
+
+}
+
+#endif
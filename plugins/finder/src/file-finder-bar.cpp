@@ -0,0 +1,593 @@
+// File finder bar.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "file-finder-bar.hpp"
+#include "file-searcher.hpp"
+#include "file-replacer.hpp"
+#include "text-matcher.hpp"
+#include "project/project.hpp"
+#include "editors/file.hpp"
+#include "editors/text-file.hpp"
+#include "editors/text-editor.hpp"
+#include "widget/notebook.hpp"
+#include "window/window.hpp"
+#include "utilities/worker.hpp"
+#include "application.hpp"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <gdk/gdk.h>
+#include <gtk/gtk.h>
+
+namespace
+{
+
+// The interval of showing the results found so far, in milliseconds.
+const int RESULT_SHOWING_INTERVAL = 100;
+
+enum ResultColumn
+{
+    FILE_NAME_COLUMN,
+    LINE_NUMBER_COLUMN,
+    TEXT_COLUMN,
+    URI_COLUMN,
+    COLUMN_COLUMN,
+    LENGTH_COLUMN
+};
+
+// Make the markup of the line text with the match highlighted.
+char *makeMarkup(const Samoyed::Finder::FileSearcher::Match &match)
+{
+    const char *text = match.text.c_str();
+    const char *textEnd = text + match.text.length();
+    int textLength = g_utf8_strlen(text, -1);
+    const char *begin = g_utf8_offset_to_pointer(
+        text,
+        std::min(match.column, textLength));
+    const char *end = g_utf8_offset_to_pointer(
+        text,
+        std::min(match.column + match.length, textLength));
+    char *before = g_markup_escape_text(text, begin - text);
+    char *matched = g_markup_escape_text(begin, end - begin);
+    char *after = g_markup_escape_text(end, textEnd - end);
+    char *markup = g_strdup_printf("%s<b>%s</b>%s", before, matched, after);
+    g_free(before);
+    g_free(matched);
+    g_free(after);
+    return markup;
+}
+
+}
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+const char *FileFinderBar::ID = "file-finder-bar";
+
+FileFinderBar::FileFinderBar(Project &project):
+    m_builder(NULL),
+    m_projectUri(project.uri()),
+    m_searcher(NULL),
+    m_matchCount(0),
+    m_resultShowerId(0),
+    m_replacer(NULL),
+    m_previewing(false),
+    m_openFileCount(0),
+    m_openFileMatchCount(0)
+{
+}
+
+FileFinderBar::~FileFinderBar()
+{
+    stop();
+    if (m_builder)
+        g_object_unref(m_builder);
+}
+
+bool FileFinderBar::setup()
+{
+    if (!Bar::setup(ID))
+        return false;
+
+    std::string uiFile(Application::instance().dataDirectoryName());
+    uiFile += G_DIR_SEPARATOR_S "plugins" G_DIR_SEPARATOR_S "finder"
+        G_DIR_SEPARATOR_S "ui" G_DIR_SEPARATOR_S "file-finder-bar.xml";
+    m_builder = gtk_builder_new_from_file(uiFile.c_str());
+
+    m_patternEntry =
+        GTK_ENTRY(gtk_builder_get_object(m_builder, "pattern-entry"));
+    m_matchCaseButton =
+        GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder,
+                                                 "match-case-button"));
+    m_regexButton =
+        GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder, "regex-button"));
+    m_replacementEntry =
+        GTK_ENTRY(gtk_builder_get_object(m_builder, "replacement-entry"));
+    m_findButton =
+        GTK_WIDGET(gtk_builder_get_object(m_builder, "find-button"));
+    m_replaceAllButton =
+        GTK_WIDGET(gtk_builder_get_object(m_builder, "replace-all-button"));
+    m_stopButton =
+        GTK_WIDGET(gtk_builder_get_object(m_builder, "stop-button"));
+    m_messageLabel =
+        GTK_LABEL(gtk_builder_get_object(m_builder, "message-label"));
+    m_resultStore =
+        GTK_LIST_STORE(gtk_builder_get_object(m_builder, "result-store"));
+
+    g_signal_connect(m_patternEntry, "activate",
+                     G_CALLBACK(onActivate), this);
+    g_signal_connect(m_findButton, "clicked",
+                     G_CALLBACK(onFind), this);
+    g_signal_connect(m_replaceAllButton, "clicked",
+                     G_CALLBACK(onReplaceAll), this);
+    g_signal_connect(m_stopButton, "clicked",
+                     G_CALLBACK(onStop), this);
+    g_signal_connect(gtk_builder_get_object(m_builder, "close-button"),
+                     "clicked", G_CALLBACK(onClose), this);
+    g_signal_connect(gtk_builder_get_object(m_builder, "result-view"),
+                     "row-activated", G_CALLBACK(onResultActivated), this);
+
+    GtkWidget *grid = GTK_WIDGET(gtk_builder_get_object(m_builder, "grid"));
+    g_signal_connect(grid, "key-press-event",
+                     G_CALLBACK(onKeyPress), this);
+    setGtkWidget(grid);
+    gtk_widget_show(grid);
+    return true;
+}
+
+FileFinderBar *FileFinderBar::create(Project &project)
+{
+    FileFinderBar *bar = new FileFinderBar(project);
+    if (!bar->setup())
+    {
+        delete bar;
+        return NULL;
+    }
+    return bar;
+}
+
+Widget::XmlElement *FileFinderBar::save() const
+{
+    return NULL;
+}
+
+int FileFinderBar::flags() const
+{
+    int flags = 0;
+    if (gtk_toggle_button_get_active(m_matchCaseButton))
+        flags |= TextMatcher::FLAG_MATCH_CASE;
+    if (gtk_toggle_button_get_active(m_regexButton))
+        flags |= TextMatcher::FLAG_REGEX;
+    return flags;
+}
+
+void FileFinderBar::setMessage(const char *message, const char *details)
+{
+    gtk_label_set_text(m_messageLabel, message);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel), details);
+}
+
+void FileFinderBar::search()
+{
+    stop();
+    gtk_list_store_clear(m_resultStore);
+    m_matchCount = 0;
+    setMessage("", "");
+
+    Project *project =
+        Application::instance().findProject(m_projectUri.c_str());
+    if (!project || project->closing())
+        return;
+
+    int flags = this->flags();
+    GError *error = NULL;
+    m_searcher = FileSearcher::create(gtk_entry_get_text(m_patternEntry),
+                                      flags,
+                                      &error);
+    if (!m_searcher)
+    {
+        if (error)
+        {
+            setMessage(error->message, error->message);
+            g_error_free(error);
+        }
+        return;
+    }
+
+    // Search the open files with edits in their in-memory text.
+    FileEnumerator::TextTable texts;
+    for (File *file = Application::instance().files();
+         file;
+         file = file->next())
+    {
+        if ((file->type() & TextFile::TYPE) && file->edited())
+            texts[file->uri()] =
+                static_cast<TextFile *>(file)->text(0, 0, -1, -1);
+    }
+    m_searcher->addProjectFiles(*project, texts);
+    m_projectClosingConn = project->addClosingCallback(
+        boost::bind(&FileFinderBar::onProjectClosing, this, _1));
+
+    m_searcher->setFinishedCallback(
+        boost::bind(&FileFinderBar::onSearcherFinished, this, _1));
+    gtk_widget_set_sensitive(m_stopButton, TRUE);
+    m_resultShowerId = g_timeout_add(RESULT_SHOWING_INTERVAL,
+                                     showResults,
+                                     this);
+    m_searcher->start(Worker::PRIORITY_INTERACTIVE);
+}
+
+void FileFinderBar::stop()
+{
+    m_projectClosingConn.disconnect();
+    if (m_resultShowerId)
+    {
+        g_source_remove(m_resultShowerId);
+        m_resultShowerId = 0;
+    }
+    if (m_searcher)
+    {
+        m_searcher->cancel();
+        delete m_searcher;
+        m_searcher = NULL;
+    }
+    if (m_replacer)
+    {
+        m_replacer->cancel();
+        delete m_replacer;
+        m_replacer = NULL;
+    }
+    gtk_widget_set_sensitive(m_stopButton, FALSE);
+}
+
+void FileFinderBar::replaceAll()
+{
+    stop();
+    gtk_list_store_clear(m_resultStore);
+    m_matchCount = 0;
+    setMessage("", "");
+
+    Project *project =
+        Application::instance().findProject(m_projectUri.c_str());
+    if (!project || project->closing())
+        return;
+
+    int flags = this->flags();
+    GError *error = NULL;
+    m_replacer = FileReplacer::create(gtk_entry_get_text(m_patternEntry),
+                                      flags,
+                                      gtk_entry_get_text(m_replacementEntry),
+                                      &error);
+    if (!m_replacer)
+    {
+        if (error)
+        {
+            setMessage(error->message, error->message);
+            g_error_free(error);
+        }
+        return;
+    }
+
+    // Count the matches in the in-memory text of all the open files, which
+    // will be replaced in their text buffers instead of on disk.
+    FileEnumerator::TextTable texts;
+    for (File *file = Application::instance().files();
+         file;
+         file = file->next())
+    {
+        if (file->type() & TextFile::TYPE)
+            texts[file->uri()] =
+                static_cast<TextFile *>(file)->text(0, 0, -1, -1);
+    }
+    m_replacer->addProjectFiles(*project, texts);
+    m_projectClosingConn = project->addClosingCallback(
+        boost::bind(&FileFinderBar::onProjectClosing, this, _1));
+
+    m_replacer->setFinishedCallback(
+        boost::bind(&FileFinderBar::onReplacerFinished, this, _1));
+    m_previewing = true;
+    gtk_widget_set_sensitive(m_stopButton, TRUE);
+    setMessage(_("Counting matches..."), "");
+    m_replacer->preview(Worker::PRIORITY_INTERACTIVE);
+}
+
+void FileFinderBar::onReplacerFinished(FileReplacer &replacer)
+{
+    gtk_widget_set_sensitive(m_stopButton, FALSE);
+    char *message;
+    if (m_previewing)
+    {
+        m_previewing = false;
+        if (replacer.canceled())
+        {
+            setMessage(_("Stopped counting matches."), "");
+            return;
+        }
+        if (replacer.matchCount() == 0)
+        {
+            setMessage(_("Found no matches."), "");
+            return;
+        }
+
+        Widget *widget;
+        for (widget = this; widget->parent(); widget = widget->parent())
+            ;
+        GtkWidget *dialog = gtk_message_dialog_new(
+            GTK_WINDOW(widget->gtkWidget()),
+            GTK_DIALOG_DESTROY_WITH_PARENT,
+            GTK_MESSAGE_QUESTION,
+            GTK_BUTTONS_YES_NO,
+            _("Replace %d matches in %d files with \"%s\"?"),
+            replacer.matchCount(),
+            replacer.matchedFileCount(),
+            gtk_entry_get_text(m_replacementEntry));
+        gtk_message_dialog_format_secondary_text(
+            GTK_MESSAGE_DIALOG(dialog),
+            _("The files not open will be rewritten on disk, which cannot be "
+              "undone. The open files will be edited and can be undone."));
+        gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_NO);
+        int response = gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        if (response != GTK_RESPONSE_YES)
+        {
+            setMessage("", "");
+            return;
+        }
+
+        // Replace the matches in the open files in their text buffers.
+        m_openFileCount = 0;
+        m_openFileMatchCount = 0;
+        std::vector<std::string> uris;
+        replacer.matchedOpenFiles(uris);
+        for (std::vector<std::string>::const_iterator it = uris.begin();
+             it != uris.end();
+             ++it)
+        {
+            File *file = Application::instance().findFile(it->c_str());
+            if (!file || !(file->type() & TextFile::TYPE))
+                continue;
+            int n = replacer.replaceInOpenFile(static_cast<TextFile &>(*file));
+            if (n)
+            {
+                m_openFileCount++;
+                m_openFileMatchCount += n;
+            }
+        }
+
+        // Rewrite the other files on disk.
+        gtk_widget_set_sensitive(m_stopButton, TRUE);
+        setMessage(_("Replacing matches..."), "");
+        replacer.replace(Worker::PRIORITY_INTERACTIVE);
+        return;
+    }
+
+    if (replacer.canceled())
+        message = g_strdup_printf(
+            _("Stopped after replacing %d matches in %d files."),
+            replacer.matchCount() + m_openFileMatchCount,
+            replacer.matchedFileCount() + m_openFileCount);
+    else
+        message = g_strdup_printf(
+            _("Replaced %d matches in %d files."),
+            replacer.matchCount() + m_openFileMatchCount,
+            replacer.matchedFileCount() + m_openFileCount);
+    const std::vector<std::string> &errors = replacer.errors();
+    if (errors.empty())
+        setMessage(message, message);
+    else
+    {
+        char *failure = g_strdup_printf(_("%s Failed to rewrite %d files."),
+                                        message,
+                                        static_cast<int>(errors.size()));
+        std::string details;
+        for (std::vector<std::string>::const_iterator it = errors.begin();
+             it != errors.end();
+             ++it)
+        {
+            if (!details.empty())
+                details += '\n';
+            details += *it;
+        }
+        setMessage(failure, details.c_str());
+        g_free(failure);
+    }
+    g_free(message);
+}
+
+void FileFinderBar::fetchResults()
+{
+    std::vector<FileSearcher::Match> matches;
+    m_searcher->takeMatches(matches);
+
+    char *projectDirName =
+        g_filename_from_uri(m_projectUri.c_str(), NULL, NULL);
+    int projectDirNameLength = projectDirName ? strlen(projectDirName) : 0;
+    GtkTreeIter iter;
+    for (std::vector<FileSearcher::Match>::const_iterator it = matches.begin();
+         it != matches.end();
+         ++it)
+    {
+        char *fileName = g_filename_from_uri(it->uri.c_str(), NULL, NULL);
+        if (!fileName)
+            continue;
+        const char *relName = fileName;
+        if (projectDirName &&
+            strncmp(fileName, projectDirName, projectDirNameLength) == 0 &&
+            fileName[projectDirNameLength] == G_DIR_SEPARATOR)
+            relName = fileName + projectDirNameLength + 1;
+        char *displayName = g_filename_display_name(relName);
+        char *markup = makeMarkup(*it);
+        gtk_list_store_append(m_resultStore, &iter);
+        gtk_list_store_set(m_resultStore, &iter,
+                           FILE_NAME_COLUMN, displayName,
+                           LINE_NUMBER_COLUMN, it->line + 1,
+                           TEXT_COLUMN, markup,
+                           URI_COLUMN, it->uri.c_str(),
+                           COLUMN_COLUMN, it->column,
+                           LENGTH_COLUMN, it->length,
+                           -1);
+        g_free(markup);
+        g_free(displayName);
+        g_free(fileName);
+    }
+    g_free(projectDirName);
+    m_matchCount += matches.size();
+
+    char *message;
+    if (m_searcher->canceled())
+        message = g_strdup_printf(
+            _("Stopped after searching %d of %d files. Found %d matches."),
+            m_searcher->searchedFileCount(),
+            m_searcher->fileCount(),
+            m_matchCount);
+    else if (m_searcher->running())
+        message = g_strdup_printf(
+            _("Searched %d of %d files. Found %d matches."),
+            m_searcher->searchedFileCount(),
+            m_searcher->fileCount(),
+            m_matchCount);
+    else
+        message = g_strdup_printf(
+            _("Searched %d files. Found %d matches."),
+            m_searcher->fileCount(),
+            m_matchCount);
+    setMessage(message, message);
+    g_free(message);
+}
+
+gboolean FileFinderBar::showResults(gpointer bar)
+{
+    FileFinderBar *b = static_cast<FileFinderBar *>(bar);
+    b->fetchResults();
+    return TRUE;
+}
+
+void FileFinderBar::onSearcherFinished(FileSearcher &searcher)
+{
+    if (m_resultShowerId)
+    {
+        g_source_remove(m_resultShowerId);
+        m_resultShowerId = 0;
+    }
+    fetchResults();
+    gtk_widget_set_sensitive(m_stopButton, FALSE);
+}
+
+void FileFinderBar::onProjectClosing(Project &project)
+{
+    // Stop the file enumerator reading the project database before it is
+    // closed.
+    stop();
+    setMessage("", "");
+}
+
+void FileFinderBar::openFile(const char *uri, int line, int column, int length)
+{
+    std::pair<File *, Editor *> fileEditor =
+        File::open(uri,
+                   Application::instance().findProject(m_projectUri.c_str()),
+                   NULL, NULL, false);
+    if (!fileEditor.second)
+        return;
+    if (!fileEditor.second->parent())
+    {
+        Widget *widget;
+        for (widget = this; widget->parent(); widget = widget->parent())
+            ;
+        Window &window = static_cast<Window &>(*widget);
+        Notebook &editorGroup = window.currentEditorGroup();
+        window.addEditorToEditorGroup(*fileEditor.second,
+                                      editorGroup,
+                                      editorGroup.currentChildIndex() + 1);
+    }
+    fileEditor.second->setCurrent();
+    static_cast<TextEditor *>(fileEditor.second)->selectRange(
+        line, column, line, column + length);
+}
+
+void FileFinderBar::onFind(GtkButton *button, FileFinderBar *bar)
+{
+    bar->search();
+}
+
+void FileFinderBar::onActivate(GtkEntry *entry, FileFinderBar *bar)
+{
+    bar->search();
+}
+
+void FileFinderBar::onReplaceAll(GtkButton *button, FileFinderBar *bar)
+{
+    bar->replaceAll();
+}
+
+void FileFinderBar::onStop(GtkButton *button, FileFinderBar *bar)
+{
+    if (bar->m_searcher && bar->m_searcher->running())
+    {
+        bar->m_searcher->cancel();
+        bar->onSearcherFinished(*bar->m_searcher);
+    }
+    if (bar->m_replacer && bar->m_replacer->running())
+    {
+        bar->m_replacer->cancel();
+        bar->onReplacerFinished(*bar->m_replacer);
+    }
+}
+
+void FileFinderBar::onClose(GtkButton *button, FileFinderBar *bar)
+{
+    bar->close();
+}
+
+void FileFinderBar::onResultActivated(GtkTreeView *view,
+                                      GtkTreePath *path,
+                                      GtkTreeViewColumn *column,
+                                      FileFinderBar *bar)
+{
+    GtkTreeIter iter;
+    if (!gtk_tree_model_get_iter(GTK_TREE_MODEL(bar->m_resultStore),
+                                 &iter, path))
+        return;
+    char *uri;
+    int lineNumber, col, length;
+    gtk_tree_model_get(GTK_TREE_MODEL(bar->m_resultStore), &iter,
+                       URI_COLUMN, &uri,
+                       LINE_NUMBER_COLUMN, &lineNumber,
+                       COLUMN_COLUMN, &col,
+                       LENGTH_COLUMN, &length,
+                       -1);
+    bar->openFile(uri, lineNumber - 1, col, length);
+    g_free(uri);
+}
+
+gboolean FileFinderBar::onKeyPress(GtkWidget *widget,
+                                   GdkEventKey *event,
+                                   FileFinderBar *bar)
+{
+    if (event->keyval == GDK_KEY_Escape)
+    {
+        bar->close();
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void FileFinderBar::grabFocus()
+{
+    gtk_widget_grab_focus(GTK_WIDGET(m_patternEntry));
+}
+
+}
+
+}
@@ -0,0 +1,112 @@
+// File finder bar.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_FIND_FILE_FINDER_BAR_HPP
+#define SMYD_FIND_FILE_FINDER_BAR_HPP
+
+#include "widget/bar.hpp"
+#include <string>
+#include <boost/signals2/connection.hpp>
+#include <gtk/gtk.h>
+
+namespace Samoyed
+{
+
+class Project;
+
+namespace Finder
+{
+
+class FileSearcher;
+class FileReplacer;
+
+/**
+ * A file finder bar searches the files in a project and lists the matched
+ * lines, which are added as they are found.  It also replaces the text in all
+ * the files after the user confirms the counted matches.
+ */
+class FileFinderBar: public Bar
+{
+public:
+    static const char *ID;
+
+    static FileFinderBar *create(Project &project);
+
+    virtual Widget::XmlElement *save() const;
+
+    virtual Orientation orientation() const { return ORIENTATION_HORIZONTAL; }
+
+    virtual void grabFocus();
+
+private:
+    static void onFind(GtkButton *button, FileFinderBar *bar);
+    static void onActivate(GtkEntry *entry, FileFinderBar *bar);
+    static void onReplaceAll(GtkButton *button, FileFinderBar *bar);
+    static void onStop(GtkButton *button, FileFinderBar *bar);
+    static void onClose(GtkButton *button, FileFinderBar *bar);
+    static void onResultActivated(GtkTreeView *view,
+                                  GtkTreePath *path,
+                                  GtkTreeViewColumn *column,
+                                  FileFinderBar *bar);
+    static gboolean onKeyPress(GtkWidget *widget,
+                               GdkEventKey *event,
+                               FileFinderBar *bar);
+
+    static gboolean showResults(gpointer bar);
+
+    FileFinderBar(Project &project);
+
+    ~FileFinderBar();
+
+    bool setup();
+
+    int flags() const;
+
+    void search();
+
+    void replaceAll();
+
+    void stop();
+
+    void setMessage(const char *message, const char *details);
+
+    void fetchResults();
+
+    void onSearcherFinished(FileSearcher &searcher);
+
+    void onReplacerFinished(FileReplacer &replacer);
+
+    void onProjectClosing(Project &project);
+
+    void openFile(const char *uri, int line, int column, int length);
+
+    GtkBuilder *m_builder;
+
+    GtkEntry *m_patternEntry;
+    GtkToggleButton *m_matchCaseButton;
+    GtkToggleButton *m_regexButton;
+    GtkEntry *m_replacementEntry;
+    GtkWidget *m_findButton;
+    GtkWidget *m_replaceAllButton;
+    GtkWidget *m_stopButton;
+    GtkLabel *m_messageLabel;
+    GtkListStore *m_resultStore;
+
+    std::string m_projectUri;
+    boost::signals2::connection m_projectClosingConn;
+
+    FileSearcher *m_searcher;
+    int m_matchCount;
+    guint m_resultShowerId;
+
+    FileReplacer *m_replacer;
+    bool m_previewing;
+    int m_openFileCount;
+    int m_openFileMatchCount;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,679 @@
+// File replacer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "file-replacer.hpp"
+#include "file-enumerator.hpp"
+#include "text-matcher.hpp"
+#include "editors/text-file.hpp"
+#include "utilities/miscellaneous.hpp"
+#include "utilities/worker.hpp"
+#include "application.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+namespace
+{
+
+// The number of the leading bytes checked for NUL's to detect binary files.
+const int BINARY_PROBE_SIZE = 8 * 1024;
+
+// The number of the bytes of the rewritten contents buffered before written.
+const std::string::size_type WRITE_BUFFER_SIZE = 64 * 1024;
+
+bool writeAll(int fd, const std::string &data)
+{
+    const char *cp = data.c_str();
+    const char *end = cp + data.length();
+    while (cp < end)
+    {
+        ssize_t n = write(fd, cp, end - cp);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        cp += n;
+    }
+    return true;
+}
+
+struct Replacement
+{
+    int beginLine, beginColumn, endLine, endColumn;
+    std::string text;
+};
+
+// Get the line number and the column number, the character index, of a
+// position in UTF-8 text, continuing from a previous position.
+void advancePosition(const char *from, const char *to, int &line, int &column)
+{
+    for (const char *cp = from; cp < to; cp = g_utf8_next_char(cp))
+    {
+        if (*cp == '\n')
+        {
+            line++;
+            column = 0;
+        }
+        else
+            column++;
+    }
+}
+
+}
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+// The replacement job shared by the file replacer and the processors, which
+// may outlive the file replacer.
+class FileReplacer::Job
+{
+public:
+    enum Phase
+    {
+        PHASE_PREVIEW,
+        PHASE_REPLACE
+    };
+
+    struct File
+    {
+        std::string uri;
+        boost::shared_ptr<char> text;
+        int matchCount;
+    };
+
+    Job(const char *pattern,
+        int flags,
+        TextMatcher *matcher,
+        const char *replacement):
+        pattern(pattern),
+        flags(flags),
+        replacement(replacement),
+        matcher(matcher),
+        phase(PHASE_PREVIEW),
+        nextFile(0),
+        processedFileCount(0),
+        matchedFileCount(0),
+        matchCount(0)
+    {}
+
+    ~Job() { delete matcher; }
+
+    // Take the next file to be processed in the current phase.
+    bool takeFile(std::vector<File>::size_type &index);
+
+    int count(const File &file) const;
+
+    int rewrite(const File &file, std::string &error) const;
+
+    const std::string pattern;
+    const int flags;
+    const std::string replacement;
+    TextMatcher *const matcher;
+    std::vector<File> files;
+
+    boost::mutex mutex;
+    Phase phase;
+    std::vector<File>::size_type nextFile;
+    int processedFileCount;
+    int matchedFileCount;
+    int matchCount;
+    std::vector<std::string> errors;
+};
+
+class FileReplacer::Processor: public Worker
+{
+public:
+    Processor(Scheduler &scheduler,
+              unsigned int priority,
+              const boost::shared_ptr<Job> &job):
+        Worker(scheduler, priority),
+        m_job(job)
+    {
+        char *desc = g_strdup_printf(
+            job->phase == Job::PHASE_PREVIEW ?
+            _("Counting \"%s\" in files") :
+            _("Replacing \"%s\" in files"),
+            job->pattern.c_str());
+        setDescription(desc);
+        g_free(desc);
+    }
+
+protected:
+    virtual bool step();
+
+private:
+    boost::shared_ptr<Job> m_job;
+};
+
+bool FileReplacer::Job::takeFile(std::vector<File>::size_type &index)
+{
+    while (nextFile < files.size())
+    {
+        index = nextFile++;
+        // Rewrite the files on disk with matches only.
+        if (phase == PHASE_PREVIEW ||
+            (!files[index].text && files[index].matchCount > 0))
+            return true;
+    }
+    return false;
+}
+
+int FileReplacer::Job::count(const File &file) const
+{
+    GMappedFile *mappedFile = NULL;
+    const char *begin, *end;
+    if (file.text)
+    {
+        begin = file.text.get();
+        end = begin + strlen(begin);
+    }
+    else
+    {
+        char *fileName = g_filename_from_uri(file.uri.c_str(), NULL, NULL);
+        if (!fileName)
+            return 0;
+        mappedFile = g_mapped_file_new(fileName, FALSE, NULL);
+        g_free(fileName);
+        if (!mappedFile)
+            return 0;
+        begin = g_mapped_file_get_contents(mappedFile);
+        end = begin + g_mapped_file_get_length(mappedFile);
+
+        // Skip binary files.
+        if (!begin ||
+            memchr(begin, '\0', std::min<gsize>(end - begin,
+                                               BINARY_PROBE_SIZE)))
+        {
+            g_mapped_file_unref(mappedFile);
+            return 0;
+        }
+    }
+
+    int n = 0;
+    const char *cp = begin;
+    const char *matchBegin, *matchEnd;
+    while (cp <= end && matcher->find(begin, end, cp, matchBegin, matchEnd))
+    {
+        n++;
+        cp = matchEnd > matchBegin ? matchEnd : matchBegin + 1;
+    }
+
+    if (mappedFile)
+        g_mapped_file_unref(mappedFile);
+    return n;
+}
+
+int FileReplacer::Job::rewrite(const File &file, std::string &error) const
+{
+    char *fileName = g_filename_from_uri(file.uri.c_str(), NULL, NULL);
+    if (!fileName)
+        return 0;
+
+    // Replace the target of a symbolic link instead of the link itself.
+    char *realName = realpath(fileName, NULL);
+    if (!realName)
+    {
+        error = g_strerror(errno);
+        g_free(fileName);
+        return 0;
+    }
+    g_free(fileName);
+
+    int n = 0;
+    GStatBuf st;
+    GMappedFile *mappedFile = NULL;
+    const char *begin, *end, *cp;
+    const char *matchBegin, *matchEnd;
+    char *dirName = NULL, *baseName = NULL, *tmpName = NULL;
+    int fd = -1;
+    std::string buffer;
+    GError *err = NULL;
+
+    if (g_stat(realName, &st))
+    {
+        error = g_strerror(errno);
+        goto END;
+    }
+    mappedFile = g_mapped_file_new(realName, FALSE, &err);
+    if (!mappedFile)
+    {
+        error = err->message;
+        g_error_free(err);
+        goto END;
+    }
+    begin = g_mapped_file_get_contents(mappedFile);
+    end = begin + g_mapped_file_get_length(mappedFile);
+    if (!begin ||
+        memchr(begin, '\0', std::min<gsize>(end - begin, BINARY_PROBE_SIZE)) ||
+        !matcher->find(begin, end, begin, matchBegin, matchEnd))
+        goto END;
+
+    // Create the temporary file in the same directory so that it can be
+    // renamed atomically, with the same permissions as the original file.
+    dirName = g_path_get_dirname(realName);
+    baseName = g_path_get_basename(realName);
+    tmpName = g_strdup_printf("%s" G_DIR_SEPARATOR_S ".%s.XXXXXX",
+                              dirName, baseName);
+    fd = g_mkstemp_full(tmpName, O_WRONLY, st.st_mode & 0777);
+    if (fd < 0 || fchmod(fd, st.st_mode & 07777))
+    {
+        error = g_strerror(errno);
+        goto END;
+    }
+
+    // Stream the contents with the matches replaced.
+    buffer.reserve(WRITE_BUFFER_SIZE * 2);
+    cp = begin;
+    do
+    {
+        buffer.append(cp, matchBegin - cp);
+        matcher->expandReplacement(begin, end, matchBegin,
+                                   replacement.c_str(), buffer);
+        n++;
+        if (matchEnd > matchBegin)
+            cp = matchEnd;
+        else
+        {
+            // Keep the character after an empty match.
+            if (matchBegin == end)
+            {
+                cp = end;
+                break;
+            }
+            buffer += *matchBegin;
+            cp = matchBegin + 1;
+        }
+        if (buffer.length() >= WRITE_BUFFER_SIZE)
+        {
+            if (!writeAll(fd, buffer))
+            {
+                error = g_strerror(errno);
+                goto END;
+            }
+            buffer.clear();
+        }
+    }
+    while (cp <= end && matcher->find(begin, end, cp, matchBegin, matchEnd));
+    buffer.append(cp, end - cp);
+    if (!writeAll(fd, buffer) || fsync(fd))
+    {
+        error = g_strerror(errno);
+        goto END;
+    }
+    if (close(fd))
+    {
+        fd = -1;
+        error = g_strerror(errno);
+        goto END;
+    }
+    fd = -1;
+    if (g_rename(tmpName, realName))
+    {
+        error = g_strerror(errno);
+        goto END;
+    }
+    g_free(tmpName);
+    tmpName = NULL;
+
+END:
+    if (fd >= 0)
+        close(fd);
+    if (tmpName)
+    {
+        g_unlink(tmpName);
+        g_free(tmpName);
+        n = 0;
+    }
+    g_free(dirName);
+    g_free(baseName);
+    if (mappedFile)
+        g_mapped_file_unref(mappedFile);
+    free(realName);
+    return n;
+}
+
+bool FileReplacer::Processor::step()
+{
+    std::vector<Job::File>::size_type index;
+    Job::Phase phase;
+    {
+        boost::mutex::scoped_lock lock(m_job->mutex);
+        if (!m_job->takeFile(index))
+            return true;
+        phase = m_job->phase;
+    }
+
+    Job::File &file = m_job->files[index];
+    std::string error;
+    int n;
+    if (phase == Job::PHASE_PREVIEW)
+        n = m_job->count(file);
+    else
+        n = m_job->rewrite(file, error);
+
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    if (phase == Job::PHASE_PREVIEW)
+        file.matchCount = n;
+    m_job->processedFileCount++;
+    if (n)
+    {
+        m_job->matchedFileCount++;
+        m_job->matchCount += n;
+    }
+    if (!error.empty())
+    {
+        char *fileName = g_filename_from_uri(file.uri.c_str(), NULL, NULL);
+        char *message = g_strdup_printf(_("Failed to rewrite \"%s\": %s."),
+                                        fileName ? fileName : file.uri.c_str(),
+                                        error.c_str());
+        m_job->errors.push_back(message);
+        g_free(message);
+        g_free(fileName);
+    }
+    return false;
+}
+
+FileReplacer::FileReplacer(const boost::shared_ptr<Job> &job):
+    m_job(job),
+    m_project(NULL),
+    m_priority(0),
+    m_runningWorkerCount(0),
+    m_canceled(false)
+{
+}
+
+FileReplacer *FileReplacer::create(const char *pattern,
+                                   int flags,
+                                   const char *replacement,
+                                   GError **error)
+{
+    TextMatcher *matcher = TextMatcher::create(pattern, flags, error);
+    if (!matcher)
+        return NULL;
+    if (!matcher->checkReplacement(replacement, error))
+    {
+        delete matcher;
+        return NULL;
+    }
+    boost::shared_ptr<Job> job(new Job(pattern, flags, matcher, replacement));
+    return new FileReplacer(job);
+}
+
+FileReplacer::~FileReplacer()
+{
+    cancel();
+}
+
+void FileReplacer::addFile(const char *uri,
+                           const boost::shared_ptr<char> &text)
+{
+    m_job->files.push_back(Job::File());
+    m_job->files.back().uri = uri;
+    m_job->files.back().text = text;
+    m_job->files.back().matchCount = 0;
+}
+
+void FileReplacer::addProjectFiles(Project &project,
+                                   const FileEnumerator::TextTable &texts)
+{
+    m_project = &project;
+    m_texts = texts;
+}
+
+void FileReplacer::preview(unsigned int priority)
+{
+    m_job->phase = Job::PHASE_PREVIEW;
+    if (!m_project)
+    {
+        start(priority);
+        return;
+    }
+
+    // Enumerate the project files first, and preview them after enumerated.
+    m_enumerator.reset(new FileEnumerator(Application::instance().scheduler(),
+                                          priority,
+                                          *m_project,
+                                          m_job->pattern.c_str(),
+                                          m_job->flags,
+                                          m_texts));
+    m_project = NULL;
+    m_texts.clear();
+    m_priority = priority;
+    m_canceled = false;
+    m_enumeratorFinishedConn = m_enumerator->addFinishedCallbackInMainThread(
+        boost::bind(onEnumeratorFinished, this, _1));
+    m_enumeratorCanceledConn = m_enumerator->addCanceledCallbackInMainThread(
+        boost::bind(onEnumeratorCanceled, this, _1));
+    m_enumerator->submit(m_enumerator);
+}
+
+void FileReplacer::onEnumeratorFinished(const boost::shared_ptr<Worker> &worker)
+{
+    m_enumeratorFinishedConn.disconnect();
+    m_enumeratorCanceledConn.disconnect();
+    const std::vector<FileEnumerator::File> &files = m_enumerator->files();
+    for (std::vector<FileEnumerator::File>::const_iterator it = files.begin();
+         it != files.end();
+         ++it)
+        addFile(it->uri.c_str(), it->text);
+    m_enumerator.reset();
+    start(m_priority);
+}
+
+void FileReplacer::onEnumeratorCanceled(const boost::shared_ptr<Worker> &worker)
+{
+    m_enumeratorFinishedConn.disconnect();
+    m_enumeratorCanceledConn.disconnect();
+    m_enumerator.reset();
+    m_canceled = true;
+    if (m_onFinished)
+        m_onFinished(*this);
+}
+
+void FileReplacer::replace(unsigned int priority)
+{
+    m_job->phase = Job::PHASE_REPLACE;
+    start(priority);
+}
+
+void FileReplacer::start(unsigned int priority)
+{
+    m_job->nextFile = 0;
+    m_job->processedFileCount = 0;
+    m_job->matchedFileCount = 0;
+    m_job->matchCount = 0;
+    m_job->errors.clear();
+    m_canceled = false;
+
+    int n = std::min<std::vector<Job::File>::size_type>(numberOfProcessors(),
+                                                        m_job->files.size());
+    if (n == 0)
+    {
+        if (m_onFinished)
+            m_onFinished(*this);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        boost::shared_ptr<Processor> processor(
+            new Processor(Application::instance().scheduler(),
+                          priority,
+                          m_job));
+        m_processors.push_back(processor);
+        m_processorConnections.push_back(
+            processor->addFinishedCallbackInMainThread(
+                boost::bind(onProcessorDone, this, _1)));
+        m_processorConnections.push_back(
+            processor->addCanceledCallbackInMainThread(
+                boost::bind(onProcessorDone, this, _1)));
+    }
+    m_runningWorkerCount = n;
+    for (int i = 0; i < n; i++)
+        m_processors[i]->submit(m_processors[i]);
+}
+
+int FileReplacer::replaceInOpenFile(TextFile &file) const
+{
+    if (!file.editable())
+        return 0;
+    boost::shared_ptr<char> text = file.text(0, 0, -1, -1);
+    const char *begin = text.get();
+    const char *end = begin + strlen(begin);
+
+    // Find all the matches and their replacements before editing.
+    std::vector<Replacement> replacements;
+    int line = 0, column = 0;
+    const char *position = begin;
+    const char *cp = begin;
+    const char *matchBegin, *matchEnd;
+    while (cp <= end &&
+           m_job->matcher->find(begin, end, cp, matchBegin, matchEnd))
+    {
+        replacements.push_back(Replacement());
+        Replacement &r = replacements.back();
+        advancePosition(position, matchBegin, line, column);
+        r.beginLine = line;
+        r.beginColumn = column;
+        advancePosition(matchBegin, matchEnd, line, column);
+        r.endLine = line;
+        r.endColumn = column;
+        position = matchEnd;
+        m_job->matcher->expandReplacement(begin, end, matchBegin,
+                                          m_job->replacement.c_str(), r.text);
+        if (matchEnd > matchBegin)
+            cp = matchEnd;
+        else
+            cp = g_utf8_next_char(matchBegin);
+    }
+    if (replacements.empty())
+        return 0;
+
+    // Replace the matches backward so that the positions of the preceding
+    // ones are kept.
+    file.beginEditGroup();
+    for (std::vector<Replacement>::reverse_iterator it = replacements.rbegin();
+         it != replacements.rend();
+         ++it)
+    {
+        if (it->beginLine != it->endLine || it->beginColumn != it->endColumn)
+            file.remove(it->beginLine, it->beginColumn,
+                        it->endLine, it->endColumn,
+                        false);
+        if (!it->text.empty())
+            file.insert(it->beginLine, it->beginColumn,
+                        it->text.c_str(), it->text.length(),
+                        NULL, NULL,
+                        false);
+    }
+    file.endEditGroup();
+    return replacements.size();
+}
+
+void FileReplacer::cancel()
+{
+    if (!running())
+        return;
+    m_canceled = true;
+    if (m_enumerator)
+    {
+        m_enumeratorFinishedConn.disconnect();
+        m_enumeratorCanceledConn.disconnect();
+        // Wait until the enumerator stops reading the project database.
+        m_enumerator->abort();
+        m_enumerator->cancel(m_enumerator);
+        m_enumerator.reset();
+    }
+    for (std::vector<boost::signals2::connection>::iterator it =
+             m_processorConnections.begin();
+         it != m_processorConnections.end();
+         ++it)
+        it->disconnect();
+    m_processorConnections.clear();
+    for (std::vector<boost::shared_ptr<Processor> >::iterator it =
+             m_processors.begin();
+         it != m_processors.end();
+         ++it)
+        (*it)->cancel(*it);
+    m_processors.clear();
+    m_runningWorkerCount = 0;
+}
+
+int FileReplacer::fileCount() const
+{
+    return m_job->files.size();
+}
+
+int FileReplacer::processedFileCount() const
+{
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    return m_job->processedFileCount;
+}
+
+int FileReplacer::matchedFileCount() const
+{
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    return m_job->matchedFileCount;
+}
+
+int FileReplacer::matchCount() const
+{
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    return m_job->matchCount;
+}
+
+void FileReplacer::matchedOpenFiles(std::vector<std::string> &uris) const
+{
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    for (std::vector<Job::File>::const_iterator it = m_job->files.begin();
+         it != m_job->files.end();
+         ++it)
+        if (it->text && it->matchCount > 0)
+            uris.push_back(it->uri);
+}
+
+const std::vector<std::string> &FileReplacer::errors() const
+{
+    return m_job->errors;
+}
+
+void FileReplacer::onProcessorDone(const boost::shared_ptr<Worker> &worker)
+{
+    if (--m_runningWorkerCount > 0)
+        return;
+    for (std::vector<boost::signals2::connection>::iterator it =
+             m_processorConnections.begin();
+         it != m_processorConnections.end();
+         ++it)
+        it->disconnect();
+    m_processorConnections.clear();
+    m_processors.clear();
+    if (m_onFinished)
+        m_onFinished(*this);
+}
+
+}
+
+}
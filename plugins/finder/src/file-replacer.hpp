@@ -0,0 +1,178 @@
+// File replacer.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_FIND_FILE_REPLACER_HPP
+#define SMYD_FIND_FILE_REPLACER_HPP
+
+#include "file-enumerator.hpp"
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2/connection.hpp>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+class Project;
+class TextFile;
+class Worker;
+
+namespace Finder
+{
+
+/**
+ * A file replacer replaces a literal string or a regular expression in a set of
+ * files in two phases.  The preview phase counts the matches in each file
+ * without producing the replacement text.  The replacement phase rewrites the
+ * files on disk containing matches by streaming the memory-mapped contents
+ * with the matches replaced into a temporary file in the same directory, which
+ * then atomically replaces the file by renaming, so that the files are never
+ * loaded into text buffers and never left partially written.  Like the file
+ * searcher, each phase is run by multiple workers, one for each processor,
+ * each of which takes the next file in each step.
+ *
+ * The open files are not rewritten on disk.  Instead, the matches in each of
+ * them are replaced in the main thread in one edit group, so that the user can
+ * undo the replacement in one step and save the file later.
+ *
+ * A file replacer can be accessed in the main thread only.
+ */
+class FileReplacer: public boost::noncopyable
+{
+public:
+    /**
+     * @param pattern The literal string or the regular expression to be
+     * replaced.
+     * @param flags The combination of the text matcher flags.
+     * @param replacement The replacement, which may refer to the matched
+     * subexpressions of the regular expression.
+     * @param error The error, if the regular expression or the replacement is
+     * invalid.
+     * @return The file replacer, or NULL if failed.
+     */
+    static FileReplacer *create(const char *pattern,
+                                int flags,
+                                const char *replacement,
+                                GError **error);
+
+    ~FileReplacer();
+
+    /**
+     * Add a file.  This function can be called before previewing only.
+     * @param uri The URI of the file.
+     * @param text The in-memory text of the file if it is open, or NULL if
+     * not.  The text is used to count the matches in the preview phase only.
+     */
+    void addFile(const char *uri, const boost::shared_ptr<char> &text);
+
+    /**
+     * Add the files in a project that may contain matches, which are
+     * enumerated from the project database in the background when previewing.
+     * This function can be called before previewing only.
+     * @param project The project, which should be kept open until the preview
+     * is finished or canceled.
+     * @param texts The in-memory text of the open files.
+     */
+    void addProjectFiles(Project &project,
+                         const FileEnumerator::TextTable &texts);
+
+    /**
+     * Count the matches in the files in the background.
+     */
+    void preview(unsigned int priority);
+
+    /**
+     * Rewrite the files on disk containing matches in the background.  The
+     * open files are skipped and should be replaced by 'replaceInOpenFile()'.
+     */
+    void replace(unsigned int priority);
+
+    /**
+     * Replace the matches in the text of an open file in one edit group.
+     * @return The number of the replaced matches.
+     */
+    int replaceInOpenFile(TextFile &file) const;
+
+    void cancel();
+
+    bool running() const
+    { return m_enumerator || m_runningWorkerCount > 0; }
+
+    bool canceled() const { return m_canceled; }
+
+    int fileCount() const;
+
+    /**
+     * @return The number of the files previewed or rewritten in the current
+     * phase.
+     */
+    int processedFileCount() const;
+
+    /**
+     * @return The number of the files with matches in the preview phase or the
+     * files rewritten in the replacement phase.
+     */
+    int matchedFileCount() const;
+
+    /**
+     * @return The number of the matches counted in the preview phase or
+     * replaced in the replacement phase.
+     */
+    int matchCount() const;
+
+    /**
+     * Get the open files containing matches found in the preview phase.
+     * @param uris The URIs of the files, appended.
+     */
+    void matchedOpenFiles(std::vector<std::string> &uris) const;
+
+    /**
+     * @return The error messages of the files that failed to be rewritten.
+     */
+    const std::vector<std::string> &errors() const;
+
+    /**
+     * The callback is called when the current phase is done or canceled.
+     */
+    void setFinishedCallback(
+        const boost::function<void (FileReplacer &)> &onFinished)
+    { m_onFinished = onFinished; }
+
+private:
+    class Job;
+    class Processor;
+
+    FileReplacer(const boost::shared_ptr<Job> &job);
+
+    void start(unsigned int priority);
+
+    void onEnumeratorFinished(const boost::shared_ptr<Worker> &worker);
+    void onEnumeratorCanceled(const boost::shared_ptr<Worker> &worker);
+
+    void onProcessorDone(const boost::shared_ptr<Worker> &worker);
+
+    boost::shared_ptr<Job> m_job;
+
+    Project *m_project;
+    FileEnumerator::TextTable m_texts;
+    boost::shared_ptr<FileEnumerator> m_enumerator;
+    boost::signals2::connection m_enumeratorFinishedConn;
+    boost::signals2::connection m_enumeratorCanceledConn;
+    unsigned int m_priority;
+
+    std::vector<boost::shared_ptr<Processor> > m_processors;
+    std::vector<boost::signals2::connection> m_processorConnections;
+    int m_runningWorkerCount;
+    bool m_canceled;
+
+    boost::function<void (FileReplacer &)> m_onFinished;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,409 @@
+// File searcher.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "file-searcher.hpp"
+#include "file-enumerator.hpp"
+#include "text-matcher.hpp"
+#include "utilities/miscellaneous.hpp"
+#include "utilities/worker.hpp"
+#include "application.hpp"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <glib.h>
+#include <glib/gi18n.h>
+
+namespace
+{
+
+// The number of the leading bytes checked for NUL's to detect binary files.
+const int BINARY_PROBE_SIZE = 8 * 1024;
+
+// The maximum number of the bytes of a line kept in a match.
+const int MAX_LINE_TEXT_LENGTH = 256;
+
+// Find a byte in the range, or return the end of the range if not found.
+const char *findByte(const char *begin, const char *end, char byte)
+{
+    if (begin >= end)
+        return end;
+    const char *cp = static_cast<const char *>(memchr(begin, byte, end - begin));
+    return cp ? cp : end;
+}
+
+// Count the characters if the text is valid UTF-8, or the bytes otherwise.
+int countCharacters(const char *begin, const char *end)
+{
+    if (g_utf8_validate(begin, end - begin, NULL))
+        return g_utf8_strlen(begin, end - begin);
+    return end - begin;
+}
+
+// Copy the text of a line, replacing invalid bytes so that it can be shown.
+void copyLineText(const char *begin, const char *end, std::string &text)
+{
+    if (end - begin > MAX_LINE_TEXT_LENGTH)
+        end = begin + MAX_LINE_TEXT_LENGTH;
+    while (begin < end)
+    {
+        const char *valid;
+        g_utf8_validate(begin, end - begin, &valid);
+        text.append(begin, valid - begin);
+        if (valid == end)
+            break;
+        text += '?';
+        begin = valid + 1;
+    }
+}
+
+}
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+// The search job shared by the file searcher and the scanners, which may
+// outlive the file searcher.
+class FileSearcher::Job
+{
+public:
+    struct File
+    {
+        std::string uri;
+        boost::shared_ptr<char> text;
+    };
+
+    Job(const char *pattern, int flags, TextMatcher *matcher):
+        pattern(pattern),
+        flags(flags),
+        matcher(matcher),
+        nextFile(0),
+        searchedFileCount(0)
+    {}
+
+    ~Job() { delete matcher; }
+
+    void search(const File &file, std::vector<Match> &matches) const;
+
+    const std::string pattern;
+    const int flags;
+    TextMatcher *const matcher;
+    std::vector<File> files;
+
+    boost::mutex mutex;
+    std::vector<File>::size_type nextFile;
+    int searchedFileCount;
+    std::vector<Match> matches;
+};
+
+class FileSearcher::Scanner: public Worker
+{
+public:
+    Scanner(Scheduler &scheduler,
+            unsigned int priority,
+            const boost::shared_ptr<Job> &job):
+        Worker(scheduler, priority),
+        m_job(job)
+    {
+        char *desc = g_strdup_printf(_("Searching files for \"%s\""),
+                                     job->pattern.c_str());
+        setDescription(desc);
+        g_free(desc);
+    }
+
+protected:
+    virtual bool step();
+
+private:
+    boost::shared_ptr<Job> m_job;
+};
+
+void FileSearcher::Job::search(const File &file,
+                               std::vector<Match> &matches) const
+{
+    GMappedFile *mappedFile = NULL;
+    const char *begin, *end;
+    if (file.text)
+    {
+        begin = file.text.get();
+        end = begin + strlen(begin);
+    }
+    else
+    {
+        char *fileName = g_filename_from_uri(file.uri.c_str(), NULL, NULL);
+        if (!fileName)
+            return;
+        mappedFile = g_mapped_file_new(fileName, FALSE, NULL);
+        g_free(fileName);
+        if (!mappedFile)
+            return;
+        begin = g_mapped_file_get_contents(mappedFile);
+        end = begin + g_mapped_file_get_length(mappedFile);
+
+        // Skip binary files.
+        if (!begin ||
+            memchr(begin, '\0', std::min<gsize>(end - begin,
+                                               BINARY_PROBE_SIZE)))
+        {
+            g_mapped_file_unref(mappedFile);
+            return;
+        }
+    }
+
+    // Report each line containing matches once, with the first match.
+    int line = 0;
+    const char *lineBegin = begin;
+    const char *cp = begin;
+    while (cp < end)
+    {
+        const char *matchBegin, *matchEnd;
+        if (!matcher->find(begin, end, cp, matchBegin, matchEnd))
+            break;
+
+        // Count the lines before the match.
+        for (const char *nl = findByte(lineBegin, matchBegin, '\n');
+             nl < matchBegin;
+             nl = findByte(nl + 1, matchBegin, '\n'))
+        {
+            line++;
+            lineBegin = nl + 1;
+        }
+        const char *lineEnd = findByte(matchBegin, end, '\n');
+        if (matchEnd > lineEnd)
+            matchEnd = lineEnd;
+
+        matches.push_back(Match());
+        Match &match = matches.back();
+        match.uri = file.uri;
+        match.line = line;
+        match.column = countCharacters(lineBegin, matchBegin);
+        match.length = countCharacters(matchBegin, matchEnd);
+        copyLineText(lineBegin, lineEnd, match.text);
+
+        if (lineEnd == end)
+            break;
+        line++;
+        lineBegin = cp = lineEnd + 1;
+    }
+
+    if (mappedFile)
+        g_mapped_file_unref(mappedFile);
+}
+
+bool FileSearcher::Scanner::step()
+{
+    std::vector<Job::File>::size_type index;
+    {
+        boost::mutex::scoped_lock lock(m_job->mutex);
+        if (m_job->nextFile == m_job->files.size())
+            return true;
+        index = m_job->nextFile++;
+    }
+
+    std::vector<Match> matches;
+    m_job->search(m_job->files[index], matches);
+
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    m_job->searchedFileCount++;
+    m_job->matches.insert(m_job->matches.end(),
+                          matches.begin(), matches.end());
+    return false;
+}
+
+FileSearcher::FileSearcher(const boost::shared_ptr<Job> &job):
+    m_job(job),
+    m_project(NULL),
+    m_priority(0),
+    m_runningScannerCount(0),
+    m_canceled(false)
+{
+}
+
+FileSearcher *FileSearcher::create(const char *pattern,
+                                   int flags,
+                                   GError **error)
+{
+    TextMatcher *matcher = TextMatcher::create(pattern, flags, error);
+    if (!matcher)
+        return NULL;
+    boost::shared_ptr<Job> job(new Job(pattern, flags, matcher));
+    return new FileSearcher(job);
+}
+
+FileSearcher::~FileSearcher()
+{
+    cancel();
+}
+
+void FileSearcher::addFile(const char *uri,
+                           const boost::shared_ptr<char> &text)
+{
+    m_job->files.push_back(Job::File());
+    m_job->files.back().uri = uri;
+    m_job->files.back().text = text;
+}
+
+void FileSearcher::addProjectFiles(Project &project,
+                                   const FileEnumerator::TextTable &texts)
+{
+    m_project = &project;
+    m_texts = texts;
+}
+
+void FileSearcher::start(unsigned int priority)
+{
+    if (!m_project)
+    {
+        startScanners(priority);
+        return;
+    }
+
+    // Enumerate the project files first, and search them after enumerated.
+    m_enumerator.reset(new FileEnumerator(Application::instance().scheduler(),
+                                          priority,
+                                          *m_project,
+                                          m_job->pattern.c_str(),
+                                          m_job->flags,
+                                          m_texts));
+    m_project = NULL;
+    m_texts.clear();
+    m_priority = priority;
+    m_enumeratorFinishedConn = m_enumerator->addFinishedCallbackInMainThread(
+        boost::bind(onEnumeratorFinished, this, _1));
+    m_enumeratorCanceledConn = m_enumerator->addCanceledCallbackInMainThread(
+        boost::bind(onEnumeratorCanceled, this, _1));
+    m_enumerator->submit(m_enumerator);
+}
+
+void FileSearcher::onEnumeratorFinished(const boost::shared_ptr<Worker> &worker)
+{
+    m_enumeratorFinishedConn.disconnect();
+    m_enumeratorCanceledConn.disconnect();
+    const std::vector<FileEnumerator::File> &files = m_enumerator->files();
+    for (std::vector<FileEnumerator::File>::const_iterator it = files.begin();
+         it != files.end();
+         ++it)
+        addFile(it->uri.c_str(), it->text);
+    m_enumerator.reset();
+    startScanners(m_priority);
+}
+
+void FileSearcher::onEnumeratorCanceled(const boost::shared_ptr<Worker> &worker)
+{
+    m_enumeratorFinishedConn.disconnect();
+    m_enumeratorCanceledConn.disconnect();
+    m_enumerator.reset();
+    m_canceled = true;
+    if (m_onFinished)
+        m_onFinished(*this);
+}
+
+void FileSearcher::startScanners(unsigned int priority)
+{
+    int n = std::min<std::vector<Job::File>::size_type>(numberOfProcessors(),
+                                                        m_job->files.size());
+    if (n == 0)
+    {
+        if (m_onFinished)
+            m_onFinished(*this);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        boost::shared_ptr<Scanner> scanner(
+            new Scanner(Application::instance().scheduler(),
+                        priority,
+                        m_job));
+        m_scanners.push_back(scanner);
+        m_scannerConnections.push_back(
+            scanner->addFinishedCallbackInMainThread(
+                boost::bind(onScannerDone, this, _1)));
+        m_scannerConnections.push_back(
+            scanner->addCanceledCallbackInMainThread(
+                boost::bind(onScannerDone, this, _1)));
+    }
+    m_runningScannerCount = n;
+    for (int i = 0; i < n; i++)
+        m_scanners[i]->submit(m_scanners[i]);
+}
+
+void FileSearcher::cancel()
+{
+    if (!running())
+        return;
+    m_canceled = true;
+    if (m_enumerator)
+    {
+        m_enumeratorFinishedConn.disconnect();
+        m_enumeratorCanceledConn.disconnect();
+        // Wait until the enumerator stops reading the project database.
+        m_enumerator->abort();
+        m_enumerator->cancel(m_enumerator);
+        m_enumerator.reset();
+    }
+    for (std::vector<boost::signals2::connection>::iterator it =
+             m_scannerConnections.begin();
+         it != m_scannerConnections.end();
+         ++it)
+        it->disconnect();
+    m_scannerConnections.clear();
+    for (std::vector<boost::shared_ptr<Scanner> >::iterator it =
+             m_scanners.begin();
+         it != m_scanners.end();
+         ++it)
+        (*it)->cancel(*it);
+    m_scanners.clear();
+    m_runningScannerCount = 0;
+}
+
+int FileSearcher::fileCount() const
+{
+    return m_job->files.size();
+}
+
+int FileSearcher::searchedFileCount() const
+{
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    return m_job->searchedFileCount;
+}
+
+void FileSearcher::takeMatches(std::vector<Match> &matches)
+{
+    boost::mutex::scoped_lock lock(m_job->mutex);
+    if (matches.empty())
+        matches.swap(m_job->matches);
+    else
+    {
+        matches.insert(matches.end(),
+                       m_job->matches.begin(), m_job->matches.end());
+        m_job->matches.clear();
+    }
+}
+
+void FileSearcher::onScannerDone(const boost::shared_ptr<Worker> &worker)
+{
+    if (--m_runningScannerCount > 0)
+        return;
+    for (std::vector<boost::signals2::connection>::iterator it =
+             m_scannerConnections.begin();
+         it != m_scannerConnections.end();
+         ++it)
+        it->disconnect();
+    m_scannerConnections.clear();
+    m_scanners.clear();
+    if (m_onFinished)
+        m_onFinished(*this);
+}
+
+}
+
+}
@@ -0,0 +1,150 @@
+// File searcher.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_FIND_FILE_SEARCHER_HPP
+#define SMYD_FIND_FILE_SEARCHER_HPP
+
+#include "file-enumerator.hpp"
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2/connection.hpp>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+class Project;
+class Worker;
+
+namespace Finder
+{
+
+/**
+ * A file searcher searches a set of files for a literal string or a regular
+ * expression in the background.  The files are shared by multiple scanners,
+ * one for each processor, each of which takes the next unsearched file in each
+ * step.  The files on disk are memory-mapped, while the open files with edits
+ * are searched in their in-memory text.  The lines containing matches are
+ * collected as they are found and taken by the user periodically, so that the
+ * results can be shown before the search completes.  The files are matched as
+ * raw bytes because they may be in any encoding.
+ *
+ * A file searcher can be accessed in the main thread only.
+ */
+class FileSearcher: public boost::noncopyable
+{
+public:
+    struct Match
+    {
+        std::string uri;
+
+        // The line number and the column number of the match, the character
+        // index, starting from 0.
+        int line;
+        int column;
+
+        // The number of the characters in the match.
+        int length;
+
+        // The text of the line, which is truncated if too long.
+        std::string text;
+    };
+
+    /**
+     * @param pattern The literal string or the regular expression to search
+     * for.
+     * @param flags The combination of the text matcher flags.
+     * @param error The error, if the regular expression is invalid.
+     * @return The file searcher, or NULL if failed.
+     */
+    static FileSearcher *create(const char *pattern,
+                                int flags,
+                                GError **error);
+
+    ~FileSearcher();
+
+    /**
+     * Add a file to be searched.  This function can be called before started
+     * only.
+     * @param uri The URI of the file.
+     * @param text The in-memory text of the file, or NULL to search the file on
+     * disk.
+     */
+    void addFile(const char *uri, const boost::shared_ptr<char> &text);
+
+    /**
+     * Add the files in a project that may contain matches, which are
+     * enumerated from the project database in the background when started.
+     * This function can be called before started only.
+     * @param project The project, which should be kept open until the search
+     * is finished or canceled.
+     * @param texts The in-memory text of the open files to be searched instead
+     * of the files on disk.
+     */
+    void addProjectFiles(Project &project,
+                         const FileEnumerator::TextTable &texts);
+
+    void start(unsigned int priority);
+
+    void cancel();
+
+    bool running() const
+    { return m_enumerator || m_runningScannerCount > 0; }
+
+    bool canceled() const { return m_canceled; }
+
+    int fileCount() const;
+
+    int searchedFileCount() const;
+
+    /**
+     * Take the matches found since the last call.
+     */
+    void takeMatches(std::vector<Match> &matches);
+
+    /**
+     * The callback is called when all the files are searched or the search is
+     * canceled.
+     */
+    void setFinishedCallback(
+        const boost::function<void (FileSearcher &)> &onFinished)
+    { m_onFinished = onFinished; }
+
+private:
+    class Job;
+    class Scanner;
+
+    FileSearcher(const boost::shared_ptr<Job> &job);
+
+    void startScanners(unsigned int priority);
+
+    void onEnumeratorFinished(const boost::shared_ptr<Worker> &worker);
+    void onEnumeratorCanceled(const boost::shared_ptr<Worker> &worker);
+
+    void onScannerDone(const boost::shared_ptr<Worker> &worker);
+
+    boost::shared_ptr<Job> m_job;
+
+    Project *m_project;
+    FileEnumerator::TextTable m_texts;
+    boost::shared_ptr<FileEnumerator> m_enumerator;
+    boost::signals2::connection m_enumeratorFinishedConn;
+    boost::signals2::connection m_enumeratorCanceledConn;
+    unsigned int m_priority;
+
+    std::vector<boost::shared_ptr<Scanner> > m_scanners;
+    std::vector<boost::signals2::connection> m_scannerConnections;
+    int m_runningScannerCount;
+    bool m_canceled;
+
+    boost::function<void (FileSearcher &)> m_onFinished;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+// Action extension: find in files.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "find-in-files-action-extension.hpp"
+#include "file-finder-bar.hpp"
+#include "finder-plugin.hpp"
+#include "editors/editor.hpp"
+#include "project/project.hpp"
+#include "window/window.hpp"
+#include "widget/notebook.hpp"
+#include "widget/widget-with-bars.hpp"
+#include "application.hpp"
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+namespace
+{
+
+// Search the project of the current editor, or the first project if the
+// current editor is not in any project.
+Samoyed::Project *findProject(Samoyed::Window &window)
+{
+    Samoyed::Notebook &editorGroup = window.currentEditorGroup();
+    if (editorGroup.childCount())
+    {
+        Samoyed::Editor &editor =
+            static_cast<Samoyed::Editor &>(editorGroup.currentChild());
+        if (editor.project())
+            return editor.project();
+    }
+    return Samoyed::Application::instance().projects();
+}
+
+}
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+void FindInFilesActionExtension::activateAction(Window &window,
+                                                GtkAction *action)
+{
+    Project *project = findProject(window);
+    if (!project)
+        return;
+    FileFinderBar *bar = FileFinderBar::create(*project);
+    if (!bar)
+        return;
+    window.mainArea().addBar(*bar, false);
+    bar->setCurrent();
+    FinderPlugin::instance().onBarCreated(*bar);
+    bar->addClosedCallback(boost::bind(&FinderPlugin::onBarClosed,
+                                       boost::ref(FinderPlugin::instance()),
+                                       _1));
+}
+
+bool FindInFilesActionExtension::isActionSensitive(Window &window,
+                                                   GtkAction *action)
+{
+    return findProject(window);
+}
+
+}
+
+}
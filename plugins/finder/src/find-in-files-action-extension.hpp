@@ -0,0 +1,33 @@
+// Action extension: find in files.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_FIND_FIND_IN_FILES_ACTION_EXTENSION_HPP
+#define SMYD_FIND_FIND_IN_FILES_ACTION_EXTENSION_HPP
+
+#include "window/action-extension.hpp"
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+class FindInFilesActionExtension: public ActionExtension
+{
+public:
+    FindInFilesActionExtension(const char *id, Plugin &plugin):
+        ActionExtension(id, plugin)
+    {}
+
+    virtual void activateAction(Window &window, GtkAction *action);
+
+    virtual void onActionToggled(Window &window, GtkToggleAction *action) {}
+
+    virtual bool isActionSensitive(Window &window, GtkAction *action);
+};
+
+}
+
+}
+
+#endif
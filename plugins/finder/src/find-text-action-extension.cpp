@@ -33,8 +33,8 @@ void FindTextActionExtension::activateAction(Window &window, GtkAction *action)
     TextFinderBar *bar = TextFinderBar::create(editor, m_next);
     window.mainArea().addBar(*bar, true);
     bar->setCurrent();
-    FinderPlugin::instance().onTextFinderBarCreated(*bar);
-    bar->addClosedCallback(boost::bind(&FinderPlugin::onTextFinderBarClosed,
+    FinderPlugin::instance().onBarCreated(*bar);
+    bar->addClosedCallback(boost::bind(&FinderPlugin::onBarClosed,
                                        boost::ref(FinderPlugin::instance()),
                                        _1));
 }
@@ -12,11 +12,15 @@
 #define TEXT_SEARCH "text-search"
 #define PATTERNS "patterns"
 #define MATCH_CASE "match-case"
+#define WHOLE_WORD "whole-word"
+#define REGEX "regex"
 
 namespace
 {
 
 const bool DEFAULT_MATCH_CASE = false;
+const bool DEFAULT_WHOLE_WORD = false;
+const bool DEFAULT_REGEX = false;
 
 }
 
@@ -32,6 +36,8 @@ void FinderHistoriesExtension::installHistories()
         Application::instance().histories().addChild(TEXT_SEARCH);
     hist.addChild(PATTERNS, std::string());
     hist.addChild(MATCH_CASE, DEFAULT_MATCH_CASE);
+    hist.addChild(WHOLE_WORD, DEFAULT_WHOLE_WORD);
+    hist.addChild(REGEX, DEFAULT_REGEX);
 }
 
 void FinderHistoriesExtension::uninstallHistories()
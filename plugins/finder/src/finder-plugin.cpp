@@ -6,6 +6,7 @@
 #endif
 #include "finder-plugin.hpp"
 #include "find-text-action-extension.hpp"
+#include "find-in-files-action-extension.hpp"
 #include "finder-histories-extension.hpp"
 #include "widget/widget.hpp"
 #include <string.h>
@@ -33,32 +34,34 @@ Extension *FinderPlugin::createExtension(const char *extensionId)
         return new FindTextActionExtension(extensionId, *this, true);
     if (strcmp(extensionId, "finder/find-text-back") == 0)
         return new FindTextActionExtension(extensionId, *this, false);
+    if (strcmp(extensionId, "finder/find-in-files") == 0)
+        return new FindInFilesActionExtension(extensionId, *this);
     if (strcmp(extensionId, "finder/histories") == 0)
         return new FinderHistoriesExtension(extensionId, *this);
     return NULL;
 }
 
-void FinderPlugin::onTextFinderBarCreated(Widget &bar)
+void FinderPlugin::onBarCreated(Widget &bar)
 {
-    m_textFinderBars.insert(&bar);
+    m_bars.insert(&bar);
 }
 
-void FinderPlugin::onTextFinderBarClosed(Widget &bar)
+void FinderPlugin::onBarClosed(Widget &bar)
 {
-    m_textFinderBars.erase(&bar);
+    m_bars.erase(&bar);
     if (completed())
         onCompleted();
 }
 
 bool FinderPlugin::completed() const
 {
-    return m_textFinderBars.empty();
+    return m_bars.empty();
 }
 
 void FinderPlugin::deactivate()
 {
-    while (!m_textFinderBars.empty())
-        (*m_textFinderBars.begin())->close();
+    while (!m_bars.empty())
+        (*m_bars.begin())->close();
 }
 
 }
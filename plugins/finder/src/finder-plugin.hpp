@@ -24,8 +24,8 @@ public:
 
     virtual void deactivate();
 
-    void onTextFinderBarCreated(Widget &bar);
-    void onTextFinderBarClosed(Widget &bar);
+    void onBarCreated(Widget &bar);
+    void onBarClosed(Widget &bar);
 
 protected:
     virtual Extension *createExtension(const char *extensionId);
@@ -35,7 +35,7 @@ protected:
 private:
     static FinderPlugin *s_instance;
 
-    std::set<Widget *> m_textFinderBars;
+    std::set<Widget *> m_bars;
 };
 
 }
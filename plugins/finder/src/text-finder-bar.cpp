@@ -5,10 +5,18 @@
 # include <config.h>
 #endif
 #include "text-finder-bar.hpp"
+#include "text-matcher.hpp"
 #include "editors/text-editor.hpp"
 #include "utilities/property-tree.hpp"
+#include "utilities/worker.hpp"
 #include "application.hpp"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <glib/gi18n.h>
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
@@ -16,12 +24,17 @@
 #define TEXT_SEARCH "text-search"
 #define PATTERNS "patterns"
 #define MATCH_CASE "match-case"
+#define WHOLE_WORD "whole-word"
+#define REGEX "regex"
 
 namespace
 {
 
 const int MAX_PATTERN_COUNT = 10;
 
+// The number of the bytes scanned by the match collector in each step.
+const int COLLECTING_STEP_SIZE = 1024 * 1024;
+
 void addHistoricalPatterns(GtkListStore *store)
 {
     GtkTreeIter iter;
@@ -100,24 +113,132 @@ void savePattern(GtkListStore *store, const char *pattern)
 
 }
 
+
 namespace Samoyed
 {
 
 namespace Finder
 {
 
+// A match collector collects all the matches in a snapshot of the text.
+class TextFinderBar::Collector: public Worker
+{
+public:
+    Collector(Scheduler &scheduler,
+              unsigned int priority,
+              const boost::shared_ptr<char> &text,
+              int length,
+              const boost::shared_ptr<TextMatcher> &matcher):
+        Worker(scheduler, priority),
+        m_text(text),
+        m_end(text.get() + length),
+        m_from(text.get()),
+        m_counted(text.get()),
+        m_countedOffset(0),
+        m_matcher(matcher)
+    {
+        setDescription(_("Finding text"));
+    }
+
+    MatchList &matches() { return m_matches; }
+
+protected:
+    virtual bool step();
+
+private:
+    boost::shared_ptr<char> m_text;
+    const char *m_end;
+    const char *m_from;
+
+    // The character offset of the counted position.
+    const char *m_counted;
+    int m_countedOffset;
+
+    boost::shared_ptr<TextMatcher> m_matcher;
+    MatchList m_matches;
+};
+
+bool TextFinderBar::Collector::step()
+{
+    const char *begin = m_text.get();
+    const char *stepEnd = m_from + COLLECTING_STEP_SIZE;
+    while (m_from < m_end)
+    {
+        if (m_from >= stepEnd)
+            return false;
+        const char *matchBegin, *matchEnd;
+        if (!m_matcher->find(begin, m_end, m_from, matchBegin, matchEnd))
+            break;
+        if (matchBegin == matchEnd)
+        {
+            // Skip empty matches.
+            m_from = g_utf8_next_char(matchEnd);
+            continue;
+        }
+        Match match;
+        m_countedOffset += g_utf8_strlen(m_counted, matchBegin - m_counted);
+        match.begin = m_countedOffset;
+        m_countedOffset += g_utf8_strlen(matchBegin, matchEnd - matchBegin);
+        match.end = m_countedOffset;
+        m_counted = matchEnd;
+        m_matches.push_back(match);
+        m_from = matchEnd;
+    }
+    return true;
+}
+
 const char *TextFinderBar::ID = "text-finder-bar";
 
+bool TextFinderBar::compareMatches(const Match &match1, const Match &match2)
+{
+    return match1.begin < match2.begin;
+}
+
 TextFinderBar::TextFinderBar(TextEditor &editor, bool nextByDefault):
+    m_builder(NULL),
+    m_nextByDefault(nextByDefault),
     m_editor(editor),
-    m_nextByDefault(nextByDefault)
+    m_buffer(NULL),
+    m_adjustment(NULL),
+    m_insertTextHandler(0),
+    m_deleteRangeHandler(0),
+    m_deleteRangeAfterHandler(0),
+    m_scrollHandler(0),
+    m_matchTag(NULL),
+    m_pendingDirection(DIRECTION_NONE),
+    m_pendingSavePosition(false),
+    m_matchesReady(true),
+    m_deletedBegin(0),
+    m_deletedEnd(0),
+    m_highlightedBegin(0),
+    m_highlightedEnd(0),
+    m_highlighterId(0)
 {
     editor.getCursor(m_line, m_column);
 }
 
 TextFinderBar::~TextFinderBar()
 {
-    g_object_unref(m_builder);
+    cancelCollecting();
+    if (m_highlighterId)
+        g_source_remove(m_highlighterId);
+    if (m_buffer)
+    {
+        unhighlightMatches();
+        g_signal_handler_disconnect(m_buffer, m_insertTextHandler);
+        g_signal_handler_disconnect(m_buffer, m_deleteRangeHandler);
+        g_signal_handler_disconnect(m_buffer, m_deleteRangeAfterHandler);
+        gtk_text_tag_table_remove(gtk_text_buffer_get_tag_table(m_buffer),
+                                  m_matchTag);
+        g_object_unref(m_buffer);
+    }
+    if (m_adjustment)
+    {
+        g_signal_handler_disconnect(m_adjustment, m_scrollHandler);
+        g_object_unref(m_adjustment);
+    }
+    if (m_builder)
+        g_object_unref(m_builder);
 }
 
 bool TextFinderBar::setup()
@@ -135,20 +256,59 @@ bool TextFinderBar::setup()
     m_matchCaseButton =
         GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder,
                                                  "match-case-button"));
+    m_wholeWordButton =
+        GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder,
+                                                 "whole-word-button"));
+    m_regexButton =
+        GTK_TOGGLE_BUTTON(gtk_builder_get_object(m_builder, "regex-button"));
     m_messageLabel =
         GTK_LABEL(gtk_builder_get_object(m_builder, "message-label"));
 
-    g_signal_connect(m_patternEntry, "changed",
-                     G_CALLBACK(onPatternChanged), this);
-    g_signal_connect(m_patternEntry, "activate",
-                     G_CALLBACK(onDone), this);
-
     gtk_toggle_button_set_active(
         m_matchCaseButton,
         Application::instance().histories().
             get<bool>(TEXT_SEARCH "/" MATCH_CASE));
+    gtk_toggle_button_set_active(
+        m_wholeWordButton,
+        Application::instance().histories().
+            get<bool>(TEXT_SEARCH "/" WHOLE_WORD));
+    gtk_toggle_button_set_active(
+        m_regexButton,
+        Application::instance().histories().
+            get<bool>(TEXT_SEARCH "/" REGEX));
+
+    // Keep the matches up to date and highlight the visible ones.
+    GtkTextView *view = GTK_TEXT_VIEW(m_editor.gtkSourceView());
+    m_buffer = gtk_text_view_get_buffer(view);
+    g_object_ref(m_buffer);
+    m_matchTag = gtk_text_buffer_create_tag(m_buffer, NULL,
+                                            "background", "yellow",
+                                            NULL);
+    m_insertTextHandler =
+        g_signal_connect_after(m_buffer, "insert-text",
+                               G_CALLBACK(onTextInserted), this);
+    m_deleteRangeHandler =
+        g_signal_connect(m_buffer, "delete-range",
+                         G_CALLBACK(onRangeDeleting), this);
+    m_deleteRangeAfterHandler =
+        g_signal_connect_after(m_buffer, "delete-range",
+                               G_CALLBACK(onRangeDeleted), this);
+    m_adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(view));
+    g_object_ref(m_adjustment);
+    m_scrollHandler =
+        g_signal_connect(m_adjustment, "value-changed",
+                         G_CALLBACK(onScrolled), this);
+
+    g_signal_connect(m_patternEntry, "changed",
+                     G_CALLBACK(onPatternChanged), this);
+    g_signal_connect(m_patternEntry, "activate",
+                     G_CALLBACK(onDone), this);
     g_signal_connect(m_matchCaseButton, "toggled",
                      G_CALLBACK(onMatchCaseChanged), this);
+    g_signal_connect(m_wholeWordButton, "toggled",
+                     G_CALLBACK(onWholeWordChanged), this);
+    g_signal_connect(m_regexButton, "toggled",
+                     G_CALLBACK(onRegexChanged), this);
 
     g_signal_connect(gtk_builder_get_object(m_builder, "next-button"),
                      "clicked", G_CALLBACK(onFindNext), this);
@@ -199,112 +359,340 @@ Widget::XmlElement *TextFinderBar::save() const
     return NULL;
 }
 
+int TextFinderBar::flags() const
+{
+    int flags = TextMatcher::FLAG_UTF8;
+    if (gtk_toggle_button_get_active(m_matchCaseButton))
+        flags |= TextMatcher::FLAG_MATCH_CASE;
+    if (gtk_toggle_button_get_active(m_wholeWordButton))
+        flags |= TextMatcher::FLAG_WHOLE_WORD;
+    if (gtk_toggle_button_get_active(m_regexButton))
+        flags |= TextMatcher::FLAG_REGEX;
+    return flags;
+}
+
+void TextFinderBar::cancelCollecting()
+{
+    if (!m_collector)
+        return;
+    m_collectorFinishedConn.disconnect();
+    m_collectorCanceledConn.disconnect();
+    m_collector->cancel(m_collector);
+    m_collector.reset();
+}
+
+// Collect all the matches of the current pattern in the background, and move
+// to the next or previous match when collected.
+void TextFinderBar::collectMatches(Direction direction, bool savePosition)
+{
+    cancelCollecting();
+    unhighlightMatches();
+    m_matches.clear();
+    m_matcher.reset();
+    m_matchesReady = true;
+    m_pendingDirection = direction;
+    m_pendingSavePosition = savePosition;
+
+    // Clear the message.
+    gtk_label_set_text(m_messageLabel, "");
+    gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel), "");
+
+    GError *error = NULL;
+    m_matcher.reset(TextMatcher::create(gtk_entry_get_text(m_patternEntry),
+                                        flags(),
+                                        &error));
+    if (!m_matcher)
+    {
+        m_pendingDirection = DIRECTION_NONE;
+        if (error)
+        {
+            gtk_label_set_text(m_messageLabel, error->message);
+            gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel),
+                                        error->message);
+            g_error_free(error);
+        }
+        return;
+    }
+
+    GtkTextIter begin, end;
+    gtk_text_buffer_get_bounds(m_buffer, &begin, &end);
+    char *text = gtk_text_buffer_get_slice(m_buffer, &begin, &end, TRUE);
+    m_matchesReady = false;
+    m_collector.reset(new Collector(Application::instance().scheduler(),
+                                    Worker::PRIORITY_INTERACTIVE,
+                                    boost::shared_ptr<char>(text, g_free),
+                                    strlen(text),
+                                    m_matcher));
+    m_collectorFinishedConn =
+        m_collector->addFinishedCallbackInMainThread(
+            boost::bind(onCollectorFinished, this, _1));
+    m_collectorCanceledConn =
+        m_collector->addCanceledCallbackInMainThread(
+            boost::bind(onCollectorFinished, this, _1));
+    m_collector->submit(m_collector);
+}
+
+void TextFinderBar::onCollectorFinished(const boost::shared_ptr<Worker> &worker)
+{
+    assert(m_collector == worker);
+    m_collectorFinishedConn.disconnect();
+    m_collectorCanceledConn.disconnect();
+    m_matches.swap(m_collector->matches());
+    m_collector.reset();
+    m_matchesReady = true;
+    queueHighlighting();
+
+    if (m_pendingDirection != DIRECTION_NONE)
+    {
+        bool found = search(m_pendingDirection == DIRECTION_NEXT);
+        if (found && m_pendingSavePosition)
+        {
+            // Save the position of the occurrence.
+            m_editor.getCursor(m_line, m_column);
+        }
+        m_pendingDirection = DIRECTION_NONE;
+    }
+}
+
+// Update the matches after the text in the range is replaced by the inserted
+// text.  The matches in the lines containing the edit are found again, while
+// the matches after them are moved.
+void TextFinderBar::updateMatches(int editBegin,
+                                  int editEnd,
+                                  int insertedLength)
+{
+    if (!m_matcher)
+        return;
+    if (!m_matchesReady)
+    {
+        // Collect the matches from the new text again.
+        collectMatches(m_pendingDirection, m_pendingSavePosition);
+        return;
+    }
+
+    int delta = insertedLength - (editEnd - editBegin);
+    GtkTextIter rescanBegin, rescanEnd;
+    gtk_text_buffer_get_iter_at_offset(m_buffer, &rescanBegin, editBegin);
+    gtk_text_iter_set_line_offset(&rescanBegin, 0);
+    gtk_text_buffer_get_iter_at_offset(m_buffer, &rescanEnd,
+                                       editBegin + insertedLength);
+    if (!gtk_text_iter_ends_line(&rescanEnd))
+        gtk_text_iter_forward_to_line_end(&rescanEnd);
+    int rescanBeginOffset = gtk_text_iter_get_offset(&rescanBegin);
+    int rescanEndOffset = gtk_text_iter_get_offset(&rescanEnd);
+
+    // Remove the matches in the rescanned lines, whose offsets are not moved
+    // yet, and move the following matches.
+    MatchList::iterator first = m_matches.begin();
+    while (first != m_matches.end() && first->end <= rescanBeginOffset)
+        ++first;
+    MatchList::iterator last = first;
+    while (last != m_matches.end() && last->begin < rescanEndOffset - delta)
+        ++last;
+    for (MatchList::iterator it = last; it != m_matches.end(); ++it)
+    {
+        it->begin += delta;
+        it->end += delta;
+    }
+    first = m_matches.erase(first, last);
+
+    // Find the matches in the edited lines.
+    MatchList found;
+    char *text = gtk_text_buffer_get_slice(m_buffer, &rescanBegin, &rescanEnd,
+                                           TRUE);
+    const char *textEnd = text + strlen(text);
+    const char *from = text, *counted = text;
+    int countedOffset = rescanBeginOffset;
+    const char *matchBegin, *matchEnd;
+    while (from < textEnd &&
+           m_matcher->find(text, textEnd, from, matchBegin, matchEnd))
+    {
+        if (matchBegin == matchEnd)
+        {
+            from = g_utf8_next_char(matchEnd);
+            continue;
+        }
+        Match match;
+        countedOffset += g_utf8_strlen(counted, matchBegin - counted);
+        match.begin = countedOffset;
+        countedOffset += g_utf8_strlen(matchBegin, matchEnd - matchBegin);
+        match.end = countedOffset;
+        counted = from = matchEnd;
+        found.push_back(match);
+    }
+    g_free(text);
+    m_matches.insert(first, found.begin(), found.end());
+
+    // The highlighted range moves with the text.
+    if (m_highlightedBegin > editBegin)
+        m_highlightedBegin = editBegin;
+    if (m_highlightedEnd > editBegin)
+        m_highlightedEnd = std::max(m_highlightedEnd + delta,
+                                    editBegin + insertedLength);
+    queueHighlighting();
+}
+
+void TextFinderBar::queueHighlighting()
+{
+    if (!m_highlighterId)
+        m_highlighterId = g_idle_add(highlightVisibleMatches, this);
+}
+
+void TextFinderBar::unhighlightMatches()
+{
+    if (m_highlightedBegin >= m_highlightedEnd)
+        return;
+    GtkTextIter begin, end;
+    gtk_text_buffer_get_iter_at_offset(m_buffer, &begin, m_highlightedBegin);
+    gtk_text_buffer_get_iter_at_offset(m_buffer, &end, m_highlightedEnd);
+    gtk_text_buffer_remove_tag(m_buffer, m_matchTag, &begin, &end);
+    m_highlightedBegin = m_highlightedEnd = 0;
+}
+
+gboolean TextFinderBar::highlightVisibleMatches(gpointer bar)
+{
+    TextFinderBar *b = static_cast<TextFinderBar *>(bar);
+    b->m_highlighterId = 0;
+    b->unhighlightMatches();
+    if (b->m_matches.empty())
+        return FALSE;
+
+    GtkTextView *view = GTK_TEXT_VIEW(b->m_editor.gtkSourceView());
+    GdkRectangle rect;
+    GtkTextIter begin, end;
+    gtk_text_view_get_visible_rect(view, &rect);
+    gtk_text_view_get_line_at_y(view, &begin, rect.y, NULL);
+    gtk_text_view_get_line_at_y(view, &end, rect.y + rect.height, NULL);
+    if (!gtk_text_iter_ends_line(&end))
+        gtk_text_iter_forward_to_line_end(&end);
+    int beginOffset = gtk_text_iter_get_offset(&begin);
+    int endOffset = gtk_text_iter_get_offset(&end);
+
+    Match key;
+    key.begin = beginOffset;
+    MatchList::const_iterator it =
+        std::lower_bound(b->m_matches.begin(), b->m_matches.end(), key,
+                         compareMatches);
+    if (it != b->m_matches.begin() && (it - 1)->end > beginOffset)
+        --it;
+    for (; it != b->m_matches.end() && it->begin < endOffset; ++it)
+    {
+        gtk_text_buffer_get_iter_at_offset(b->m_buffer, &begin, it->begin);
+        gtk_text_buffer_get_iter_at_offset(b->m_buffer, &end, it->end);
+        gtk_text_buffer_apply_tag(b->m_buffer, b->m_matchTag, &begin, &end);
+    }
+    b->m_highlightedBegin = beginOffset;
+    b->m_highlightedEnd = endOffset;
+    return FALSE;
+}
+
 bool TextFinderBar::search(bool next)
 {
     // Clear the message.
     gtk_label_set_text(m_messageLabel, "");
     gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel), "");
 
-    const char *pattern = gtk_entry_get_text(m_patternEntry);
-    if (*pattern == '\0')
+    if (!m_matcher)
         return false;
+    if (m_matches.empty())
+    {
+        gtk_label_set_text(m_messageLabel, _("Not found."));
+        gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel),
+                                    _("Not found."));
+        return false;
+    }
 
-    GtkTextBuffer *buffer =
-        gtk_text_view_get_buffer(GTK_TEXT_VIEW(m_editor.gtkSourceView()));
-    GtkTextIter start, matchBegin, matchEnd;
-    unsigned int flags = GTK_TEXT_SEARCH_TEXT_ONLY;
-    if (!gtk_toggle_button_get_active(m_matchCaseButton))
-        flags |= GTK_TEXT_SEARCH_CASE_INSENSITIVE;
-
-    gboolean found;
+    GtkTextIter start, end;
+    gtk_text_buffer_get_selection_bounds(m_buffer, &start, &end);
+    Match key;
+    MatchList::const_iterator it;
     bool wrapped = false;
     if (next)
     {
-        gtk_text_buffer_get_selection_bounds(buffer, NULL, &start);
-        found = gtk_text_iter_forward_search(
-            &start, pattern,
-            static_cast<GtkTextSearchFlags>(flags),
-            &matchBegin, &matchEnd,
-            NULL);
-        if (!found)
+        key.begin = gtk_text_iter_get_offset(&end);
+        it = std::lower_bound(m_matches.begin(), m_matches.end(), key,
+                              compareMatches);
+        if (it == m_matches.end())
         {
             wrapped = true;
-            gtk_text_buffer_get_start_iter(buffer, &start);
-            found = gtk_text_iter_forward_search(
-                &start, pattern,
-                static_cast<GtkTextSearchFlags>(flags),
-                &matchBegin, &matchEnd,
-                NULL);
+            it = m_matches.begin();
         }
     }
     else
     {
-        gtk_text_buffer_get_selection_bounds(buffer, &start, NULL);
-        found = gtk_text_iter_backward_search(
-            &start, pattern,
-            static_cast<GtkTextSearchFlags>(flags),
-            &matchBegin, &matchEnd,
-            NULL);
-        if (!found)
+        key.begin = gtk_text_iter_get_offset(&start);
+        it = std::lower_bound(m_matches.begin(), m_matches.end(), key,
+                              compareMatches);
+        if (it == m_matches.begin())
         {
             wrapped = true;
-            gtk_text_buffer_get_end_iter(buffer, &start);
-            found = gtk_text_iter_backward_search(
-                &start, pattern,
-                static_cast<GtkTextSearchFlags>(flags),
-                &matchBegin, &matchEnd,
-                NULL);
+            it = m_matches.end();
         }
+        --it;
     }
 
-    if (found)
+    int line, column, line2, column2;
+    gtk_text_buffer_get_iter_at_offset(m_buffer, &start, it->begin);
+    gtk_text_buffer_get_iter_at_offset(m_buffer, &end, it->end);
+    line = gtk_text_iter_get_line(&start);
+    column = gtk_text_iter_get_line_offset(&start);
+    line2 = gtk_text_iter_get_line(&end);
+    column2 = gtk_text_iter_get_line_offset(&end);
+    m_editor.selectRange(line, column, line2, column2);
+
+    char *message;
+    if (wrapped)
     {
-        int line, column, line2, column2;
-        line = gtk_text_iter_get_line(&matchBegin);
-        column = gtk_text_iter_get_line_offset(&matchBegin);
-        line2 = gtk_text_iter_get_line(&matchEnd);
-        column2 = gtk_text_iter_get_line_offset(&matchEnd);
-        m_editor.selectRange(line, column, line2, column2);
-        if (wrapped)
-        {
-            if (next)
-            {
-                gtk_label_set_text(
-                    m_messageLabel,
-                    _("Reached the end of the file. Continued from the "
-                      "beginning."));
-                gtk_widget_set_tooltip_text(
-                    GTK_WIDGET(m_messageLabel),
-                    _("Reached the end of the file. Continued from the "
-                      "beginning."));
-            }
-            else
-            {
-                gtk_label_set_text(
-                    m_messageLabel,
-                    _("Reached the beginning of the file. Continued from the "
-                      "end."));
-                gtk_widget_set_tooltip_text(
-                    GTK_WIDGET(m_messageLabel),
-                    _("Reached the beginning of the file. Continued from the "
-                      "end."));
-            }
-        }
+        if (next)
+            message = g_strdup_printf(
+                _("Match %d of %d. Reached the end of the file. Continued "
+                  "from the beginning."),
+                static_cast<int>(it - m_matches.begin()) + 1,
+                static_cast<int>(m_matches.size()));
+        else
+            message = g_strdup_printf(
+                _("Match %d of %d. Reached the beginning of the file. "
+                  "Continued from the end."),
+                static_cast<int>(it - m_matches.begin()) + 1,
+                static_cast<int>(m_matches.size()));
     }
     else
+        message = g_strdup_printf(
+            _("Match %d of %d."),
+            static_cast<int>(it - m_matches.begin()) + 1,
+            static_cast<int>(m_matches.size()));
+    gtk_label_set_text(m_messageLabel, message);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel), message);
+    g_free(message);
+    return true;
+}
+
+// Move to the next or previous match, after the matches are collected.
+void TextFinderBar::find(bool next)
+{
+    savePattern(GTK_LIST_STORE(gtk_entry_completion_get_model(
+                gtk_entry_get_completion(m_patternEntry))),
+                gtk_entry_get_text(m_patternEntry));
+    if (!m_matchesReady)
     {
-        gtk_label_set_text(m_messageLabel, _("Not found."));
-        gtk_widget_set_tooltip_text(GTK_WIDGET(m_messageLabel),
-                                    _("Not found."));
+        m_pendingDirection = next ? DIRECTION_NEXT : DIRECTION_PREVIOUS;
+        m_pendingSavePosition = true;
+        return;
+    }
+    if (search(next))
+    {
+        // Save the position of the occurrence.
+        m_editor.getCursor(m_line, m_column);
     }
-    return found;
 }
 
 void TextFinderBar::onPatternChanged(GtkEditable *edit, TextFinderBar *bar)
 {
     // Always start from the initial starting point.
     bar->m_editor.setCursor(bar->m_line, bar->m_column);
-    bar->search(bar->m_nextByDefault);
+    bar->collectMatches(bar->m_nextByDefault ?
+                        DIRECTION_NEXT : DIRECTION_PREVIOUS,
+                        false);
 }
 
 void TextFinderBar::onMatchCaseChanged(GtkToggleButton *button,
@@ -318,31 +706,51 @@ void TextFinderBar::onMatchCaseChanged(GtkToggleButton *button,
 
     // Always start from the initial starting point.
     bar->m_editor.setCursor(bar->m_line, bar->m_column);
-    bar->search(bar->m_nextByDefault);
+    bar->collectMatches(bar->m_nextByDefault ?
+                        DIRECTION_NEXT : DIRECTION_PREVIOUS,
+                        false);
+}
+
+void TextFinderBar::onWholeWordChanged(GtkToggleButton *button,
+                                       TextFinderBar *bar)
+{
+    Application::instance().histories().set(
+        TEXT_SEARCH "/" WHOLE_WORD,
+        gtk_toggle_button_get_active(bar->m_wholeWordButton) ?
+        true : false,
+        false, NULL);
+
+    // Always start from the initial starting point.
+    bar->m_editor.setCursor(bar->m_line, bar->m_column);
+    bar->collectMatches(bar->m_nextByDefault ?
+                        DIRECTION_NEXT : DIRECTION_PREVIOUS,
+                        false);
+}
+
+void TextFinderBar::onRegexChanged(GtkToggleButton *button,
+                                   TextFinderBar *bar)
+{
+    Application::instance().histories().set(
+        TEXT_SEARCH "/" REGEX,
+        gtk_toggle_button_get_active(bar->m_regexButton) ?
+        true : false,
+        false, NULL);
+
+    // Always start from the initial starting point.
+    bar->m_editor.setCursor(bar->m_line, bar->m_column);
+    bar->collectMatches(bar->m_nextByDefault ?
+                        DIRECTION_NEXT : DIRECTION_PREVIOUS,
+                        false);
 }
 
 void TextFinderBar::onFindNext(GtkButton *button, TextFinderBar *bar)
 {
-    savePattern(GTK_LIST_STORE(gtk_entry_completion_get_model(
-                gtk_entry_get_completion(bar->m_patternEntry))),
-                gtk_entry_get_text(bar->m_patternEntry));
-    if (bar->search(true))
-    {
-        // Save the position of the occurrence.
-        bar->m_editor.getCursor(bar->m_line, bar->m_column);
-    }
+    bar->find(true);
 }
 
 void TextFinderBar::onFindPrevious(GtkButton *button, TextFinderBar *bar)
 {
-    savePattern(GTK_LIST_STORE(gtk_entry_completion_get_model(
-                gtk_entry_get_completion(bar->m_patternEntry))),
-                gtk_entry_get_text(bar->m_patternEntry));
-    if (bar->search(false))
-    {
-        // Save the position of the occurrence.
-        bar->m_editor.getCursor(bar->m_line, bar->m_column);
-    }
+    bar->find(false);
 }
 
 void TextFinderBar::onDone(GtkEntry *entry, TextFinderBar *bar)
@@ -379,6 +787,39 @@ gboolean TextFinderBar::onKeyPress(GtkWidget *widget,
     return FALSE;
 }
 
+void TextFinderBar::onTextInserted(GtkTextBuffer *buffer,
+                                   GtkTextIter *location,
+                                   char *text,
+                                   int length,
+                                   TextFinderBar *bar)
+{
+    int insertedLength = g_utf8_strlen(text, length);
+    int begin = gtk_text_iter_get_offset(location) - insertedLength;
+    bar->updateMatches(begin, begin, insertedLength);
+}
+
+void TextFinderBar::onRangeDeleting(GtkTextBuffer *buffer,
+                                    GtkTextIter *begin,
+                                    GtkTextIter *end,
+                                    TextFinderBar *bar)
+{
+    bar->m_deletedBegin = gtk_text_iter_get_offset(begin);
+    bar->m_deletedEnd = gtk_text_iter_get_offset(end);
+}
+
+void TextFinderBar::onRangeDeleted(GtkTextBuffer *buffer,
+                                   GtkTextIter *begin,
+                                   GtkTextIter *end,
+                                   TextFinderBar *bar)
+{
+    bar->updateMatches(bar->m_deletedBegin, bar->m_deletedEnd, 0);
+}
+
+void TextFinderBar::onScrolled(GtkAdjustment *adjustment, TextFinderBar *bar)
+{
+    bar->queueHighlighting();
+}
+
 void TextFinderBar::grabFocus()
 {
     gtk_widget_grab_focus(GTK_WIDGET(m_patternEntry));
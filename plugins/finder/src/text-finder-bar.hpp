@@ -5,16 +5,30 @@
 #define SMYD_FIND_TEXT_FINDER_BAR_HPP
 
 #include "widget/bar.hpp"
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/signals2/connection.hpp>
 #include <gtk/gtk.h>
 
 namespace Samoyed
 {
 
 class TextEditor;
+class Worker;
 
 namespace Finder
 {
 
+class TextMatcher;
+
+/**
+ * A text finder bar finds text in a text editor incrementally.  When the
+ * pattern or the options are changed, all the matches are collected by a
+ * background worker from a snapshot of the text.  The matches are then kept
+ * up to date as the text is edited, by rescanning the edited lines only, so
+ * that moving to the next or previous match is a binary search.  The matches
+ * in the visible range are highlighted.
+ */
 class TextFinderBar: public Bar
 {
 public:
@@ -29,8 +43,29 @@ public:
     virtual void grabFocus();
 
 private:
+    class Collector;
+
+    // The character offsets of a match.
+    struct Match
+    {
+        int begin;
+        int end;
+    };
+
+    typedef std::vector<Match> MatchList;
+
+    enum Direction
+    {
+        DIRECTION_NONE,
+        DIRECTION_NEXT,
+        DIRECTION_PREVIOUS
+    };
+
     static void onPatternChanged(GtkEditable *edit, TextFinderBar *bar);
     static void onMatchCaseChanged(GtkToggleButton *button, TextFinderBar *bar);
+    static void onWholeWordChanged(GtkToggleButton *button,
+                                   TextFinderBar *bar);
+    static void onRegexChanged(GtkToggleButton *button, TextFinderBar *bar);
     static void onFindNext(GtkButton *button, TextFinderBar *bar);
     static void onFindPrevious(GtkButton *button, TextFinderBar *bar);
     static void onDone(GtkEntry *entry, TextFinderBar *bar);
@@ -39,18 +74,55 @@ private:
                                GdkEventKey *event,
                                TextFinderBar *bar);
 
+    static void onTextInserted(GtkTextBuffer *buffer,
+                               GtkTextIter *location,
+                               char *text,
+                               int length,
+                               TextFinderBar *bar);
+    static void onRangeDeleting(GtkTextBuffer *buffer,
+                                GtkTextIter *begin,
+                                GtkTextIter *end,
+                                TextFinderBar *bar);
+    static void onRangeDeleted(GtkTextBuffer *buffer,
+                               GtkTextIter *begin,
+                               GtkTextIter *end,
+                               TextFinderBar *bar);
+    static void onScrolled(GtkAdjustment *adjustment, TextFinderBar *bar);
+
+    static gboolean highlightVisibleMatches(gpointer bar);
+
+    static bool compareMatches(const Match &match1, const Match &match2);
+
     TextFinderBar(TextEditor &editor, bool nextByDefault);
 
     ~TextFinderBar();
 
     bool setup();
 
+    int flags() const;
+
+    void collectMatches(Direction direction, bool savePosition);
+
+    void cancelCollecting();
+
+    void onCollectorFinished(const boost::shared_ptr<Worker> &worker);
+
+    void updateMatches(int editBegin, int editEnd, int insertedLength);
+
+    void queueHighlighting();
+
+    void unhighlightMatches();
+
     bool search(bool next);
 
+    void find(bool next);
+
     GtkBuilder *m_builder;
 
     GtkEntry *m_patternEntry;
     GtkToggleButton *m_matchCaseButton;
+    GtkToggleButton *m_wholeWordButton;
+    GtkToggleButton *m_regexButton;
     GtkLabel *m_messageLabel;
 
     bool m_nextByDefault;
@@ -58,6 +130,32 @@ private:
     TextEditor &m_editor;
     int m_line;
     int m_column;
+
+    GtkTextBuffer *m_buffer;
+    GtkAdjustment *m_adjustment;
+    gulong m_insertTextHandler;
+    gulong m_deleteRangeHandler;
+    gulong m_deleteRangeAfterHandler;
+    gulong m_scrollHandler;
+    GtkTextTag *m_matchTag;
+
+    boost::shared_ptr<TextMatcher> m_matcher;
+    boost::shared_ptr<Collector> m_collector;
+    boost::signals2::connection m_collectorFinishedConn;
+    boost::signals2::connection m_collectorCanceledConn;
+    Direction m_pendingDirection;
+    bool m_pendingSavePosition;
+
+    // The matches sorted by their offsets.
+    MatchList m_matches;
+    bool m_matchesReady;
+
+    int m_deletedBegin;
+    int m_deletedEnd;
+
+    int m_highlightedBegin;
+    int m_highlightedEnd;
+    guint m_highlighterId;
 };
 
 }
@@ -0,0 +1,336 @@
+// Text matcher.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "text-matcher.hpp"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <glib.h>
+
+namespace
+{
+
+// Find a byte in the range, or return the end of the range if not found.
+const char *findByte(const char *begin, const char *end, char byte)
+{
+    if (begin >= end)
+        return end;
+    const char *cp = static_cast<const char *>(memchr(begin, byte, end - begin));
+    return cp ? cp : end;
+}
+
+bool equalIgnoringCase(const char *s1, const char *s2, int length)
+{
+    for (int i = 0; i < length; i++)
+        if (g_ascii_tolower(s1[i]) != g_ascii_tolower(s2[i]))
+            return false;
+    return true;
+}
+
+// Non-ASCII bytes are regarded as parts of words.
+bool isWordByte(char c)
+{
+    return g_ascii_isalnum(c) || c == '_' || (c & 0x80);
+}
+
+bool isAscii(const char *text)
+{
+    for (const char *cp = text; *cp; cp++)
+        if (*cp & 0x80)
+            return false;
+    return true;
+}
+
+// Keep a run of ordinary characters if long enough to be narrowed down by.
+// Non-ASCII letters may be folded when matching case-insensitively.
+void addLiteral(std::string &literal,
+                bool matchCase,
+                std::vector<std::string> &literals)
+{
+    if (literal.length() >= 3 && (matchCase || isAscii(literal.c_str())))
+        literals.push_back(literal);
+    literal.clear();
+}
+
+}
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+TextMatcher::TextMatcher(const char *pattern, int flags):
+    m_pattern(pattern),
+    m_flags(flags),
+    m_regex(NULL)
+{
+}
+
+TextMatcher::~TextMatcher()
+{
+    if (m_regex)
+        g_regex_unref(m_regex);
+}
+
+TextMatcher *TextMatcher::create(const char *pattern, int flags,
+                                 GError **error)
+{
+    if (*pattern == '\0')
+        return NULL;
+    TextMatcher *matcher = new TextMatcher(pattern, flags);
+
+    // Fold the case of non-ASCII letters in UTF-8 text by the regular
+    // expression engine.
+    bool regex = flags & FLAG_REGEX;
+    std::string regexPattern;
+    if (regex)
+        regexPattern = pattern;
+    else if (!(flags & FLAG_MATCH_CASE) && (flags & FLAG_UTF8) &&
+             !isAscii(pattern))
+    {
+        char *escaped = g_regex_escape_string(pattern, -1);
+        regexPattern = escaped;
+        g_free(escaped);
+        regex = true;
+    }
+    if (!regex)
+        return matcher;
+
+    if (flags & FLAG_WHOLE_WORD)
+        regexPattern = "\\b(?:" + regexPattern + ")\\b";
+    int compileFlags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+    if (!(flags & FLAG_UTF8))
+        compileFlags |= G_REGEX_RAW;
+    if (!(flags & FLAG_MATCH_CASE))
+        compileFlags |= G_REGEX_CASELESS;
+    matcher->m_regex =
+        g_regex_new(regexPattern.c_str(),
+                    static_cast<GRegexCompileFlags>(compileFlags),
+                    static_cast<GRegexMatchFlags>(0),
+                    error);
+    if (!matcher->m_regex)
+    {
+        delete matcher;
+        return NULL;
+    }
+    return matcher;
+}
+
+void TextMatcher::requiredLiterals(const char *pattern,
+                                   int flags,
+                                   std::vector<std::string> &literals)
+{
+    literals.clear();
+    bool matchCase = flags & FLAG_MATCH_CASE;
+    if (!(flags & FLAG_REGEX))
+    {
+        std::string literal(pattern);
+        addLiteral(literal, matchCase, literals);
+        return;
+    }
+
+    std::string literal;
+    int depth = 0;
+    for (const char *cp = pattern; *cp; cp++)
+    {
+        switch (*cp)
+        {
+        case '\\':
+            // Skip the escaped character, which may be a character class.
+            addLiteral(literal, matchCase, literals);
+            if (cp[1])
+                cp++;
+            break;
+        case '[':
+            addLiteral(literal, matchCase, literals);
+            cp++;
+            if (*cp == '^')
+                cp++;
+            if (*cp == ']')
+                cp++;
+            for (; *cp && *cp != ']'; cp++)
+                if (*cp == '\\' && cp[1])
+                    cp++;
+            if (!*cp)
+                cp--;
+            break;
+        case '(':
+            addLiteral(literal, matchCase, literals);
+            depth++;
+            break;
+        case ')':
+            addLiteral(literal, matchCase, literals);
+            depth--;
+            break;
+        case '|':
+            // Any of the alternatives may match.
+            if (depth <= 0)
+            {
+                literals.clear();
+                return;
+            }
+            break;
+        case '?':
+        case '*':
+        case '{':
+            // The quantified character, which may be a multibyte UTF-8
+            // character, is optional.
+            if (depth <= 0 && !literal.empty())
+            {
+                const char *begin = literal.c_str();
+                const char *last = g_utf8_find_prev_char(
+                    begin, begin + literal.length());
+                literal.erase(last ? last - begin : 0);
+            }
+            addLiteral(literal, matchCase, literals);
+            if (*cp == '{')
+            {
+                for (; *cp && *cp != '}'; cp++)
+                    ;
+                if (!*cp)
+                    cp--;
+            }
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            addLiteral(literal, matchCase, literals);
+            break;
+        default:
+            if (depth <= 0)
+                literal += *cp;
+        }
+    }
+    addLiteral(literal, matchCase, literals);
+}
+
+const char *TextMatcher::findLiteral(const char *from, const char *end) const
+{
+    int length = m_pattern.length();
+    if (end - from < length)
+        return NULL;
+    const char *last = end - length + 1;
+    const char *rest = m_pattern.c_str() + 1;
+    char first = m_pattern[0];
+    bool matchCase = m_flags & FLAG_MATCH_CASE;
+    if (matchCase || !g_ascii_isalpha(first))
+    {
+        for (const char *cp = findByte(from, last, first);
+             cp < last;
+             cp = findByte(cp + 1, last, first))
+        {
+            if (matchCase ?
+                memcmp(cp + 1, rest, length - 1) == 0 :
+                equalIgnoringCase(cp + 1, rest, length - 1))
+                return cp;
+        }
+        return NULL;
+    }
+
+    // Scan for the both cases of the first byte and keep the next occurrence of
+    // each.
+    char lower = g_ascii_tolower(first);
+    char upper = g_ascii_toupper(first);
+    const char *nextLower = findByte(from, last, lower);
+    const char *nextUpper = findByte(from, last, upper);
+    for (;;)
+    {
+        const char *cp = std::min(nextLower, nextUpper);
+        if (cp >= last)
+            return NULL;
+        if (equalIgnoringCase(cp + 1, rest, length - 1))
+            return cp;
+        if (cp == nextLower)
+            nextLower = findByte(cp + 1, last, lower);
+        else
+            nextUpper = findByte(cp + 1, last, upper);
+    }
+}
+
+bool TextMatcher::find(const char *begin,
+                       const char *end,
+                       const char *from,
+                       const char *&matchBegin,
+                       const char *&matchEnd) const
+{
+    if (m_regex)
+    {
+        GMatchInfo *matchInfo;
+        if (!g_regex_match_full(m_regex, begin, end - begin, from - begin,
+                                static_cast<GRegexMatchFlags>(0),
+                                &matchInfo, NULL))
+        {
+            g_match_info_free(matchInfo);
+            return false;
+        }
+        int matchBeginPos, matchEndPos;
+        g_match_info_fetch_pos(matchInfo, 0, &matchBeginPos, &matchEndPos);
+        g_match_info_free(matchInfo);
+        matchBegin = begin + matchBeginPos;
+        matchEnd = begin + matchEndPos;
+        return true;
+    }
+
+    for (;;)
+    {
+        matchBegin = findLiteral(from, end);
+        if (!matchBegin)
+            return false;
+        matchEnd = matchBegin + m_pattern.length();
+        if (!(m_flags & FLAG_WHOLE_WORD) ||
+            ((matchBegin == begin ||
+              !isWordByte(*(matchBegin - 1)) ||
+              !isWordByte(*matchBegin)) &&
+             (matchEnd == end ||
+              !isWordByte(*matchEnd) ||
+              !isWordByte(*(matchEnd - 1)))))
+            return true;
+        from = matchBegin + 1;
+    }
+}
+
+void TextMatcher::expandReplacement(const char *begin,
+                                    const char *end,
+                                    const char *matchBegin,
+                                    const char *replacement,
+                                    std::string &expanded) const
+{
+    if (!m_regex || !(m_flags & FLAG_REGEX))
+    {
+        expanded += replacement;
+        return;
+    }
+
+    // Match again at the beginning of the match to get the subexpressions.
+    GMatchInfo *matchInfo;
+    if (!g_regex_match_full(m_regex, begin, end - begin, matchBegin - begin,
+                            G_REGEX_MATCH_ANCHORED, &matchInfo, NULL))
+    {
+        g_match_info_free(matchInfo);
+        return;
+    }
+    char *exp = g_match_info_expand_references(matchInfo, replacement, NULL);
+    g_match_info_free(matchInfo);
+    if (exp)
+    {
+        expanded += exp;
+        g_free(exp);
+    }
+}
+
+bool TextMatcher::checkReplacement(const char *replacement,
+                                   GError **error) const
+{
+    if (!(m_flags & FLAG_REGEX))
+        return true;
+    return g_regex_check_replacement(replacement, NULL, error);
+}
+
+}
+
+}
@@ -0,0 +1,124 @@
+// Text matcher.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_FIND_TEXT_MATCHER_HPP
+#define SMYD_FIND_TEXT_MATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+namespace Finder
+{
+
+/**
+ * A text matcher finds a literal string or a regular expression in text.
+ * Literal strings are located by scanning for the first byte with memchr(),
+ * which is vectorized by the C library, followed by verifying the remaining
+ * bytes.  Case-insensitive matching of literal strings folds ASCII letters
+ * only, unless the text is known to be UTF-8 encoded.
+ *
+ * A text matcher is immutable after created and can be shared by multiple
+ * threads.
+ */
+class TextMatcher: public boost::noncopyable
+{
+public:
+    enum Flag
+    {
+        FLAG_MATCH_CASE = 1,
+        FLAG_REGEX      = 2,
+        FLAG_WHOLE_WORD = 4,
+
+        /**
+         * The text is valid UTF-8.  Otherwise, the text is matched as raw
+         * bytes.
+         */
+        FLAG_UTF8       = 8
+    };
+
+    /**
+     * @param pattern The literal string or the regular expression.
+     * @param flags The combination of the flags.
+     * @param error The error, if the regular expression is invalid.
+     * @return The text matcher, or NULL if failed.
+     */
+    static TextMatcher *create(const char *pattern, int flags, GError **error);
+
+    /**
+     * Get the literal strings that any text matching a pattern must contain,
+     * which are used to narrow down the files to be searched.  The literal
+     * strings of a regular expression are extracted conservatively: only the
+     * runs of ordinary characters outside groups and character classes are
+     * extracted, excluding the characters followed by optional quantifiers.
+     * @param pattern The literal string or the regular expression.
+     * @param flags The combination of the flags.
+     * @param literals The required literal strings, at least three bytes long
+     * each, or none if the pattern cannot be narrowed down.
+     */
+    static void requiredLiterals(const char *pattern,
+                                 int flags,
+                                 std::vector<std::string> &literals);
+
+    ~TextMatcher();
+
+    int flags() const { return m_flags; }
+
+    /**
+     * Find the first match starting in a range.
+     * @param begin The beginning of the text, which is used to check the
+     * boundaries of words and the anchors.
+     * @param end The end of the text.
+     * @param from The beginning of the range.
+     * @param matchBegin The beginning of the found match.
+     * @param matchEnd The end of the found match.
+     * @return True iff found.
+     */
+    bool find(const char *begin,
+              const char *end,
+              const char *from,
+              const char *&matchBegin,
+              const char *&matchEnd) const;
+
+    /**
+     * Expand the replacement of a match found by 'find()'.  The references to
+     * the matched subexpressions in the replacement of a regular expression,
+     * e.g., "\\1", are replaced by the matched text.  The replacement of a
+     * literal string is used as it is.
+     * @param begin The beginning of the text.
+     * @param end The end of the text.
+     * @param matchBegin The beginning of the match.
+     * @param replacement The replacement.
+     * @param expanded The expanded replacement, appended.
+     */
+    void expandReplacement(const char *begin,
+                           const char *end,
+                           const char *matchBegin,
+                           const char *replacement,
+                           std::string &expanded) const;
+
+    /**
+     * Check a replacement for the matches of a regular expression.
+     * @return False if the replacement contains invalid references.
+     */
+    bool checkReplacement(const char *replacement, GError **error) const;
+
+private:
+    TextMatcher(const char *pattern, int flags);
+
+    const char *findLiteral(const char *from, const char *end) const;
+
+    const std::string m_pattern;
+    const int m_flags;
+    GRegex *m_regex;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,862 @@
+// Ninja build graph.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "ninja-build-graph.hpp"
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+namespace
+{
+
+const char MANIFEST_FILE_NAME[] = "build.ninja";
+const char DEPS_FILE_NAME[] = ".ninja_deps";
+const char LOG_FILE_NAME[] = ".ninja_log";
+
+const char DEPS_SIGNATURE[] = "# ninjadeps\n";
+const char LOG_SIGNATURE[] = "# ninja log v";
+
+// The maximum nesting depth of the "include" and "subninja" statements.
+const int MAX_INCLUDE_DEPTH = 16;
+
+// The modification time of a node that is not checked yet.
+const gint64 TIME_UNKNOWN = -2;
+
+typedef std::map<std::string, std::string> VariableTable;
+
+inline bool isVariableCharacter(char c)
+{
+    return g_ascii_isalnum(c) || c == '_' || c == '-';
+}
+
+inline bool isIdentifierCharacter(char c)
+{
+    return isVariableCharacter(c) || c == '.';
+}
+
+inline bool isSeparator(char c)
+{
+#ifdef OS_WINDOWS
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+inline bool atNewLine(const char *cp, const char *end)
+{
+    return *cp == '\n' || (*cp == '\r' && cp + 1 < end && cp[1] == '\n');
+}
+
+// Skip an escaped newline, i.e., a line continuation, and the indentation of
+// the continued line.  'cp' points to the character after "$".
+void skipLineContinuation(const char *&cp, const char *end)
+{
+    if (*cp == '\r')
+        ++cp;
+    if (cp < end && *cp == '\n')
+        ++cp;
+    while (cp < end && *cp == ' ')
+        ++cp;
+}
+
+void skipSpaces(const char *&cp, const char *end)
+{
+    while (cp < end)
+    {
+        if (*cp == ' ')
+            ++cp;
+        else if (*cp == '$' && cp + 1 < end &&
+                 (cp[1] == '\n' || cp[1] == '\r'))
+        {
+            ++cp;
+            skipLineContinuation(cp, end);
+        }
+        else
+            break;
+    }
+}
+
+// Skip the rest of the line, including the continued lines.
+void skipLine(const char *&cp, const char *end)
+{
+    while (cp < end)
+    {
+        if (*cp == '$' && cp + 1 < end)
+        {
+            ++cp;
+            if (*cp == '\n' || *cp == '\r')
+                skipLineContinuation(cp, end);
+            else
+                ++cp;
+            continue;
+        }
+        if (*cp++ == '\n')
+            break;
+    }
+}
+
+void readIdentifier(const char *&cp, const char *end, std::string &identifier)
+{
+    const char *begin = cp;
+    while (cp < end && isIdentifierCharacter(*cp))
+        ++cp;
+    identifier.assign(begin, cp);
+}
+
+void expandVariable(const std::string &name,
+                    const VariableTable &variables,
+                    std::string &value)
+{
+    VariableTable::const_iterator it = variables.find(name);
+    if (it != variables.end())
+        value += it->second;
+}
+
+// Read a string, expanding the variables and unescaping the escaped
+// characters, up to the end of the line, or up to the end of the path if
+// reading a path.
+void readEvalString(const char *&cp,
+                    const char *end,
+                    bool path,
+                    const VariableTable &variables,
+                    std::string &value)
+{
+    while (cp < end)
+    {
+        char c = *cp;
+        if (atNewLine(cp, end))
+            break;
+        if (path && (c == ' ' || c == ':' || c == '|'))
+            break;
+        ++cp;
+        if (c != '$')
+        {
+            value += c;
+            continue;
+        }
+        if (cp == end)
+            break;
+        c = *cp;
+        if (c == '\n' || c == '\r')
+            skipLineContinuation(cp, end);
+        else if (c == ' ' || c == ':' || c == '$')
+        {
+            value += c;
+            ++cp;
+        }
+        else if (c == '{')
+        {
+            const char *begin = ++cp;
+            while (cp < end && *cp != '}' && !atNewLine(cp, end))
+                ++cp;
+            expandVariable(std::string(begin, cp), variables, value);
+            if (cp < end && *cp == '}')
+                ++cp;
+        }
+        else if (isVariableCharacter(c))
+        {
+            const char *begin = cp;
+            while (cp < end && isVariableCharacter(*cp))
+                ++cp;
+            expandVariable(std::string(begin, cp), variables, value);
+        }
+        else
+            value += '$';
+    }
+}
+
+}
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+BuildGraph::BuildGraph(const char *buildDir):
+    m_buildDir(buildDir)
+{
+    m_manifestStamp.mtime = -1;
+    m_manifestStamp.size = -1;
+    m_depsStamp = m_manifestStamp;
+    m_logStamp = m_manifestStamp;
+}
+
+BuildGraph::FileStamp BuildGraph::stamp(const char *fileName)
+{
+    FileStamp s;
+    GStatBuf st;
+    if (g_stat(fileName, &st) == 0)
+    {
+        s.mtime = st.st_mtime;
+        s.size = st.st_size;
+    }
+    else
+    {
+        s.mtime = -1;
+        s.size = -1;
+    }
+    return s;
+}
+
+// Resolve a path against the build directory and remove the "." and ".."
+// components and the redundant separators.  The separators are converted to
+// "/".
+std::string BuildGraph::normalizePath(const char *path) const
+{
+    std::string full;
+    if (!g_path_is_absolute(path))
+    {
+        full = m_buildDir;
+        full += '/';
+    }
+    full += path;
+
+    std::string normalized;
+    std::string::size_type i = 0;
+#ifdef OS_WINDOWS
+    if (full.length() >= 2 && full[1] == ':')
+    {
+        normalized.assign(full, 0, 2);
+        i = 2;
+    }
+#endif
+    std::string::size_type root = normalized.length();
+    std::vector<std::string::size_type> components;
+    while (i < full.length())
+    {
+        if (isSeparator(full[i]))
+        {
+            ++i;
+            continue;
+        }
+        std::string::size_type j = i;
+        while (j < full.length() && !isSeparator(full[j]))
+            ++j;
+        if (j - i == 2 && full[i] == '.' && full[i + 1] == '.')
+        {
+            if (!components.empty())
+            {
+                normalized.resize(components.back());
+                components.pop_back();
+            }
+        }
+        else if (j - i != 1 || full[i] != '.')
+        {
+            components.push_back(normalized.length());
+            normalized += '/';
+            normalized.append(full, i, j - i);
+        }
+        i = j;
+    }
+    if (normalized.length() == root)
+        normalized += '/';
+    return normalized;
+}
+
+int BuildGraph::internNode(const std::string &name)
+{
+    std::pair<std::map<std::string, int>::iterator, bool> inserted =
+        m_nodeIds.insert(std::make_pair(normalizePath(name.c_str()),
+                                        static_cast<int>(m_nodes.size())));
+    if (inserted.second)
+    {
+        m_nodes.push_back(Node());
+        Node &node = m_nodes.back();
+        node.path = &inserted.first->first;
+        node.name = name;
+        node.producer = -1;
+        node.duration = -1;
+    }
+    return inserted.first->second;
+}
+
+int BuildGraph::findNode(const char *path) const
+{
+    std::map<std::string, int>::const_iterator it =
+        m_nodeIds.find(normalizePath(path));
+    if (it == m_nodeIds.end())
+        return -1;
+    return it->second;
+}
+
+bool BuildGraph::update()
+{
+    std::string fileName(m_buildDir);
+    fileName += G_DIR_SEPARATOR;
+    fileName += MANIFEST_FILE_NAME;
+    FileStamp manifestStamp = stamp(fileName.c_str());
+    if (manifestStamp.mtime == -1)
+        return false;
+    if (!(manifestStamp == m_manifestStamp))
+    {
+        // The nodes are renumbered, so read the dependencies and the durations
+        // again, too.
+        m_nodeIds.clear();
+        m_nodes.clear();
+        m_edges.clear();
+        m_defaults.clear();
+        m_variables.clear();
+        m_manifestStamp.mtime = -1;
+        m_manifestStamp.size = -1;
+        m_depsStamp = m_manifestStamp;
+        m_logStamp = m_manifestStamp;
+        if (!readManifest(fileName.c_str(), 0))
+            return false;
+        m_manifestStamp = manifestStamp;
+    }
+
+    fileName = m_buildDir;
+    fileName += G_DIR_SEPARATOR;
+    fileName += DEPS_FILE_NAME;
+    FileStamp depsStamp = stamp(fileName.c_str());
+    if (!(depsStamp == m_depsStamp))
+    {
+        readDeps(fileName.c_str());
+        m_depsStamp = depsStamp;
+    }
+
+    fileName = m_buildDir;
+    fileName += G_DIR_SEPARATOR;
+    fileName += LOG_FILE_NAME;
+    FileStamp logStamp = stamp(fileName.c_str());
+    if (!(logStamp == m_logStamp))
+    {
+        readLog(fileName.c_str());
+        m_logStamp = logStamp;
+    }
+    return true;
+}
+
+bool BuildGraph::readManifest(const char *fileName, int depth)
+{
+    char *contents;
+    gsize length;
+    if (!g_file_get_contents(fileName, &contents, &length, NULL))
+        return false;
+
+    const char *cp = contents, *end = contents + length;
+    std::string keyword, path, value;
+    while (cp < end)
+    {
+        // Skip the bindings in the blocks, the comments and the empty lines.
+        if (*cp == ' ' || *cp == '#')
+        {
+            skipLine(cp, end);
+            continue;
+        }
+        if (*cp == '\n' || *cp == '\r')
+        {
+            ++cp;
+            continue;
+        }
+
+        readIdentifier(cp, end, keyword);
+        if (keyword == "build")
+            readBuildEdge(cp, end);
+        else if (keyword == "default")
+        {
+            for (;;)
+            {
+                skipSpaces(cp, end);
+                path.clear();
+                readEvalString(cp, end, true, m_variables, path);
+                if (path.empty())
+                    break;
+                m_defaults.push_back(internNode(path));
+            }
+            skipLine(cp, end);
+        }
+        else if (keyword == "include" || keyword == "subninja")
+        {
+            // The included files are read in the same scope, which suffices
+            // to find the build edges.
+            skipSpaces(cp, end);
+            path.clear();
+            readEvalString(cp, end, true, m_variables, path);
+            skipLine(cp, end);
+            if (!path.empty() && depth < MAX_INCLUDE_DEPTH)
+                readManifest(normalizePath(path.c_str()).c_str(), depth + 1);
+        }
+        else if (keyword.empty() ||
+                 keyword == "rule" ||
+                 keyword == "pool")
+            skipLine(cp, end);
+        else
+        {
+            // A variable binding at the file scope.
+            skipSpaces(cp, end);
+            if (cp < end && *cp == '=')
+            {
+                ++cp;
+                skipSpaces(cp, end);
+                value.clear();
+                readEvalString(cp, end, false, m_variables, value);
+                m_variables[keyword] = value;
+            }
+            skipLine(cp, end);
+        }
+    }
+
+    g_free(contents);
+    return true;
+}
+
+// Read a build edge in the form of "build OUTPUTS | IMPLICIT_OUTPUTS: RULE
+// INPUTS | IMPLICIT_INPUTS || ORDER_ONLY_INPUTS |@ VALIDATIONS".
+void BuildGraph::readBuildEdge(const char *&cp, const char *end)
+{
+    Edge edge;
+    std::string path;
+
+    for (;;)
+    {
+        skipSpaces(cp, end);
+        if (cp == end || atNewLine(cp, end))
+        {
+            skipLine(cp, end);
+            return;
+        }
+        if (*cp == ':')
+        {
+            ++cp;
+            break;
+        }
+        if (*cp == '|')
+        {
+            ++cp;
+            continue;
+        }
+        path.clear();
+        readEvalString(cp, end, true, m_variables, path);
+        if (path.empty())
+        {
+            skipLine(cp, end);
+            return;
+        }
+        edge.outputs.push_back(internNode(path));
+    }
+
+    std::string rule;
+    skipSpaces(cp, end);
+    readIdentifier(cp, end, rule);
+    edge.phony = rule == "phony";
+    edge.explicitInputCount = 0;
+    edge.implicitInputEnd = 0;
+
+    enum
+    {
+        EXPLICIT,
+        IMPLICIT,
+        ORDER_ONLY,
+        VALIDATION
+    } kind = EXPLICIT;
+    for (;;)
+    {
+        skipSpaces(cp, end);
+        if (cp == end || atNewLine(cp, end))
+            break;
+        if (*cp == '|')
+        {
+            ++cp;
+            if (cp < end && *cp == '|')
+            {
+                ++cp;
+                kind = ORDER_ONLY;
+            }
+            else if (cp < end && *cp == '@')
+            {
+                ++cp;
+                kind = VALIDATION;
+            }
+            else
+                kind = IMPLICIT;
+            continue;
+        }
+        path.clear();
+        readEvalString(cp, end, true, m_variables, path);
+        if (path.empty())
+            break;
+        if (kind == VALIDATION)
+            continue;
+        edge.inputs.push_back(internNode(path));
+        if (kind == EXPLICIT)
+            edge.explicitInputCount++;
+        if (kind != ORDER_ONLY)
+            edge.implicitInputEnd++;
+    }
+    skipLine(cp, end);
+
+    if (edge.outputs.empty())
+        return;
+    for (std::vector<int>::const_iterator it = edge.outputs.begin();
+         it != edge.outputs.end();
+         ++it)
+        m_nodes[*it].producer = m_edges.size();
+    m_edges.push_back(edge);
+}
+
+// Read the dependencies discovered by the compilers.  The file consists of path
+// records, each of which assigns the next ID to a path, and dependency records,
+// each of which lists the IDs of the dependencies of an output.
+void BuildGraph::readDeps(const char *fileName)
+{
+    for (std::vector<Node>::iterator it = m_nodes.begin();
+         it != m_nodes.end();
+         ++it)
+        it->deps.clear();
+
+    char *contents;
+    gsize length;
+    if (!g_file_get_contents(fileName, &contents, &length, NULL))
+        return;
+
+    const gsize signatureLength = sizeof(DEPS_SIGNATURE) - 1;
+    const char *cp = contents, *end = contents + length;
+    if (length < signatureLength + 4 ||
+        memcmp(cp, DEPS_SIGNATURE, signatureLength) != 0)
+    {
+        g_free(contents);
+        return;
+    }
+    cp += signatureLength;
+    gint32 version;
+    memcpy(&version, cp, 4);
+    cp += 4;
+    // Version 4 records 64-bit modification times.
+    gsize mtimeSize;
+    if (version == 3)
+        mtimeSize = 4;
+    else if (version == 4)
+        mtimeSize = 8;
+    else
+    {
+        g_free(contents);
+        return;
+    }
+
+    std::vector<int> ids;
+    while (end - cp >= 4)
+    {
+        guint32 size;
+        memcpy(&size, cp, 4);
+        cp += 4;
+        bool depsRecord = size & 0x80000000u;
+        size &= 0x7fffffffu;
+        if (size > static_cast<gsize>(end - cp) || size % 4 != 0)
+            break;
+        const char *record = cp;
+        cp += size;
+
+        if (depsRecord)
+        {
+            if (size < 4 + mtimeSize)
+                break;
+            gint32 output;
+            memcpy(&output, record, 4);
+            if (output < 0 || output >= static_cast<gint32>(ids.size()))
+                continue;
+            std::vector<int> &deps = m_nodes[ids[output]].deps;
+            deps.clear();
+            for (const char *p = record + 4 + mtimeSize; p < cp; p += 4)
+            {
+                gint32 input;
+                memcpy(&input, p, 4);
+                if (input >= 0 && input < static_cast<gint32>(ids.size()))
+                    deps.push_back(ids[input]);
+            }
+        }
+        else
+        {
+            // The path is padded with NULs to a multiple of 4 bytes and is
+            // followed by a checksum.
+            if (size < 4)
+                break;
+            const char *pathEnd = cp - 4;
+            while (pathEnd > record && pathEnd[-1] == '\0')
+                --pathEnd;
+            ids.push_back(internNode(std::string(record, pathEnd)));
+        }
+    }
+
+    g_free(contents);
+}
+
+// Read the durations of the build edges.  Each line of the file records the
+// start time, the end time, the modification time, the output and the command
+// hash of a build edge, separated by tabs.  The later lines override the
+// earlier ones.
+void BuildGraph::readLog(const char *fileName)
+{
+    for (std::vector<Node>::iterator it = m_nodes.begin();
+         it != m_nodes.end();
+         ++it)
+        it->duration = -1;
+
+    char *contents;
+    gsize length;
+    if (!g_file_get_contents(fileName, &contents, &length, NULL))
+        return;
+    if (strncmp(contents, LOG_SIGNATURE, sizeof(LOG_SIGNATURE) - 1) != 0)
+    {
+        g_free(contents);
+        return;
+    }
+
+    std::string path;
+    char *line = strchr(contents, '\n');
+    while (line && *++line)
+    {
+        char *lineEnd = strchr(line, '\n');
+        if (lineEnd)
+            *lineEnd = '\0';
+        char *fields[4];
+        int n = 0;
+        for (char *cp = line; n < 4; ++cp)
+        {
+            fields[n++] = cp;
+            cp = strchr(cp, '\t');
+            if (!cp)
+                break;
+            *cp = '\0';
+        }
+        if (n == 4)
+        {
+            gint64 start = g_ascii_strtoll(fields[0], NULL, 10);
+            gint64 end = g_ascii_strtoll(fields[1], NULL, 10);
+            int node = findNode(fields[3]);
+            if (node != -1 && end >= start)
+                m_nodes[node].duration = end - start;
+        }
+        line = lineEnd;
+    }
+
+    g_free(contents);
+}
+
+int BuildGraph::findCompileEdge(int node) const
+{
+    for (std::vector<Edge>::size_type i = 0; i < m_edges.size(); ++i)
+    {
+        const Edge &edge = m_edges[i];
+        if (edge.phony)
+            continue;
+        for (int j = 0; j < edge.explicitInputCount; ++j)
+            if (edge.inputs[j] == node)
+                return i;
+    }
+
+    // A header file is compiled as part of a source file including it.
+    for (std::vector<Node>::const_iterator it = m_nodes.begin();
+         it != m_nodes.end();
+         ++it)
+    {
+        if (it->producer == -1 || m_edges[it->producer].phony)
+            continue;
+        if (std::find(it->deps.begin(), it->deps.end(), node) !=
+            it->deps.end())
+            return it->producer;
+    }
+    return -1;
+}
+
+bool BuildGraph::findCompileTarget(const char *fileName,
+                                   std::string &target) const
+{
+    int node = findNode(fileName);
+    if (node == -1)
+        return false;
+    int edge = findCompileEdge(node);
+    if (edge == -1)
+        return false;
+    target = m_nodes[m_edges[edge].outputs[0]].name;
+    return true;
+}
+
+bool BuildGraph::findLinkTarget(const char *fileName,
+                                std::string &target) const
+{
+    int node = findNode(fileName);
+    if (node == -1)
+        return false;
+    int compileEdge = findCompileEdge(node);
+    if (compileEdge == -1)
+        return false;
+    int object = m_edges[compileEdge].outputs[0];
+    for (std::vector<Edge>::const_iterator it = m_edges.begin();
+         it != m_edges.end();
+         ++it)
+    {
+        if (it->phony)
+            continue;
+        for (int j = 0; j < it->explicitInputCount; ++j)
+            if (it->inputs[j] == object)
+            {
+                target = m_nodes[it->outputs[0]].name;
+                return true;
+            }
+    }
+    target = m_nodes[object].name;
+    return true;
+}
+
+// Modification times are compared in seconds, so an input changed in the same
+// second as the output was built may be missed, which is fine for estimation.
+gint64 BuildGraph::nodeTime(int node, Estimation &estimation) const
+{
+    gint64 &mtime = estimation.mtimes[node];
+    if (mtime == TIME_UNKNOWN)
+        mtime = stamp(m_nodes[node].path->c_str()).mtime;
+    return mtime;
+}
+
+// Check whether a build edge is out of date, i.e., any of its outputs is
+// missing or older than any of its inputs, or any of its inputs is out of
+// date, like ninja does, and add up the durations of the out-of-date build
+// edges.
+bool BuildGraph::visitEdge(int edge, Estimation &estimation) const
+{
+    if (estimation.edgeStates[edge] == Estimation::EDGE_DIRTY)
+        return true;
+    if (estimation.edgeStates[edge] != Estimation::EDGE_UNVISITED)
+        return false;
+    estimation.edgeStates[edge] = Estimation::EDGE_VISITING;
+
+    const Edge &e = m_edges[edge];
+    bool dirty = false;
+    gint64 outputTime = G_MAXINT64;
+    if (!e.phony)
+    {
+        for (std::vector<int>::const_iterator it = e.outputs.begin();
+             it != e.outputs.end();
+             ++it)
+        {
+            gint64 mtime = nodeTime(*it, estimation);
+            if (mtime == -1)
+                dirty = true;
+            else if (mtime < outputTime)
+                outputTime = mtime;
+        }
+    }
+
+    // Check the explicit and implicit inputs and the discovered dependencies.
+    // The order-only inputs are built but don't make the build edge out of
+    // date.
+    const std::vector<int> &deps = m_nodes[e.outputs[0]].deps;
+    std::vector<int>::size_type inputCount = e.inputs.size() + deps.size();
+    for (std::vector<int>::size_type i = 0; i < inputCount; ++i)
+    {
+        int input = i < e.inputs.size() ?
+            e.inputs[i] : deps[i - e.inputs.size()];
+        int producer = m_nodes[input].producer;
+        bool inputDirty = producer != -1 && visitEdge(producer, estimation);
+        if (i >= static_cast<std::vector<int>::size_type>(e.implicitInputEnd) &&
+            i < e.inputs.size())
+            continue;
+        if (inputDirty)
+            dirty = true;
+        else if (!dirty && !e.phony &&
+                 (producer == -1 || !m_edges[producer].phony) &&
+                 nodeTime(input, estimation) > outputTime)
+            dirty = true;
+    }
+
+    estimation.edgeStates[edge] =
+        dirty ? Estimation::EDGE_DIRTY : Estimation::EDGE_CLEAN;
+    if (dirty && !e.phony)
+    {
+        gint64 duration = -1;
+        for (std::vector<int>::const_iterator it = e.outputs.begin();
+             it != e.outputs.end();
+             ++it)
+            duration = std::max(duration, m_nodes[*it].duration);
+        if (duration == -1)
+            estimation.unknownDurationCount++;
+        else
+        {
+            estimation.totalDuration += duration;
+            estimation.longestDuration =
+                std::max(estimation.longestDuration, duration);
+        }
+    }
+    return dirty;
+}
+
+gint64 BuildGraph::estimateDuration(const char *target, int jobs) const
+{
+    Estimation estimation;
+    estimation.mtimes.assign(m_nodes.size(), TIME_UNKNOWN);
+    estimation.edgeStates.assign(m_edges.size(),
+                                 Estimation::EDGE_UNVISITED);
+    estimation.totalDuration = 0;
+    estimation.longestDuration = 0;
+    estimation.unknownDurationCount = 0;
+
+    if (target)
+    {
+        int node = findNode(target);
+        if (node == -1 || m_nodes[node].producer == -1)
+            return -1;
+        visitEdge(m_nodes[node].producer, estimation);
+    }
+    else if (!m_defaults.empty())
+    {
+        for (std::vector<int>::const_iterator it = m_defaults.begin();
+             it != m_defaults.end();
+             ++it)
+            if (m_nodes[*it].producer != -1)
+                visitEdge(m_nodes[*it].producer, estimation);
+    }
+    else
+    {
+        // Build the outputs that are not inputs of any build edge, as ninja
+        // does if no default target is specified.
+        std::vector<bool> consumed(m_nodes.size(), false);
+        for (std::vector<Edge>::const_iterator it = m_edges.begin();
+             it != m_edges.end();
+             ++it)
+            for (std::vector<int>::const_iterator it2 = it->inputs.begin();
+                 it2 != it->inputs.end();
+                 ++it2)
+                consumed[*it2] = true;
+        for (std::vector<Node>::size_type i = 0; i < m_nodes.size(); ++i)
+            if (!consumed[i] && m_nodes[i].producer != -1)
+                visitEdge(m_nodes[i].producer, estimation);
+    }
+
+    if (estimation.unknownDurationCount)
+    {
+        // Assume the build edges never built take the average duration.
+        gint64 total = 0;
+        int count = 0;
+        for (std::vector<Node>::const_iterator it = m_nodes.begin();
+             it != m_nodes.end();
+             ++it)
+            if (it->duration != -1)
+            {
+                total += it->duration;
+                count++;
+            }
+        if (count == 0)
+            return -1;
+        estimation.totalDuration +=
+            total / count * estimation.unknownDurationCount;
+    }
+
+    if (jobs < 1)
+        jobs = 1;
+    return std::max(estimation.totalDuration / jobs,
+                    estimation.longestDuration);
+}
+
+}
+
+}
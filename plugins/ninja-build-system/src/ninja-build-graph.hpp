@@ -0,0 +1,163 @@
+// Ninja build graph.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_NINJA_BUILD_GRAPH_HPP
+#define SMYD_NINJA_BUILD_GRAPH_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <glib.h>
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+/**
+ * A build graph holds the build edges declared in "build.ninja", the header
+ * dependencies recorded in ".ninja_deps" and the durations of the build edges
+ * recorded in ".ninja_log" in a build directory.  It keeps only what is needed
+ * to find the targets containing files and to estimate build durations.  Rules
+ * and edge bindings are skipped and variables are expanded only at the file
+ * scope, which suffices for the build files generated by CMake and Meson.
+ *
+ * The files are read again only when changed.  The paths are resolved against
+ * the build directory and normalized, so that the files can be looked up by
+ * their absolute names.
+ */
+class BuildGraph: public boost::noncopyable
+{
+public:
+    BuildGraph(const char *buildDir);
+
+    const char *buildDirectory() const { return m_buildDir.c_str(); }
+
+    /**
+     * Read the files again if changed.
+     * @return False iff "build.ninja" can't be read.
+     */
+    bool update();
+
+    /**
+     * Find the output compiled from a file.  A header file is compiled as part
+     * of a source file including it.
+     * @param target The path of the output known by ninja.
+     */
+    bool findCompileTarget(const char *fileName, std::string &target) const;
+
+    /**
+     * Find the target containing a file, i.e., the program or library linking
+     * the output compiled from the file, or the output itself if it is not
+     * linked.
+     * @param target The path of the target known by ninja.
+     */
+    bool findLinkTarget(const char *fileName, std::string &target) const;
+
+    /**
+     * Estimate the duration of a build from the recorded durations of the
+     * out-of-date build edges.  The build edges that were never built are
+     * assumed to take the average duration.
+     * @param target The path of the target known by ninja, or NULL if building
+     * all the targets.
+     * @param jobs The number of the jobs run in parallel.
+     * @return The estimated duration, in milliseconds, or -1 if unknown.
+     */
+    gint64 estimateDuration(const char *target, int jobs) const;
+
+private:
+    struct Node
+    {
+        // The normalized absolute path.
+        const std::string *path;
+        // The path as written in the build files.
+        std::string name;
+        // The build edge producing the node, or -1 if it is a source.
+        int producer;
+        std::vector<int> deps;
+        // The recorded duration of the build edge producing the node, in
+        // milliseconds, or -1 if unknown.
+        gint64 duration;
+    };
+
+    struct Edge
+    {
+        bool phony;
+        std::vector<int> outputs;
+        // The explicit inputs, followed by the implicit inputs and the
+        // order-only inputs.
+        std::vector<int> inputs;
+        int explicitInputCount;
+        int implicitInputEnd;
+    };
+
+    struct FileStamp
+    {
+        gint64 mtime;
+        gint64 size;
+        bool operator==(const FileStamp &rhs) const
+        { return mtime == rhs.mtime && size == rhs.size; }
+    };
+
+    struct Estimation
+    {
+        enum EdgeState
+        {
+            EDGE_UNVISITED,
+            EDGE_VISITING,
+            EDGE_CLEAN,
+            EDGE_DIRTY
+        };
+        std::vector<gint64> mtimes;
+        std::vector<char> edgeStates;
+        gint64 totalDuration;
+        gint64 longestDuration;
+        int unknownDurationCount;
+    };
+
+    static FileStamp stamp(const char *fileName);
+
+    std::string normalizePath(const char *path) const;
+
+    int internNode(const std::string &name);
+
+    int findNode(const char *path) const;
+
+    bool readManifest(const char *fileName, int depth);
+
+    void readBuildEdge(const char *&cp, const char *end);
+
+    void readDeps(const char *fileName);
+
+    void readLog(const char *fileName);
+
+    int findCompileEdge(int node) const;
+
+    bool visitEdge(int edge, Estimation &estimation) const;
+
+    gint64 nodeTime(int node, Estimation &estimation) const;
+
+    std::string m_buildDir;
+
+    FileStamp m_manifestStamp;
+    FileStamp m_depsStamp;
+    FileStamp m_logStamp;
+
+    std::map<std::string, int> m_nodeIds;
+    std::vector<Node> m_nodes;
+    std::vector<Edge> m_edges;
+
+    // The targets built by default.
+    std::vector<int> m_defaults;
+
+    // The variables bound at the file scope.
+    std::map<std::string, std::string> m_variables;
+};
+
+}
+
+}
+
+#endif
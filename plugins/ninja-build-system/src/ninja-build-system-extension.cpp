@@ -0,0 +1,23 @@
+// Build system extension: Ninja build system.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "ninja-build-system-extension.hpp"
+#include "ninja-build-system.hpp"
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+BuildSystem *NinjaBuildSystemExtension::activateBuildSystem(Project &project)
+{
+    return new NinjaBuildSystem(project, id());
+}
+
+}
+
+}
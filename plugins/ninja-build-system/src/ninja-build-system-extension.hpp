@@ -0,0 +1,29 @@
+// Build system extension: Ninja build system.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_NINJA_BUILD_SYSTEM_EXTENSION_HPP
+#define SMYD_NINJA_BUILD_SYSTEM_EXTENSION_HPP
+
+#include "build-system/build-system-extension.hpp"
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+class NinjaBuildSystemExtension: public BuildSystemExtension
+{
+public:
+    NinjaBuildSystemExtension(const char *id, Plugin &plugin):
+        BuildSystemExtension(id, plugin)
+    {}
+
+    virtual BuildSystem *activateBuildSystem(Project &project);
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Plugin: Ninja build system.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "ninja-build-system-plugin.hpp"
+#include "ninja-build-system-extension.hpp"
+#include <string.h>
+#include <gmodule.h>
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+NinjaBuildSystemPlugin *NinjaBuildSystemPlugin::s_instance = NULL;
+
+NinjaBuildSystemPlugin::NinjaBuildSystemPlugin(PluginManager &manager,
+                                               const char *id,
+                                               GModule *module):
+    Plugin(manager, id, module)
+{
+    s_instance = this;
+}
+
+Extension *NinjaBuildSystemPlugin::createExtension(const char *extensionId)
+{
+    if (strcmp(extensionId, "ninja-build-system/build-system") == 0)
+        return new NinjaBuildSystemExtension(extensionId, *this);
+    return NULL;
+}
+
+void NinjaBuildSystemPlugin::onBuildSystemCreated(
+    NinjaBuildSystem &buildSystem)
+{
+    m_buildSystems.insert(&buildSystem);
+}
+
+void NinjaBuildSystemPlugin::onBuildSystemDestroyed(
+    NinjaBuildSystem &buildSystem)
+{
+    m_buildSystems.erase(&buildSystem);
+    if (completed())
+        onCompleted();
+}
+
+bool NinjaBuildSystemPlugin::completed() const
+{
+    return m_buildSystems.empty();
+}
+
+void NinjaBuildSystemPlugin::deactivate()
+{
+    // TBD: Close all Ninja build system projects?
+}
+
+}
+
+}
+
+extern "C"
+{
+
+G_MODULE_EXPORT
+Samoyed::Plugin *createPlugin(Samoyed::PluginManager *manager,
+                              const char *id,
+                              GModule *module,
+                              std::string *error)
+{
+    return new Samoyed::NinjaBuildSystem::NinjaBuildSystemPlugin(*manager,
+                                                                 id,
+                                                                 module);
+}
+
+}
@@ -0,0 +1,47 @@
+// Plugin: Ninja build system.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_NINJA_BUILD_SYSTEM_PLUGIN_HPP
+#define SMYD_NINJA_BUILD_SYSTEM_PLUGIN_HPP
+
+#include "plugin/plugin.hpp"
+#include <set>
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+class NinjaBuildSystem;
+
+class NinjaBuildSystemPlugin: public Plugin
+{
+public:
+    static NinjaBuildSystemPlugin &instance() { return *s_instance; }
+
+    NinjaBuildSystemPlugin(PluginManager &manager,
+                           const char *id,
+                           GModule *module);
+
+    virtual void deactivate();
+
+    void onBuildSystemCreated(NinjaBuildSystem &buildSystem);
+    void onBuildSystemDestroyed(NinjaBuildSystem &buildSystem);
+
+protected:
+    virtual Extension *createExtension(const char *extensionId);
+
+    virtual bool completed() const;
+
+private:
+    static NinjaBuildSystemPlugin *s_instance;
+
+    std::set<NinjaBuildSystem *> m_buildSystems;
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,227 @@
+// Ninja build system.
+// Copyright (C) 2015 Gang Chen.
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "ninja-build-system.hpp"
+#include "ninja-build-system-plugin.hpp"
+#include "ninja-build-graph.hpp"
+#include "build-system/build-system.hpp"
+#include "build-system/builder.hpp"
+#include "build-system/configuration.hpp"
+#include "project/project.hpp"
+#include "utilities/miscellaneous.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <boost/thread/mutex.hpp>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+namespace
+{
+
+const char *NINJA = "ninja";
+
+const char MANIFEST_FILE_NAME[] = "build.ninja";
+
+}
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+NinjaBuildSystem::NinjaBuildSystem(Project &project, const char *extensionId):
+    BuildSystem(project, extensionId)
+{
+    NinjaBuildSystemPlugin::instance().onBuildSystemCreated(*this);
+}
+
+NinjaBuildSystem::~NinjaBuildSystem()
+{
+    for (BuildGraphTable::iterator it = m_buildGraphs.begin();
+         it != m_buildGraphs.end();
+         ++it)
+        delete it->second;
+    NinjaBuildSystemPlugin::instance().onBuildSystemDestroyed(*this);
+}
+
+// Find the build directory and the number of the parallel jobs from the build
+// commands, and check whether the build commands are a single invocation of
+// ninja, to which a target can be appended.
+void NinjaBuildSystem::parseBuildCommands(const Configuration &config,
+                                          std::string &buildDir,
+                                          int &jobs,
+                                          bool &invokingNinja) const
+{
+    char *projectDir = g_filename_from_uri(project().uri(), NULL, NULL);
+    buildDir = projectDir;
+    jobs = 0;
+    invokingNinja = false;
+
+    const char *commands = config.buildCommands();
+    int argc;
+    char **argv;
+    if (g_shell_parse_argv(commands, &argc, &argv, NULL))
+    {
+        char *baseName = g_path_get_basename(argv[0]);
+        invokingNinja = g_str_has_prefix(baseName, NINJA) &&
+            !strpbrk(commands, ";&|<>`\n");
+        g_free(baseName);
+        const char *dir = NULL;
+        for (int i = 1; i < argc; i++)
+        {
+            if ((strcmp(argv[i], "-C") == 0 ||
+                 strcmp(argv[i], "--build") == 0) &&
+                i + 1 < argc)
+                dir = argv[++i];
+            else if (strncmp(argv[i], "-C", 2) == 0)
+                dir = argv[i] + 2;
+            else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                jobs = atoi(argv[++i]);
+            else if (strncmp(argv[i], "-j", 2) == 0)
+                jobs = atoi(argv[i] + 2);
+        }
+        if (dir)
+        {
+            if (g_path_is_absolute(dir))
+                buildDir = dir;
+            else
+            {
+                char *d = g_build_filename(projectDir, dir, NULL);
+                buildDir = d;
+                g_free(d);
+            }
+        }
+        g_strfreev(argv);
+    }
+    g_free(projectDir);
+
+    // Ninja runs two more jobs than the processors by default.
+    if (jobs <= 0)
+    {
+        int n = numberOfProcessors();
+        jobs = n <= 1 ? 2 : (n == 2 ? 3 : n + 2);
+    }
+}
+
+// The caller should lock the build graphs.
+BuildGraph *NinjaBuildSystem::buildGraph(const Configuration &config) const
+{
+    std::string buildDir;
+    int jobs;
+    bool invokingNinja;
+    parseBuildCommands(config, buildDir, jobs, invokingNinja);
+    BuildGraphTable::iterator it = m_buildGraphs.find(buildDir);
+    if (it == m_buildGraphs.end())
+        it = m_buildGraphs.insert(
+            std::make_pair(buildDir, new BuildGraph(buildDir.c_str()))).first;
+    if (!it->second->update())
+        return NULL;
+    return it->second;
+}
+
+bool NinjaBuildSystem::getTargetBuildCommands(const Configuration &config,
+                                              const char *fileUri,
+                                              bool compileOnly,
+                                              std::string &commands,
+                                              std::string &target) const
+{
+    boost::mutex::scoped_lock lock(m_buildGraphsMutex);
+    BuildGraph *graph = buildGraph(config);
+    if (!graph)
+        return false;
+    char *fileName = g_filename_from_uri(fileUri, NULL, NULL);
+    if (!fileName)
+        return false;
+    bool found = compileOnly ?
+        graph->findCompileTarget(fileName, target) :
+        graph->findLinkTarget(fileName, target);
+    g_free(fileName);
+    if (!found)
+        return false;
+
+    std::string buildDir;
+    int jobs;
+    bool invokingNinja;
+    parseBuildCommands(config, buildDir, jobs, invokingNinja);
+    if (invokingNinja)
+        commands = config.buildCommands();
+    else
+    {
+        char *quotedBuildDir = g_shell_quote(buildDir.c_str());
+        commands = NINJA;
+        commands += " -C ";
+        commands += quotedBuildDir;
+        g_free(quotedBuildDir);
+    }
+    char *quotedTarget = g_shell_quote(target.c_str());
+    commands += ' ';
+    commands += quotedTarget;
+    g_free(quotedTarget);
+    return true;
+}
+
+gint64 NinjaBuildSystem::estimateBuildDuration(const Configuration &config,
+                                               const char *target) const
+{
+    boost::mutex::scoped_lock lock(m_buildGraphsMutex);
+    BuildGraph *graph = buildGraph(config);
+    if (!graph)
+        return -1;
+    std::string buildDir;
+    int jobs;
+    bool invokingNinja;
+    parseBuildCommands(config, buildDir, jobs, invokingNinja);
+    return graph->estimateDuration(target, jobs);
+}
+
+void NinjaBuildSystem::onBuildSucceeded(const Configuration &config,
+                                        int action)
+{
+    if (action != Builder::ACTION_CONFIGURE && action != Builder::ACTION_BUILD)
+        return;
+    std::string buildDir;
+    int jobs;
+    bool invokingNinja;
+    parseBuildCommands(config, buildDir, jobs, invokingNinja);
+
+    // The compiler options are generated from the build files, so import them
+    // again only if the build files are changed.  Check the modification time
+    // of "build.ninja" only, without reading the build graph.
+    char *manifestFileName =
+        g_build_filename(buildDir.c_str(), MANIFEST_FILE_NAME, NULL);
+    GStatBuf st;
+    bool found = g_stat(manifestFileName, &st) == 0;
+    g_free(manifestFileName);
+    if (!found)
+        return;
+    std::map<std::string, gint64>::iterator it =
+        m_compilerOptsImportTimes.find(buildDir);
+    if (it != m_compilerOptsImportTimes.end() && it->second == st.st_mtime)
+        return;
+    m_compilerOptsImportTimes[buildDir] = st.st_mtime;
+    const char *argv[4] = { NINJA, "-t", "compdb", NULL };
+    importCompilationDatabase(buildDir.c_str(), argv);
+}
+
+Configuration NinjaBuildSystem::defaultConfiguration() const
+{
+    Configuration config(BuildSystem::defaultConfiguration());
+    config.setConfigureCommands(
+        "mkdir -p build && cd build && cmake -G Ninja ..");
+    config.setBuildCommands("ninja -C build");
+    config.setInstallCommands("ninja -C build install");
+    config.setCleanCommands("ninja -C build clean");
+    config.setCCompiler("gcc");
+    config.setCppCompiler("g++");
+    return config;
+}
+
+}
+
+}
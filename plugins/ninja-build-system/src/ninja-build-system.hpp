@@ -0,0 +1,78 @@
+// Ninja build system.
+// Copyright (C) 2015 Gang Chen.
+
+#ifndef SMYD_NINJA_BUILD_SYSTEM_HPP
+#define SMYD_NINJA_BUILD_SYSTEM_HPP
+
+#include "build-system/build-system.hpp"
+#include <map>
+#include <string>
+#include <boost/thread/mutex.hpp>
+
+namespace Samoyed
+{
+
+namespace NinjaBuildSystem
+{
+
+class BuildGraph;
+
+/**
+ * A Ninja build system builds a project with ninja in a build directory
+ * generated by a meta build system, such as CMake or Meson.  The build
+ * directory is the one passed to ninja by the "-C" option in the build
+ * commands, or the project directory by default.
+ *
+ * The build graph is read from the build directory in background threads to
+ * build only the target containing a file and to estimate build durations.
+ * The compiler options are exported by ninja itself, so the compiler
+ * invocations are not intercepted.
+ */
+class NinjaBuildSystem: public BuildSystem
+{
+public:
+    NinjaBuildSystem(Project &project, const char *extensionId);
+
+    virtual ~NinjaBuildSystem();
+
+    virtual void onBuildSucceeded(const Configuration &config, int action);
+
+    virtual bool interceptsCompilerInvocations() const { return false; }
+
+    virtual gint64 estimateBuildDuration(const Configuration &config,
+                                         const char *target) const;
+
+    virtual Configuration defaultConfiguration() const;
+
+protected:
+    virtual bool getTargetBuildCommands(const Configuration &config,
+                                        const char *fileUri,
+                                        bool compileOnly,
+                                        std::string &commands,
+                                        std::string &target) const;
+
+private:
+    typedef std::map<std::string, BuildGraph *> BuildGraphTable;
+
+    void parseBuildCommands(const Configuration &config,
+                            std::string &buildDir,
+                            int &jobs,
+                            bool &invokingNinja) const;
+
+    BuildGraph *buildGraph(const Configuration &config) const;
+
+    // The build graphs keyed by the build directories, used by the background
+    // threads.
+    mutable BuildGraphTable m_buildGraphs;
+    mutable boost::mutex m_buildGraphsMutex;
+
+    // The modification times of "build.ninja" in the build directories when
+    // the compiler options were imported, used by the main thread.
+    std::map<std::string, gint64> m_compilerOptsImportTimes;
+};
+
+}
+
+}
+
+#endif